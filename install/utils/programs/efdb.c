@@ -1,10 +1,13 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
+#include <pthread.h>
 #include "eaarl.h"
 
 
@@ -16,10 +19,30 @@
   C. Wayne Wright 6/24/2001 wright@lidar.wff.nasa.gov
 
 Usage:
-  ls *.tld | efdb outputfile.bin
+  ls *.tld | efdb [-j threads] outputfile.idx
 
+  The TLD files are scanned in parallel, using one thread per processor by
+  default (-j overrides this). The index is written to a temporary file
+  alongside outputfile.idx and renamed into place once complete, so an
+  existing index is never left half written.
 
- Output file format:
+
+ Output file format (version 2, written by this program):
+
+        "EFDB"  4 byte magic
+        VVVV    32 bit format version (2)
+        XXXX    64 bit offset to beginning of file name records
+        NNNN    64 bit number of EAARL_INDEX2 records
+        ZZZZ    64 bit number of file names
+
+        EAARL_INDEX2-1   First EAARL_INDEX2 record, at byte 32
+        EAARL_INDEX2-2   Second
+        ....             EAARL_INDEX2 records continue for NNNN records
+XXXX->  LL      16 bit filename-1 byte length
+        filename   LL length filename string
+        ....       filename and length pairs continue for ZZZZ
+
+ Legacy output file format (version 1, no longer written):
 
      	XXXX   	32 bit offset to beginning of file name records
      	NNNN   	32 bit number of EAARL_INDEX records
@@ -32,148 +55,294 @@ XXXX-> 	LL   	16 bit filename-1 byte length
      	filename   LL length filename string
        	JJ       16 bit filename-2 byte length
      	filename   JJ length filename string
-     	....       filename and length pairs continue for ZZZZ 
-
+     	....       filename and length pairs continue for ZZZZ
 
+  Version 1 stored offsets and lengths in 32 bits and file numbers in 16 bits,
+  which limited it to TLD files under 4 GB. Readers tell the versions apart by
+  the magic: a version 1 file starts with its (even) filename offset, which
+  can never match "EFDB".
 
+  All values are written in native (little-endian) byte order.
 
 ************************************************************/
 
+#define EFDB_MAGIC    "EFDB"
+#define EFDB_VERSION  2
+
 typedef struct __attribute__ ((packed)) {
-  unsigned seconds;
-  unsigned fseconds;
-  unsigned offset;
-  unsigned raster_length;
-  unsigned short file_number;
-  unsigned char  pixels;
-  unsigned char  digitizer;
-} EAARL_INDEX;
+  char     magic[4];
+  UI32     version;
+  uint64_t files_offset;
+  uint64_t record_count;
+  uint64_t file_count;
+} EFDB_HEADER;
 
-EAARL_INDEX eaarl_index;
+typedef struct __attribute__ ((packed)) {
+  UI32     seconds;
+  UI32     fseconds;
+  uint64_t offset;
+  UI32     raster_length;
+  UI32     file_number;
+  UI8      pixels;
+  UI8      digitizer;
+  UI8      pad[6];
+} EAARL_INDEX2;
+
+// Per-file scan results, filled in by the worker threads
+typedef struct {
+  char *fn;
+  EAARL_INDEX2 *records;
+  uint64_t count;
+  uint64_t bytes;         // bytes covered by the indexed rasters
+  const char *error;      // set if the file could not be read at all
+  const char *warning;    // set if the scan stopped at a corrupt raster
+} TLD_SCAN;
+
+// Shared work queue state
+struct {
+  TLD_SCAN *files;
+  long nfiles;
+  long next;              // next file to claim
+  long done;              // files finished, for progress reporting
+  pthread_mutex_t lock;
+} queue;
 
+#define MAXSTR	1024
 
-unsigned int XXXX=0, XXXX_LOC = 0;
-unsigned int NNNN=0, NNNN_LOC = 4;
-unsigned int ZZZZ=0, ZZZZ_LOC = 8;
+/* scan_tld
+ * Walks the raster headers in one TLD file and records an index entry for
+ * each. The rules match the original serial scanner: a raster longer than a
+ * raster can be, or of zero length, marks the file as corrupt and ends the
+ * scan; a raster that runs past the end of the file is still indexed.
+ */
+static void scan_tld(TLD_SCAN *scan, UI32 file_number) {
+  struct stat st;
+  struct raster_header rh;
+  unsigned char *map;
+  uint64_t offset = 0, size, cap = 0;
+  EAARL_INDEX2 *rec;
+  int fd;
+
+  if ( (fd = open(scan->fn, O_RDONLY)) < 0 ) {
+    scan->error = "unable to open file";
+    return;
+  }
+  if ( fstat(fd, &st) ) {
+    close(fd);
+    scan->error = "unable to stat file";
+    return;
+  }
+  size = st.st_size;
+  if ( size < sizeof(rh) ) {    // nothing to index
+    close(fd);
+    return;
+  }
 
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);                    // the mapping stays valid
+  if ( map == MAP_FAILED ) {
+    scan->error = "unable to map file";
+    return;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
 
-FILE *ifd;
-int run = 1;				// loops until run=0
+  while ( offset + sizeof(rh) <= size ) {
+    memcpy(&rh, map + offset, sizeof(rh));
+    if ( rh.len > MAX_BYTES_PIXEL * NSEGS * 2 ) {
+      scan->warning = "is corrupt";
+      break;
+    }
+    if ( rh.len == 0 ) {
+      scan->warning = "has a zero length raster and is corrupt";
+      break;
+    }
 
-UI8 raster[ MAX_BYTES_PIXEL * NSEGS * 2 ];	// temp buffer for a raster
-struct tl { 
-  unsigned len          :       24;     // bytes in this raster
-  unsigned type         :        8;     // type id wf=5
-};
+    if ( scan->count == cap ) {
+      cap = cap ? cap * 2 : 4096;
+      rec = realloc(scan->records, cap * sizeof(EAARL_INDEX2));
+      if ( !rec ) {
+        scan->error = "out of memory";
+        break;
+      }
+      scan->records = rec;
+    }
 
-struct tl tl;				// holds a type/len
-struct raster_header lrh, *rh;		// holds a raster header
-UI32	offset, pixel_offset;		// fseek offsets
+    rec = scan->records + scan->count++;
+    memset(rec, 0, sizeof(*rec));
+    rec->seconds = rh.seconds;
+    rec->fseconds = rh.fseconds;
+    rec->offset = offset;
+    rec->raster_length = rh.len;
+    rec->file_number = file_number;
+    rec->pixels = rh.npixels;
+    rec->digitizer = rh.digitizer;
+
+    offset += rh.len;
+  }
 
-#define MAXSTR	1024
+  scan->bytes = offset < size ? offset : size;
+  munmap(map, size);
+}
 
-struct {
-  char *fn;
-  short len;
-} nlst[ 1024 ] ;
+/* worker
+ * Thread body: claims files from the queue until none are left.
+ */
+static void * worker(void *arg) {
+  long i;
+  TLD_SCAN *scan;
+
+  (void)arg;    // all state is in queue
+  while ( 1 ) {
+    pthread_mutex_lock(&queue.lock);
+    i = queue.next++;
+    pthread_mutex_unlock(&queue.lock);
+    if ( i >= queue.nfiles ) break;
+
+    scan = queue.files + i;
+    scan_tld(scan, i + 1);      // file numbers are 1-based
+
+    pthread_mutex_lock(&queue.lock);
+    queue.done++;
+    printf("\r%ld of %ld files processed", queue.done, queue.nfiles);
+    fflush(stdout);
+    pthread_mutex_unlock(&queue.lock);
+  }
+  return NULL;
+}
+
+/* write_index
+ * Writes the index to TMP. Returns 0 on success.
+ */
+static int write_index(const char *tmp) {
+  EFDB_HEADER hdr;
+  uint64_t nrec = 0;
+  unsigned short len;
+  long i;
+  int ok = 1;
+  FILE *odf;
+
+  for ( i = 0; i < queue.nfiles; i++ )
+    nrec += queue.files[i].count;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, EFDB_MAGIC, 4);
+  hdr.version = EFDB_VERSION;
+  hdr.files_offset = sizeof(hdr) + nrec * sizeof(EAARL_INDEX2);
+  hdr.record_count = nrec;
+  hdr.file_count = queue.nfiles;
+
+  if ( (odf = fopen(tmp, "wb")) == NULL ) {
+    perror(tmp);
+    return 1;
+  }
+
+  ok = fwrite(&hdr, sizeof(hdr), 1, odf) == 1;
+  for ( i = 0; ok && i < queue.nfiles; i++ ) {
+    TLD_SCAN *scan = queue.files + i;
+    ok = fwrite(scan->records, sizeof(EAARL_INDEX2), scan->count, odf)
+      == scan->count;
+  }
+  for ( i = 0; ok && i < queue.nfiles; i++ ) {
+    len = strlen(queue.files[i].fn);
+    ok = fwrite(&len, sizeof(len), 1, odf) == 1
+      && fwrite(queue.files[i].fn, sizeof(char), len, odf) == len;
+  }
+  if ( ok ) ok = fflush(odf) == 0 && fsync(fileno(odf)) == 0;
+  if ( fclose(odf) ) ok = 0;
+
+  if ( !ok ) perror(tmp);
+  return !ok;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: ls *.tld | efdb [-j threads] outputfile.idx\n");
+  exit(1);
+}
 
 int main(int argc, char *argv[]) {
- unsigned short si;
- int i,j,k,n;
- int findex = 1;
- unsigned int offset;
- char *p, ifn[ MAXSTR ], odfn[ MAXSTR ], *fnlinked_list=NULL;
- FILE *idf, *odf;
- if ( argc > 1 ) {
-   strncpy( odfn, argv[1], MAXSTR );
-   if ( (odf = fopen(odfn, "w+" ) ) == NULL ) {
-     perror(odfn); 
-     exit(1);
-   }
-   printf("\nGenerating master index to: %s", odfn);
-   fwrite( &XXXX, sizeof(XXXX), 1, odf );  // place holder for offset
-   fwrite( &NNNN, sizeof(NNNN), 1, odf );  // place holder for record count
-   fwrite( &ZZZZ, sizeof(ZZZZ), 1, odf );  // place holder for file name count
- }
-  while ( 1)  {
-    fgets( ifn, MAXSTR, stdin );
-    if ( feof(stdin) ) break;
-    p = strchr( ifn, '\n' ); 
+  char ifn[ MAXSTR ], *odfn, *tmp, *p;
+  long i, cap = 0, nthreads = 0;
+  int status = 0, opt;
+  uint64_t nrec = 0, bytes = 0;
+  pthread_t *threads;
+
+  while ( (opt = getopt(argc, argv, "j:")) != -1 ) {
+    if ( opt == 'j' ) nthreads = atol(optarg);
+    else usage();
+  }
+  if ( optind != argc - 1 ) usage();
+  odfn = argv[optind];
+
+  // Read the list of TLD files; file numbers follow the input order
+  memset(&queue, 0, sizeof(queue));
+  while ( fgets( ifn, MAXSTR, stdin ) ) {
+    p = strchr( ifn, '\n' );
     if ( p ) *p = (char)0;
-    p = strchr( ifn, '\r' ); 
+    p = strchr( ifn, '\r' );
     if ( p ) *p = (char)0;
-    printf("\n           Processing:    %s %d", ifn, findex);
-    if ( (idf = fopen( ifn, "r" )) == NULL ) {
-      perror(ifn); exit(1); 
+    if ( !ifn[0] ) continue;
+
+    if ( queue.nfiles == cap ) {
+      cap = cap ? cap * 2 : 1024;
+      queue.files = realloc(queue.files, cap * sizeof(TLD_SCAN));
+      if ( !queue.files ) {
+        perror("efdb");
+        exit(1);
+      }
     }
+    memset(queue.files + queue.nfiles, 0, sizeof(TLD_SCAN));
+    queue.files[queue.nfiles++].fn = strdup(ifn);
+  }
 
+  printf("\nGenerating master index to: %s\n", odfn);
 
-      nlst[findex].len = strlen( ifn );
-      nlst[findex].fn  = (char *)malloc( nlst[findex].len );
-      strncpy( nlst[findex].fn, ifn, nlst[findex].len );		// copy string in
-      ZZZZ++;				// add to file name count
+  if ( nthreads < 1 ) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if ( nthreads > queue.nfiles ) nthreads = queue.nfiles;
+  if ( nthreads < 1 ) nthreads = 1;
 
-    rewind(idf);
-    while ( !feof(idf) ) {
-      offset = ftell( idf );
-      if ( fread( &lrh, sizeof(lrh), 1, idf ) < 1 ) {
-        break;
-      }
-      if ( lrh.len > sizeof( raster ) ) {
-        printf("\nFile %s is corrupt.  Aborting\n", ifn );
-        break;
-      }
-      if ( lrh.len == 0 ) {
-        printf("\nZero length raster. File %s is corrupt.  Aborting\n", ifn );
-        break;
-      }
-//      fread( &raster, sizeof(char), lrh.len-sizeof(lrh), idf );
-      if ( fseek( idf, lrh.len - sizeof(lrh), SEEK_CUR ) != 0 ) {
-        perror(ifn); 
-        break;
-      }
-      rh = ( struct raster_header *) &lrh;
-      NNNN++;
-      eaarl_index.seconds = lrh.seconds;
-      eaarl_index.fseconds = lrh.fseconds;
-      eaarl_index.offset = offset;
-      eaarl_index.raster_length = lrh.len;
-      eaarl_index.file_number = findex;
-      eaarl_index.pixels = lrh.npixels;
-      eaarl_index.digitizer = lrh.digitizer;
-      fwrite( &eaarl_index, sizeof(eaarl_index), 1, odf);
-/*
-      printf("\n%6d %8d %6d %6d %6d %6d %6d %6d %6d", findex, offset, rh->type, 
-               rh->len, rh->seconds, rh->fseconds, rh->raster, rh->npixels, 
-                                       rh->digitizer );
-*/
-      if ( (rh->seconds % 10) == 0 ) 
-          printf("\r%d megabytes processed", offset/1000000);
+  pthread_mutex_init(&queue.lock, NULL);
+  threads = malloc(nthreads * sizeof(pthread_t));
+  for ( i = 0; i < nthreads; i++ ) {
+    if ( pthread_create(threads + i, NULL, worker, NULL) ) {
+      perror("efdb");
+      exit(1);
     }
-    printf("\r%d megabytes processed", offset/1000000);
-    fclose(idf);  
-    findex++;  
   }
-    printf("\n");
-
-// Install filename offset
-    XXXX = ftell(odf);
-    fseek( odf, XXXX_LOC, SEEK_SET);
-    fwrite( &XXXX, sizeof(XXXX), 1, odf);		// write filename offset
-    fwrite( &NNNN, sizeof(NNNN), 1, odf);		// write number records
-    fwrite( &ZZZZ, sizeof(ZZZZ), 1, odf);		// write filename count
-
-printf("\n%d files", ZZZZ );
-
-// Install filename data at the end of the master index file
-    fseek( odf, XXXX, SEEK_SET);
-    for ( i = 1; i<= ZZZZ; i++ )  {
-//       printf( "\n%d %d %s \n", i, nlst[i].len, nlst[i].fn );
-       fwrite( &nlst[i].len, sizeof(short), 1, odf);		// write string length
-       fwrite( nlst[i].fn, sizeof(char), nlst[i].len, odf);		// write string 
+  for ( i = 0; i < nthreads; i++ )
+    pthread_join(threads[i], NULL);
+  free(threads);
+  printf("\n");
+
+  // Report in file order so the output is the same on every run
+  for ( i = 0; i < queue.nfiles; i++ ) {
+    TLD_SCAN *scan = queue.files + i;
+    if ( scan->error ) {
+      fprintf(stderr, "%s: %s\n", scan->fn, scan->error);
+      status = 1;
+    } else if ( scan->warning ) {
+      printf("File %s %s; indexed %llu rasters before it\n",
+        scan->fn, scan->warning, (unsigned long long)scan->count);
     }
-    printf("\n");
-     
-}
+    nrec += scan->count;
+    bytes += scan->bytes;
+  }
+  if ( status ) {
+    fprintf(stderr, "No index written\n");
+    exit(status);
+  }
 
+  // Write to a temporary file in the same directory, then rename it into
+  // place so that readers never see a partial index.
+  tmp = malloc(strlen(odfn) + 32);
+  sprintf(tmp, "%s.%ld.tmp", odfn, (long)getpid());
+  if ( write_index(tmp) || rename(tmp, odfn) ) {
+    perror(odfn);
+    remove(tmp);
+    exit(1);
+  }
+  free(tmp);
 
+  printf("%llu megabytes processed\n", (unsigned long long)(bytes/1000000));
+  printf("%ld files, %llu rasters\n", queue.nfiles, (unsigned long long)nrec);
+  return 0;
+}
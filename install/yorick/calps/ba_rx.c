@@ -0,0 +1,494 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "yapi.h"
+#include "pulses_exec.h"
+
+// CNSH2O2X from alps_constants.i: speed of light in water, round trip
+#define BA_RX_CNSH2O2X (0.299792458 / 1.333 * 0.5)
+
+// Minimum length of a lognormal decay curve, as in
+// bathy_wf_compensate_decay_lognorm
+#define BA_RX_DECAY_MINLEN 300
+
+// Bathy conf values used by the bathy algorithm, for one channel
+typedef struct ba_conf_t
+{
+  double thresh;
+  long first, last;
+  long sfc_last;
+  double maxsat;
+  long smoothwf;
+  long lwing_dist, rwing_dist;
+  double lwing_factor, rwing_factor;
+  // Surface search window, after the bathy_detect_surface hook
+  long wantlen;
+
+  // Exponential decay
+  int lognormal;
+  double laser, water, agc;
+  // Lognormal decay
+  double mean, stdev, xshift, xscale;
+  long tiepoint;
+  // Lognormal decay curve (from log_normal), shared by all threads; NULL for
+  // exponential decay
+  const double *decay;
+} ba_conf_t;
+
+// Output columns, in the order of ba_rx_columns
+#define BA_RX_LRX 0
+#define BA_RX_FINTENSITY 1
+#define BA_RX_LINTENSITY 2
+#define BA_RX_BBACK1 3
+#define BA_RX_BBACK2 4
+
+// Bits for pulses_exec_t.col_off that disable bback1 and bback2
+#define BA_RX_NO_BBACK ((1U << BA_RX_BBACK1) | (1U << BA_RX_BBACK2))
+
+static const pulses_column_t ba_rx_columns[] = {
+  {"lrx", Y_FLOAT}, {"fintensity", Y_FLOAT}, {"lintensity", Y_FLOAT},
+  {"bback1", Y_FLOAT}, {"bback2", Y_FLOAT}, {NULL, 0}
+};
+
+/* ba_rx_surface
+ * Equivalent to bathy_detect_surface in bathy.i. Returns the 1-based surface
+ * index; stores the surface intensity and decay scale.
+ */
+static long ba_rx_surface(const double *wf, long n, double maxint,
+  const ba_conf_t *c, double *intensity, double *escale)
+{
+  long i, surface, first_sat = 0, numsat = 0, wfl, k, stop, peak;
+
+  for(i = 0; i < n; i++)
+  {
+    if(wf[i] != maxint) continue;
+    if(!numsat) first_sat = i + 1;
+    numsat++;
+  }
+
+  if(numsat > 1 && first_sat <= c->sfc_last)
+  {
+    // Surface ends where the first contiguous run of saturated samples ends
+    surface = first_sat;
+    while(surface < n && wf[surface] == maxint) surface++;
+    *escale = maxint - 1;
+  }
+  else
+  {
+    wfl = c->wantlen < n ? c->wantlen : n;
+    if(n > c->wantlen + 8)
+    {
+      surface = 1;
+      for(i = 1; i < c->wantlen; i++)
+        if(wf[i] > wf[surface - 1]) surface = i + 1;
+    }
+    else
+    {
+      surface = wfl;
+    }
+    *escale = wf[0];
+    for(i = 1; i < wfl; i++)
+      if(wf[i] > *escale) *escale = wf[i];
+    *escale -= 1;
+  }
+
+  // Surface peak: within five samples after the first leading edge
+  *intensity = 0;
+  for(k = 0; k + 2 < n; k++)
+  {
+    if(wf[k+1] - wf[k] >= c->thresh || !(wf[k+2] - wf[k+1] >= c->thresh))
+      continue;
+    stop = k + 5 < n - 1 ? k + 5 : n - 1;
+    peak = k;
+    for(i = k + 1; i <= stop; i++)
+      if(wf[i] > wf[peak]) peak = i;
+    *intensity = wf[peak];
+    break;
+  }
+
+  return surface;
+}
+
+/* ba_rx_decay
+ * Equivalent to bathy_wf_compensate_decay_exp and
+ * bathy_wf_compensate_decay_lognorm in bathy.i: stores the decay compensated
+ * waveform in WFD. SURFACE is 1-based. Returns 0 if the waveform is too short
+ * for the lognormal tie point, in which case WFD is all zeros.
+ */
+static int ba_rx_decay(const double *wf, long n, const ba_conf_t *c,
+  long surface, double escale, double *wfd)
+{
+  long j, k, head = surface + 1 < n ? surface + 1 : n;
+  double att, decay, agc, scale = 0;
+
+  if(c->lognormal)
+  {
+    if(n < c->tiepoint)
+    {
+      memset(wfd, 0, sizeof(double) * n);
+      return 0;
+    }
+    scale = wf[c->tiepoint - 1] / c->decay[c->tiepoint - 1];
+  }
+
+  for(j = 0; j < n; j++)
+  {
+    // The exponential decay and the agc curve are shifted to start at the
+    // surface; the lognormal decay is not, as in Yorick
+    k = j - surface + 1;
+
+    if(c->lognormal)
+    {
+      decay = c->decay[j] * scale;
+    }
+    else if(j < head)
+    {
+      decay = escale;
+    }
+    else
+    {
+      att = k * 1.0 * BA_RX_CNSH2O2X;
+      decay = exp(c->laser * att) * escale +
+        exp(c->water * att) * escale * .25;
+    }
+
+    if(j < surface)
+    {
+      agc = 0.0;
+    }
+    else
+    {
+      att = k * 1.0 * BA_RX_CNSH2O2X;
+      agc = 1.0 - exp(c->agc * att);
+    }
+
+    wfd[j] = (wf[j] - decay) * agc + (1 - agc) * -5.0;
+  }
+  return 1;
+}
+
+/* ba_rx_bottom
+ * Equivalent to bathy_detect_bottom in bathy.i (with remove_noisy_tail and
+ * extract_peaks_first_deriv from wf_analysis.i). FIRST and LAST are 1-based.
+ * Returns the 1-based bottom index, or 0 if none was found.
+ */
+static long ba_rx_bottom(const double *wfd, long first, long last,
+  double thresh)
+{
+  const double *seg = wfd + first - 1;
+  long len = last - first + 1, i, tail, bottom = 0;
+  double min;
+
+  if(first < 1 || len < 1) return 0;
+
+  // Remove noisy tail
+  min = seg[0];
+  for(i = 1; i < len; i++)
+    if(seg[i] < min) min = seg[i];
+  tail = len;
+  for(i = len - 1; i >= 0; i--)
+  {
+    if(seg[i] > min + thresh)
+    {
+      if(i + 2 < tail) tail = i + 2;
+      break;
+    }
+  }
+  if(tail - 1 < 4) return 0;
+
+  // Peaks where the first derivative (less a small allowance) changes sign
+  // from positive or zero to negative; keep the last above threshold
+  for(i = 1; i + 1 < tail; i++)
+  {
+    if(seg[i] - seg[i-1] + 0.05 >= 0 && seg[i+1] - seg[i] + 0.05 < 0
+      && seg[i] >= thresh)
+      bottom = first + i;
+  }
+  return bottom;
+}
+
+/* ba_rx_saturation
+ * Equivalent to bathy_compensate_saturation in bathy.i. BOTTOM is 1-based.
+ */
+static long ba_rx_saturation(const double *wf, long n, double maxint,
+  long bottom)
+{
+  long sat0, sat1;
+#define BA_RX_SAT(i) (wf[(i)-1] == maxint)
+  if(bottom > 1 && !BA_RX_SAT(bottom) && BA_RX_SAT(bottom-1)) bottom--;
+  sat0 = sat1 = bottom;
+  while(sat0 > 1 && BA_RX_SAT(sat0-1)) sat0--;
+  while(sat1 < n && BA_RX_SAT(sat1+1)) sat1++;
+#undef BA_RX_SAT
+  return (long)(0.5 * (sat0 + sat1));
+}
+
+/* ba_rx_valid
+ * Equivalent to bathy_validate_bottom in bathy.i. Returns 1 if the bottom at
+ * 1-based index B passes.
+ */
+static int ba_rx_valid(const double *wfd, long b, long first, long last,
+  double thresh, const ba_conf_t *c)
+{
+  long lw = b - c->lwing_dist;
+  long rw = b + c->rwing_dist;
+  if(wfd[b-1] <= thresh || last < rw) return 0;
+  if(lw < first || rw > last) return 0;
+  if(wfd[lw-1] > c->lwing_factor * wfd[b-1]) return 0;
+  if(wfd[rw-1] > c->rwing_factor * wfd[b-1]) return 0;
+  return 1;
+}
+
+/* ba_rx_bback
+ * Equivalent to eaarl_ba_bback in process_ba.i: the average of WF over
+ * 1-based START through STOP, backed off 5 samples from the bottom, or 0.
+ */
+static float ba_rx_bback(const double *wf, long lrx, long start, long stop)
+{
+  long i;
+  double sum = 0;
+  if(lrx - 5 < stop) stop = lrx - 5;
+  if(stop < start) return 0;
+  for(i = start; i <= stop; i++) sum += wf[i-1];
+  sum /= stop - start + 1;
+  return sum > 0 ? sum : 0;
+}
+
+/* ba_rx_wf
+ * Equivalent to eaarl_ba_rx_wf in process_ba.i (without plotting): finds the
+ * bottom in waveform RAW of length N using conf C, storing results for pulse
+ * I. WORK must have room for 3*N doubles. Indices noted as 1-based match the
+ * Yorick code.
+ */
+static void ba_rx_wf(const pulses_exec_t *x, int thread, long i,
+  const unsigned char *raw, long n, const void *conf, double *work)
+{
+  const ba_conf_t *c = conf;
+  float *lrx = x->col[BA_RX_LRX];
+  float *fintensity = x->col[BA_RX_FINTENSITY];
+  float *lintensity = x->col[BA_RX_LINTENSITY];
+  float *bback1 = x->col[BA_RX_BBACK1];
+  float *bback2 = x->col[BA_RX_BBACK2];
+  double *wf = work, *wfd = work + n, *tmp = work + 2 * n;
+  double bias, maxint, intensity, escale, thresh;
+  long j, numsat = 0, surface, first, last, bottom;
+
+  // Retrieve the waveform and remove bias
+  bias = (unsigned char)~raw[0];
+  for(j = 0; j < n; j++)
+  {
+    wf[j] = (unsigned char)~raw[j];
+    if(j < 15 && wf[j] < bias) bias = wf[j];
+  }
+  maxint = 255 - (long)bias;
+  for(j = 0; j < n; j++) wf[j] -= bias;
+
+  if(c->smoothwf > 0)
+  {
+    pulses_exec_smooth(wf, n, c->smoothwf, tmp);
+    memcpy(wf, tmp, sizeof(double) * n);
+  }
+
+  for(j = 0; j < n; j++)
+    if(wf[j] == maxint) numsat++;
+  if(numsat && numsat >= c->maxsat) return;
+
+  surface = ba_rx_surface(wf, n, maxint, c, &intensity, &escale);
+  fintensity[i] = intensity;
+
+  thresh = c->thresh;
+  if(numsat > 14) thresh = thresh * (numsat - 13) * 0.65;
+
+  if(!ba_rx_decay(wf, n, c, surface, escale, wfd)) return;
+
+  first = c->first < n ? c->first : n;
+  last = c->last < n ? c->last : n;
+
+  bottom = ba_rx_bottom(wfd, first, last, thresh);
+  if(!bottom) return;
+
+  bottom = ba_rx_saturation(wf, n, maxint, bottom);
+  lintensity[i] = wf[bottom - 1];
+
+  if(!ba_rx_valid(wfd, bottom, first, last, thresh, c)) return;
+
+  lrx[i] = bottom;
+  if(bback1)
+  {
+    bback1[i] = ba_rx_bback(wf, bottom, 25, 35);
+    bback2[i] = ba_rx_bback(wf, bottom, 35, 45);
+  }
+}
+
+/* ba_rx_select
+ * Equivalent to eaarl_ba_rx_eaarla_channel in process_ba.i: picks the first
+ * of channels 1 and 2 with no more saturated samples than its maxsat setting,
+ * falling back to channel 3. Stores the channel in CHANNEL (0 if channel 1 or
+ * 2 is missing).
+ */
+static void ba_rx_select(pulses_exec_t *x, long *channel)
+{
+  const ba_conf_t *conf = x->conf;
+  long i, j, np, nsat;
+  int chan;
+  for(i = 0; i < x->count; i++)
+  {
+    channel[i] = 3;
+    for(chan = 1; chan <= 2; chan++)
+    {
+      const unsigned char *wf = x->wf[chan-1][i];
+      np = x->len[chan-1][i];
+      if(!wf || !np)
+      {
+        channel[i] = 0;
+        break;
+      }
+      nsat = 0;
+      for(j = 0; j < np; j++)
+        if(!wf[j]) nsat++;
+      if(nsat <= conf[chan-1].maxsat)
+      {
+        channel[i] = chan;
+        break;
+      }
+    }
+  }
+}
+
+/* ba_rx_decay_curve
+ * Equivalent to log_normal(indgen(1:len), mean, stdev, xshift=-xshift,
+ * xscale=xscale) from distributions.i, stored in DECAY.
+ */
+static void ba_rx_decay_curve(const ba_conf_t *c, long len, double *decay)
+{
+  double variance = c->stdev * c->stdev;
+  double xp, lx;
+  long i;
+  for(i = 0; i < len; i++)
+  {
+    xp = ((i + 1) + -c->xshift) / c->xscale;
+    if(xp > 0)
+    {
+      lx = log(xp) - c->mean;
+      decay[i] = exp(-(lx * lx) / (2 * variance)) /
+        (xp * sqrt(2 * M_PI * variance));
+    }
+    else
+    {
+      decay[i] = 0.;
+    }
+  }
+}
+
+static void ba_rx_read_conf(pulses_exec_t *x, void *obj, yo_ops_t *ops)
+{
+  static const char *names[19] = {
+    "thresh", "first", "last", "sfc_last", "maxsat", "smoothwf",
+    "lwing_dist", "rwing_dist", "lwing_factor", "rwing_factor", "wantlen",
+    "laser", "water", "agc", "mean", "stdev", "xshift", "xscale", "tiepoint"
+  };
+  double val[19][4];
+  const char *decay[4];
+  long chan;
+  int i;
+  for(i = 0; i < 19; i++)
+    pulses_exec_conf_d(obj, ops, names[i], val[i]);
+  pulses_exec_conf_q(obj, ops, "decay", decay);
+
+  for(chan = 0; chan < 4; chan++)
+  {
+    ba_conf_t *c = (ba_conf_t *)x->conf + chan;
+    const char *type = decay[chan];
+    double *v[19];
+    for(i = 0; i < 19; i++) v[i] = &val[i][chan];
+    c->thresh = *v[0];
+    c->first = *v[1];
+    c->last = *v[2];
+    c->sfc_last = *v[3];
+    c->maxsat = *v[4];
+    c->smoothwf = *v[5];
+    c->lwing_dist = *v[6];
+    c->rwing_dist = *v[7];
+    c->lwing_factor = *v[8];
+    c->rwing_factor = *v[9];
+    c->wantlen = *v[10];
+    c->laser = *v[11];
+    c->water = *v[12];
+    c->agc = *v[13];
+    c->mean = *v[14];
+    c->stdev = *v[15];
+    c->xshift = *v[16];
+    c->xscale = *v[17];
+    c->tiepoint = *v[18];
+    c->decay = NULL;
+
+    if(!type || !strcmp(type, "exponential"))
+      c->lognormal = 0;
+    else if(!strcmp(type, "lognormal"))
+      c->lognormal = 1;
+    else
+      y_error("Unknown decay type");
+
+    if(c->wantlen < 1)
+      y_error("conf.wantlen must be at least 1");
+    if(c->lognormal && !c->xscale)
+      y_error("conf.xscale must not be zero");
+    if(c->lognormal && c->tiepoint < 1)
+      y_error("conf.tiepoint must be at least 1");
+  }
+
+  // Optional; backscatter is only computed if requested
+  int bback = 0;
+  // stack + 1 = +1
+  if(!ops->get_q(obj, "bback", -1) && !yarg_nil(0))
+    bback = yarg_true(0);
+  // stack - 1 = +0
+  yarg_drop(1);
+  if(!bback) x->col_off |= BA_RX_NO_BBACK;
+}
+
+/* ba_rx_prepare
+ * Computes the lognormal decay curves, once per distinct set of parameters,
+ * to be shared by every thread (in place of the closure cache used by
+ * bathy_wf_compensate_decay_lognorm).
+ */
+static void ba_rx_prepare(pulses_exec_t *x, long maxlen)
+{
+  ba_conf_t *conf = x->conf;
+  long decaylen = maxlen > BA_RX_DECAY_MINLEN ? maxlen : BA_RX_DECAY_MINLEN;
+  int i, k;
+
+  ypush_check(4);
+  // stack + 4 (at most)
+  for(i = 0; i < 4; i++)
+  {
+    ba_conf_t *c = &conf[i];
+    if(!x->wf[i] || !c->lognormal) continue;
+    for(k = 0; k < i; k++)
+    {
+      ba_conf_t *o = &conf[k];
+      if(o->decay && o->mean == c->mean && o->stdev == c->stdev &&
+        o->xshift == c->xshift && o->xscale == c->xscale)
+      {
+        c->decay = o->decay;
+        break;
+      }
+    }
+    if(c->decay) continue;
+    double *decay = ypush_scratch(sizeof(double) * decaylen, NULL);
+    ba_rx_decay_curve(c, decaylen, decay);
+    c->decay = decay;
+  }
+}
+
+const pulses_kernel_t ba_rx_kernel = {
+  "ba", ba_rx_columns, sizeof(ba_conf_t), 3, ba_rx_read_conf, ba_rx_select,
+  ba_rx_prepare, ba_rx_wf, pulses_exec_finish_had
+};
+
+void Y_eaarl_ba_rx_batch(int nArgs)
+{
+  pulses_exec_builtin(&ba_rx_kernel, nArgs);
+}
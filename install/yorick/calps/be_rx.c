@@ -0,0 +1,148 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <string.h>
+#include "yapi.h"
+#include "pulses_exec.h"
+
+// Veg conf values used by the bare earth algorithm, for one channel
+typedef struct be_conf_t
+{
+  double thresh;
+  long noiseadj;
+  long max_samples;
+  long smoothwf;
+} be_conf_t;
+
+// Output columns, in the order of be_rx_columns
+#define BE_RX_LRX 0
+#define BE_RX_LINTENSITY 1
+#define BE_RX_RETS 2
+
+static const pulses_column_t be_rx_columns[] = {
+  {"lrx", Y_FLOAT}, {"lintensity", Y_FLOAT}, {"rets", Y_CHAR}, {NULL, 0}
+};
+
+/* be_rx_wf
+ * Equivalent to eaarl_be_rx_wf in process_be.i (without plotting): finds the
+ * last return in waveform RAW of length N using conf C. WORK must have room
+ * for 2*N doubles. Indices noted as 1-based match the Yorick code.
+ */
+static void be_rx_wf(const unsigned char *raw, long n, const be_conf_t *c,
+  double *work, float *lrx, float *lintensity, char *rets)
+{
+  double *wf = work, *wfd1 = work + n;
+  double bias = (unsigned char)~raw[0];
+  long i, nedges = 0, edge = 0, ret_len, rx;
+
+  *lrx = *lintensity = 0;
+  *rets = 0;
+
+  // Invert and remove bias
+  for(i = 0; i < n; i++)
+    wf[i] = (double)(unsigned char)~raw[i] - bias;
+
+  if(c->max_samples > 0 && n > c->max_samples) n = c->max_samples;
+
+  if(c->smoothwf > 0)
+  {
+    pulses_exec_smooth(wf, n, c->smoothwf, wfd1);
+    memcpy(wf, wfd1, sizeof(double) * n);
+  }
+
+  // First derivative
+  for(i = 0; i < n - 1; i++)
+    wfd1[i] = wf[i+1] - wf[i];
+
+  // Leading edges: where the derivative first reaches the threshold. EDGE is
+  // the 1-based index of the last one.
+  for(i = 1; i < n - 1; i++)
+  {
+    if(wfd1[i] >= c->thresh && !(wfd1[i-1] >= c->thresh))
+    {
+      nedges++;
+      edge = i;
+    }
+  }
+  *rets = nedges;
+
+  if(!nedges)
+  {
+    double max = wf[0];
+    for(i = 1; i < n; i++)
+      if(wf[i] > max) max = wf[i];
+    *lintensity = max;
+    return;
+  }
+
+  // Assume 18ns to be the longest duration for a complete last return, but
+  // truncate based on length of waveform.
+  ret_len = n - edge - 1;
+  if(ret_len > 18) ret_len = 18;
+
+  // Noise pulses
+  if(ret_len < 5) return;
+
+  if(c->noiseadj)
+  {
+    for(i = 0; i < 4; i++)
+    {
+      if(wfd1[edge - 1 + i] < 0)
+      {
+        edge += i + 1;
+        if(edge + ret_len + 1 > n) ret_len = n - edge - 1;
+        break;
+      }
+    }
+  }
+
+  // Find where the bottom return changes direction after its trailing edge
+  for(i = 0; i < ret_len; i++)
+  {
+    if(wfd1[edge + i] < 0)
+    {
+      rx = edge + i + 1;
+      *lrx = rx;
+      *lintensity = wf[rx - 1];
+      return;
+    }
+  }
+}
+
+static void be_rx_pulse(const pulses_exec_t *x, int thread, long i,
+  const unsigned char *wf, long n, const void *conf, double *work)
+{
+  be_rx_wf(wf, n, conf, work, (float *)x->col[BE_RX_LRX] + i,
+    (float *)x->col[BE_RX_LINTENSITY] + i, (char *)x->col[BE_RX_RETS] + i);
+}
+
+static void be_rx_read_conf(pulses_exec_t *x, void *obj, yo_ops_t *ops)
+{
+  static const char *names[4] = {
+    "thresh", "noiseadj", "max_samples", "smoothwf"
+  };
+  be_conf_t *conf = x->conf;
+  double val[4][4];
+  long chan;
+  int i;
+  for(i = 0; i < 4; i++)
+    pulses_exec_conf_d(obj, ops, names[i], val[i]);
+  for(chan = 0; chan < 4; chan++)
+  {
+    conf[chan].thresh = val[0][chan];
+    conf[chan].noiseadj = val[1][chan];
+    conf[chan].max_samples = val[2][chan];
+    conf[chan].smoothwf = val[3][chan];
+  }
+}
+
+// Channels are selected as eaarl_be_rx_eaarla_channel does in process_be.i
+const pulses_kernel_t be_rx_kernel = {
+  "be", be_rx_columns, sizeof(be_conf_t), 2, be_rx_read_conf,
+  pulses_exec_select_sfc, NULL, be_rx_pulse, pulses_exec_finish_had
+};
+
+void Y_eaarl_be_rx_batch(int nArgs)
+{
+  pulses_exec_builtin(&be_rx_kernel, nArgs);
+}
@@ -34,9 +34,73 @@ func calps_compatibility(nil) {
   Version 7
     Fixes wf_centroid to avoid 1e1000/INFINITY which is now invalid in Yorick.
 
-  This version of calps_compatibility returns 7.
+  Version 8
+    Adds packed= to eaarl_decode_fast for the packed waveform layout, which
+    eaarl_fs_rx_cent_eaarlb also accepts.
+
+  Version 9
+    Adds eaarl_decode_open and eaarl_decode_next for streaming decodes.
+
+  Version 10
+    Adds filebuffer_stats.
+
+  Version 11
+    Adds eaarl_index_open and eaarl_index_decode.
+
+  Version 12
+    Adds eaarl_be_rx_batch.
+
+  Version 13
+    Adds eaarl_ba_rx_batch.
+
+  Version 14
+    Adds eaarl_fs_rx_cent_eaarla.
+
+  Version 15
+    Adds eaarl_cf_fit_batch.
+
+  Version 16
+    Adds eaarl_mp_rx_batch.
+
+  Version 17
+    Adds eaarl_rx_batch. eaarl_be_rx_batch, eaarl_ba_rx_batch, and
+    eaarl_mp_rx_batch now share its thread pool.
+
+  Version 18
+    Adds eaarl_sb_rx_batch.
+
+  Version 19
+    Adds eaarl_trajectory_interp.
+
+  Version 20
+    Adds eaarl_direct_vector_batch and _ypoint_project3.
+
+  Version 21
+    Adds _yll2utm_batch and _yutm2ll_batch.
+
+  Version 22
+    Adds geoid_map and geoid_map_interp.
+
+  Version 23
+    Adds spatial_index, spatial_index_radius, spatial_index_box, and
+    spatial_index_nearest.
+
+  Version 24
+    Adds radius_grid_cells.
+
+  Version 25
+    Adds cell_grid_cells.
+
+  Version 26
+    _ytriangle_interp indexes the triangles by location instead of checking
+    every triangle for every point.
+
+  Version 27
+    Adds triangle_grid_cells.
+
+  This version of calps_compatibility returns 27.
 */
-  return 7;
+  return 27;
 }
 
 // *** defined in triangle_y.c ***
@@ -217,6 +281,29 @@ extern _yutm2ll;
   double *lat, long count, double a, double e2)
 */
 
+// As _yll2utm and _yutm2ll, but they leave their input alone and take the
+// number of threads to use and a flag for the single precision fast path
+extern _yll2utm_batch;
+/* PROTOTYPE
+  void ll2utm_batch(double *lat, double *lon, double *north, double *east,
+  short *zone, long count, double a, double e2, long threads, int fast)
+*/
+
+extern _yutm2ll_batch;
+/* PROTOTYPE
+  void utm2ll_batch(double *north, double *east, short *zone, double *lon,
+  double *lat, long count, double a, double e2, long threads, int fast)
+*/
+
+// *** defined in georef.c ***
+
+// func point_project in geometry.i makes use of this, if it's available
+extern _ypoint_project3;
+/* PROTOTYPE
+  long point_project3(double *p1, double *p2, double *dist, long ndist,
+  double *result, long count)
+*/
+
 // *** defined in navd88.c ***
 
 func calps_n88_interp_qfit2d(x, y, f) {
@@ -312,6 +399,21 @@ extern profiler_ticks;
   The time measured is wall time.
 */
 
+// *** defined in filebuffer.c ***
+
+extern filebuffer_stats;
+/* DOCUMENT stats = filebuffer_stats(reset=)
+  Returns statistics about reads of TLD files that could not be
+  memory-mapped and were instead read through a buffer (for instance, by
+  eaarl_decode_fast). In that mode, a background thread reads the next block
+  of the file while the current one is being decoded. The result is an array
+  of three values, totaled since the plugin was loaded:
+    stats(1) - number of times the buffer was refilled
+    stats(2) - number of those refills served by the background thread
+    stats(3) - seconds spent waiting for data to be read (stall time)
+  Use reset=1 to zero the counters after retrieving them.
+*/
+
 // *** defined in eaarl_decode_fast.c ***
 
 extern eaarl_decode_fast;
@@ -337,6 +439,21 @@ extern eaarl_decode_fast;
       raw=1   All data returned as it was in the file
     wfs= By default, waveforms are included. Use wfs=0 to disable, which will
       omit the rx and tx fields.
+    index= By default, a raster index for the TLD file is used to determine
+      how many pulses are in the requested range without scanning it. The
+      index is built on first use and saved alongside the TLD file as
+      FN+".ridx"; it is rebuilt automatically if the TLD file's size or
+      modification time changes. Use index=0 to scan the file instead.
+    threads= Number of threads to use for decoding. The requested rasters are
+      split into contiguous runs with about the same number of pulses, and
+      each run is decoded by its own thread. Default is threads=1. Threads are
+      only used if the TLD file could be memory-mapped.
+    packed= By default, each waveform is returned as its own array of char,
+      referenced by the TX and RX arrays of pointers. Use packed=1 to instead
+      store all waveform samples in one contiguous array of char, WFBUF, with
+      the start and length of each waveform stored in index arrays. This
+      avoids one allocation per waveform. Use eaarl_pulse_tx and
+      eaarl_pulse_rx to retrieve individual waveforms from either layout.
 
   Returns:
     An oxy group object containing the following array members:
@@ -347,10 +464,88 @@ extern eaarl_decode_fast;
       scan_angle - int16_t
       raster - int32_t (if rnstart!=0)
       soe - double
-      tx - pointer (if wfs=1)
-      rx - pointer x 4 (if wfs=1)
-    All arrays have the same size and dimensions, except for RX which has an
-    extra dimension of size 4.
+      tx - pointer (if wfs=1, packed=0)
+      rx - pointer x 4 (if wfs=1, packed=0)
+      wfbuf - scalar pointer to char (if wfs=1, packed=1)
+      tx_start - long (if wfs=1, packed=1)
+      tx_len - int (if wfs=1, packed=1)
+      rx_start - long x 4 (if wfs=1, packed=1)
+      rx_len - int x 4 (if wfs=1, packed=1)
+    All arrays have the same size and dimensions, except for RX, RX_START, and
+    RX_LEN which have an extra dimension of size 4. TX_START and RX_START are
+    1-based indices into *WFBUF; a length of 0 means the waveform is absent.
+*/
+
+extern eaarl_decode_open;
+/* DOCUMENT handle = eaarl_decode_open(fn, start, stop)
+  Opens a streaming decoder for the data in the specified TLD file from offset
+  START through offset STOP. The parameters and options are the same as for
+  eaarl_decode_fast. The returned handle is passed to eaarl_decode_next to
+  retrieve the decoded pulses in batches.
+
+  The handle holds the file open (or mapped) until it is released.
+
+  SEE ALSO: eaarl_decode_next, eaarl_decode_fast
+*/
+
+extern eaarl_decode_next;
+/* DOCUMENT pulses = eaarl_decode_next(handle, max_pulses)
+  Decodes the next batch of pulses for a HANDLE returned by eaarl_decode_open.
+  Batches always consist of whole rasters: as many rasters as fit within
+  MAX_PULSES pulses are decoded, except that a single raster with more than
+  MAX_PULSES pulses is returned on its own. Returns [] once all rasters have
+  been decoded.
+
+  The result is an oxy group object like that returned by eaarl_decode_fast.
+  The raster field, if requested, continues numbering from the prior batch.
+  The working memory used for decoding is reused from batch to batch, so
+  memory use is bounded by MAX_PULSES rather than by the size of the range.
+
+  Example:
+    h = eaarl_decode_open(fn, start, stop, rnstart=rn);
+    while(!is_void((pulses = eaarl_decode_next(h, 100000)))) {
+      // process pulses
+    }
+
+  SEE ALSO: eaarl_decode_open, eaarl_decode_fast
+*/
+
+// *** defined in eaarl_index.c ***
+
+extern eaarl_index_open;
+/* DOCUMENT handle = eaarl_index_open(offset, file_number, files)
+  Creates a handle for decoding rasters by raster number, for use with
+  eaarl_index_decode.
+
+  Parameters:
+    offset: Array of the offset (0-based) of each raster in its TLD file, as
+      in edb.offset.
+    file_number: Array of the file number of each raster, as in
+      edb.file_number. This must be the same size as OFFSET.
+    files: Array of full paths to the TLD files, indexed by FILE_NUMBER.
+
+  The handle keeps up to 8 TLD files open (least recently used files are
+  closed first), which makes repeated small requests much cheaper. Normally
+  you should use edb_decoder to get a handle for the currently loaded EDB
+  rather than calling this directly.
+
+  SEE ALSO: eaarl_index_decode, edb_decoder
+*/
+
+extern eaarl_index_decode;
+/* DOCUMENT pulses = eaarl_index_decode(handle, start, stop)
+  Decodes the rasters START through STOP, which are raster numbers as used by
+  the EDB. START and STOP may also be arrays of the same size. The rasters may
+  span any number of TLD files; the result is a single oxy group object.
+
+  Options:
+    raw=, wfs=, threads=, packed= Same as for eaarl_decode_fast.
+
+  Returns:
+    An oxy group object as described by eaarl_decode_fast, always including
+    the raster field.
+
+  SEE ALSO: eaarl_index_open, eaarl_decode_fast, decode_rasters
 */
 
 // *** defined in wf_centroid.c ***
@@ -410,14 +605,503 @@ extern cent;
 extern eaarl_fs_rx_cent_eaarlb;
 /* DOCUMENT eaarl_fs_rx_cent_eaarlb, pulses
   Updates the given pulses oxy group object with first return info using the
-  centroid from the specified channel. The following fields are added to
-  pulses:
+  centroid from the specified channel. Pulses may use either the default or
+  the packed waveform layout (see eaarl_decode_fast). The following fields are
+  added to pulses:
     frx - Location in waveform of first return
     fint - Peak intensity value of first return
     fchannel - Channel used (=channel except for chan 4, which uses 2)
     fbias - The channel range bias (ops_conf.chn%d_range_bias)
 */
 
+extern eaarl_fs_rx_cent_eaarla;
+/* DOCUMENT eaarl_fs_rx_cent_eaarla, pulses
+  Updates the given pulses oxy group object with first return info using the
+  centroid from the most sensitive channel that is not saturated, as for
+  EAARL-A: channel 1 or 2 if no more than ops_conf.max_sfc_sat of its first 12
+  samples are below 5, otherwise channel 3. Pulses may use either the default
+  or the packed waveform layout (see eaarl_decode_fast). The following fields
+  are added to pulses:
+    frx - Location in waveform of first return
+    fintensity - Peak intensity value of first return
+    fchannel - Channel used
+    fbias - The channel range bias (ops_conf.chn%d_range_bias)
+  Also, channel is replaced by fchannel.
+
+  Unlike nocalps_eaarl_fs_rx_cent_eaarla, which raises an error, a pulse whose
+  channel 1 is saturated and whose channel 2 is missing is not fatal here. A
+  missing waveform counts as unsaturated, so channel 2 is used and, as for
+  any waveform with fewer than 2 samples, frx and fintensity are 0.
+*/
+
+// *** Defined in pulses_exec.c ***
+
+extern eaarl_rx_batch;
+/* DOCUMENT result = eaarl_rx_batch(kernel, pulses, lchannel, conf, threads=)
+  Runs the named native waveform kernel on every pulse in the given pulses
+  oxy group object at once. Pulses may use either the default or the packed
+  waveform layout (see eaarl_decode_fast).
+
+  Parameters:
+    kernel: The name of the kernel, one of:
+      "be" - As eaarl_be_rx_batch.
+      "ba" - As eaarl_ba_rx_batch.
+      "mp" - As eaarl_mp_rx_batch.
+      "sb" - As eaarl_sb_rx_batch.
+      "cf" - The curve fits of eaarl_cf_rx_channel, as eaarl_cf_fit_batch
+        does them.
+    pulses: The pulses object to update.
+    lchannel: The channel to use for each pulse; 0 skips the pulse. If [],
+      the kernel selects the channel (see each kernel's builtin) and it is
+      stored in pulses.lchannel. The "cf" kernel requires LCHANNEL.
+    conf: An oxy group with the kernel's settings, as for its builtin. Each
+      may be a scalar, used for every channel, or an array of four values
+      indexed by channel.
+
+  The "cf" kernel's conf has the members smoothwf (as for cfconf), itmax and
+  tol (as for eaarl_cf_fit_batch), seeds (double, as for eaarl_cf_fit_batch,
+  for the pulses with npeaks > 0 in pulse order), and npeaks (long, one per
+  pulse). Each pulse's waveform is prepared as eaarl_cf_rx_wf_seed does. It
+  returns an oxy group with the fitted parameters, a (in the layout of
+  seeds), and niter, the number of iterations used for each pulse.
+
+  Options:
+    threads= Number of threads to use, at most 64. Threads take pulses from a
+      shared queue in runs of 256, so a thread that draws costly waveforms
+      does not hold up the others. Default is threads=1.
+
+  Returns the result of the kernel, as for its builtin.
+
+  SEE ALSO: eaarl_be_rx_batch, eaarl_ba_rx_batch, eaarl_mp_rx_batch,
+    eaarl_sb_rx_batch, eaarl_cf_fit_batch
+*/
+
+// *** Defined in be_rx.c ***
+
+extern eaarl_be_rx_batch;
+/* DOCUMENT had = eaarl_be_rx_batch(pulses, lchannel, conf, threads=)
+  Runs the bare earth last return algorithm (eaarl_be_rx_wf) on every pulse
+  in the given pulses oxy group object at once. Pulses may use either the
+  default or the packed waveform layout (see eaarl_decode_fast). The results
+  are the same as calling eaarl_be_rx_wf on each pulse's waveform.
+
+  Parameters:
+    pulses: The pulses object to update.
+    lchannel: The channel to use for each pulse; 0 skips the pulse. If [],
+      the channel is selected as eaarl_be_rx_eaarla_channel does (the first of
+      channels 1-3 with no more than ops_conf.max_sfc_sat saturated samples)
+      and stored in pulses.lchannel.
+    conf: An oxy group with the vegconf settings thresh, noiseadj,
+      max_samples, and smoothwf. Each may be a scalar, used for every channel,
+      or an array of four values indexed by channel.
+
+  Options:
+    threads= Number of threads to use, as for eaarl_rx_batch. Default is
+      threads=1.
+
+  The following fields are added to pulses:
+    lrx - Location in waveform of last return (float)
+    lintensity - Intensity at last return (float)
+    rets - Number of returns found (char)
+    lchannel - Channel used (char), only if LCHANNEL is []
+
+  Returns an array of char with one value per pulse: 1 if the pulse had a
+  waveform on its channel and was processed, otherwise 0.
+
+  SEE ALSO: eaarl_be_rx_wf, eaarl_be_rx_eaarla, eaarl_rx_batch
+*/
+
+// *** Defined in ba_rx.c ***
+
+extern eaarl_ba_rx_batch;
+/* DOCUMENT had = eaarl_ba_rx_batch(pulses, lchannel, conf, threads=)
+  Runs the bathy algorithm (eaarl_ba_rx_wf: surface detection, decay
+  compensation, bottom detection, and bottom validation) on every pulse in the
+  given pulses oxy group object at once. Pulses may use either the default or
+  the packed waveform layout (see eaarl_decode_fast). The results are the
+  same as calling eaarl_ba_rx_wf on each pulse's waveform.
+
+  Parameters:
+    pulses: The pulses object to update.
+    lchannel: The channel to use for each pulse; 0 skips the pulse. If [],
+      the channel is selected as eaarl_ba_rx_eaarla_channel does (the first of
+      channels 1-2 with no more than maxsat saturated samples, otherwise
+      channel 3) and stored in pulses.lchannel.
+    conf: An oxy group with the bathconf settings thresh, first, last,
+      sfc_last, maxsat, smoothwf, lwing_dist, rwing_dist, lwing_factor,
+      rwing_factor, decay, laser, water, agc, mean, stdev, xshift, xscale, and
+      tiepoint, plus wantlen (the surface search window used by
+      bathy_detect_surface). Each may be a scalar, used for every channel, or
+      an array of four values indexed by channel. If conf.bback is 1, the
+      backscatter values added by eaarl_ba_bback are computed as well. See
+      eaarl_ba_rx_batch_conf.
+
+  Options:
+    threads= Number of threads to use, as for eaarl_rx_batch. Lognormal decay
+      curves are computed once per call and shared by all threads. Default is
+      threads=1.
+
+  The following fields are added to pulses:
+    lrx - Location in waveform of bottom (float)
+    fintensity - Intensity at surface (float)
+    lintensity - Intensity at bottom (float)
+    bback1, bback2 - Backscatter values (float), only if conf.bback is 1
+    lchannel - Channel used (char), only if LCHANNEL is []
+
+  Returns an array of char with one value per pulse: 1 if the pulse had a
+  waveform on its channel and was processed, otherwise 0.
+
+  SEE ALSO: eaarl_ba_rx_wf, eaarl_ba_rx_eaarla, eaarl_ba_rx_batch_conf,
+    eaarl_rx_batch
+*/
+
+// *** Defined in mp_rx.c ***
+
+extern eaarl_mp_rx_batch;
+/* DOCUMENT lrets = eaarl_mp_rx_batch(pulses, lchannel, conf, threads=)
+  Runs the multi-peak algorithm (eaarl_mp_rx_wf) on every pulse in the given
+  pulses oxy group object at once. Pulses may use either the default or the
+  packed waveform layout (see eaarl_decode_fast). The returns found are the
+  same as calling eaarl_mp_rx_wf on each pulse's waveform.
+
+  Parameters:
+    pulses: The pulses object to update.
+    lchannel: The channel to use for each pulse; 0 skips the pulse. If [],
+      the channel is selected as eaarl_mp_rx_eaarla_channel does (the first of
+      channels 1-3 with no more than ops_conf.max_sfc_sat saturated samples)
+      and stored in pulses.lchannel.
+    conf: An oxy group with the mpconf settings thresh, max_samples,
+      smoothwf, and alg_mode. Each may be a scalar, used for every channel,
+      or an array of four values indexed by channel.
+
+  Options:
+    threads= Number of threads to use, as for eaarl_rx_batch. Default is
+      threads=1.
+
+  The following fields are added to pulses:
+    num_rets - Number of returns found (char)
+    lchannel - Channel used (char), only if LCHANNEL is []
+
+  Returns the returns of all pulses as an oxy group in compressed sparse row
+  form:
+    lrx - Location in waveform of each return (long, or double if any return
+      was located with alg_mode="cent"), or [] if none
+    lintensity - Intensity at each return (float, or double if any return
+      came from a channel with smoothwf > 0), or [] if none
+    start - Offsets into lrx and lintensity (long), one more than there are
+      pulses: the returns of pulse I are lrx(start(I)+1:start(I+1)).
+    had - Whether each pulse had a waveform on its channel and was processed
+      (char, 1 or 0)
+
+  SEE ALSO: eaarl_mp_rx_wf, eaarl_mp_rx_channel, eaarl_mp_rx_eaarla,
+    eaarl_rx_batch
+*/
+
+// *** Defined in sb_rx.c ***
+
+extern eaarl_sb_rx_batch;
+/* DOCUMENT had = eaarl_sb_rx_batch(pulses, lchannel, conf, threads=)
+  Runs the shallow bathy algorithm (eaarl_sb_rx_wf) on every pulse in the
+  given pulses oxy group object at once. Pulses may use either the default or
+  the packed waveform layout (see eaarl_decode_fast). The results are the
+  same as calling eaarl_sb_rx_wf on each pulse's waveform: the bias is the
+  lowest of the first 15 samples, and only the first 20 samples are searched
+  for the last return.
+
+  Parameters:
+    pulses: The pulses object to update.
+    lchannel: The channel to use for each pulse; 0 skips the pulse. If [],
+      the channel is selected as eaarl_sb_rx_eaarla_channel does (the first of
+      channels 1-3 with no more than ops_conf.max_sfc_sat saturated samples)
+      and stored in pulses.lchannel.
+    conf: An oxy group with the sbconf setting thresh. It may be a scalar,
+      used for every channel, or an array of four values indexed by channel.
+
+  Options:
+    threads= Number of threads to use, as for eaarl_rx_batch. Default is
+      threads=1.
+
+  The following fields are added to pulses:
+    lrx - Location in waveform of last return (float)
+    lintensity - Intensity at last return (float)
+    rets - Number of returns found (char)
+    lchannel - Channel used (char), only if LCHANNEL is []
+
+  Returns an array of char with one value per pulse: 1 if the pulse had a
+  waveform on its channel and was processed, otherwise 0.
+
+  SEE ALSO: eaarl_sb_rx_wf, eaarl_sb_rx_eaarla, eaarl_rx_batch
+*/
+
+// *** Defined in georef.c ***
+
+extern eaarl_direct_vector_batch;
+/* DOCUMENT eaarl_direct_vector_batch, arZ, arX, arY, gx, gy, gz, dx, dy, dz,
+    maZ, laX, maX, maY, mag, &mx, &my, &mz, &px, &py, &pz
+  Computes the mirror and target points for EAARL pulses. This takes the same
+  arguments and gives the same results as eaarl_direct_vector, which uses it
+  when it is available. Each pulse is handled in one pass through the
+  rotation math, without intermediate arrays.
+
+  Each input may be a scalar or an array; all arrays must have the same
+  number of values. The outputs are arrays of doubles with the dimensions of
+  the largest input.
+
+  SEE ALSO: eaarl_direct_vector, eaarl_fs_vector
+*/
+
+// *** Defined in trajectory.c ***
+
+extern eaarl_trajectory_interp;
+/* DOCUMENT traj = eaarl_trajectory_interp(sod, ins_sod, roll, pitch, heading,
+    gps_sod, alt, north, east, roll_bias=, pitch_bias=, yaw_bias=)
+  Interpolates the aircraft trajectory at the times SOD in a single pass, as
+  eaarl_fs_trajectory does with interp and interp_angles. SOD may be in any
+  order, but it is fastest when it is sorted or nearly so (as pulse times
+  are).
+
+  Parameters:
+    sod: Times to interpolate for, in seconds of the mission day.
+    ins_sod: Times of the INS records, ascending (tans.somd).
+    roll, pitch, heading: INS attitude at each of INS_SOD, in degrees.
+    gps_sod: Times of the GPS records, ascending.
+    alt, north, east: GPS position at each of GPS_SOD, with NORTH and EAST
+      in UTM.
+
+  Options:
+    roll_bias=, pitch_bias=, yaw_bias= Added to roll, pitch, and yaw (which
+      is -heading). Default is 0 for each.
+
+  Returns an oxy group with members easting, northing, alt, pitch, roll, and
+  yaw, each double and dimensioned like SOD. Wherever SOD is outside the time
+  range of either track, all six are 0. As in eaarl_fs_trajectory, if INS_SOD
+  has a single value or all of SOD is before its first value or at or after
+  its last, each member is instead an array of long zeros with one value per
+  element of SOD.
+
+  SEE ALSO: eaarl_fs_trajectory, interp_angles
+*/
+
+// *** Defined in navd88.c ***
+
+extern geoid_map;
+/* DOCUMENT map = geoid_map(fn)
+  Memory-maps the NGS .bin format GEOID file FN, which may be in either byte
+  order. The result is an opaque object that can be passed to
+  geoid_map_interp; its header values are available as map.glamn, map.glomn,
+  map.dla, map.dlo, map.nrows, map.ncols, and map.itype (as read from the
+  file, without the longitude adjustment geoid_load makes). The file is
+  unmapped when the object is freed.
+
+  Only the parts of the grid that are interpolated are read from disk, so
+  this is much cheaper than geoid_load for a small area.
+
+  SEE ALSO: geoid_map_interp geoid_cached
+*/
+
+extern geoid_map_interp;
+/* DOCUMENT result = geoid_map_interp(map, x, y, threads=)
+  Interpolates the GEOID grid MAP (as returned by geoid_map) at the grid
+  coordinates X and Y, which are 1-based indices into the columns and rows of
+  the grid. The result is the same as n88_interp_spline2d(x, y, data) with
+  the data from geoid_load.
+
+  The spline coefficients for each neighborhood of the grid are cached as
+  they are calculated, so points that are close together share most of the
+  work.
+
+  Option:
+    threads= Number of threads to split the work across. Default is 1.
+
+  SEE ALSO: geoid_map nad832navd88offset
+*/
+
+// *** Defined in spatial_index.c ***
+
+extern spatial_index;
+/* DOCUMENT index = spatial_index(x, y, bucket=)
+  Builds a spatial index over the points X, Y for use with
+  spatial_index_radius, spatial_index_box, and spatial_index_nearest. This is
+  worth doing whenever the same points are searched more than a handful of
+  times, since each query then only looks at the points near it instead of
+  all of them.
+
+  The points are binned into a grid of square buckets. Points with
+  non-finite coordinates are left out. Indices given by queries refer to the
+  original X and Y arrays, which aren't needed afterwards; the index keeps
+  its own copy of the coordinates.
+
+  Option:
+    bucket= Size of the buckets, in the same units as X and Y. By default,
+      this is picked so that there are about 4 points per bucket. A bucket
+      size that would make far more buckets than points is enlarged.
+
+  The resulting handle has the members index.count (points indexed),
+  index.npoints (size of X and Y), index.bucket, index.nx, and index.ny.
+
+  SEE ALSO: spatial_index_radius spatial_index_box spatial_index_nearest
+*/
+
+extern spatial_index_radius;
+/* DOCUMENT list = spatial_index_radius(index, xp, yp, radius, &start)
+  Finds the points in INDEX that are within RADIUS of each location XP, YP.
+  RADIUS may be scalar or have a value for each location. This gives the same
+  points as find_points_in_radius (the box around each location, then the
+  distance), for every location at once.
+
+  The result is a single array of the 1-based indices found for all of the
+  locations, or [] if none were. The indices for location i are
+    list(start(i):start(i+1)-1)
+  which is empty when start(i+1) == start(i). Each location's indices are in
+  ascending order. START is optional when there's only one location.
+
+  SEE ALSO: spatial_index spatial_index_box find_points_in_radius
+*/
+
+extern spatial_index_box;
+/* DOCUMENT list = spatial_index_box(index, xmin, xmax, ymin, ymax, &start)
+  Finds the points in INDEX that are inside each box XMIN, XMAX, YMIN, YMAX
+  (edges included, as for data_box). The bounds may be scalar or arrays with
+  a value for each box. The result and START are as for
+  spatial_index_radius.
+
+  SEE ALSO: spatial_index spatial_index_radius data_box
+*/
+
+extern spatial_index_nearest;
+/* DOCUMENT idx = spatial_index_nearest(index, xp, yp, &dist, k=)
+  Finds the point in INDEX nearest each location XP, YP. The result has the
+  same dimensions as XP, holding the 1-based index of each nearest point. If
+  given, DIST is set to the distance to each.
+
+  Option:
+    k= Number of nearest points to find for each location. Default is 1.
+      For k > 1, IDX and DIST get a new leading dimension of length k,
+      nearest first. Equally near points are ordered by index. Where there
+      are fewer than k points, the remaining entries are 0 with a DIST of
+      -1.
+
+  SEE ALSO: spatial_index find_nearest_point
+*/
+
+// *** Defined in radius_grid.c ***
+
+extern radius_grid_cells;
+/* DOCUMENT zgrid = radius_grid_cells(x, y, z, xc, yc, method, maxradius,
+    minpoints, wtpower, nodata, threads=)
+  Calculates the cells of a radius-based grid, as radius_grid does in
+  Yorick with moveavg_interp or invdist_interp. Normally you should use
+  radius_grid rather than calling this directly.
+
+  Parameters:
+    x, y, z: Arrays of the known points.
+    xc, yc: Evenly spaced x coordinates of the cell centers for each column,
+      and y coordinates for each row.
+    method: Either "invdist" or "average".
+    maxradius, minpoints, wtpower, nodata: As for radius_grid.
+
+  Option:
+    threads= Number of threads to split the rows of the grid across.
+      Default is 1.
+
+  Returns a 2-dimensional array of doubles, [numberof(xc), numberof(yc)].
+  Each cell has exactly the value the Yorick functions would give it.
+
+  SEE ALSO: radius_grid
+*/
+
+// *** Defined in cell_grid.c ***
+
+extern cell_grid_cells;
+/* DOCUMENT zgrid = cell_grid_cells(x, y, z, method, xmin, ymin, cell, xcount,
+    ycount, nodata, xsnap=, ysnap=)
+  Grids the points x, y, z into cells, as cell_grid does in Yorick. Normally
+  you should use cell_grid rather than calling this directly.
+
+  Parameters:
+    x, y, z: Arrays of the known points.
+    method: One of "last", "average", "median", "counts", "density", or
+      "coverage"; see cell_grid.
+    xmin, ymin, cell, xcount, ycount: The grid, as set by grid_fix_params.
+    nodata: Value for cells without data. This is a long for "counts" and
+      "coverage" and a double otherwise, as is the result.
+
+  Options:
+    xsnap=, ysnap= As for cell_grid, but note that these default to "w" and
+      "s" here.
+
+  The points are grouped by cell with a counting sort in a single pass, and
+  medians are found by selection rather than by sorting.
+
+  SEE ALSO: cell_grid
+*/
+
+// *** Defined in triangle_grid.c ***
+
+extern triangle_grid_cells;
+/* DOCUMENT zgrid = triangle_grid_cells(x, y, z, v1, v2, v3, xc, yc, nodata,
+    threads=)
+  Grids the triangulated points x, y, z, as triangle_grid does with
+  triangle_interp. Normally you should use triangle_grid rather than calling
+  this directly.
+
+  Parameters:
+    x, y, z: Arrays of the known points.
+    v1, v2, v3: Indexes into x, y, z of the vertices of each triangle, as
+      from splitary on the result of triangulate.
+    xc, yc: Evenly spaced x coordinates of the cell centers for each column,
+      and y coordinates for each row.
+    nodata: Value for cells that aren't in any triangle.
+
+  Option:
+    threads= Number of threads to split the rows of the grid across.
+      Default is 1.
+
+  Returns a 2-dimensional array of doubles, [numberof(xc), numberof(yc)].
+  Each triangle is rasterized once, row by row, instead of searching for the
+  triangle that contains each cell. A cell in more than one triangle gets its
+  value from the first of them, so the result is the same as triangle_interp
+  gives.
+
+  SEE ALSO: triangle_grid
+*/
+
+// *** Defined in cf_rx.c ***
+
+extern eaarl_cf_fit_batch;
+/* DOCUMENT fit = eaarl_cf_fit_batch(wf, wflen, seeds, npeaks, &niter, itmax=,
+    tol=)
+  Fits a sum of gaussians to each of a batch of waveforms by
+  Levenberg-Marquardt least squares, as the curve fitting mode (process_cf)
+  does with lmfit and eaarl_cf_lmfit_gauss. Each gaussian is
+  a1*exp(-0.5*((x-a2)/a3)^2), as for gauss, where x is the sample number
+  (1-based) within its waveform.
+
+  Unlike lmfit, the derivatives are computed analytically rather than by
+  finite differences, so fitted values will differ slightly from lmfit's.
+
+  Parameters:
+    wf: All of the waveforms, concatenated.
+    wflen: The number of samples in each waveform.
+    seeds: The initial parameters, concatenated: [amplitude, center, standard
+      deviation] for each peak of each waveform, as seeded by
+      eaarl_cf_rx_wf_seed.
+    npeaks: The number of peaks (parameter triples) for each waveform.
+    niter: Output parameter, the number of iterations used for each waveform.
+      As for lmfit, only steps that improve the fit count as iterations. This
+      is ITMAX for fits that did not converge.
+
+  Options:
+    itmax= Maximum number of iterations per waveform. Default is itmax=100.
+    tol= Relative tolerance on chi2 used to decide convergence. Default is
+      tol=1e-7.
+
+  Returns the fitted parameters, in the same layout as SEEDS. The waveforms
+  are fitted one after another.
+
+  SEE ALSO: eaarl_cf_rx_wf, eaarl_cf_rx_channel, lmfit
+*/
+
 // *** Defined in multidata.c ***
 
 extern sortedness;
@@ -546,15 +1230,32 @@ __calps_backup = save(
   _ycross_product_sign, _yin_triangle,
   _ytriangle_interp, _ywrite_arc_grid,
   _yin_box, _ylevel_short_dips,
-  _yll2utm, _yutm2ll,
+  _yll2utm, _yutm2ll, _yll2utm_batch, _yutm2ll_batch,
+  _ypoint_project3,
   calps_n88_interp_qfit2d, calps_n88_interp_spline2d,
+  geoid_map, geoid_map_interp,
   _yset_intersect_long, _yset_intersect_double,
   unique,
   get_pid,
   profiler_init, profiler_lastinit, profiler_reset, profiler_ticks,
-  eaarl_decode_fast,
+  filebuffer_stats,
+  eaarl_decode_fast, eaarl_decode_open, eaarl_decode_next,
+  eaarl_index_open, eaarl_index_decode,
   wf_centroid, cent,
-  eaarl_fs_rx_cent_eaarlb,
+  eaarl_fs_rx_cent_eaarlb, eaarl_fs_rx_cent_eaarla,
+  eaarl_be_rx_batch,
+  eaarl_ba_rx_batch,
+  eaarl_cf_fit_batch,
+  eaarl_mp_rx_batch,
+  eaarl_rx_batch,
+  eaarl_sb_rx_batch,
+  eaarl_trajectory_interp,
+  eaarl_direct_vector_batch,
+  spatial_index, spatial_index_radius, spatial_index_box,
+  spatial_index_nearest,
+  radius_grid_cells,
+  cell_grid_cells,
+  triangle_grid_cells,
   sortedness, sortedness_obj,
   timsort, timsort_obj,
   file_exists, file_readable, file_size,
@@ -0,0 +1,270 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements the gridding for cell_grid in gridding.i:
+ *
+ *    zgrid = cell_grid_cells(x, y, z, method, xmin, ymin, cell, xcount,
+ *      ycount, nodata, xsnap=, ysnap=)
+ *
+ * The points are placed into cells exactly as cell_grid does (including which
+ * points on the grid's edges are kept, per xsnap and ysnap), then grouped by
+ * cell with a counting sort, which is linear and keeps each cell's points in
+ * their original order. Each cell is then reduced in place: the median by
+ * selection rather than a full sort, and the average in one pass.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yapi.h"
+
+#define CELL_GRID_LAST 0
+#define CELL_GRID_AVERAGE 1
+#define CELL_GRID_MEDIAN 2
+#define CELL_GRID_COUNTS 3
+#define CELL_GRID_DENSITY 4
+#define CELL_GRID_COVERAGE 5
+
+static const char *cell_grid_methods[] = {
+  "last", "average", "median", "counts", "density", "coverage", 0
+};
+
+/* cell_grid_select
+ * Rearranges the N values in V so that V[K] is the value that would be there
+ * if V were sorted, with everything before it no greater and everything after
+ * it no less (as C++'s nth_element does).
+ */
+static void cell_grid_select(double *v, long n, long k)
+{
+  long lo = 0, hi = n - 1;
+  while(hi > lo)
+  {
+    // Median of three for the pivot
+    long mid = lo + (hi - lo) / 2;
+    double a = v[lo], b = v[mid], c = v[hi], pivot;
+    if(a < b)
+      pivot = b < c ? b : (a < c ? c : a);
+    else
+      pivot = a < c ? a : (b < c ? c : b);
+
+    long i = lo, j = hi;
+    while(i <= j)
+    {
+      while(v[i] < pivot) i++;
+      while(v[j] > pivot) j--;
+      if(i <= j)
+      {
+        double t = v[i];
+        v[i] = v[j];
+        v[j] = t;
+        i++;
+        j--;
+      }
+    }
+    if(k <= j)
+      hi = j;
+    else if(k >= i)
+      lo = i;
+    else
+      return;
+  }
+}
+
+/* cell_grid_median
+ * Median of the N values in V (which are rearranged), as Yorick's median
+ * gives it: the middle value, or the average of the two middle values. If
+ * IS_FLOAT, the values came from floats and those two are added as floats,
+ * as Yorick would.
+ */
+static double cell_grid_median(double *v, long n, int is_float)
+{
+  long i, k = n / 2;
+  cell_grid_select(v, n, k);
+  if(n % 2) return v[k];
+
+  // The lower middle value is the largest of those before v[k]
+  double lower = v[0];
+  for(i = 1; i < k; i++)
+    if(v[i] > lower) lower = v[i];
+  if(is_float)
+    return 0.5 * (float)((float)lower + (float)v[k]);
+  return 0.5 * (lower + v[k]);
+}
+
+void Y_cell_grid_cells(int nArgs)
+{
+  static char *knames[3] = {"xsnap", "ysnap", 0};
+  static long kglobs[3];
+  int kiargs[2];
+  int iarg[10], i;
+  long count, n, dims[Y_DIMSIZE];
+  char *xsnap = "w", *ysnap = "s";
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 10; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[9] == -1 || yarg_kw(iarg[9]-1, kglobs, kiargs) != -1)
+    y_error("must provide 10 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0])) xsnap = ygets_q(kiargs[0]);
+  if(kiargs[1] != -1 && !yarg_nil(kiargs[1])) ysnap = ygets_q(kiargs[1]);
+  if(!xsnap) xsnap = "";
+  if(!ysnap) ysnap = "";
+
+  if(!yarg_number(iarg[0])) y_error("x must be numeric");
+  if(!yarg_number(iarg[1])) y_error("y must be numeric");
+  if(!yarg_number(iarg[2])) y_error("z must be numeric");
+  int is_float = yarg_typeid(iarg[2]) == Y_FLOAT;
+  double *x = ygeta_d(iarg[0], &count, 0);
+  double *y = ygeta_d(iarg[1], &n, 0);
+  if(n != count) y_error("x and y must have the same number of values");
+  double *z = ygeta_d(iarg[2], &n, 0);
+  if(n != count) y_error("x and z must have the same number of values");
+
+  if(!yarg_string(iarg[3]) || yarg_rank(iarg[3]) != 0)
+    y_error("method must be a scalar string");
+  char *mname = ygets_q(iarg[3]);
+  int method = -1;
+  for(i = 0; mname && cell_grid_methods[i]; i++)
+    if(!strcmp(mname, cell_grid_methods[i])) method = i;
+  if(method < 0) y_error("invalid method");
+
+  double xmin = ygets_d(iarg[4]);
+  double ymin = ygets_d(iarg[5]);
+  double cell = ygets_d(iarg[6]);
+  long xcount = ygets_l(iarg[7]);
+  long ycount = ygets_l(iarg[8]);
+  if(xcount < 1 || ycount < 1) y_error("grid must have at least one cell");
+  long ncell = xcount * ycount;
+
+  // As grid_fix_params sets them
+  double xmax = xmin + xcount * cell;
+  double ymax = ymin + ycount * cell;
+
+  // Which edges are kept, and which way points snap, as in cell_grid
+  int xkeepmin = !strcmp(xsnap, "w"), xkeepmax = !strcmp(xsnap, "e");
+  int ykeepmin = !strcmp(ysnap, "s"), ykeepmax = !strcmp(ysnap, "n");
+
+  // Grid storage
+  dims[0] = 2;
+  dims[1] = xcount;
+  dims[2] = ycount;
+  long *lgrid = 0;
+  double *dgrid = 0;
+  if(method == CELL_GRID_COUNTS || method == CELL_GRID_COVERAGE)
+  {
+    long nodata = ygets_l(iarg[9]);
+    // stack + 1 = +1
+    lgrid = ypush_l(dims);
+    for(n = 0; n < ncell; n++) lgrid[n] = nodata;
+  }
+  else
+  {
+    double nodata = ygets_d(iarg[9]);
+    // stack + 1 = +1
+    dgrid = ypush_d(dims);
+    for(n = 0; n < ncell; n++) dgrid[n] = nodata;
+  }
+
+  // Cell for each point (0-based), or -1 if it's left out. Scratch space is
+  // pushed on the stack so that it's released if anything goes wrong; it's
+  // dropped at the end so the grid is the result.
+  // stack + 1 = +2
+  long *cellof = ypush_scratch(sizeof(long) * (count ? count : 1), 0);
+  long maxcell = -1;
+  for(n = 0; n < count; n++)
+  {
+    double px = x[n], py = y[n];
+    cellof[n] = -1;
+
+    // Same as data_box with keepxmin=, keepxmax=, keepymin=, keepymax=
+    if(!(px >= xmin && px <= xmax && py >= ymin && py <= ymax)) continue;
+    if(!xkeepmin && px == xmin) continue;
+    if(!xkeepmax && px == xmax) continue;
+    if(!ykeepmin && py == ymin) continue;
+    if(!ykeepmax && py == ymax) continue;
+
+    // 1-based grid position
+    long xc = xkeepmin ?
+      (long)((px - xmin) / cell + 1) : (long)ceil((px - xmin) / cell);
+    long yc = ykeepmin ?
+      (long)((py - ymin) / cell + 1) : (long)ceil((py - ymin) / cell);
+    long zi = (yc - 1) * xcount + xc - 1;
+    if(zi < 0 || zi >= ncell) continue;
+
+    cellof[n] = zi;
+    if(zi > maxcell) maxcell = zi;
+  }
+
+  if(method == CELL_GRID_COVERAGE || method == CELL_GRID_LAST)
+  {
+    for(n = 0; n < count; n++)
+    {
+      if(cellof[n] < 0) continue;
+      if(lgrid)
+        lgrid[cellof[n]] = 1;
+      else
+        dgrid[cellof[n]] = z[n];
+    }
+    // stack - 1 = +1
+    yarg_drop(1);
+    return;
+  }
+
+  // Counting sort: start[c] through start[c+1]-1 are cell c's points
+  // stack + 1 = +3
+  long *start = ypush_scratch(sizeof(long) * (ncell + 1), 0);
+  memset(start, 0, sizeof(long) * (ncell + 1));
+  for(n = 0; n < count; n++)
+    if(cellof[n] >= 0) start[cellof[n]+1]++;
+
+  // counts and density are just the histogram; as with zgrid(1:max) = hist,
+  // the cells up to the last one with data get their count even if it's 0
+  if(method == CELL_GRID_COUNTS || method == CELL_GRID_DENSITY)
+  {
+    for(n = 0; n <= maxcell; n++)
+    {
+      if(lgrid)
+        lgrid[n] = start[n+1];
+      else
+        dgrid[n] = start[n+1] / (cell * cell);
+    }
+    // stack - 2 = +1
+    yarg_drop(2);
+    return;
+  }
+
+  for(n = 0; n < ncell; n++)
+    start[n+1] += start[n];
+
+  long used = start[ncell];
+  // stack + 1 = +4
+  double *sorted = ypush_scratch(sizeof(double) * (used ? used : 1), 0);
+  for(n = 0; n < count; n++)
+    if(cellof[n] >= 0) sorted[start[cellof[n]]++] = z[n];
+  // Each start[c] is now where cell c+1 begins
+  long first = 0;
+  for(n = 0; n < ncell; n++)
+  {
+    long stop = start[n], k;
+    long cnt = stop - first;
+    if(cnt > 0)
+    {
+      double *v = sorted + first;
+      if(method == CELL_GRID_AVERAGE)
+      {
+        double sum = 0;
+        for(k = 0; k < cnt; k++) sum += v[k];
+        dgrid[n] = sum / cnt;
+      }
+      else
+      {
+        dgrid[n] = cell_grid_median(v, cnt, is_float);
+      }
+    }
+    first = stop;
+  }
+
+  // stack - 3 = +1
+  yarg_drop(3);
+}
@@ -1,10 +1,15 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 #include "yapi.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // Calculate the centroid of the given waveform. Returns Inf if unable to
 // calculate.
 double wf_centroid(long *wf, long count)
@@ -154,32 +159,127 @@ void cent(long *wf, long count, double *result)
   #undef max_intensity
 }
 
-long *retrieve_wf(int iarg, long *count)
+#ifdef __SSE2__
+// Sum of the four 32-bit lanes of V
+static long cent_uc_hsum(__m128i v)
 {
-  if(yarg_rank(iarg) != 1) y_error("waveform must be one dimensional");
-  long *wf = NULL;
+  v = _mm_add_epi32(v, _mm_srli_si128(v, 8));
+  v = _mm_add_epi32(v, _mm_srli_si128(v, 4));
+  return _mm_cvtsi128_si32(v);
+}
+#endif
+
+// Equivalent to cent for a raw char waveform, as Y_cent would convert it:
+// inverted, with the bias of the first sample removed. Since ~a - ~b == b - a,
+// sample i of that waveform is raw[0] - raw[i], so it is computed on the fly
+// rather than stored. COUNT must already be limited as for cent. Returns the
+// number of samples with raw values no greater than SAT (the saturated
+// samples), which callers would otherwise need a second pass for.
+//
+// With SSE2, sixteen samples are handled at a time. cent normally looks at no
+// more than 12 samples, which fits in a single pass, so wider vectors would
+// not help here.
+long cent_uc(const unsigned char *raw, long count, unsigned char sat,
+  double *result)
+{
+  // The first sample is always 0 once bias is removed, so it is the initial
+  // maximum
+  long power = 0, weighted = 0, nsat = 0, max_index = 1, max_intensity = 0;
+  long i = 0;
+
+  if(count < 1)
+  {
+    result[0] = result[1] = result[2] = 0;
+    return 0;
+  }
+
+  int bias = raw[0];
 
-  if(yarg_typeid(iarg) == Y_CHAR)
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i vbias = _mm_set1_epi16(bias);
+  const __m128i vsat = _mm_set1_epi8((char)sat);
+  const __m128i lo_pos = _mm_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+  const __m128i hi_pos = _mm_setr_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+  const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15);
+  unsigned char pad[16];
+
+  for(i = 0; i < count; i += 16)
   {
-    long i = 0, dims[Y_DIMSIZE];
-    unsigned char *tmp = ygeta_uc(iarg, count, dims);
-    wf = ypush_l(dims);
-    yarg_swap(0, iarg+1);
-    yarg_drop(1);
+    long n = count - i;
+    __m128i r;
+    if(n >= 16)
+    {
+      r = _mm_loadu_si128((const __m128i *)(raw + i));
+      n = 16;
+    }
+    else
+    {
+      // Pad with the bias so that the extra lanes are 0 after removing it;
+      // they then add nothing to the sums and can never be a new maximum
+      memset(pad, bias, sizeof(pad));
+      memcpy(pad, raw + i, n);
+      r = _mm_loadu_si128((const __m128i *)pad);
+    }
 
-    long bias = (long)(~tmp[0]);
-    wf[0] = 0;
-    for(i = 1; i < *count; i++)
+    __m128i lo = _mm_sub_epi16(vbias, _mm_unpacklo_epi8(r, zero));
+    __m128i hi = _mm_sub_epi16(vbias, _mm_unpackhi_epi8(r, zero));
+
+    // weighted needs sample positions i+1 onward; lo_pos/hi_pos give 1-16,
+    // so add i times this block's power
+    long block = cent_uc_hsum(_mm_add_epi32(
+      _mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones)));
+    power += block;
+    weighted += i * block + cent_uc_hsum(_mm_add_epi32(
+      _mm_madd_epi16(lo, lo_pos), _mm_madd_epi16(hi, hi_pos)));
+
+    __m128i m = _mm_max_epi16(lo, hi);
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 2));
+    long block_max = (short)_mm_cvtsi128_si32(m);
+    if(block_max > max_intensity)
     {
-      wf[i] = (long)(~tmp[i]) - bias;
+      __m128i vmax = _mm_set1_epi16(block_max);
+      int mask = _mm_movemask_epi8(_mm_packs_epi16(
+        _mm_cmpeq_epi16(lo, vmax), _mm_cmpeq_epi16(hi, vmax)));
+      max_index = i + __builtin_ctz(mask) + 1;
+      max_intensity = block_max;
     }
+
+    // raw <= sat, in the lanes that hold samples
+    __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(r, vsat), r);
+    le = _mm_and_si128(le, _mm_cmplt_epi8(lanes, _mm_set1_epi8(n)));
+    nsat += __builtin_popcount(_mm_movemask_epi8(le));
   }
-  else
+#else
+  for(i = 0; i < count; i++)
+  {
+    long value = bias - raw[i];
+    power += value;
+    weighted += value * (i + 1);
+    if(value > max_intensity)
+    {
+      max_index = i + 1;
+      max_intensity = value;
+    }
+    if(raw[i] <= sat) nsat++;
+  }
+#endif
+
+  if(count < 2)
   {
-    wf = ygeta_l(iarg, count, NULL);
+    result[0] = result[1] = result[2] = 0;
+    return nsat;
   }
 
-  return wf;
+  result[0] = power ? (double)weighted / power : FLT_MAX;
+  if(result[0] > 10000) result[0] = 10000;
+  result[1] = max_index;
+  result[2] = max_intensity;
+  return nsat;
 }
 
 #define CENT_KEYCT 1
@@ -205,8 +305,16 @@ void Y_cent(int nArgs)
     return;
   }
 
+  if(yarg_rank(iarg_wf) != 1) y_error("waveform must be one dimensional");
+
+  // Char waveforms are converted on the fly by cent_uc
   long count = 0;
-  long *wf = retrieve_wf(iarg_wf, &count);
+  long *wf = NULL;
+  unsigned char *raw = NULL;
+  if(yarg_typeid(iarg_wf) == Y_CHAR)
+    raw = ygeta_uc(iarg_wf, &count, NULL);
+  else
+    wf = ygeta_l(iarg_wf, &count, NULL);
 
   if(kiargs[0] == -1 || yarg_nil(kiargs[0]))
   {
@@ -223,5 +331,8 @@ void Y_cent(int nArgs)
   }
 
   double *result = ypush_d(dims);
-  cent(wf, count, result);
+  if(raw)
+    cent_uc(raw, count, 0, result);
+  else
+    cent(wf, count, result);
 }
@@ -0,0 +1,461 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <math.h>
+#include <string.h>
+#include "yapi.h"
+#include "pulses_exec.h"
+
+// Levenberg-Marquardt damping: initial value and the factor it is scaled by
+// after each step (the same defaults as lmfit in lmfit.i)
+#define CF_FIT_LAMBDA 1e-3
+#define CF_FIT_GAIN 10.0
+// Once lambda passes this, the damped step is too small to change chi2
+// meaningfully, so the fit is taken as converged
+#define CF_FIT_LAMBDA_MAX 1e10
+
+/* cf_fit_eval
+ * Evaluates the sum of gaussians given by A (NP parameters, as triples of
+ * amplitude, center, and standard deviation) at x = 1..N, as gauss from
+ * gauss.i does, and stores the residuals Y - fit in R. Returns chi2, the sum
+ * of the squared residuals.
+ */
+static double cf_fit_eval(const double *y, long n, const double *a, long np,
+  double *r)
+{
+  long i, k;
+  double t, chi2 = 0;
+  for(i = 0; i < n; i++) r[i] = y[i];
+  for(k = 0; k < np; k += 3)
+  {
+    for(i = 0; i < n; i++)
+    {
+      t = (i + 1 - a[k+1]) / a[k+2];
+      r[i] -= a[k] * exp(-0.5 * t * t);
+    }
+  }
+  for(i = 0; i < n; i++) chi2 += r[i] * r[i];
+  return chi2;
+}
+
+/* cf_fit_normal
+ * Computes the analytic Jacobian of the fit at A and from it the normal
+ * equations: ALPHA = J'J (NP x NP) and BETA = J'R. J is scratch space for N x
+ * NP values.
+ */
+static void cf_fit_normal(long n, const double *a, long np, const double *r,
+  double *j, double *alpha, double *beta)
+{
+  long i, k, l;
+  double t, e, s;
+  for(k = 0; k < np; k += 3)
+  {
+    double *jamp = j + k * n, *jcen = jamp + n, *jsd = jcen + n;
+    for(i = 0; i < n; i++)
+    {
+      t = (i + 1 - a[k+1]) / a[k+2];
+      e = exp(-0.5 * t * t);
+      jamp[i] = e;
+      jcen[i] = a[k] * e * t / a[k+2];
+      jsd[i] = jcen[i] * t;
+    }
+  }
+  for(k = 0; k < np; k++)
+  {
+    const double *jk = j + k * n;
+    for(l = 0; l <= k; l++)
+    {
+      const double *jl = j + l * n;
+      s = 0;
+      for(i = 0; i < n; i++) s += jk[i] * jl[i];
+      alpha[k*np+l] = alpha[l*np+k] = s;
+    }
+    s = 0;
+    for(i = 0; i < n; i++) s += jk[i] * r[i];
+    beta[k] = s;
+  }
+}
+
+/* cf_fit_solve
+ * Solves M x = B in place (X overwrites B) for symmetric positive definite M
+ * (NP x NP) by Cholesky decomposition, overwriting the lower triangle of M.
+ * Returns 0 on success, or 1 if M is not positive definite.
+ */
+static int cf_fit_solve(double *m, double *b, long np)
+{
+  long i, j, k;
+  double s;
+  for(j = 0; j < np; j++)
+  {
+    s = m[j*np+j];
+    for(k = 0; k < j; k++) s -= m[j*np+k] * m[j*np+k];
+    if(!(s > 0)) return 1;
+    m[j*np+j] = s = sqrt(s);
+    for(i = j + 1; i < np; i++)
+    {
+      double v = m[i*np+j];
+      for(k = 0; k < j; k++) v -= m[i*np+k] * m[j*np+k];
+      m[i*np+j] = v / s;
+    }
+  }
+  for(i = 0; i < np; i++)
+  {
+    s = b[i];
+    for(k = 0; k < i; k++) s -= m[i*np+k] * b[k];
+    b[i] = s / m[i*np+i];
+  }
+  for(i = np - 1; i >= 0; i--)
+  {
+    s = b[i];
+    for(k = i + 1; k < np; k++) s -= m[k*np+i] * b[k];
+    b[i] = s / m[i*np+i];
+  }
+  return 0;
+}
+
+/* cf_fit_one
+ * Fits the NP parameters in A to waveform Y (N samples) by Levenberg-Marquardt
+ * minimization of chi2, following lmfit: each iteration solves the damped
+ * normal equations (the diagonal of ALPHA scaled by 1 + lambda) and either
+ * accepts the step and divides lambda by the gain, or rejects it and
+ * multiplies lambda by the gain and tries again. The fit has converged once
+ * an accepted step improves chi2 by no more than TOL relative to its previous
+ * value, or once lambda exceeds CF_FIT_LAMBDA_MAX without finding a better
+ * step.
+ *
+ * As in lmfit, only accepted steps count as iterations. Returns the number of
+ * iterations used, which is ITMAX if the fit did not converge. A is updated
+ * with the last accepted parameters. WORK must hold 3*N + NP*(N + 2*NP + 4)
+ * doubles.
+ */
+static long cf_fit_one(const double *y, long n, double *a, long np,
+  long itmax, double tol, double *work)
+{
+  double *r = work;
+  double *rnew = r + n;
+  double *j = rnew + n;
+  double *alpha = j + n * np;
+  double *m = alpha + np * np;
+  double *beta = m + np * np;
+  double *da = beta + np;
+  double *anew = da + np;
+  double lambda = CF_FIT_LAMBDA;
+  double chi2, chi2new;
+  long niter = 0, k;
+
+  chi2 = cf_fit_eval(y, n, a, np, r);
+  if(!isfinite(chi2)) return itmax;
+  if(chi2 == 0) return 0;
+
+  while(niter < itmax)
+  {
+    cf_fit_normal(n, a, np, r, j, alpha, beta);
+    for(;;)
+    {
+      memcpy(m, alpha, sizeof(double) * np * np);
+      for(k = 0; k < np; k++) m[k*np+k] *= 1 + lambda;
+      memcpy(da, beta, sizeof(double) * np);
+      chi2new = INFINITY;
+      if(!cf_fit_solve(m, da, np))
+      {
+        for(k = 0; k < np; k++) anew[k] = a[k] + da[k];
+        chi2new = cf_fit_eval(y, n, anew, np, rnew);
+      }
+      if(chi2new < chi2) break;
+      lambda *= CF_FIT_GAIN;
+      if(lambda > CF_FIT_LAMBDA_MAX) return niter;
+    }
+
+    niter++;
+    lambda /= CF_FIT_GAIN;
+    memcpy(a, anew, sizeof(double) * np);
+    memcpy(r, rnew, sizeof(double) * n);
+    if(chi2 - chi2new <= tol * chi2) return niter;
+    chi2 = chi2new;
+  }
+  return itmax;
+}
+
+// Settings for the cf kernel, for one channel. Only smoothwf differs by
+// channel; the rest are the same in all four. SEEDS and NPEAKS belong to the
+// conf group.
+typedef struct cf_conf_t
+{
+  long smoothwf;
+  long itmax;
+  double tol;
+  const double *seeds;
+  long nseeds;
+  const long *npeaks;
+  long npulses;
+} cf_conf_t;
+
+// Shared state for the cf kernel, set up by cf_rx_prepare
+typedef struct cf_rx_t
+{
+  // Pulse i's parameters are a[astart[i]] through a[astart[i+1]-1]
+  long *astart;
+  double *a;
+  long *niter;
+  // Fit scratch for each thread, fitlen doubles apiece
+  double *fitwork;
+  long fitlen;
+} cf_rx_t;
+
+static const pulses_column_t cf_rx_columns[] = {{NULL, 0}};
+
+/* cf_rx_read_conf
+ * Reads smoothwf (a scalar or one per channel), itmax, tol, seeds (double),
+ * and npeaks (long, one per pulse) from the conf group.
+ */
+static void cf_rx_read_conf(pulses_exec_t *x, void *obj, yo_ops_t *ops)
+{
+  cf_conf_t *c = x->conf;
+  double smoothwf[4], itmax[4], tol[4];
+  const double *seeds;
+  const long *npeaks;
+  long nseeds, npulses, chan;
+
+  pulses_exec_conf_d(obj, ops, "smoothwf", smoothwf);
+  pulses_exec_conf_d(obj, ops, "itmax", itmax);
+  pulses_exec_conf_d(obj, ops, "tol", tol);
+  if(itmax[0] < 1) y_error("conf.itmax must be positive");
+
+  // The arrays must already have the right type, so that the pointers stay
+  // valid once they're off the stack
+  // stack + 1 = +1
+  if(ops->get_q(obj, "seeds", -1) || yarg_typeid(0) != Y_DOUBLE)
+    y_error("conf.seeds must be an array of doubles");
+  seeds = ygeta_d(0, &nseeds, NULL);
+  // stack - 1 = +0
+  yarg_drop(1);
+  // stack + 1 = +1
+  if(ops->get_q(obj, "npeaks", -1) || yarg_typeid(0) != Y_LONG)
+    y_error("conf.npeaks must be an array of longs");
+  npeaks = ygeta_l(0, &npulses, NULL);
+  // stack - 1 = +0
+  yarg_drop(1);
+
+  for(chan = 0; chan < 4; chan++)
+  {
+    c[chan].smoothwf = smoothwf[chan];
+    c[chan].itmax = itmax[0];
+    c[chan].tol = tol[0];
+    c[chan].seeds = seeds;
+    c[chan].nseeds = nseeds;
+    c[chan].npeaks = npeaks;
+    c[chan].npulses = npulses;
+  }
+}
+
+/* cf_rx_prepare
+ * Checks the seeds against the pulses and sets up the fitted parameters
+ * (starting from the seeds), the iteration counts, and fit scratch for each
+ * thread.
+ */
+static void cf_rx_prepare(pulses_exec_t *x, long maxlen)
+{
+  const cf_conf_t *c = x->conf;
+  long i, total = 0, maxp = 0;
+
+  if(c->npulses != x->count)
+    y_error("conf.npeaks must have one value per pulse");
+
+  ypush_check(5);
+  // stack + 1
+  cf_rx_t *r = ypush_scratch(sizeof(cf_rx_t), NULL);
+  // stack + 1
+  r->astart = ypush_scratch(sizeof(long) * (x->count + 1), NULL);
+  for(i = 0; i < x->count; i++)
+  {
+    if(c->npeaks[i] < 0) y_error("conf.npeaks must not be negative");
+    r->astart[i] = total;
+    total += 3 * c->npeaks[i];
+    if(3 * c->npeaks[i] > maxp) maxp = 3 * c->npeaks[i];
+  }
+  r->astart[x->count] = total;
+  if(total != c->nseeds)
+    y_error("conf.seeds must contain 3*sum(conf.npeaks) values");
+
+  // stack + 1
+  r->a = ypush_scratch(sizeof(double) * (total ? total : 1), NULL);
+  memcpy(r->a, c->seeds, sizeof(double) * total);
+  // stack + 1
+  r->niter = ypush_scratch(sizeof(long) * (x->count ? x->count : 1), NULL);
+  memset(r->niter, 0, sizeof(long) * x->count);
+
+  r->fitlen = 3 * maxlen + maxp * (maxlen + 2 * maxp + 4);
+  // stack + 1
+  r->fitwork = ypush_scratch(sizeof(double) * (r->fitlen ? r->fitlen : 1) *
+    x->nthreads, NULL);
+  x->data = r;
+}
+
+/* cf_rx_pulse
+ * Prepares pulse I's waveform as eaarl_cf_rx_wf_seed does (inverted, with the
+ * first sample's bias removed, and smoothed per smoothwf) and fits its seeded
+ * parameters to it. Pulses without seeds are left alone.
+ */
+static void cf_rx_pulse(const pulses_exec_t *x, int thread, long i,
+  const unsigned char *wf, long n, const void *conf, double *work)
+{
+  const cf_conf_t *c = conf;
+  cf_rx_t *r = x->data;
+  long k, np = r->astart[i+1] - r->astart[i];
+  if(!np) return;
+
+  double *y = work, *smooth = work + n;
+  double bias = (unsigned char)~wf[0];
+  for(k = 0; k < n; k++)
+    y[k] = (double)(unsigned char)~wf[k] - bias;
+  if(c->smoothwf > 0)
+  {
+    pulses_exec_smooth(y, n, c->smoothwf, smooth);
+    y = smooth;
+  }
+
+  r->niter[i] = cf_fit_one(y, n, r->a + r->astart[i], np, c->itmax, c->tol,
+    r->fitwork + r->fitlen * thread);
+}
+
+/* cf_rx_finish
+ * Pushes the result group: a (the fitted parameters, in the layout of
+ * conf.seeds) and niter (per pulse).
+ */
+static void cf_rx_finish(pulses_exec_t *x)
+{
+  cf_rx_t *r = x->data;
+  long dims[Y_DIMSIZE];
+  long total = r->astart[x->count];
+  yo_ops_t *ops;
+
+  ypush_check(3);
+  // stack + 1 = +1
+  void *result = yo_new_group(&ops);
+  dims[0] = 1;
+  if(total)
+  {
+    dims[1] = total;
+    // stack + 1 = +2
+    memcpy(ypush_d(dims), r->a, sizeof(double) * total);
+  }
+  else
+  {
+    // stack + 1 = +2
+    ypush_nil();
+  }
+  ops->set_q(result, "a", -1, 0);
+  if(x->count)
+  {
+    dims[1] = x->count;
+    // stack + 1 = +3
+    memcpy(ypush_l(dims), r->niter, sizeof(long) * x->count);
+  }
+  else
+  {
+    // stack + 1 = +3
+    ypush_nil();
+  }
+  ops->set_q(result, "niter", -1, 0);
+  // stack - 2 = +1
+  yarg_drop(2);
+}
+
+// The cf kernel has no channel selection of its own; eaarl_cf_rx_channel
+// uses the first return's channel
+const pulses_kernel_t cf_rx_kernel = {
+  "cf", cf_rx_columns, sizeof(cf_conf_t), 2, cf_rx_read_conf, NULL,
+  cf_rx_prepare, cf_rx_pulse, cf_rx_finish
+};
+
+void Y_eaarl_cf_fit_batch(int nArgs)
+{
+  static char *knames[3] = {"itmax", "tol", 0};
+  static long kglobs[3];
+  int kiargs[2];
+  int iarg[5], i;
+  long itmax = 100, niter_ref = -1;
+  double tol = 1e-7;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 5; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[3] == -1)
+    y_error("must provide at least 4 arguments");
+  if(iarg[4] != -1 && yarg_kw(iarg[4]-1, kglobs, kiargs) != -1)
+    y_error("must provide at most 5 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+  {
+    if(yarg_number(kiargs[0]) != 1 || yarg_rank(kiargs[0]) != 0)
+      y_error("itmax= must be scalar integer");
+    itmax = ygets_l(kiargs[0]);
+    if(itmax < 1) y_error("itmax= must be positive");
+  }
+  if(kiargs[1] != -1 && !yarg_nil(kiargs[1]))
+  {
+    if(!yarg_number(kiargs[1]) || yarg_rank(kiargs[1]) != 0)
+      y_error("tol= must be scalar number");
+    tol = ygets_d(kiargs[1]);
+  }
+
+  if(iarg[4] != -1)
+    niter_ref = yget_ref(iarg[4]);
+
+  // Inputs; converted before anything else is pushed so that the argument
+  // indices stay valid
+  long nwf, nlen, na, ncount, dims[Y_DIMSIZE];
+  for(i = 0; i < 4; i++)
+    if(!yarg_number(iarg[i]))
+      y_error("wf, wflen, seeds, and npeaks must be numeric arrays");
+  const double *wf = ygeta_d(iarg[0], &nwf, NULL);
+  const long *wflen = ygeta_l(iarg[1], &nlen, NULL);
+  const double *seeds = ygeta_d(iarg[2], &na, dims);
+  const long *npeaks = ygeta_l(iarg[3], &ncount, NULL);
+  if(nlen != ncount)
+    y_error("wflen and npeaks must have the same length");
+
+  long j, total = 0, totala = 0, maxn = 0, maxp = 0;
+  for(j = 0; j < ncount; j++)
+  {
+    if(wflen[j] < 0 || npeaks[j] < 0)
+      y_error("wflen and npeaks must not be negative");
+    total += wflen[j];
+    totala += 3 * npeaks[j];
+    if(wflen[j] > maxn) maxn = wflen[j];
+    if(3 * npeaks[j] > maxp) maxp = 3 * npeaks[j];
+  }
+  if(total != nwf)
+    y_error("wf must contain sum(wflen) samples");
+  if(totala != na)
+    y_error("seeds must contain 3*sum(npeaks) values");
+
+  ypush_check(3);
+
+  // Outputs
+  // stack + 1 = +1
+  double *a = ypush_d(dims);
+  memcpy(a, seeds, sizeof(double) * na);
+  dims[0] = 1;
+  dims[1] = ncount;
+  // stack + 1 = +2
+  long *niter = ypush_l(dims);
+
+  long worklen = 3 * maxn + maxp * (maxn + 2 * maxp + 4);
+  // stack + 1 = +3
+  double *work = ypush_scratch(sizeof(double) * (worklen ? worklen : 1),
+    NULL);
+
+  for(j = 0; j < ncount; j++)
+  {
+    niter[j] = cf_fit_one(wf, wflen[j], a, 3 * npeaks[j], itmax, tol, work);
+    wf += wflen[j];
+    a += 3 * npeaks[j];
+  }
+
+  // stack - 1 = +2
+  yarg_drop(1);
+  if(niter_ref != -1) yput_global(niter_ref, 0);
+  // stack - 1 = +1; the fitted parameters are returned
+  yarg_drop(1);
+}
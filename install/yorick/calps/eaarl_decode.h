@@ -0,0 +1,142 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#ifndef EAARL_DECODE_H
+#define EAARL_DECODE_H
+
+#include "yapi.h"
+#include "filebuffer.h"
+#include "raster_index.h"
+
+/* eaarl_decode internals
+ *
+ * This exposes the raster decoding machinery from eaarl_decode_fast.c so that
+ * other entry points (such as eaarl_index_decode in eaarl_index.c) can decode
+ * into the same output layout. It is not a general purpose API; see calps.i
+ * for the user-facing functions.
+ */
+
+// Upper limit for threads=
+#define EAARL_DECODE_MAX_THREADS 64
+
+/* Decoding is split into two steps. First, each raster is parsed by
+ * decode_raster, which works on a borrowed pointer to the raster's bytes and
+ * never touches the Yorick stack. It fills in the scalar output fields and
+ * records where each waveform is located in the file. Since the raster index
+ * tells us how many pulses precede each raster, every raster has a fixed
+ * output slot and rasters can be parsed in any order (and in parallel).
+ * Second, back on the main thread, the waveforms are copied out of the file
+ * into Yorick arrays.
+ */
+
+// State shared by all rasters being decoded
+typedef struct decode_t
+{
+  filebuffer_t *f;
+  const unsigned char *map;   // file contents, if memory-mapped
+  long size;                  // file size
+  raster_index_t *ri;
+  long first;                 // first raster in range (index into ri)
+
+  long rnstart;
+  int wfs;
+  double time_offset;
+  double *time_offsets;
+
+  // Output fields; see calps.i for their documentation
+  char *digitizer, *dropout, *pulse;
+  short *irange, *scan_angle;
+  double *soe;
+  int *raster;
+
+  // For each pulse, file offset and length of tx then rx 1-4. A length of 0
+  // means the waveform is absent.
+  long (*wfoff)[5];
+  long (*wflen)[5];
+
+  // Number of pulses actually decoded for each raster (relative to first).
+  // This may be less than the header claims if a raster is truncated.
+  long *written;
+} decode_t;
+
+// Output pointers for the packed waveform layout
+typedef struct decode_packed_t
+{
+  // Start (1-based) and length of each waveform, tx then rx 1-4, already
+  // offset for the channel so that pulse i is at index i (tx) or 4*i (rx)
+  long *start[5];
+  int *len[5];
+  char *buf;
+  long pos;   // bytes of buf used so far
+} decode_packed_t;
+
+/* decode_range
+ * Decodes rasters R0 (inclusive) through R1 (exclusive). If the file is not
+ * memory-mapped, this goes through the filebuffer API and must only be called
+ * from the main thread.
+ */
+void decode_range(decode_t *d, long r0, long r1);
+
+/* decode_threaded
+ * Decodes rasters R0 through R1 (exclusive) using NTHREADS threads. The file
+ * must be memory-mapped.
+ */
+void decode_threaded(decode_t *d, long r0, long r1, long nthreads);
+
+/* decode_compact
+ * Shifts the output for NRASTERS rasters (claiming COUNT pulses in total) so
+ * that the decoded pulses are contiguous, and clears the unused tail. Returns
+ * the number of pulses decoded.
+ */
+long decode_compact(decode_t *d, long nrasters, long count);
+
+/* decode_globals
+ * Retrieves ops_conf.tx_clean and eaarl_time_offset (unless RAW). If
+ * eaarl_time_offset is an array, it is left on the stack so that
+ * TIME_OFFSETS stays valid; otherwise the stack is unchanged.
+ */
+void decode_globals(long raw, long rnstart, long *tx_clean,
+  double *time_offset, double **time_offsets, long *time_offsets_count);
+
+/* decode_init
+ * Sets up D for decoding rasters from RFIRST in RI, numbering them starting
+ * at RNSTART (or not at all, if 0). The working arrays and outputs are left
+ * unset.
+ */
+void decode_init(decode_t *d, filebuffer_t *f, raster_index_t *ri,
+  long rfirst, long rnstart, long wfs);
+
+/* decode_fields
+ * Creates the output arrays for COUNT pulses, adds them to OBJ, and points D
+ * at them. Unless PACKED, the tx and rx pointer arrays are also created and
+ * returned in TX and RX; otherwise those are set to NULL. Stack neutral.
+ */
+void decode_fields(decode_t *d, long count, int packed, void *obj,
+  yo_ops_t *ops, ypointer_t **tx, ypointer_t (**rx)[4]);
+
+/* decode_pointers_copy
+ * Copies the waveforms for the first N pulses in D into their own arrays,
+ * storing them in TX and RX starting at pulse BASE. Stack neutral.
+ */
+void decode_pointers_copy(decode_t *d, ypointer_t *tx, ypointer_t (*rx)[4],
+  long base, long n, long tx_clean);
+
+/* decode_packed_size
+ * Returns the number of bytes needed to pack the first N pulses in D.
+ */
+long decode_packed_size(decode_t *d, long n);
+
+/* decode_packed_init
+ * Creates the packed layout fields for COUNT pulses with TOTAL bytes of
+ * waveforms and adds them to OBJ. Stack neutral.
+ */
+void decode_packed_init(decode_packed_t *pk, long count, long total,
+  void *obj, yo_ops_t *ops);
+
+/* decode_packed_copy
+ * Appends the waveforms for the first N pulses in D to the packed buffer,
+ * recording them for pulses BASE onward.
+ */
+void decode_packed_copy(decode_packed_t *pk, decode_t *d, long base, long n,
+  long tx_clean);
+
+#endif
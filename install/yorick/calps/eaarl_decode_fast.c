@@ -1,159 +1,257 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "yapi.h"
 #include "filebuffer.h"
-
-#define i32(F, OFFSET) filebuffer_i32((F), (OFFSET))
-#define i24(F, OFFSET) filebuffer_i24((F), (OFFSET))
-#define i16(F, OFFSET) filebuffer_i16((F), (OFFSET))
-#define i8(F, OFFSET) filebuffer_i8((F), (OFFSET))
-
-#define EAARL_DECODE_FAST_KEYCT 3
-void Y_eaarl_decode_fast(int nArgs)
+#include "raster_index.h"
+#include "eaarl_decode.h"
+
+// Little-endian accessors relative to the start of the raster, matching
+// filebuffer_i8 .. filebuffer_i32
+#define U8(O) (p[O])
+#define U16(O) (p[O] | (p[(O)+1] << 8))
+#define U24(O) (p[O] | (p[(O)+1] << 8) | (p[(O)+2] << 16))
+#define U32(O) (U24(O) | (p[(O)+3] << 24))
+
+/* decode_raster
+ * Decodes raster R, whose bytes are at P. RLEN is the raster's length per its
+ * header; AVAIL is how many bytes at P are actually available (which is less
+ * than RLEN if the file is truncated).
+ */
+static void decode_raster(decode_t *d, long r, const unsigned char *p,
+  long rlen, long avail)
 {
-  static char *knames[EAARL_DECODE_FAST_KEYCT+1] = {"rnstart", "raw", "wfs", 0};
-  static long kglobs[EAARL_DECODE_FAST_KEYCT+1];
+  long idx = r - d->first;
+  long base = d->ri->cumulative[r] - d->ri->cumulative[d->first];
+  long pidx = base;
+  long rn = d->rnstart ? d->rnstart + idx : 0;
+  long seconds, fseconds, npulse, dig, tmp, offset, pstart, pstop, wflen;
+  long i, j;
+  double toff;
 
-  char *fn = NULL;
-  long start = 0, stop = 0, rnstart = 0, raw = 0, wfs = 1;
+  d->written[idx] = 0;
+  if(rlen < 18 || avail < 18 || U8(3) != 5) return;
 
-  long tx_clean = 0;
-  // one for scalar, the other for array
-  double eaarl_time_offset = 0.;
-  double *eaarl_time_offsets = NULL;
+  seconds = U32(4);
+  fseconds = U32(8);
 
-  filebuffer_t *f = NULL;
-  long count = 0, offset = 0, pidx = -1, rn = 0, rstart = 0, rstop = 0;
-  unsigned long rlen = 0, wflen = 0, tmp = 0;
-  long seconds = 0, fseconds = 0, npulse = 0, dig = 0;
-  long i = 0, j = 0, k = 0;
-  long pstart = 0, pstop = 0;
-  long dims[Y_DIMSIZE];
-  long *pulse_offsets = NULL;
-  char *wf = NULL;
-
-  char *digitizer = NULL, *dropout = NULL, *pulse = NULL;
-  short *irange = NULL, *scan_angle = NULL;
-  double *soe = NULL;
-  int *raster = NULL;
-  ypointer_t *tx = NULL;
-  ypointer_t (*rx)[4] = NULL;
+  tmp = U16(16);
+  npulse = tmp & 0x7fff;
+  dig = (tmp >> 15) & 0x1;
 
-  yo_ops_t *ops;
-  void *obj;
+  toff = d->time_offsets ? d->time_offsets[rn-1] : d->time_offset;
 
-  // Retrieve the provided arguments and options
+  offset = 18;
+  for(i = 1; i <= npulse; i++)
   {
-    int kiargs[EAARL_DECODE_FAST_KEYCT];
-    yarg_kw_init(knames, kglobs, kiargs);
+    if(offset + 15 > rlen - 1 || offset + 15 > avail)
+      break;
+    pstart = offset;
 
-    int iarg_fn = yarg_kw(nArgs-1, kglobs, kiargs);
-    if(iarg_fn == -1) y_error("must provide 3 arguments");
+    if(rn) d->raster[pidx] = rn;
+    d->pulse[pidx] = i;
+    d->digitizer[pidx] = dig;
 
-    int iarg_start = yarg_kw(iarg_fn-1, kglobs, kiargs);
-    if(iarg_start == -1) y_error("must provide 3 arguments");
+    d->soe[pidx] = seconds + (fseconds + U24(offset)) * 1.6e-6 + toff;
 
-    int iarg_stop = yarg_kw(iarg_start-1, kglobs, kiargs);
-    if(iarg_stop == -1) y_error("must provide 3 arguments");
+    d->scan_angle[pidx] = U16(offset+9);
 
-    if(yarg_kw(iarg_stop-1, kglobs, kiargs) != -1)
-      y_error("must provide 3 arguments");
+    tmp = U16(offset+11);
+    d->irange[pidx] = (tmp & 0x3fff);
+    d->dropout[pidx] = ((tmp >> 14) & 0x3);
 
-    if(!yarg_string(iarg_fn))
-      y_error("first argument must be string");
-    if(yarg_number(iarg_start) != 1 || yarg_rank(iarg_start) != 0)
-      y_error("second argument must be scalar integer");
-    if(yarg_number(iarg_stop) != 1 || yarg_rank(iarg_stop) != 0)
-      y_error("third argument must be scalar integer");
+    pstop = pstart + 15 + U16(offset+13) - 1;
+    pidx++;
 
-    if(kiargs[0] != -1)
+    if(!d->wfs)
     {
-      if(yarg_number(kiargs[0]) != 1 || yarg_rank(kiargs[0]) != 0)
-        y_error("rnstart= must be scalar integer");
-      rnstart = ygets_l(kiargs[0]);
+      offset = pstop + 1;
+      continue;
     }
 
-    if(kiargs[1] != -1) raw = yarg_true(kiargs[1]);
-    if(kiargs[2] != -1 && !yarg_nil(kiargs[2])) wfs = yarg_true(kiargs[2]);
+    offset += 15;
 
-    fn = ygets_q(iarg_fn);
-    start = ygets_l(iarg_start);
-    stop = ygets_l(iarg_stop);
+    wflen = offset < avail ? U8(offset) : 0;
+    if(!wflen || offset + 1 + wflen > avail)
+    {
+      offset = pstop + 1;
+      continue;
+    }
+    d->wfoff[pidx-1][0] = d->ri->offset[r] + offset + 1;
+    d->wflen[pidx-1][0] = wflen;
+    offset += 1 + wflen;
+
+    for(j = 1; j <= 4; j++)
+    {
+      if(offset + 2 > avail) break;
+      wflen = U16(offset);
+      tmp = offset + 1 + wflen;
+      if(!wflen || tmp > pstop || tmp > rlen - 1 || tmp >= avail) break;
+      d->wfoff[pidx-1][j] = d->ri->offset[r] + offset + 2;
+      d->wflen[pidx-1][j] = wflen;
+      offset += 2 + wflen;
+    }
 
-    yarg_drop(nArgs);
+    offset = pstop + 1;
   }
 
-  ypush_check(3);
+  d->written[idx] = pidx - base;
+}
 
-  // Retrieve extern values: ops_conf.tx_clean and eaarl_time_offset
+#undef U8
+#undef U16
+#undef U24
+#undef U32
+
+/* decode_range
+ * Decodes rasters R0 (inclusive) through R1 (exclusive). If the file is not
+ * memory-mapped, this goes through the filebuffer API and must only be called
+ * from the main thread.
+ */
+void decode_range(decode_t *d, long r0, long r1)
+{
+  long r, rstart, rlen, avail;
+  const unsigned char *p;
+  for(r = r0; r < r1; r++)
   {
-    long idx = yfind_global("ops_conf", 0);
-    if(idx != -1)
+    rstart = d->ri->offset[r];
+    avail = d->size - rstart;
+    if(d->map)
     {
-      ypush_global(idx);
-      obj = yo_get(0, &ops);
-      if(!obj)
-        y_error("ops_conf not defined properly");
-      if(!ops->get_q(obj, "tx_clean", -1))
-      {
-        tx_clean = ygets_l(0);
-      }
-      yarg_drop(2);
+      p = d->map + rstart;
+      rlen = p[0] | (p[1] << 8) | (p[2] << 16);
+      if(avail > rlen) avail = rlen;
     }
-
-    idx = yfind_global("eaarl_time_offset", 0);
-    if(idx != -1)
+    else
     {
-      ypush_global(idx);
-      if(yarg_rank(0) == 0) {
-        eaarl_time_offset = ygets_d(0);
-        yarg_drop(1);
-      } else if(yarg_rank(0) == 1) {
-        if(!rnstart) {
-          y_error("if eaarl_time_offset is array, must provide rnstart");
-        }
-        eaarl_time_offsets = ygeta_d(0, 0, 0);
-      }
+      rlen = filebuffer_i24(d->f, rstart);
+      if(avail > rlen) avail = rlen;
+      p = filebuffer_ptr(d->f, rstart, avail);
     }
+    decode_raster(d, r, p, rlen, avail);
   }
+}
 
-  f = filebuffer_open(fn);
+typedef struct decode_worker_t
+{
+  pthread_t thread;
+  decode_t *d;
+  long r0, r1;
+} decode_worker_t;
 
-  // stop=0 is special for indicating to use the rest of the file
-  if(stop == 0)
+static void * decode_worker(void *arg)
+{
+  decode_worker_t *w = arg;
+  decode_range(w->d, w->r0, w->r1);
+  return NULL;
+}
+
+/* decode_threaded
+ * Decodes rasters R0 through R1 (exclusive) using NTHREADS threads. Each
+ * thread gets a contiguous run of rasters with roughly equal pulse counts.
+ */
+void decode_threaded(decode_t *d, long r0, long r1, long nthreads)
+{
+  decode_worker_t workers[EAARL_DECODE_MAX_THREADS];
+  int64_t *cum = d->ri->cumulative;
+  long total = cum[r1] - cum[r0];
+  long t, r = r0, started = 0;
+
+  for(t = 0; t < nthreads; t++)
   {
-    stop = filebuffer_size(f) - 1;
+    workers[t].d = d;
+    workers[t].r0 = r;
+    if(t == nthreads - 1)
+    {
+      r = r1;
+    }
+    else
+    {
+      long target = cum[r0] + total * (t + 1) / nthreads;
+      while(r < r1 && cum[r] < target) r++;
+    }
+    workers[t].r1 = r;
   }
 
-  // Scan to see how many pulses there are
-  offset = start - 1;
-  while(offset < stop)
+  for(t = 0; t < nthreads; t++)
   {
-    rlen = (unsigned long) i24(f, offset);
-    if(rlen >= 18 && i8(f, offset+3) == 5)
-      count += (i16(f, offset+16) & 0x7fff);
-    else if(!rlen)
+    if(pthread_create(&workers[t].thread, NULL, decode_worker, &workers[t]))
       break;
-    offset += rlen;
+    started++;
   }
+  // If a thread could not be started, decode its share here instead
+  for(t = started; t < nthreads; t++)
+    decode_range(d, workers[t].r0, workers[t].r1);
+  for(t = 0; t < started; t++)
+    pthread_join(workers[t].thread, NULL);
+}
 
-  // Edge case: no output found
-  if(!count) {
-    ypush_nil();
-    return;
+/* decode_compact
+ * If any raster produced fewer pulses than its header claimed, shifts the
+ * output so that all decoded pulses are contiguous (matching a sequential
+ * decode) and clears the unused tail. Returns the number of pulses decoded.
+ */
+long decode_compact(decode_t *d, long nrasters, long count)
+{
+  long r, src = 0, dst = 0, n;
+  for(r = 0; r < nrasters; r++)
+  {
+    n = d->written[r];
+    if(src != dst && n)
+    {
+      #define SHIFT(VAR) \
+        if(d->VAR) memmove(&d->VAR[dst], &d->VAR[src], n * sizeof(d->VAR[0]))
+      SHIFT(digitizer);
+      SHIFT(dropout);
+      SHIFT(pulse);
+      SHIFT(irange);
+      SHIFT(scan_angle);
+      SHIFT(soe);
+      SHIFT(raster);
+      SHIFT(wfoff);
+      SHIFT(wflen);
+      #undef SHIFT
+    }
+    src += d->ri->pulses[d->first + r];
+    dst += n;
   }
 
-  // Initialize output arrays and group
+  if(dst < count)
+  {
+    n = count - dst;
+    #define CLEAR(VAR) \
+      if(d->VAR) memset(&d->VAR[dst], 0, n * sizeof(d->VAR[0]))
+    CLEAR(digitizer);
+    CLEAR(dropout);
+    CLEAR(pulse);
+    CLEAR(irange);
+    CLEAR(scan_angle);
+    CLEAR(soe);
+    CLEAR(raster);
+    CLEAR(wfoff);
+    CLEAR(wflen);
+    #undef CLEAR
+  }
 
-  obj = yo_new_group(&ops);
+  return dst;
+}
+
+// API methods shared with other decoders, see eaarl_decode.h for
+// documentation
+
+void decode_fields(decode_t *d, long count, int packed, void *obj,
+  yo_ops_t *ops, ypointer_t **tx, ypointer_t (**rx)[4])
+{
+  long dims[Y_DIMSIZE];
 
   dims[0] = 1;
   dims[1] = count;
 
   #define obj_create_and_add(VAR, FNC) \
-    VAR = FNC(dims); ops->set_q(obj, #VAR, -1, 0); yarg_drop(1)
+    d->VAR = FNC(dims); ops->set_q(obj, #VAR, -1, 0); yarg_drop(1)
 
   obj_create_and_add(digitizer, ypush_c);
   obj_create_and_add(dropout, ypush_c);
@@ -162,116 +260,619 @@ void Y_eaarl_decode_fast(int nArgs)
   obj_create_and_add(scan_angle, ypush_s);
   obj_create_and_add(soe, ypush_d);
 
-  if(rnstart)
+  if(d->rnstart)
   {
     obj_create_and_add(raster, ypush_i);
   }
+  else
+  {
+    d->raster = NULL;
+  }
+
+  #undef obj_create_and_add
 
-  if(wfs)
+  *tx = NULL;
+  *rx = NULL;
+  if(d->wfs && !packed)
   {
-    obj_create_and_add(tx, ypush_p);
+    *tx = ypush_p(dims);
+    ops->set_q(obj, "tx", -1, 0);
+    yarg_drop(1);
 
     dims[0] = 2;
     dims[1] = 4;
     dims[2] = count;
-    rx = (ypointer_t (*)[4])ypush_p(dims);
+    *rx = (ypointer_t (*)[4])ypush_p(dims);
     ops->set_q(obj, "rx", -1, 0);
     yarg_drop(1);
   }
+}
 
-  #undef obj_create_and_add
-
-  // Actually retrieve data now
-  rn = rnstart;
-  offset = start - 1;
-  while(offset < stop)
+void decode_pointers_copy(decode_t *d, ypointer_t *tx, ypointer_t (*rx)[4],
+  long base, long n, long tx_clean)
+{
+  long i, j;
+  char *wf;
+  for(i = 0; i < n; i++)
   {
-    rstart = offset;
+    if(!d->wflen[i][0]) continue;
 
-    rlen = (unsigned long) i24(f, offset);
-    rstop = rstart + rlen - 1;
-    if(rlen < 18 || i8(f, offset+3) != 5) {
-      offset = rstop - 1;
-      continue;
-    }
-
-    seconds = i32(f, offset+4);
-    fseconds = i32(f, offset+8);
+    wf = filebuffer_read(d->f, d->wfoff[i][0], d->wflen[i][0]);
+    tx[base+i] = yget_use(0);
+    yarg_drop(1);
 
-    tmp = i16(f, offset+16);
-    npulse = tmp & 0x7fff;
-    dig = (tmp >> 15) & 0x1;
+    if(tx_clean)
+    {
+      for(j = tx_clean-1; j < d->wflen[i][0]; j++)
+      {
+        wf[j] = wf[0];
+      }
+    }
 
-    offset += 18;
-    for(i = 1; i <= npulse; i++)
+    for(j = 0; j < 4; j++)
     {
-      if(offset + 15 > rstart + rlen - 1)
-        break;
-      pstart = offset;
-      pidx++;
+      if(!d->wflen[i][j+1]) break;
+      filebuffer_read(d->f, d->wfoff[i][j+1], d->wflen[i][j+1]);
+      rx[base+i][j] = yget_use(0);
+      yarg_drop(1);
+    }
+  }
+}
 
-      if(rn) raster[pidx] = rn;
-      pulse[pidx] = i;
-      digitizer[pidx] = dig;
+long decode_packed_size(decode_t *d, long n)
+{
+  long i, j, total = 0;
+  for(i = 0; i < n; i++)
+    for(j = 0; j < 5; j++)
+      total += d->wflen[i][j];
+  return total;
+}
 
-      soe[pidx] = seconds + (fseconds + i24(f, offset)) * 1.6e-6 +
-          (eaarl_time_offsets ? eaarl_time_offsets[rn-1] : eaarl_time_offset);
+void decode_packed_init(decode_packed_t *pk, long count, long total,
+  void *obj, yo_ops_t *ops)
+{
+  long dims[Y_DIMSIZE];
+  long j;
+  ypointer_t *wfbuf;
 
-      scan_angle[pidx] = i16(f, offset+9);
+  dims[0] = 1;
+  dims[1] = count;
+  pk->start[0] = ypush_l(dims);
+  ops->set_q(obj, "tx_start", -1, 0);
+  pk->len[0] = ypush_i(dims);
+  ops->set_q(obj, "tx_len", -1, 0);
+  yarg_drop(2);
+
+  dims[0] = 2;
+  dims[1] = 4;
+  dims[2] = count;
+  pk->start[1] = ypush_l(dims);
+  ops->set_q(obj, "rx_start", -1, 0);
+  pk->len[1] = ypush_i(dims);
+  ops->set_q(obj, "rx_len", -1, 0);
+  yarg_drop(2);
+
+  // tx has stride 1; rx is [4, count] so channel j is at 4*i + j-1
+  for(j = 2; j < 5; j++)
+  {
+    pk->start[j] = pk->start[1] + j - 1;
+    pk->len[j] = pk->len[1] + j - 1;
+  }
 
-      tmp = i16(f, offset+11);
-      irange[pidx] = (tmp & 0x3fff);
-      dropout[pidx] = ((tmp >> 14) & 0x3);
-      
-      pstop = pstart + 15 + i16(f, offset+13) - 1;
+  pk->buf = NULL;
+  pk->pos = 0;
+  dims[0] = 0;
+  wfbuf = ypush_p(dims);
+  if(total)
+  {
+    dims[0] = 1;
+    dims[1] = total;
+    pk->buf = ypush_c(dims);
+    *wfbuf = yget_use(0);
+    yarg_drop(1);
+  }
+  ops->set_q(obj, "wfbuf", -1, 0);
+  yarg_drop(1);
+}
 
-      if(!wfs)
+void decode_packed_copy(decode_packed_t *pk, decode_t *d, long base, long n,
+  long tx_clean)
+{
+  long i, j, k;
+  char *buf = pk->buf;
+  for(i = 0; i < n; i++)
+  {
+    for(j = 0; j < 5; j++)
+    {
+      long len = d->wflen[i][j];
+      if(!len) continue;
+      k = j ? 4*(base+i) : base+i;
+      pk->start[j][k] = pk->pos + 1;
+      pk->len[j][k] = len;
+      memcpy(buf + pk->pos, filebuffer_ptr(d->f, d->wfoff[i][j], len), len);
+      if(!j && tx_clean)
       {
-        offset = pstop + 1;
-        continue;
+        for(k = pk->pos + tx_clean-1; k < pk->pos + len; k++)
+        {
+          buf[k] = buf[pk->pos];
+        }
       }
+      pk->pos += len;
+    }
+  }
+}
 
-      offset += 15;
+/* decode_output
+ * Decodes rasters D->FIRST through RLAST (exclusive) and pushes an oxy group
+ * with the results onto the stack, or nil if there are no pulses. D must be
+ * fully set up, including its working arrays, which must have room for the
+ * requested rasters and pulses.
+ */
+static void decode_output(decode_t *d, long rlast, long nthreads, int packed,
+  long tx_clean)
+{
+  long nrasters = rlast - d->first;
+  long count = d->ri->cumulative[rlast] - d->ri->cumulative[d->first];
+  long decoded;
+  ypointer_t *tx;
+  ypointer_t (*rx)[4];
+  yo_ops_t *ops;
+  void *obj;
 
-      wflen = i8(f, offset);
-      if(!wflen) continue;
+  // Edge case: no output found
+  if(!count) {
+    ypush_nil();
+    return;
+  }
 
-      wf = filebuffer_read(f, offset+1, wflen);
-      yget_use(0);
-      tx[pidx] = wf;
-      yarg_drop(1);
+  if(d->wfs)
+  {
+    memset(d->wfoff, 0, sizeof(long) * 5 * count);
+    memset(d->wflen, 0, sizeof(long) * 5 * count);
+  }
 
-      if(tx_clean)
-      {
-        for(j = tx_clean-1; j < wflen; j++)
-        {
-          wf[j] = wf[0];
-        }
-      }
+  // Initialize output arrays and group
+  obj = yo_new_group(&ops);
+  decode_fields(d, count, packed, obj, ops, &tx, &rx);
 
-      offset += 1 + wflen;
+  // Parse the rasters. Threads need the file to be memory-mapped, since the
+  // buffered reader is not thread safe.
+  if(nthreads > nrasters) nthreads = nrasters;
+  if(nthreads > 1 && d->map)
+    decode_threaded(d, d->first, rlast, nthreads);
+  else
+    decode_range(d, d->first, rlast);
 
-      for(j = 0; j < 4; j++)
-      {
-        wflen = i16(f, offset);
-        tmp = offset + 1 + wflen;
-        if(!wflen || tmp > pstop || tmp > rstop) break;
-        wf = filebuffer_read(f, offset+2, wflen);
-        yget_use(0);
-        rx[pidx][j] = wf;
-        yarg_drop(1);
-        offset += 2 + wflen;
-      }
+  decoded = decode_compact(d, nrasters, count);
 
-      offset = pstop + 1;
+  // Copy out the waveforms
+  if(d->wfs && packed)
+  {
+    decode_packed_t pk;
+    decode_packed_init(&pk, count, decode_packed_size(d, decoded), obj, ops);
+    decode_packed_copy(&pk, d, 0, decoded, tx_clean);
+  }
+  else if(d->wfs)
+  {
+    decode_pointers_copy(d, tx, rx, 0, decoded, tx_clean);
+  }
+}
+
+// Options shared by eaarl_decode_fast and eaarl_decode_open
+typedef struct decode_opts_t
+{
+  char *fn;
+  long start, stop;
+  long rnstart, raw, wfs, use_index, nthreads, packed;
+} decode_opts_t;
+
+/* decode_args
+ * Retrieves the arguments and options common to eaarl_decode_fast and
+ * eaarl_decode_open into O, then drops them from the stack. The filename is
+ * copied, since its string goes away with the arguments; it is placed on the
+ * stack, so the stack is left with one entry.
+ */
+#define DECODE_KEYCT 6
+static void decode_args(int nArgs, decode_opts_t *o)
+{
+  static char *knames[DECODE_KEYCT+1] = {
+    "rnstart", "raw", "wfs", "index", "threads", "packed", 0
+  };
+  static long kglobs[DECODE_KEYCT+1];
+  int kiargs[DECODE_KEYCT];
+  char *fn;
+  long dims[Y_DIMSIZE];
+
+  memset(o, 0, sizeof(decode_opts_t));
+  o->wfs = 1;
+  o->use_index = 1;
+  o->nthreads = 1;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+
+  int iarg_fn = yarg_kw(nArgs-1, kglobs, kiargs);
+  if(iarg_fn == -1) y_error("must provide 3 arguments");
+
+  int iarg_start = yarg_kw(iarg_fn-1, kglobs, kiargs);
+  if(iarg_start == -1) y_error("must provide 3 arguments");
+
+  int iarg_stop = yarg_kw(iarg_start-1, kglobs, kiargs);
+  if(iarg_stop == -1) y_error("must provide 3 arguments");
+
+  if(yarg_kw(iarg_stop-1, kglobs, kiargs) != -1)
+    y_error("must provide 3 arguments");
+
+  if(!yarg_string(iarg_fn))
+    y_error("first argument must be string");
+  if(yarg_number(iarg_start) != 1 || yarg_rank(iarg_start) != 0)
+    y_error("second argument must be scalar integer");
+  if(yarg_number(iarg_stop) != 1 || yarg_rank(iarg_stop) != 0)
+    y_error("third argument must be scalar integer");
+
+  if(kiargs[0] != -1)
+  {
+    if(yarg_number(kiargs[0]) != 1 || yarg_rank(kiargs[0]) != 0)
+      y_error("rnstart= must be scalar integer");
+    o->rnstart = ygets_l(kiargs[0]);
+  }
+
+  if(kiargs[1] != -1) o->raw = yarg_true(kiargs[1]);
+  if(kiargs[2] != -1 && !yarg_nil(kiargs[2])) o->wfs = yarg_true(kiargs[2]);
+  if(kiargs[3] != -1 && !yarg_nil(kiargs[3]))
+    o->use_index = yarg_true(kiargs[3]);
+  if(kiargs[4] != -1 && !yarg_nil(kiargs[4]))
+  {
+    if(yarg_number(kiargs[4]) != 1 || yarg_rank(kiargs[4]) != 0)
+      y_error("threads= must be scalar integer");
+    o->nthreads = ygets_l(kiargs[4]);
+    if(o->nthreads < 1) o->nthreads = 1;
+    if(o->nthreads > EAARL_DECODE_MAX_THREADS)
+      o->nthreads = EAARL_DECODE_MAX_THREADS;
+  }
+
+  if(kiargs[5] != -1) o->packed = yarg_true(kiargs[5]);
+
+  fn = ygets_q(iarg_fn);
+  o->start = ygets_l(iarg_start);
+  o->stop = ygets_l(iarg_stop);
+
+  dims[0] = 1;
+  dims[1] = strlen(fn) + 1;
+  o->fn = ypush_c(dims);
+  strcpy(o->fn, fn);
+  yarg_swap(0, nArgs);
+  yarg_drop(nArgs);
+}
+#undef DECODE_KEYCT
+
+/* decode_globals
+ * Retrieves the extern values used while decoding: ops_conf.tx_clean and
+ * eaarl_time_offset (unless RAW). If eaarl_time_offset is an array, it is
+ * left on the stack so that TIME_OFFSETS stays valid; otherwise the stack is
+ * unchanged.
+ */
+void decode_globals(long raw, long rnstart, long *tx_clean,
+  double *time_offset, double **time_offsets, long *time_offsets_count)
+{
+  yo_ops_t *ops;
+  void *obj;
+  long idx = yfind_global("ops_conf", 0);
+
+  *tx_clean = 0;
+  *time_offset = 0.;
+  *time_offsets = NULL;
+  *time_offsets_count = 0;
+
+  if(idx != -1)
+  {
+    ypush_global(idx);
+    obj = yo_get(0, &ops);
+    if(!obj)
+      y_error("ops_conf not defined properly");
+    if(!ops->get_q(obj, "tx_clean", -1))
+    {
+      *tx_clean = ygets_l(0);
     }
+    yarg_drop(2);
+  }
+
+  idx = raw ? -1 : yfind_global("eaarl_time_offset", 0);
+  if(idx != -1)
+  {
+    ypush_global(idx);
+    if(yarg_rank(0) == 0) {
+      *time_offset = ygets_d(0);
+      yarg_drop(1);
+    } else if(yarg_rank(0) == 1) {
+      if(!rnstart) {
+        y_error("if eaarl_time_offset is array, must provide rnstart");
+      }
+      *time_offsets = ygeta_d(0, time_offsets_count, 0);
+    } else {
+      yarg_drop(1);
+    }
+  }
+}
+
+/* decode_locate
+ * Opens the file for O and determines which rasters are in its range. Pushes
+ * two entries onto the stack (the file buffer and the raster index). The
+ * range is *RFIRST (inclusive) through *RLAST (exclusive), as indices into
+ * *RI.
+ */
+static void decode_locate(decode_opts_t *o, filebuffer_t **f,
+  raster_index_t **ri, long *rfirst, long *rlast)
+{
+  *f = filebuffer_open(o->fn);
+  *rfirst = -1;
+
+  // stop=0 is special for indicating to use the rest of the file
+  if(o->stop == 0)
+  {
+    o->stop = filebuffer_size(*f);
+  }
+
+  // Determine which rasters are in range and how many pulses they have. The
+  // raster index can answer this without scanning, provided that START is on
+  // a raster boundary; otherwise, scan just the requested range.
+  if(o->use_index)
+  {
+    *ri = raster_index_load(o->fn, *f, 1);
+    *rfirst = raster_index_find(*ri, o->start - 1);
+    if(*rfirst == -1) yarg_drop(1);
+  }
+  if(*rfirst == -1)
+  {
+    *ri = raster_index_scan(*f, o->start - 1, o->stop);
+    *rfirst = 0;
+  }
+  *rlast = raster_index_bound(*ri, o->stop);
+  if(*rlast < *rfirst) *rlast = *rfirst;
+}
+
+/* decode_init
+ * Sets up D for decoding rasters from RFIRST, numbering them starting at
+ * RNSTART (or not at all, if 0).
+ */
+void decode_init(decode_t *d, filebuffer_t *f, raster_index_t *ri,
+  long rfirst, long rnstart, long wfs)
+{
+  memset(d, 0, sizeof(decode_t));
+  d->f = f;
+  d->size = filebuffer_size(f);
+  d->map = filebuffer_mapped(f) ? filebuffer_ptr(f, 0, d->size) : NULL;
+  d->ri = ri;
+  d->first = rfirst;
+  d->rnstart = rnstart;
+  d->wfs = wfs;
+}
+
+void Y_eaarl_decode_fast(int nArgs)
+{
+  decode_opts_t o;
+  long tx_clean = 0;
+  // one for scalar, the other for array
+  double eaarl_time_offset = 0.;
+  double *eaarl_time_offsets = NULL;
+  long time_offsets_count = 0;
+
+  filebuffer_t *f = NULL;
+  raster_index_t *ri = NULL;
+  long rfirst = -1, rlast = 0, nrasters = 0, count = 0;
+  long dims[Y_DIMSIZE];
+  decode_t d;
+
+  // stack: fn
+  decode_args(nArgs, &o);
+
+  ypush_check(10);
+
+  // stack: fn, time offsets (maybe)
+  decode_globals(o.raw, o.rnstart, &tx_clean, &eaarl_time_offset,
+    &eaarl_time_offsets, &time_offsets_count);
+
+  // stack: ..., file buffer, raster index
+  decode_locate(&o, &f, &ri, &rfirst, &rlast);
+  nrasters = rlast - rfirst;
+  count = ri->cumulative[rlast] - ri->cumulative[rfirst];
+
+  if(count && eaarl_time_offsets
+    && o.rnstart + nrasters - 1 > time_offsets_count)
+    y_error("eaarl_time_offset does not cover the requested rasters");
+
+  decode_init(&d, f, ri, rfirst, o.rnstart, o.wfs);
+  d.time_offset = eaarl_time_offset;
+  d.time_offsets = eaarl_time_offsets;
+
+  // Working arrays
+  dims[0] = 1;
+  dims[1] = nrasters ? nrasters : 1;
+  d.written = ypush_l(dims);
+
+  if(o.wfs)
+  {
+    dims[0] = 2;
+    dims[1] = 5;
+    dims[2] = count ? count : 1;
+    d.wfoff = (long (*)[5])ypush_l(dims);
+    d.wflen = (long (*)[5])ypush_l(dims);
+  }
+
+  decode_output(&d, rlast, o.nthreads, o.packed, tx_clean);
+}
+
+/* Streaming decoder
+ *
+ * eaarl_decode_open returns a handle that remembers the file, its raster
+ * index, and how far decoding has progressed. Each call to eaarl_decode_next
+ * then decodes the next run of whole rasters that fits within the requested
+ * number of pulses. The file buffer and raster index are kept alive by
+ * holding a use of their stack objects, and the working arrays are reused
+ * from one batch to the next, so memory use is bounded by the batch size
+ * rather than the size of the range.
+ */
+
+typedef struct eaarl_decoder_t
+{
+  // Uses of the file buffer and raster index stack objects
+  void *f_use, *ri_use;
+  filebuffer_t *f;
+  raster_index_t *ri;
+
+  // Range of rasters as indices into ri: FIRST is where the range started,
+  // NEXT is the next raster to decode, LAST is the end (exclusive)
+  long first, next, last;
+
+  long rnstart, raw, wfs, packed, nthreads;
+
+  // Working arrays, reused across batches; capacities in rasters and pulses
+  long cap_rasters, cap_pulses;
+  long *written;
+  long (*wfoff)[5];
+  long (*wflen)[5];
+} eaarl_decoder_t;
 
-    if(rn) rn++;
-    offset = rstop + 1;
+static void eaarl_decoder_free(void *ptr)
+{
+  eaarl_decoder_t *dec = ptr;
+  if(dec->written) free(dec->written);
+  if(dec->wfoff) free(dec->wfoff);
+  if(dec->wflen) free(dec->wflen);
+  if(dec->ri_use) ydrop_use(dec->ri_use);
+  if(dec->f_use) ydrop_use(dec->f_use);
+}
+
+static void eaarl_decoder_print(void *ptr)
+{
+  eaarl_decoder_t *dec = ptr;
+  char buf[128];
+  snprintf(buf, sizeof(buf),
+    "eaarl_decoder: %ld of %ld rasters decoded",
+    dec->next - dec->first, dec->last - dec->first);
+  y_print(buf, 1);
+}
+
+static y_userobj_t eaarl_decoder_ops = {
+  "eaarl_decoder",
+  &eaarl_decoder_free,
+  &eaarl_decoder_print,
+  0,
+  0,
+  0
+};
+
+/* eaarl_decoder_reserve
+ * Makes sure the working arrays have room for NRASTERS rasters and COUNT
+ * pulses.
+ */
+static void eaarl_decoder_reserve(eaarl_decoder_t *dec, long nrasters,
+  long count)
+{
+  if(nrasters > dec->cap_rasters)
+  {
+    long *w = realloc(dec->written, sizeof(long) * nrasters);
+    if(!w) y_error("unable to allocate decoder working arrays");
+    dec->written = w;
+    dec->cap_rasters = nrasters;
+  }
+  if(dec->wfs && count > dec->cap_pulses)
+  {
+    long (*o)[5] = realloc(dec->wfoff, sizeof(long) * 5 * count);
+    if(o) dec->wfoff = o;
+    long (*l)[5] = realloc(dec->wflen, sizeof(long) * 5 * count);
+    if(l) dec->wflen = l;
+    if(!o || !l) y_error("unable to allocate decoder working arrays");
+    dec->cap_pulses = count;
   }
 }
 
-#undef i32
-#undef i24
-#undef i16
-#undef i8
+void Y_eaarl_decode_open(int nArgs)
+{
+  decode_opts_t o;
+  filebuffer_t *f = NULL;
+  raster_index_t *ri = NULL;
+  long rfirst, rlast;
+  eaarl_decoder_t *dec;
+
+  // stack: fn
+  decode_args(nArgs, &o);
+
+  // stack: fn, file buffer, raster index
+  decode_locate(&o, &f, &ri, &rfirst, &rlast);
+
+  // stack: fn, file buffer, raster index, decoder
+  dec = ypush_obj(&eaarl_decoder_ops, sizeof(eaarl_decoder_t));
+  memset(dec, 0, sizeof(eaarl_decoder_t));
+  dec->f = f;
+  dec->f_use = yget_use(2);
+  dec->ri = ri;
+  dec->ri_use = yget_use(1);
+  dec->first = dec->next = rfirst;
+  dec->last = rlast;
+  dec->rnstart = o.rnstart;
+  dec->raw = o.raw;
+  dec->wfs = o.wfs;
+  dec->packed = o.packed;
+  dec->nthreads = o.nthreads;
+}
+
+void Y_eaarl_decode_next(int nArgs)
+{
+  eaarl_decoder_t *dec;
+  long max_pulses, rend, nrasters, count, rnstart;
+  long tx_clean = 0, time_offsets_count = 0;
+  double time_offset = 0.;
+  double *time_offsets = NULL;
+  int64_t *cum;
+  decode_t d;
+
+  if(nArgs != 2) y_error("must provide 2 arguments, handle and max_pulses");
+  dec = yget_obj(1, &eaarl_decoder_ops);
+  if(yarg_number(0) != 1 || yarg_rank(0) != 0)
+    y_error("max_pulses must be scalar integer");
+  max_pulses = ygets_l(0);
+  if(max_pulses < 1) y_error("max_pulses must be positive");
+
+  ypush_check(4);
+
+  // Skip rasters without pulses, so that they can't end the stream early
+  while(dec->next < dec->last && !dec->ri->pulses[dec->next])
+    dec->next++;
+
+  // Take whole rasters for as long as they fit. The first raster is always
+  // taken, even if it alone exceeds max_pulses.
+  cum = dec->ri->cumulative;
+  rend = dec->next;
+  if(rend < dec->last) rend++;
+  while(rend < dec->last && cum[rend+1] - cum[dec->next] <= max_pulses)
+    rend++;
+
+  nrasters = rend - dec->next;
+  count = cum[rend] - cum[dec->next];
+  if(!count)
+  {
+    dec->next = rend;
+    ypush_nil();
+    return;
+  }
+
+  rnstart = dec->rnstart ? dec->rnstart + dec->next - dec->first : 0;
+
+  // stack: handle, max_pulses, time offsets (maybe)
+  decode_globals(dec->raw, rnstart, &tx_clean, &time_offset, &time_offsets,
+    &time_offsets_count);
+  if(time_offsets && rnstart + nrasters - 1 > time_offsets_count)
+    y_error("eaarl_time_offset does not cover the requested rasters");
+
+  eaarl_decoder_reserve(dec, nrasters, count);
+
+  decode_init(&d, dec->f, dec->ri, dec->next, rnstart, dec->wfs);
+  d.time_offset = time_offset;
+  d.time_offsets = time_offsets;
+  d.written = dec->written;
+  d.wfoff = dec->wfoff;
+  d.wflen = dec->wflen;
+
+  decode_output(&d, rend, dec->nthreads, dec->packed, tx_clean);
+  dec->next = rend;
+}
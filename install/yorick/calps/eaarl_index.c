@@ -0,0 +1,429 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yapi.h"
+#include "filebuffer.h"
+#include "raster_index.h"
+#include "eaarl_decode.h"
+
+/* Decoding driven by the EDB index
+ *
+ * eaarl_index_open copies the per-raster offset and file number from an EDB
+ * (as loaded by load_edb) along with the full paths to its TLD files. The
+ * resulting handle is then used by eaarl_index_decode to decode arbitrary
+ * raster ranges, including ranges that span several TLD files, straight into
+ * a single output group.
+ *
+ * The handle keeps a small LRU cache of open TLD files (with their raster
+ * indexes), so that repeated small requests against the same files do not
+ * reopen them each time.
+ */
+
+// Number of TLD files kept open by a handle
+#define EAARL_INDEX_CACHE 8
+
+// An open TLD file
+typedef struct eaarl_index_file_t
+{
+  long fnum;        // file number (1-based), or 0 if the slot is unused
+  void *f_use, *ri_use;
+  filebuffer_t *f;
+  raster_index_t *ri;
+  long stamp;       // call in which this file was last used
+} eaarl_index_file_t;
+
+typedef struct eaarl_index_t
+{
+  // Per raster: offset (0-based) of the raster in its file, and file number
+  long count;
+  long *offset;
+  long *fnum;
+
+  // Full paths to the TLD files
+  long nfiles;
+  char **files;
+
+  // Open files; ncache slots are in use, out of capcache allocated
+  long ncache, capcache;
+  eaarl_index_file_t *cache;
+  long stamp;
+} eaarl_index_t;
+
+// A run of rasters from a single file, as indices into its raster index
+typedef struct eaarl_index_seg_t
+{
+  long slot;        // index into cache
+  long rfirst, rlast;
+  long rnstart;
+  long count;       // pulses claimed by the rasters' headers
+  long pos, n;      // where the decoded pulses went in the output, and count
+} eaarl_index_seg_t;
+
+static void eaarl_index_free(void *ptr)
+{
+  eaarl_index_t *idx = ptr;
+  long i;
+  for(i = 0; i < idx->ncache; i++)
+  {
+    if(idx->cache[i].ri_use) ydrop_use(idx->cache[i].ri_use);
+    if(idx->cache[i].f_use) ydrop_use(idx->cache[i].f_use);
+  }
+  if(idx->cache) free(idx->cache);
+  if(idx->files)
+  {
+    for(i = 0; i < idx->nfiles; i++)
+      if(idx->files[i]) free(idx->files[i]);
+    free(idx->files);
+  }
+  if(idx->offset) free(idx->offset);
+  if(idx->fnum) free(idx->fnum);
+}
+
+static void eaarl_index_print(void *ptr)
+{
+  eaarl_index_t *idx = ptr;
+  char buf[128];
+  snprintf(buf, sizeof(buf),
+    "eaarl_index: %ld rasters in %ld files, %ld open",
+    idx->count, idx->nfiles, idx->ncache);
+  y_print(buf, 1);
+}
+
+static y_userobj_t eaarl_index_ops = {
+  "eaarl_index",
+  &eaarl_index_free,
+  &eaarl_index_print,
+  0,
+  0,
+  0
+};
+
+/* eaarl_index_file
+ * Returns the cache slot for file FNUM, opening it if necessary. Files
+ * already used during the current call are never evicted, since segments
+ * refer to them; if all slots are in use by the current call, the cache
+ * grows instead.
+ */
+static long eaarl_index_file(eaarl_index_t *idx, long fnum)
+{
+  eaarl_index_file_t *e;
+  long i, slot = -1;
+
+  for(i = 0; i < idx->ncache; i++)
+  {
+    if(idx->cache[i].fnum == fnum)
+    {
+      idx->cache[i].stamp = idx->stamp;
+      return i;
+    }
+  }
+
+  if(fnum < 1 || fnum > idx->nfiles)
+    y_error("edb file number out of range");
+
+  if(idx->ncache < EAARL_INDEX_CACHE)
+  {
+    slot = idx->ncache;
+  }
+  else
+  {
+    // Evict the least recently used file that isn't needed by this call
+    for(i = 0; i < idx->ncache; i++)
+    {
+      if(idx->cache[i].stamp == idx->stamp) continue;
+      if(slot == -1 || idx->cache[i].stamp < idx->cache[slot].stamp)
+        slot = i;
+    }
+    if(slot == -1) slot = idx->ncache;
+  }
+
+  if(slot == idx->ncache)
+  {
+    if(idx->ncache == idx->capcache)
+    {
+      long cap = idx->capcache ? 2 * idx->capcache : EAARL_INDEX_CACHE;
+      e = realloc(idx->cache, sizeof(eaarl_index_file_t) * cap);
+      if(!e) y_error("unable to allocate file cache");
+      idx->cache = e;
+      idx->capcache = cap;
+    }
+    memset(&idx->cache[slot], 0, sizeof(eaarl_index_file_t));
+    idx->ncache++;
+  }
+
+  e = &idx->cache[slot];
+  if(e->ri_use) ydrop_use(e->ri_use);
+  if(e->f_use) ydrop_use(e->f_use);
+  memset(e, 0, sizeof(eaarl_index_file_t));
+
+  // Each of these pushes an entry; keep a use of each, then drop them
+  e->f = filebuffer_open(idx->files[fnum-1]);
+  e->ri = raster_index_load(idx->files[fnum-1], e->f, 1);
+  e->f_use = yget_use(1);
+  e->ri_use = yget_use(0);
+  yarg_drop(2);
+
+  e->fnum = fnum;
+  e->stamp = idx->stamp;
+  return slot;
+}
+
+void Y_eaarl_index_open(int nArgs)
+{
+  eaarl_index_t *idx;
+  long count = 0, nfnum = 0, nfiles = 0, i;
+  long *offset, *fnum;
+  ystring_t *files;
+
+  if(nArgs != 3)
+    y_error("must provide 3 arguments: offset, file_number, files");
+
+  offset = ygeta_l(2, &count, NULL);
+  fnum = ygeta_l(1, &nfnum, NULL);
+  files = ygeta_q(0, &nfiles, NULL);
+  if(count != nfnum)
+    y_error("offset and file_number must have the same size");
+
+  idx = ypush_obj(&eaarl_index_ops, sizeof(eaarl_index_t));
+  memset(idx, 0, sizeof(eaarl_index_t));
+
+  idx->offset = malloc(sizeof(long) * (count ? count : 1));
+  idx->fnum = malloc(sizeof(long) * (count ? count : 1));
+  idx->files = calloc(nfiles ? nfiles : 1, sizeof(char *));
+  if(!idx->offset || !idx->fnum || !idx->files)
+    y_error("unable to allocate edb index");
+  idx->count = count;
+  idx->nfiles = nfiles;
+  memcpy(idx->offset, offset, sizeof(long) * count);
+  memcpy(idx->fnum, fnum, sizeof(long) * count);
+  for(i = 0; i < nfiles; i++)
+  {
+    idx->files[i] = strdup(files[i] ? files[i] : "");
+    if(!idx->files[i]) y_error("unable to allocate edb index");
+  }
+}
+
+#define EAARL_INDEX_DECODE_KEYCT 4
+void Y_eaarl_index_decode(int nArgs)
+{
+  static char *knames[EAARL_INDEX_DECODE_KEYCT+1] = {
+    "raw", "wfs", "threads", "packed", 0
+  };
+  static long kglobs[EAARL_INDEX_DECODE_KEYCT+1];
+
+  eaarl_index_t *idx;
+  long *rn_start, *rn_stop, nranges = 0, nstop = 0;
+  long raw = 0, wfs = 1, nthreads = 1, packed = 0;
+
+  long tx_clean = 0, time_offsets_count = 0;
+  double time_offset = 0.;
+  double *time_offsets = NULL;
+
+  eaarl_index_seg_t *segs;
+  long nsegs = 0, maxsegs = 0, maxrasters = 0, count = 0, pos = 0, rnmax = 0;
+  long i, r, s;
+  long dims[Y_DIMSIZE];
+  decode_t d, tmpl;
+  ypointer_t *tx;
+  ypointer_t (*rx)[4];
+  long *written;
+  long (*wfoff)[5] = NULL;
+  long (*wflen)[5] = NULL;
+  yo_ops_t *ops;
+  void *obj;
+
+  // Retrieve the provided arguments and options
+  {
+    int kiargs[EAARL_INDEX_DECODE_KEYCT];
+    yarg_kw_init(knames, kglobs, kiargs);
+
+    int iarg_idx = yarg_kw(nArgs-1, kglobs, kiargs);
+    if(iarg_idx == -1) y_error("must provide 3 arguments");
+    int iarg_start = yarg_kw(iarg_idx-1, kglobs, kiargs);
+    if(iarg_start == -1) y_error("must provide 3 arguments");
+    int iarg_stop = yarg_kw(iarg_start-1, kglobs, kiargs);
+    if(iarg_stop == -1) y_error("must provide 3 arguments");
+    if(yarg_kw(iarg_stop-1, kglobs, kiargs) != -1)
+      y_error("must provide 3 arguments");
+
+    if(kiargs[0] != -1) raw = yarg_true(kiargs[0]);
+    if(kiargs[1] != -1 && !yarg_nil(kiargs[1])) wfs = yarg_true(kiargs[1]);
+    if(kiargs[2] != -1 && !yarg_nil(kiargs[2]))
+    {
+      if(yarg_number(kiargs[2]) != 1 || yarg_rank(kiargs[2]) != 0)
+        y_error("threads= must be scalar integer");
+      nthreads = ygets_l(kiargs[2]);
+      if(nthreads < 1) nthreads = 1;
+      if(nthreads > EAARL_DECODE_MAX_THREADS)
+        nthreads = EAARL_DECODE_MAX_THREADS;
+    }
+    if(kiargs[3] != -1) packed = yarg_true(kiargs[3]);
+
+    idx = yget_obj(iarg_idx, &eaarl_index_ops);
+    if(yarg_number(iarg_start) != 1 || yarg_number(iarg_stop) != 1)
+      y_error("start and stop must be integers");
+    rn_start = ygeta_l(iarg_start, &nranges, NULL);
+    rn_stop = ygeta_l(iarg_stop, &nstop, NULL);
+    if(nranges != nstop)
+      y_error("start and stop must have the same size");
+
+    // The arguments stay on the stack; idx, rn_start, and rn_stop point into
+    // them.
+  }
+
+  ypush_check(10);
+  idx->stamp++;
+
+  // Upper bound on the number of segments: one per file change, plus one per
+  // range
+  for(i = 0; i < nranges; i++)
+  {
+    if(rn_start[i] < 1 || rn_stop[i] > idx->count || rn_start[i] > rn_stop[i])
+      y_error("raster range out of bounds");
+    maxsegs++;
+    for(r = rn_start[i]; r < rn_stop[i]; r++)
+      if(idx->fnum[r] != idx->fnum[r-1]) maxsegs++;
+    if(rn_stop[i] > rnmax) rnmax = rn_stop[i];
+  }
+
+  // stack: ..., segs
+  segs = ypush_scratch(sizeof(eaarl_index_seg_t) * (maxsegs ? maxsegs : 1), 0);
+
+  // Split the ranges into per-file segments and locate each one in its file
+  for(i = 0; i < nranges; i++)
+  {
+    r = rn_start[i];
+    while(r <= rn_stop[i])
+    {
+      // Rasters r through e (1-based, inclusive) are in the same file
+      long e = r, stop;
+      eaarl_index_seg_t *seg = &segs[nsegs];
+      eaarl_index_file_t *file;
+      while(e < rn_stop[i] && idx->fnum[e] == idx->fnum[r-1]) e++;
+
+      seg->slot = eaarl_index_file(idx, idx->fnum[r-1]);
+      file = &idx->cache[seg->slot];
+
+      seg->rfirst = raster_index_find(file->ri, idx->offset[r-1]);
+      if(seg->rfirst == -1)
+        y_error("edb offset does not match a raster in the TLD file");
+
+      // The segment ends where the next raster in the same file starts
+      if(e < idx->count && idx->fnum[e] == idx->fnum[r-1])
+        stop = idx->offset[e];
+      else
+        stop = filebuffer_size(file->f);
+      seg->rlast = raster_index_bound(file->ri, stop);
+      if(seg->rlast < seg->rfirst) seg->rlast = seg->rfirst;
+
+      seg->rnstart = r;
+      seg->pos = seg->n = 0;
+      seg->count = file->ri->cumulative[seg->rlast]
+        - file->ri->cumulative[seg->rfirst];
+      count += seg->count;
+      if(seg->rlast - seg->rfirst > maxrasters)
+        maxrasters = seg->rlast - seg->rfirst;
+
+      nsegs++;
+      r = e + 1;
+    }
+  }
+
+  // Edge case: no output found
+  if(!count) {
+    ypush_nil();
+    return;
+  }
+
+  // stack: ..., segs, time offsets (maybe)
+  decode_globals(raw, 1, &tx_clean, &time_offset, &time_offsets,
+    &time_offsets_count);
+  if(time_offsets && rnmax > time_offsets_count)
+    y_error("eaarl_time_offset does not cover the requested rasters");
+
+  // Working arrays
+  // stack: ..., written, wfoff, wflen
+  dims[0] = 1;
+  dims[1] = maxrasters ? maxrasters : 1;
+  written = ypush_l(dims);
+  if(wfs)
+  {
+    dims[0] = 2;
+    dims[1] = 5;
+    dims[2] = count;
+    wfoff = (long (*)[5])ypush_l(dims);
+    wflen = (long (*)[5])ypush_l(dims);
+  }
+
+  // Initialize output arrays and group
+  // stack: ..., result
+  obj = yo_new_group(&ops);
+  memset(&tmpl, 0, sizeof(decode_t));
+  tmpl.rnstart = 1;
+  tmpl.wfs = wfs;
+  decode_fields(&tmpl, count, packed, obj, ops, &tx, &rx);
+
+  // Decode each segment into the output, right after the previous one
+  for(s = 0; s < nsegs; s++)
+  {
+    eaarl_index_seg_t *seg = &segs[s];
+    eaarl_index_file_t *file = &idx->cache[seg->slot];
+    long nrasters = seg->rlast - seg->rfirst;
+    long nt = nthreads;
+
+    if(!seg->count) continue;
+
+    decode_init(&d, file->f, file->ri, seg->rfirst, seg->rnstart, wfs);
+    d.time_offset = time_offset;
+    d.time_offsets = time_offsets;
+    d.written = written;
+    d.digitizer = tmpl.digitizer + pos;
+    d.dropout = tmpl.dropout + pos;
+    d.pulse = tmpl.pulse + pos;
+    d.irange = tmpl.irange + pos;
+    d.scan_angle = tmpl.scan_angle + pos;
+    d.soe = tmpl.soe + pos;
+    d.raster = tmpl.raster + pos;
+    if(wfs)
+    {
+      d.wfoff = wfoff + pos;
+      d.wflen = wflen + pos;
+    }
+
+    if(nt > nrasters) nt = nrasters;
+    if(nt > 1 && d.map)
+      decode_threaded(&d, seg->rfirst, seg->rlast, nt);
+    else
+      decode_range(&d, seg->rfirst, seg->rlast);
+
+    seg->pos = pos;
+    seg->n = decode_compact(&d, nrasters, seg->count);
+    pos += seg->n;
+  }
+
+  // Copy out the waveforms, each segment from its own file
+  if(wfs)
+  {
+    decode_packed_t pk;
+    if(packed)
+    {
+      d.wflen = wflen;
+      decode_packed_init(&pk, count, decode_packed_size(&d, pos), obj, ops);
+    }
+
+    for(s = 0; s < nsegs; s++)
+    {
+      eaarl_index_seg_t *seg = &segs[s];
+      if(!seg->n) continue;
+      d.f = idx->cache[seg->slot].f;
+      d.wfoff = wfoff + seg->pos;
+      d.wflen = wflen + seg->pos;
+      if(packed)
+        decode_packed_copy(&pk, &d, seg->pos, seg->n, tx_clean);
+      else
+        decode_pointers_copy(&d, tx, rx, seg->pos, seg->n, tx_clean);
+    }
+  }
+}
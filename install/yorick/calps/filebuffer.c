@@ -1,7 +1,14 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "yapi.h"
 
 #include "filebuffer.h"
@@ -10,37 +17,185 @@ struct filebuffer_t
 {
   FILE *f;
   long size;      // file size
-  long offset;    // offset in file where buffer is currently loaded from
-  unsigned char buffer[FILEBUFFER_SIZE];
+  unsigned char *map;   // mapping of entire file, or NULL if using buffer
+
+  // Buffered mode: DATA holds LEN bytes of the file starting at OFFSET. DATA
+  // points into one of the two windows; the other is filled in the
+  // background by the readahead thread.
+  long offset;
+  long len;
+  unsigned char *data;
+  unsigned char *window[2];
+  int current;    // which window DATA points into
+
+  // Readahead state, protected by LOCK. AHEAD_OFFSET is the file offset being
+  // (or already) read into the other window, or -1 if none was requested.
+  int threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  long ahead_offset;
+  long ahead_len;
+  int ahead_ready;
+  int quit;
 };
 
+// Totals across all filebuffer handles, reported by filebuffer_stats. These
+// are only updated from the main thread.
+static filebuffer_stats_t filebuffer_totals = {0, 0, 0.};
+
+/* filebuffer_now
+ * Internal function. Returns a monotonic time in seconds.
+ */
+static double filebuffer_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* filebuffer_pread
+ * Internal function. Reads LEN bytes at OFFSET into DST. Safe to call from
+ * any thread since it does not use the FILE position.
+ */
+static long filebuffer_pread(filebuffer_t *fb, unsigned char *dst, long offset,
+  long len)
+{
+  long got = 0, n;
+  int fd = fileno(fb->f);
+  while(got < len)
+  {
+    n = pread(fd, dst + got, len - got, offset + got);
+    if(n <= 0) break;
+    got += n;
+  }
+  return got;
+}
+
+/* filebuffer_readahead
+ * Internal function. Body of the readahead thread: waits for a window to be
+ * requested, reads it into the spare window, and reports it ready.
+ */
+static void * filebuffer_readahead(void *arg)
+{
+  filebuffer_t *fb = arg;
+  long offset, len;
+  unsigned char *dst;
+
+  pthread_mutex_lock(&fb->lock);
+  while(1)
+  {
+    while(!fb->quit && (fb->ahead_offset < 0 || fb->ahead_ready))
+      pthread_cond_wait(&fb->cond, &fb->lock);
+    if(fb->quit) break;
+
+    offset = fb->ahead_offset;
+    len = fb->ahead_len;
+    // The window keeps FILEBUFFER_SIZE bytes free in front of the read-ahead
+    // data, so that the tail of the current window can be carried over.
+    dst = fb->window[!fb->current] + FILEBUFFER_SIZE;
+    pthread_mutex_unlock(&fb->lock);
+
+    filebuffer_pread(fb, dst, offset, len);
+
+    pthread_mutex_lock(&fb->lock);
+    fb->ahead_ready = 1;
+    pthread_cond_broadcast(&fb->cond);
+  }
+  pthread_mutex_unlock(&fb->lock);
+  return NULL;
+}
+
+/* filebuffer_request
+ * Internal function. Asks the readahead thread to read the data following
+ * the current window. Caller must hold the lock.
+ */
+static void filebuffer_request(filebuffer_t *fb)
+{
+  long next = fb->offset + fb->len;
+  fb->ahead_ready = 0;
+  fb->ahead_offset = -1;
+  if(!fb->threaded || next >= fb->size) return;
+  fb->ahead_offset = next;
+  fb->ahead_len = fb->size - next;
+  if(fb->ahead_len > FILEBUFFER_SIZE) fb->ahead_len = FILEBUFFER_SIZE;
+  pthread_cond_broadcast(&fb->cond);
+}
+
 /* filebuffer_load
- * Internal function. Loads a block of data from file into the buffer.
+ * Internal function. Makes sure that the LEN bytes at OFFSET are in the
+ * buffer. If they end within the data the readahead thread was asked for,
+ * any part of them still in the current window is carried over in front of it
+ * and the windows are swapped; otherwise the data is read directly. Either
+ * way, the next window is then requested in the background. Time spent
+ * waiting on reads is counted as stall time.
  */
-static void filebuffer_load(filebuffer_t *fb, long offset)
+static void filebuffer_load(filebuffer_t *fb, long offset, long len)
 {
-  long len = FILEBUFFER_SIZE;
-  if(offset == fb->offset) return;
-  fb->offset = offset;
-  fseek(fb->f, offset, SEEK_SET);
-  if(offset + len > fb->size)
+  double t0 = filebuffer_now();
+  long keep;
+  int hit = 0;
+
+  if(fb->threaded)
+  {
+    pthread_mutex_lock(&fb->lock);
+    // Wait out any read in progress; the spare window can't be touched while
+    // it's being filled.
+    while(fb->ahead_offset >= 0 && !fb->ahead_ready)
+      pthread_cond_wait(&fb->cond, &fb->lock);
+    hit = fb->ahead_ready && fb->ahead_offset == fb->offset + fb->len
+      && offset >= fb->offset
+      && offset + len <= fb->ahead_offset + fb->ahead_len;
+  }
+
+  if(hit)
+  {
+    // Carry over whatever part of the request is still in the current window
+    unsigned char *spare = fb->window[!fb->current];
+    keep = offset < fb->ahead_offset ? fb->ahead_offset - offset : 0;
+    memcpy(spare + FILEBUFFER_SIZE - keep, fb->data + (offset - fb->offset),
+      keep);
+    fb->current = !fb->current;
+    fb->data = spare + FILEBUFFER_SIZE - keep;
+    fb->offset = fb->ahead_offset - keep;
+    fb->len = keep + fb->ahead_len;
+    filebuffer_totals.hits++;
+  }
+  else
+  {
+    fb->data = fb->window[fb->current];
+    fb->offset = offset;
+    fb->len = fb->size - offset;
+    if(fb->len > FILEBUFFER_SIZE) fb->len = FILEBUFFER_SIZE;
+    filebuffer_pread(fb, fb->data, offset, fb->len);
+  }
+  filebuffer_totals.loads++;
+
+  if(fb->threaded)
   {
-    len = fb->size - offset;
+    filebuffer_request(fb);
+    pthread_mutex_unlock(&fb->lock);
   }
-  fread(fb->buffer, len, 1, fb->f);
+
+  filebuffer_totals.stall += filebuffer_now() - t0;
 }
 
 /* filebuffer_check
- * Internal function. Makes sure a request is valid, then makes sure the buffer
- * can accomodate it.
+ * Internal function. Makes sure a request is valid, then returns a pointer to
+ * the requested data, loading it into the buffer if necessary.
  */
-static void filebuffer_check(filebuffer_t *fb, long offset, long len)
+static inline const unsigned char * filebuffer_check(filebuffer_t *fb,
+  long offset, long len)
 {
-  if(offset + len > fb->size) y_error("attempt to read outside file bounds");
-  if(offset < fb->offset || offset + len > fb->offset + FILEBUFFER_SIZE)
+  if(offset < 0 || offset + len > fb->size)
+    y_error("attempt to read outside file bounds");
+  if(fb->map) return fb->map + offset;
+  if(offset < fb->offset || offset + len > fb->offset + fb->len)
   {
-    filebuffer_load(fb, offset);
+    if(len > FILEBUFFER_SIZE) y_error("attempt to read exceeded buffer size");
+    filebuffer_load(fb, offset, len);
   }
+  return fb->data + offset - fb->offset;
 }
 
 /* filebuffer_close
@@ -50,22 +205,88 @@ static void filebuffer_check(filebuffer_t *fb, long offset, long len)
 static void filebuffer_close(void *ptr)
 {
   filebuffer_t *fb = ptr;
+  if(fb->threaded)
+  {
+    pthread_mutex_lock(&fb->lock);
+    fb->quit = 1;
+    pthread_cond_broadcast(&fb->cond);
+    pthread_mutex_unlock(&fb->lock);
+    pthread_join(fb->thread, NULL);
+    pthread_cond_destroy(&fb->cond);
+    pthread_mutex_destroy(&fb->lock);
+  }
+  if(fb->window[0]) free(fb->window[0]);
+  if(fb->window[1]) free(fb->window[1]);
+  if(fb->map) munmap(fb->map, fb->size);
   if(fb->f) fclose(fb->f);
 }
 
+/* filebuffer_start
+ * Internal function. Sets up buffered mode. Each window holds the tail
+ * carried over from the previous window followed by the read-ahead data, so
+ * each is twice the buffer size. If the readahead thread can't be started,
+ * every load is simply read directly.
+ */
+static void filebuffer_start(filebuffer_t *fb)
+{
+  fb->window[0] = malloc(2 * FILEBUFFER_SIZE);
+  fb->window[1] = malloc(2 * FILEBUFFER_SIZE);
+  if(!fb->window[0] || !fb->window[1])
+    y_error("unable to allocate file buffer");
+  fb->data = fb->window[0];
+
+  if(pthread_mutex_init(&fb->lock, NULL)) return;
+  if(pthread_cond_init(&fb->cond, NULL))
+  {
+    pthread_mutex_destroy(&fb->lock);
+    return;
+  }
+  if(pthread_create(&fb->thread, NULL, filebuffer_readahead, fb))
+  {
+    pthread_cond_destroy(&fb->cond);
+    pthread_mutex_destroy(&fb->lock);
+    return;
+  }
+  fb->threaded = 1;
+
+  // Start reading the beginning of the file right away
+  pthread_mutex_lock(&fb->lock);
+  filebuffer_request(fb);
+  pthread_mutex_unlock(&fb->lock);
+}
+
 // API methods, see filbuffer.h for documentation
 
 filebuffer_t * filebuffer_open(const char *fn)
 {
-  long i;
+  struct stat st;
   filebuffer_t *fb = ypush_scratch(sizeof(filebuffer_t), filebuffer_close);
+  memset(fb, 0, sizeof(filebuffer_t));
+  fb->ahead_offset = -1;
   fb->f = fopen(fn, "rb");
   if(!fb->f) y_error("unable to open file");
 
-  fseek(fb->f, 0, SEEK_END);
-  fb->size = ftell(fb->f) + 1;
+  if(fstat(fileno(fb->f), &st)) y_error("unable to stat file");
+  fb->size = st.st_size;
+
+  // Map the whole file if we can; the buffer is only used as a fallback (for
+  // instance, for empty files or file systems that do not support mmap).
+  if(fb->size > 0)
+  {
+    void *map = mmap(NULL, fb->size, PROT_READ, MAP_SHARED, fileno(fb->f), 0);
+    if(map != MAP_FAILED)
+    {
+      fb->map = map;
+      madvise(map, fb->size, MADV_SEQUENTIAL);
+      madvise(map, fb->size, MADV_WILLNEED);
+      // The mapping stays valid after the file is closed.
+      fclose(fb->f);
+      fb->f = NULL;
+    }
+  }
+
+  if(!fb->map) filebuffer_start(fb);
 
-  fb->offset = -1 * FILEBUFFER_SIZE;
   return fb;
 }
 
@@ -74,58 +295,77 @@ long filebuffer_size(filebuffer_t *fb)
   return fb->size;
 }
 
+int filebuffer_mapped(filebuffer_t *fb)
+{
+  return fb->map != NULL;
+}
+
 long filebuffer_i32(filebuffer_t *fb, long offset)
 {
-  filebuffer_check(fb, offset, 4);
-  offset -= fb->offset;
-  return (
-    fb->buffer[offset]
-    | (fb->buffer[offset+1] << 8)
-    | (fb->buffer[offset+2] << 16)
-    | (fb->buffer[offset+3] << 24)
-    );
+  const unsigned char *p = filebuffer_check(fb, offset, 4);
+  return (p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24));
 }
 
 long filebuffer_i24(filebuffer_t *fb, long offset)
 {
-  filebuffer_check(fb, offset, 3);
-  offset -= fb->offset;
-  return (
-    fb->buffer[offset]
-    | (fb->buffer[offset+1] << 8)
-    | (fb->buffer[offset+2] << 16)
-    );
+  const unsigned char *p = filebuffer_check(fb, offset, 3);
+  return (p[0] | (p[1] << 8) | (p[2] << 16));
 }
 
 long filebuffer_i16(filebuffer_t *fb, long offset)
 {
-  filebuffer_check(fb, offset, 2);
-  offset -= fb->offset;
-  return (fb->buffer[offset] | (fb->buffer[offset+1] << 8));
+  const unsigned char *p = filebuffer_check(fb, offset, 2);
+  return (p[0] | (p[1] << 8));
 }
 
 unsigned char filebuffer_i8(filebuffer_t *fb, long offset)
 {
-  filebuffer_check(fb, offset, 1);
-  return fb->buffer[offset-fb->offset];
+  return *filebuffer_check(fb, offset, 1);
+}
+
+const unsigned char * filebuffer_ptr(filebuffer_t *fb, long offset, long len)
+{
+  return filebuffer_check(fb, offset, len);
 }
 
 char * filebuffer_read(filebuffer_t *fb, long offset, long len)
 {
   long dims[Y_DIMSIZE];
-  long i = 0;
-  char *out = NULL;
-
-  if(len > FILEBUFFER_SIZE) y_error("attempt to read exceeded buffer size");
-  filebuffer_check(fb, offset, len);
+  const unsigned char *src = filebuffer_check(fb, offset, len);
 
   dims[0] = 1;
   dims[1] = len;
-  out = ypush_c(dims);
-
-  offset -= fb->offset;
-  for(i = 0; i < len; i++)
-    out[i] = fb->buffer[offset+i];
+  char *out = ypush_c(dims);
+  memcpy(out, src, len);
 
   return out;
 }
+
+void filebuffer_stats(filebuffer_stats_t *stats)
+{
+  *stats = filebuffer_totals;
+}
+
+void Y_filebuffer_stats(int nArgs)
+{
+  static char *knames[2] = {"reset", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int reset = 0;
+  long dims[Y_DIMSIZE];
+  double *result;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  if(yarg_kw(nArgs-1, kglobs, kiargs) != -1)
+    y_error("filebuffer_stats does not accept positional arguments");
+  if(kiargs[0] != -1) reset = yarg_true(kiargs[0]);
+
+  dims[0] = 1;
+  dims[1] = 3;
+  result = ypush_d(dims);
+  result[0] = filebuffer_totals.loads;
+  result[1] = filebuffer_totals.hits;
+  result[2] = filebuffer_totals.stall;
+
+  if(reset) memset(&filebuffer_totals, 0, sizeof(filebuffer_totals));
+}
@@ -1,5 +1,8 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
 
+#ifndef FILEBUFFER_H
+#define FILEBUFFER_H
+
 #include <stdio.h>
 #include <string.h>
 #include "yapi.h"
@@ -11,20 +14,38 @@
  * file since individual small calls to the hard drive are much, much slower
  * than making a few larger calls and storing the results in memory.
  *
- * This library is optimized for forward sequential access. Highly random
- * access may not see much gain from this and may even see a performance
+ * Whenever possible, the file is memory-mapped in its entirety. All reads are
+ * then served directly from the mapping (and thus from the kernel's page
+ * cache) with no copying into an intermediate buffer, and random access is as
+ * cheap as sequential access. The kernel is advised that access will be
+ * sequential so that it reads ahead aggressively.
+ *
+ * If the file cannot be mapped, the library falls back to reading it through
+ * a fixed-size internal buffer. That mode is optimized for forward sequential
+ * access: a background thread reads the next block of the file while the
+ * current one is being parsed, so that parsing and I/O overlap. Highly random
+ * access may not see much gain from it and may even see a performance
  * penalty. However, a small amount of backtracking will not cause a problem.
  * (For instance, making two passes over a file has a negligible impact since
- * you only backtrack once.)
+ * you only backtrack once.) Time spent waiting on reads in this mode is
+ * tallied and can be retrieved via filebuffer_stats.
  *
  * Warning: Some API methods will place items on the Yorick stack to
  * dynamically allocate memory. See the documentation below for details on
  * which methods do so.
  */
 
-// Size of internal buffer, currently 1 MB
+// Size of internal buffer used when the file cannot be mapped, currently 1 MB
 #define FILEBUFFER_SIZE (1024 * 1024)
 
+// Counters for buffered mode, see filebuffer_stats
+typedef struct filebuffer_stats_t
+{
+  long loads;     // number of times the buffer had to be (re)filled
+  long hits;      // loads that were served by the readahead thread
+  double stall;   // seconds spent waiting for data to be read
+} filebuffer_stats_t;
+
 // Opaque type used for filebuffer handle.
 typedef struct filebuffer_t filebuffer_t;
 
@@ -72,7 +93,37 @@ unsigned char filebuffer_i8(filebuffer_t *fb, long offset);
  * This pushes one entry onto the Yorick stack to allocate the memory for the
  * array of char.
  *
- * Warning: The maximum LEN permitted is FILEBUFFER_SIZE. Larger reads will
- * result in an error.
+ * Warning: If the file could not be memory-mapped, the maximum LEN permitted
+ * is FILEBUFFER_SIZE. Larger reads will result in an error.
  */
 char * filebuffer_read(filebuffer_t *fb, long offset, long len);
+
+/* filebuffer_ptr
+ *
+ * Returns a borrowed pointer to the LEN bytes at OFFSET without copying them.
+ * Nothing is placed on the Yorick stack.
+ *
+ * The pointer must not be written through. If the file is memory-mapped, it
+ * remains valid for as long as the filebuffer handle itself. Otherwise it
+ * points into the internal buffer and is only valid until the next call to
+ * any other filebuffer API method on the same handle.
+ *
+ * Warning: If the file could not be memory-mapped, the maximum LEN permitted
+ * is FILEBUFFER_SIZE. Larger reads will result in an error.
+ */
+const unsigned char * filebuffer_ptr(filebuffer_t *fb, long offset, long len);
+
+/* filebuffer_mapped
+ * Returns 1 if the file is memory-mapped, 0 if it is read through the
+ * internal buffer.
+ */
+int filebuffer_mapped(filebuffer_t *fb);
+
+/* filebuffer_stats
+ * Retrieves the buffered mode counters, totaled over all filebuffer handles
+ * since the plugin was loaded (or since they were last reset from Yorick).
+ * Memory-mapped files do not contribute to them.
+ */
+void filebuffer_stats(filebuffer_stats_t *stats);
+
+#endif
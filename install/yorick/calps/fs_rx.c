@@ -3,132 +3,231 @@
 #include <stdio.h>
 #include <math.h>
 #include "yapi.h"
+#include "pulses.h"
 
 // From centroid.c
-void cent(long *wf, long count, double *result);
+long cent_uc(const unsigned char *raw, long count, unsigned char sat,
+  double *result);
 
 // Comments about "stack" are to track how many items we add to the stack.
-// Yorick ensures there is room to add at least 8; if at any point we exceed 8,
-// then we'd need to use a ypush_check call.
-
-void Y_eaarl_fs_rx_cent_eaarlb(int nArgs)
+// Yorick ensures there is room to add at least 8; beyond that, we need to use a
+// ypush_check call.
+
+/* fs_rx_ops_conf
+ * Retrieves ops_conf.chn1_range_bias through chn3_range_bias into BIAS, and
+ * ops_conf.max_sfc_sat into MAX_SAT if it isn't NULL.
+ */
+static void fs_rx_ops_conf(double bias[3], double *max_sat)
 {
-  if(nArgs != 1) y_error("must provide exactly one argument, pulses");
-
-  long tmp = 0;
   yo_ops_t *ops;
-  void *obj = NULL;
+  void *obj;
+  char name[32];
+  int i;
 
-  // Retrieve values needed from ops_conf
-  double range_bias[3];
+  long idx = yfind_global("ops_conf", 0);
+  if(idx == -1) y_error("ops_conf not defined");
+  // stack + 1 = +1
+  ypush_global(idx);
+  obj = yo_get(0, &ops);
+  if(!obj) y_error("ops_conf not defined properly");
+
+  // Channel 2 is used for channel 4, so we do not need chn4_range_bias.
+  for(i = 0; i < 3; i++)
   {
-    long idx = yfind_global("ops_conf", 0);
-    if(idx == -1) y_error("ops_conf not defined");
-    // stack + 1 = +1
-    ypush_global(idx);
-    obj = yo_get(0, &ops);
-    if(!obj) y_error("ops_conf not defined properly");
+    sprintf(name, "chn%d_range_bias", i + 1);
+    // stack + 1 = +2
+    if(ops->get_q(obj, name, -1))
+      y_errorq("ops_conf.%s not defined", name);
+    bias[i] = ygets_d(0);
+    // stack - 1 = +1
+    yarg_drop(1);
+  }
 
+  if(max_sat)
+  {
     // stack + 1 = +2
-    if(ops->get_q(obj, "chn1_range_bias", -1))
-      y_error("ops_conf.chn1_range_bias not defined");
-    range_bias[0] = ygets_d(0);
+    if(ops->get_q(obj, "max_sfc_sat", -1))
+      y_error("ops_conf.max_sfc_sat not defined");
+    *max_sat = ygets_d(0);
+    // stack - 1 = +1
+    yarg_drop(1);
+  }
 
-    // stack + 1 = +3
-    if(ops->get_q(obj, "chn2_range_bias", -1))
-      y_error("ops_conf.chn2_range_bias not defined");
-    range_bias[1] = ygets_d(0);
+  // stack - 1 = +0
+  yarg_drop(1);
+}
 
-    // stack + 1 = +4
-    if(ops->get_q(obj, "chn3_range_bias", -1))
-      y_error("ops_conf.chn3_range_bias not defined");
-    range_bias[2] = ygets_d(0);
+void Y_eaarl_fs_rx_cent_eaarlb(int nArgs)
+{
+  if(nArgs != 1) y_error("must provide exactly one argument, pulses");
 
-    // Channel 2 is used for channel 4, so we do not need chn4_range_bias.
+  yo_ops_t *ops;
+  void *obj = NULL;
 
-    // stack - 4 = +0
-    yarg_drop(4);
-  }
+  // Retrieve values needed from ops_conf
+  double range_bias[3];
+  fs_rx_ops_conf(range_bias, NULL);
 
   // Retrieve pulses
   obj = yo_get(0, &ops);
   if(!obj) y_error("pulses not defined properly");
 
-  // Retrieve fields needed from pulses: channel, rx
+  // Retrieve fields needed from pulses: channel, rx (or packed waveforms)
   // stack + 1 = +1
   if(ops->get_q(obj, "channel", -1))
     y_error("pulses.channel not defined");
   long npulses;
   long *channel = ygeta_l(0, &npulses, NULL);
-  // stack + 1 = +2
-  if(ops->get_q(obj, "rx", -1))
-    y_error("pulses.rx not defined");
-  ypointer_t (*rx)[4] = (ypointer_t (*)[4])ygeta_p(0, &tmp, NULL);
-  if(tmp != npulses * 4)
-    y_error("pulses.rx and pulses.channel do not have same size");
+  // stack + 5 = +6 (at most; the unpacked layout only uses +2 = +3)
+  pulses_wf_t wfs;
+  pulses_wf_init(&wfs, obj, ops, npulses);
+
+  // Make room for the rest: 4 outputs, 1 for pulses_wf_get, 1 for return
+  ypush_check(6);
 
   // Output fields
   long dims[Y_DIMSIZE];
   dims[0] = 1;
   dims[1] = npulses;
-  // stack + 1 = +3
+  // stack + 1 = +7
   float *frx = ypush_f(dims);
   ops->set_q(obj, "frx", -1, 0);
-  // stack + 1 = +4
+  // stack + 1 = +8
   float *fint = ypush_f(dims);
   ops->set_q(obj, "fint", -1, 0);
-  // stack + 1 = +5
+  // stack + 1 = +9
   double *fbias = ypush_d(dims);
   ops->set_q(obj, "fbias", -1, 0);
-  // stack + 1 = +6
+  // stack + 1 = +10
   long *fchannel = ypush_l(dims);
   ops->set_q(obj, "fchannel", -1, 0);
 
-  long i, j, samples;
+  long i, samples;
   for(i = 0; i < npulses; i++)
   {
     fchannel[i] = channel[i] == 4 ? 2 : channel[i];
     fbias[i] = range_bias[fchannel[i]-1];
 
     // Get rx waveform
-    // stack + 1 = +7
-    int typeid = ypush_ptr(rx[i][fchannel[i]-1], &samples);
-    if(yarg_nil(0) || (typeid == Y_CHAR && samples < 2))
+    // stack + 1 - 1 = +10
+    const unsigned char *raw = pulses_wf_get(&wfs, i, fchannel[i], &samples);
+    if(samples < 2)
     {
       frx[i] = 10000.;
-      // stack - 1 = +6
-      yarg_drop(1);
       continue;
     }
-    if(typeid != Y_CHAR)
-      y_error("rx encountered that was not an array of char");
+
     if(samples > 12) samples = 12;
-    dims[2] = samples;
-    unsigned char *raw = ygeta_uc(0, NULL, dims);
-
-    // Convert into clean wf for cent, get saturated count
-    // stack + 1 = +8
-    long *wf = ypush_l(dims);
-    long bias = (long)(~raw[0]);
-    long nsat = raw[0] <= 1;
-    wf[0] = 0;
-    for(j = 1; j < samples; j++)
-    {
-      wf[j] = (long)(~raw[j]) - bias;
-      if(raw[j] <= 1) nsat++;
-    }
 
+    // Centroid and saturated count (raw <= 1) in one pass
     double rx_cent[3];
-    cent(wf, samples, rx_cent);
-
-    // stack - 2 = +6
-    yarg_drop(2);
+    long nsat = cent_uc(raw, samples, 1, rx_cent);
 
     frx[i] = rx_cent[0];
     fint[i] = rx_cent[2] + nsat * 20;
   }
 
   // Don't return anything
+  // stack + 1 = +11
+  ypush_nil();
+}
+
+void Y_eaarl_fs_rx_cent_eaarla(int nArgs)
+{
+  if(nArgs != 1) y_error("must provide exactly one argument, pulses");
+
+  yo_ops_t *ops;
+  void *obj = NULL;
+
+  // Retrieve values needed from ops_conf
+  double range_bias[3], max_sfc_sat;
+  fs_rx_ops_conf(range_bias, &max_sfc_sat);
+
+  // Retrieve pulses
+  obj = yo_get(0, &ops);
+  if(!obj) y_error("pulses not defined properly");
+
+  // stack + 1 = +1
+  if(ops->get_q(obj, "soe", -1))
+    y_error("pulses.soe not defined");
+  long npulses;
+  ygeta_any(0, &npulses, NULL, NULL);
+  // stack + 5 = +6 (at most; the unpacked layout only uses +2 = +3)
+  pulses_wf_t wfs;
+  pulses_wf_init(&wfs, obj, ops, npulses);
+
+  // Make room for the rest: 4 outputs, 1 for pulses_wf_get, 1 for return
+  ypush_check(6);
+
+  // Output fields
+  long dims[Y_DIMSIZE];
+  dims[0] = 1;
+  dims[1] = npulses;
   // stack + 1 = +7
+  float *frx = ypush_f(dims);
+  ops->set_q(obj, "frx", -1, 0);
+  // stack + 1 = +8
+  float *fintensity = ypush_f(dims);
+  ops->set_q(obj, "fintensity", -1, 0);
+  // stack + 1 = +9
+  float *fbias = ypush_f(dims);
+  ops->set_q(obj, "fbias", -1, 0);
+  // stack + 1 = +10
+  char *fchannel = ypush_c(dims);
+  ops->set_q(obj, "fchannel", -1, 0);
+  ops->set_q(obj, "channel", -1, 0);
+
+  long i, j, np, samples, nsat;
+  int chan;
+  for(i = 0; i < npulses; i++)
+  {
+    // 10000 is the "bad data" value that cent will return, match that
+    frx[i] = 10000.;
+
+    // Number of points in most sensitive channel (all channels are same
+    // length); give up if not at least 2 points
+    // stack + 1 - 1 = +10
+    const unsigned char *raw = pulses_wf_get(&wfs, i, 1, &np);
+    if(np < 2) continue;
+
+    // Use no more than 12 for saturation check
+    if(np > 12) np = 12;
+
+    // Most sensitive channel that is not saturated (fewer than 5 counts),
+    // falling back to 3. The centroid is found in the same pass as the
+    // saturation check, so the chosen channel's result is ready at once. A
+    // missing channel 2 has no saturated samples and so is selected, which
+    // gives 0's; the Yorick version raises an error instead.
+    double rx_cent[3];
+    for(chan = 1; chan <= 3; chan++)
+    {
+      if(chan > 1) raw = pulses_wf_get(&wfs, i, chan, &samples);
+      else samples = np;
+      if(samples > 12) samples = 12;
+      nsat = cent_uc(raw, samples, 4, rx_cent);
+      if(chan == 3) break;
+
+      // The check covers as many samples as channel 1 has
+      if(samples != np)
+      {
+        nsat = 0;
+        for(j = 0; j < samples && j < np; j++)
+          if(raw[j] < 5) nsat++;
+      }
+      if(nsat <= max_sfc_sat) break;
+    }
+    fchannel[i] = chan;
+    fbias[i] = range_bias[chan-1];
+
+    // Must be water column only return
+    if(chan == 1 && rx_cent[2] < -90)
+      rx_cent[0] += 0.029625 * (rx_cent[2] - 90);
+
+    frx[i] = rx_cent[0];
+    fintensity[i] = rx_cent[2];
+  }
+
+  // Don't return anything
+  // stack + 1 = +11
   ypush_nil();
 }
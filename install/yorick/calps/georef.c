@@ -0,0 +1,212 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements the georeferencing math for EAARL pulses:
+ *
+ *    eaarl_direct_vector_batch, arZ, arX, arY, gx, gy, gz, dx, dy, dz, maZ,
+ *      laX, maX, maY, mag, &mx, &my, &mz, &px, &py, &pz
+ *
+ * does the same thing as eaarl_direct_vector in eaarl_vector.i (see there for
+ * the derivation) one pulse at a time, so that none of the intermediate
+ * rotation terms need arrays of their own; and
+ *
+ *    point_project3(p1, p2, dist, ndist, result, count)
+ *
+ * is the core of point_project in geometry.i for 3D points given as
+ * [[x1,x2,...],[y1,y2,...],[z1,z2,...]] (tp=1), which is how the last return
+ * is projected along the beam in each processing mode.
+ *
+ * The arithmetic follows the Yorick versions operation for operation so that
+ * the results are the same.
+ */
+
+#include <math.h>
+#include "constants.h"
+#include "yapi.h"
+
+#define DIRECT_VECTOR_INPUTS 14
+#define DIRECT_VECTOR_OUTPUTS 6
+
+// An input value that is either scalar (step 0) or one per pulse (step 1)
+typedef struct georef_in_t
+{
+  const double *v;
+  long step;
+} georef_in_t;
+
+#define GEOREF_AT(in, i) ((in).v[(i) * (in).step])
+
+// Sine and cosine of an angle in degrees, recalculated only when the angle
+// changes (the mounting angles are usually the same for every pulse)
+typedef struct georef_trig_t
+{
+  double ang, s, c;
+  int valid;
+} georef_trig_t;
+
+static inline void georef_trig(georef_trig_t *t, double ang)
+{
+  if(!t->valid || t->ang != ang)
+  {
+    double rad = ang * DEG2RAD;
+    t->s = sin(rad);
+    t->c = cos(rad);
+    t->ang = ang;
+    t->valid = 1;
+  }
+}
+
+void Y_eaarl_direct_vector_batch(int nArgs)
+{
+  static const char *names[DIRECT_VECTOR_INPUTS] = {
+    "arZ", "arX", "arY", "gx", "gy", "gz", "dx", "dy", "dz", "maZ", "laX",
+    "maX", "maY", "mag"
+  };
+  georef_in_t in[DIRECT_VECTOR_INPUTS];
+  long ref[DIRECT_VECTOR_OUTPUTS];
+  long count = 1, n, dims[Y_DIMSIZE], tmp[Y_DIMSIZE];
+  int k, iarg;
+
+  if(nArgs != DIRECT_VECTOR_INPUTS + DIRECT_VECTOR_OUTPUTS)
+    y_error("must provide 20 arguments");
+
+  for(k = 0; k < DIRECT_VECTOR_OUTPUTS; k++)
+  {
+    ref[k] = yget_ref(DIRECT_VECTOR_OUTPUTS - 1 - k);
+    if(ref[k] < 0) y_error("output arguments must be simple variables");
+  }
+
+  // Every input is either scalar or has the same number of values as the
+  // largest; the outputs take the dimensions of the largest
+  dims[0] = 0;
+  for(k = 0; k < DIRECT_VECTOR_INPUTS; k++)
+  {
+    iarg = nArgs - 1 - k;
+    if(!yarg_number(iarg))
+      y_errorq("%s must be numeric", names[k]);
+    in[k].v = ygeta_d(iarg, &n, tmp);
+    in[k].step = n > 1;
+    if(n > count)
+    {
+      if(count > 1) y_errorq("%s is not conformable", names[k]);
+      count = n;
+      for(n = 0; n <= tmp[0]; n++) dims[n] = tmp[n];
+    }
+    else if(n != count && n != 1)
+    {
+      y_errorq("%s is not conformable", names[k]);
+    }
+  }
+
+  // stack + 6 = +6
+  double *out[DIRECT_VECTOR_OUTPUTS];
+  ypush_check(DIRECT_VECTOR_OUTPUTS);
+  for(k = 0; k < DIRECT_VECTOR_OUTPUTS; k++)
+    out[k] = ypush_d(dims);
+  double *mx = out[0], *my = out[1], *mz = out[2];
+  double *px = out[3], *py = out[4], *pz = out[5];
+
+  georef_trig_t tla = {0}, tmz = {0}, tmx = {0};
+  long i;
+  for(i = 0; i < count; i++)
+  {
+    // Rotation of aircraft wrt real world
+    double z = GEOREF_AT(in[0], i) * DEG2RAD;
+    double x = GEOREF_AT(in[1], i) * DEG2RAD;
+    double y = GEOREF_AT(in[2], i) * DEG2RAD;
+
+    double cx = cos(x), cy = cos(y), cz = cos(z);
+    double sx = sin(x), sy = sin(y), sz = sin(z);
+
+    double SXSY = sx*sy;
+    double CYCZ = cy*cz;
+    double CYSZ = cy*sz;
+
+    double RarA = CYCZ - sz*SXSY;
+    double RarB = -sz*cx;
+    double RarC = cz*sy + CYSZ*sx;
+    double RarD = CYSZ + cz*SXSY;
+    double RarE = cz*cx;
+    double RarF = sz*sy - CYCZ*sx;
+    double RarG = -cx*sy;
+    double RarH = sx;
+    double RarI = cx*cy;
+
+    // Location of mirror
+    double dx = GEOREF_AT(in[6], i);
+    double dy = GEOREF_AT(in[7], i);
+    double dz = GEOREF_AT(in[8], i);
+    mx[i] = RarA*dx + RarB*dy + RarC*dz + GEOREF_AT(in[3], i);
+    my[i] = RarD*dx + RarE*dy + RarF*dz + GEOREF_AT(in[4], i);
+    mz[i] = RarG*dx + RarH*dy + RarI*dz + GEOREF_AT(in[5], i);
+
+    // Incidence vector for laser
+    georef_trig(&tla, GEOREF_AT(in[10], i));
+    georef_trig(&tmz, GEOREF_AT(in[9], i));
+    cx = tla.c;
+    sx = tla.s;
+    cz = tmz.c;
+    sz = tmz.s;
+
+    double LIrX = (RarA*sz - RarB*cz)*cx - RarC*sx;
+    double LIrY = (RarD*sz - RarE*cz)*cx - RarF*sx;
+    double LIrZ = (RarG*sz - RarH*cz)*cx - RarI*sx;
+
+    // Rotation of mirror wrt aircraft
+    georef_trig(&tmx, GEOREF_AT(in[11], i));
+    cx = tmx.c;
+    sx = tmx.s;
+    y = GEOREF_AT(in[12], i) * DEG2RAD;
+    cy = cos(y);
+    sy = sin(y);
+
+    double SXCY = sx*cy;
+
+    double RmaC = sy*cz+SXCY*sz;
+    double RmaF = sy*sz-SXCY*cz;
+    double RmaI = cx*cy;
+
+    // Normal vector for laser
+    double LNrX = RarA*RmaC + RarB*RmaF + RarC*RmaI;
+    double LNrY = RarD*RmaC + RarE*RmaF + RarF*RmaI;
+    double LNrZ = RarG*RmaC + RarH*RmaF + RarI*RmaI;
+
+    // Reflection vector for laser
+    double DP = LNrX*LIrX + LNrY*LIrY + LNrZ*LIrZ;
+
+    double LSrX = 2 * DP * LNrX - LIrX;
+    double LSrY = 2 * DP * LNrY - LIrY;
+    double LSrZ = 2 * DP * LNrZ - LIrZ;
+
+    // Location of target
+    double mag = GEOREF_AT(in[13], i);
+    px[i] = LSrX * mag + mx[i];
+    py[i] = LSrY * mag + my[i];
+    pz[i] = LSrZ * mag + mz[i];
+  }
+
+  for(k = 0; k < DIRECT_VECTOR_OUTPUTS; k++)
+    yput_global(ref[k], DIRECT_VECTOR_OUTPUTS - 1 - k);
+  // stack - 6 = +0
+  yarg_drop(DIRECT_VECTOR_OUTPUTS);
+  ypush_nil();
+}
+
+long point_project3(double *p1, double *p2, double *dist, long ndist,
+  double *result, long count)
+{
+  long i, bad = 0;
+  long step = ndist > 1;
+  for(i = 0; i < count; i++)
+  {
+    double x = p2[i] - p1[i];
+    double y = p2[count+i] - p1[count+i];
+    double z = p2[2*count+i] - p1[2*count+i];
+    double d1 = sqrt(x*x + y*y + z*z);
+    if(!d1) bad++;
+    double ratio = (d1 + dist[i*step]) / d1;
+    result[i] = p1[i] + x * ratio;
+    result[count+i] = p1[count+i] + y * ratio;
+    result[2*count+i] = p1[2*count+i] + z * ratio;
+  }
+  return bad;
+}
@@ -1,9 +1,17 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include "yapi.h"
 
+// Limit on how many bucket entries the triangle index may use per triangle;
+// the buckets are enlarged until the index fits
+#define TRIANGLE_INDEX_MAX_ENTRIES 16
+// With fewer triangles than this, checking them all is quicker than indexing
+#define TRIANGLE_INDEX_MIN_TRIANGLES 16
+
 // Finds the determinant of a matrix. Only valid for 4 and 9 element arrays
 // (2x2 and 3x3 matrices). Available in Yorick as _ydet.
 double det(double *A, long len)
@@ -169,6 +177,173 @@ double triangle_interp_single(double *x, double *y, double *z,
   return A * xp + B * yp + C;
 }
 
+// Index for locating the triangle that contains a point. Triangles are binned
+// by their bounding boxes into a grid of buckets; a triangle is listed in
+// every bucket its bounding box touches, in ascending order, so the first
+// triangle in a point's bucket that contains it is also the first one in the
+// whole triangulation. The plane for each triangle is calculated the first
+// time it's needed and kept.
+typedef struct triangle_index_t {
+  double xmin, xmax, ymin, ymax, bucket;
+  long nx, ny;
+  long *start;    // bucket b lists tri[start[b]] through tri[start[b+1]-1]
+  long *tri;
+  double *plane;  // A, B, D for each triangle
+  char *known;    // whether plane has been calculated for each triangle
+} triangle_index_t;
+
+static void triangle_index_free(triangle_index_t *ti)
+{
+  if(ti->start) free(ti->start);
+  if(ti->tri) free(ti->tri);
+  if(ti->plane) free(ti->plane);
+  if(ti->known) free(ti->known);
+}
+
+static inline long triangle_index_cell(double v, double min, double size,
+      long n)
+{
+  double c = floor((v - min) / size);
+  if(!(c > 0)) return 0;
+  if(c >= n - 1) return n - 1;
+  return (long)c;
+}
+
+// Finds the bounding box of triangle i. Returns 0 if it isn't finite.
+static int triangle_bbox(double *x, double *y, long *v1, long *v2, long *v3,
+      long i, double *bb)
+{
+  double x1 = x[v1[i]-1], x2 = x[v2[i]-1], x3 = x[v3[i]-1];
+  double y1 = y[v1[i]-1], y2 = y[v2[i]-1], y3 = y[v3[i]-1];
+  bb[0] = x1 < x2 ? (x1 < x3 ? x1 : x3) : (x2 < x3 ? x2 : x3);
+  bb[1] = x1 > x2 ? (x1 > x3 ? x1 : x3) : (x2 > x3 ? x2 : x3);
+  bb[2] = y1 < y2 ? (y1 < y3 ? y1 : y3) : (y2 < y3 ? y2 : y3);
+  bb[3] = y1 > y2 ? (y1 > y3 ? y1 : y3) : (y2 > y3 ? y2 : y3);
+  return isfinite(bb[0]) && isfinite(bb[1]) && isfinite(bb[2]) &&
+    isfinite(bb[3]);
+}
+
+// Builds the triangle index. Returns 0 if memory could not be allocated.
+static int triangle_index_build(triangle_index_t *ti, double *x, double *y,
+      long *v1, long *v2, long *v3, long nv)
+{
+  long i, b, bi, bj, nb, entries, have = 0;
+  double bb[4];
+
+  memset(ti, 0, sizeof(triangle_index_t));
+  for(i = 0; i < nv; i++) {
+    if(!triangle_bbox(x, y, v1, v2, v3, i, bb)) continue;
+    if(!have || bb[0] < ti->xmin) ti->xmin = bb[0];
+    if(!have || bb[1] > ti->xmax) ti->xmax = bb[1];
+    if(!have || bb[2] < ti->ymin) ti->ymin = bb[2];
+    if(!have || bb[3] > ti->ymax) ti->ymax = bb[3];
+    have++;
+  }
+
+  // Aim for about one triangle per bucket
+  double w = ti->xmax - ti->xmin, h = ti->ymax - ti->ymin;
+  if(w > 0 && h > 0)
+    ti->bucket = sqrt(w * h / (have ? have : 1));
+  else
+    ti->bucket = (w > h ? w : h) / (have ? have : 1);
+  if(!(ti->bucket > 0)) ti->bucket = 1;
+
+  // Long, thin triangles cover many buckets; enlarge the buckets until the
+  // index is a reasonable size
+  for(;;) {
+    ti->nx = (long)floor(w / ti->bucket) + 1;
+    ti->ny = (long)floor(h / ti->bucket) + 1;
+    double cells = (double)ti->nx * ti->ny;
+    double limit = (double)TRIANGLE_INDEX_MAX_ENTRIES * have + 1024;
+    entries = 0;
+    if(cells <= limit) {
+      for(i = 0; i < nv && entries <= limit; i++) {
+        if(!triangle_bbox(x, y, v1, v2, v3, i, bb)) continue;
+        entries +=
+          (triangle_index_cell(bb[1], ti->xmin, ti->bucket, ti->nx) -
+            triangle_index_cell(bb[0], ti->xmin, ti->bucket, ti->nx) + 1) *
+          (triangle_index_cell(bb[3], ti->ymin, ti->bucket, ti->ny) -
+            triangle_index_cell(bb[2], ti->ymin, ti->bucket, ti->ny) + 1);
+      }
+      if(entries <= limit) break;
+    }
+    ti->bucket *= 2;
+  }
+  nb = ti->nx * ti->ny;
+
+  ti->start = calloc(nb + 1, sizeof(long));
+  ti->tri = malloc(sizeof(long) * (entries ? entries : 1));
+  ti->plane = malloc(sizeof(double) * 3 * (nv ? nv : 1));
+  ti->known = calloc(nv ? nv : 1, 1);
+  if(!ti->start || !ti->tri || !ti->plane || !ti->known) {
+    triangle_index_free(ti);
+    return 0;
+  }
+
+  // Count each bucket's triangles, then place them, in order
+  for(i = 0; i < nv; i++) {
+    if(!triangle_bbox(x, y, v1, v2, v3, i, bb)) continue;
+    long i0 = triangle_index_cell(bb[0], ti->xmin, ti->bucket, ti->nx);
+    long i1 = triangle_index_cell(bb[1], ti->xmin, ti->bucket, ti->nx);
+    long j0 = triangle_index_cell(bb[2], ti->ymin, ti->bucket, ti->ny);
+    long j1 = triangle_index_cell(bb[3], ti->ymin, ti->bucket, ti->ny);
+    for(bj = j0; bj <= j1; bj++)
+      for(bi = i0; bi <= i1; bi++)
+        ti->start[bj * ti->nx + bi + 1]++;
+  }
+  for(b = 0; b < nb; b++)
+    ti->start[b+1] += ti->start[b];
+  for(i = 0; i < nv; i++) {
+    if(!triangle_bbox(x, y, v1, v2, v3, i, bb)) continue;
+    long i0 = triangle_index_cell(bb[0], ti->xmin, ti->bucket, ti->nx);
+    long i1 = triangle_index_cell(bb[1], ti->xmin, ti->bucket, ti->nx);
+    long j0 = triangle_index_cell(bb[2], ti->ymin, ti->bucket, ti->ny);
+    long j1 = triangle_index_cell(bb[3], ti->ymin, ti->bucket, ti->ny);
+    for(bj = j0; bj <= j1; bj++)
+      for(bi = i0; bi <= i1; bi++)
+        ti->tri[ti->start[bj * ti->nx + bi]++] = i;
+  }
+  for(b = nb; b > 0; b--)
+    ti->start[b] = ti->start[b-1];
+  ti->start[0] = 0;
+
+  return 1;
+}
+
+// Interpolates the value for a single point, as triangle_interp_single does,
+// using a triangle index.
+static double triangle_index_interp(triangle_index_t *ti,
+      double *x, double *y, double *z,
+      long *v1, long *v2, long *v3,
+      double xp, double yp, double nodata)
+{
+  long k, stop;
+  double *p;
+
+  // Nothing outside of all of the triangles' bounding boxes can be in one
+  if(xp < ti->xmin || xp > ti->xmax || yp < ti->ymin || yp > ti->ymax)
+    return nodata;
+
+  k = triangle_index_cell(yp, ti->ymin, ti->bucket, ti->ny) * ti->nx +
+    triangle_index_cell(xp, ti->xmin, ti->bucket, ti->nx);
+  stop = ti->start[k+1];
+  for(k = ti->start[k]; k < stop; k++) {
+    long i = ti->tri[k];
+    long a = v1[i]-1, b = v2[i]-1, c = v3[i]-1;
+    if(!in_triangle(x[a], y[a], x[b], y[b], x[c], y[c], xp, yp))
+      continue;
+
+    p = ti->plane + 3 * i;
+    if(!ti->known[i]) {
+      planar_params_from_pts(x[a], y[a], z[a], x[b], y[b], z[b],
+        x[c], y[c], z[c], &p[0], &p[1], &p[2]);
+      ti->known[i] = 1;
+    }
+    return p[0] * xp + p[1] * yp + p[2];
+  }
+  return nodata;
+}
+
 // Interpolates the value for a set of points. Available in Yorick as
 // _ytriangle_interp.
 // Argument zp is modified.
@@ -178,9 +353,23 @@ void _ytriangle_interp(double *x, double *y, double *z,
       double nodata)
 {
   long i;
+  triangle_index_t ti;
+
+  // Without an index (too few triangles to need one, or not enough memory for
+  // one), every triangle is checked for every point
+  if(nv < TRIANGLE_INDEX_MIN_TRIANGLES ||
+      !triangle_index_build(&ti, x, y, v1, v2, v3, nv)) {
+    for(i = 0; i < np; i++) {
+      zp[i] = triangle_interp_single(x,y,z,v1,v2,v3,nv,xp[i],yp[i],nodata);
+    }
+    return;
+  }
+
   for(i = 0; i < np; i++) {
-    zp[i] = triangle_interp_single(x,y,z,v1,v2,v3,nv,xp[i],yp[i],nodata);
+    zp[i] = triangle_index_interp(&ti, x, y, z, v1, v2, v3, xp[i], yp[i],
+      nodata);
   }
+  triangle_index_free(&ti);
 }
 
 // Creates an ARC ASCII grid file. Available in Yorick as _ywrite_arc_grid.
@@ -1,6 +1,9 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+// sincos and sincosf are GNU extensions
+#define _GNU_SOURCE
 #include "yapi.h"
 #include <math.h>
+#include <pthread.h>
 
 #ifndef DEG2RAD
 #define DEG2RAD 0.017453292519943295
@@ -9,18 +12,69 @@
 #define RAD2DEG 57.295779513082
 #endif
 
-void ll2utm(
-  double *lat, double *lon,
+// Conversions are only split across threads in pieces at least this large;
+// smaller ones aren't worth the cost of starting a thread
+#define UTM_MIN_PER_THREAD 16384
+#define UTM_MAX_THREADS 64
+
+/* utm_sincos
+ * Sine and cosine of X. With FAST, they are calculated in single precision,
+ * which is much quicker but only good to about 1e-7.
+ */
+static inline void utm_sincos(double x, int fast, double *s, double *c)
+{
+#ifdef __GLIBC__
+  if(fast)
+  {
+    float sf, cf;
+    sincosf((float)x, &sf, &cf);
+    *s = sf;
+    *c = cf;
+  }
+  else
+  {
+    sincos(x, s, c);
+  }
+#else
+  if(fast)
+  {
+    *s = sinf((float)x);
+    *c = cosf((float)x);
+  }
+  else
+  {
+    *s = sin(x);
+    *c = cos(x);
+  }
+#endif
+}
+
+/* utm_sin246
+ * Given the sine and cosine of X, calculates sin(2X), sin(4X), and sin(6X)
+ * from the multiple angle identities.
+ */
+static inline void utm_sin246(double s, double c, double *s2, double *s4,
+  double *s6)
+{
+  double c2 = c*c - s*s;
+  *s2 = 2*s*c;
+  *s4 = 2*(*s2)*c2;
+  *s6 = (*s4)*c2 + (2*c2*c2 - 1)*(*s2);
+}
+
+static void ll2utm_range(
+  const double *lat, const double *lon,
   double *north, double *east, short *zone,
-  long count,
-  double a, double e2)
+  long start, long stop,
+  double a, double e2, int fast)
 {
-  // This code is structured to mirror the code in the Yorick function, so that
-  // the two can be kept in sync in case of code changes / bug fixes.
+  // This uses the same PP1395 equations as the Yorick function, rearranged so
+  // that each point needs a single sincos. Fixes to one should be carried over
+  // to the other.
 
   long i;
-  double cmeridian;
-  double N, T, C, A, M;
+  double cmeridian, lat_i, lon_i, s, c, s2, s4, s6;
+  double N, T, C, A, A2, A3, M;
 
   // Scale factor along central meridian
   double k0 = 0.9996;
@@ -38,65 +92,68 @@ void ll2utm(
   double M4 = 15*e4/256 + 45*e6/1024;
   double M6 = 35*e6/3072;
 
-  for(i = 0; i < count; i++) {
+  for(i = start; i < stop; i++) {
     // Make sure the longitude is between -180. and 179.99999
-    lon[i] -= floor(.5+lon[i]/360.)*360.;
+    lon_i = lon[i] - floor(.5+lon[i]/360.)*360.;
 
     // Calculate zone if needed
     if(!zone[i])
-      zone[i] = floor(lon[i]/6. + 31);
+      zone[i] = floor(lon_i/6. + 31);
 
     // Convert to radians
-    lon[i] *= DEG2RAD;
-    lat[i] *= DEG2RAD;
+    lon_i *= DEG2RAD;
+    lat_i = lat[i] * DEG2RAD;
 
     // Central meridian
     cmeridian = (zone[i] * 6 - 183) * DEG2RAD;
 
+    utm_sincos(lat_i, fast, &s, &c);
+
     // PP1395 eq 4-20 p25, p61
     // N is radius of curvature of the ellipsoid in a plane perpendicular to the
     // meridian and also perpendiuclar to a plane tangent to the surface
-    N = a/sqrt(1 - e2 * pow(sin(lat[i]), 2));
+    N = a/sqrt(1 - e2 * s*s);
 
     // PP1395 eq 8-13 p61
-    T = pow(tan(lat[i]), 2);
+    T = s*s/(c*c);
 
     // PP1395 eq 8-14 p61
-    C = ep2 * pow(cos(lat[i]), 2);
+    C = ep2 * c*c;
 
     // PP1395 eq 8-15 p61
-    A = cos(lat[i]) * (lon[i] - cmeridian);
+    A = c * (lon_i - cmeridian);
+    A2 = A*A;
+    A3 = A2*A;
 
     // PP1395 eq 3-21 p17, p61
     // M is the true distance along the central meridian from the equator to
     // this latitude
-    M = (
-      M0 * lat[i] - M2 * sin(2*lat[i]) +
-      M4 * sin(4*lat[i]) - M6 * sin(6*lat[i])
-    ) * a;
+    utm_sin246(s, c, &s2, &s4, &s6);
+    M = (M0 * lat_i - M2 * s2 + M4 * s4 - M6 * s6) * a;
 
     // PP1395 eq 8-9 p61
     east[i] = (
-      (5-18*T+T*T+72*C-58*ep2) * pow(A,5)/120 + A + (1-T+C) * pow(A,3)/6
+      (5-18*T+T*T+72*C-58*ep2) * A3*A2/120 + A + (1-T+C) * A3/6
     ) * k0 * N + 500000.;
 
     // PP1395 eq 8-10 p61
     north[i] = (
       ( (-(58+T)*T + 600*C - 330*ep2 + 61
-        ) * pow(A,6) / 720 + (5-T+9*C+4*C*C) * pow(A,4)/24 + A*A/2
-      ) * N * tan(lat[i]) + M
+        ) * A3*A3 / 720 + (5-T+9*C+4*C*C) * A2*A2/24 + A2/2
+      ) * N * (s/c) + M
     ) * k0;
   }
 }
 
-void utm2ll(
-  double *north, double *east, short *zone,
+static void utm2ll_range(
+  const double *north, const double *east, const short *zone,
   double *lon, double *lat,
-  long count,
-  double a, double e2)
+  long start, long stop,
+  double a, double e2, int fast)
 {
   long i;
-  double x, y, M, N1, T1, C1, R1, D, lon0, lat1, mu;
+  double x, y, M, N1, T1, C1, R1, D, D2, D3, lon0, lat1, mu, t1, w;
+  double s, c, s2, s4, s6;
 
   // Scale factor along central meridian
   double k0 = 0.9996;
@@ -108,7 +165,7 @@ void utm2ll(
   // PP1395 eq 3-24 ??, p63
   double e1 = (1-sqrt(1-e2))/(1+sqrt(1-e2));
 
-  for(i = 0; i < count; i++) {
+  for(i = start; i < stop; i++) {
     x = east[i] - 500000.;
     y = north[i];
 
@@ -125,34 +182,150 @@ void utm2ll(
     // PP1395 eq 3-26 p??, p63
     // "footprint latitude" or latitude at central meridian which has same y
     // coordinate as that of the point (lat,lon).
-    lat1 = mu + (3*e1/2-27*e1*e1*e1/32)*sin(2*mu) +
-      (21*e1*e1/16-55*e1*e1*e1*e1/32)*sin(4*mu) +
-      (151*e1*e1*e1/96)*sin(6*mu);
+    utm_sincos(mu, fast, &s, &c);
+    utm_sin246(s, c, &s2, &s4, &s6);
+    lat1 = mu + (3*e1/2-27*e1*e1*e1/32)*s2 +
+      (21*e1*e1/16-55*e1*e1*e1*e1/32)*s4 +
+      (151*e1*e1*e1/96)*s6;
+
+    utm_sincos(lat1, fast, &s, &c);
+    t1 = s/c;
+    w = 1-e2*s*s;
 
     // PP1395 eq 8-23 p64
-    N1 = a/sqrt(1-e2*pow(sin(lat1), 2));
+    N1 = a/sqrt(w);
     // PP1395 eq 8-22 p64
-    T1 = pow(tan(lat1), 2);
+    T1 = t1*t1;
     // PP1395 eq 8-21 p64
-    C1 = ep2*pow(cos(lat1), 2);
+    C1 = ep2*c*c;
     // PP1395 eq 8-24 p64
-    R1 = a*(1-e2)/pow(1-e2*pow(sin(lat1), 2), 1.5);
+    R1 = a*(1-e2)/(w*sqrt(w));
     // PP1395 eq 8-25 p64
     D = x/(N1*k0);
+    D2 = D*D;
+    D3 = D2*D;
 
     // PP1395 eq 8-17 p63
     lat[i] = lat1 -
-      (N1*tan(lat1)/R1)*(D*D/2-
-      (5+3*T1+10*C1-4*C1*C1-9*ep2)*D*D*D*D/24 +
+      (N1*t1/R1)*(D2/2-
+      (5+3*T1+10*C1-4*C1*C1-9*ep2)*D2*D2/24 +
       (61+90*T1+298*C1+45*T1*T1-252*ep2-
-      3*C1*C1)*D*D*D*D*D*D/720);
+      3*C1*C1)*D3*D3/720);
 
     // PP1395 eq 8-18 p63
-    lon[i] = lon0 + (D-(1+2*T1+C1)*D*D*D/6+(5-2*C1+28*T1-
+    lon[i] = lon0 + (D-(1+2*T1+C1)*D3/6+(5-2*C1+28*T1-
       3*C1*C1+8*ep2+24*T1*T1)
-      *D*D*D*D*D/120)/cos(lat1);
+      *D3*D2/120)/c;
 
     lat[i] *= RAD2DEG;
     lon[i] *= RAD2DEG;
   }
 }
+
+// One thread's share of a batch conversion
+typedef struct utm_job_t
+{
+  // ll2utm: in1, in2 are lat, lon; out1, out2 are north, east
+  // utm2ll: in1, in2 are north, east; out1, out2 are lon, lat
+  const double *in1, *in2;
+  double *out1, *out2;
+  short *zone;
+  long start, stop;
+  double a, e2;
+  int fast;
+  pthread_t thread;
+} utm_job_t;
+
+static void * ll2utm_worker(void *arg)
+{
+  utm_job_t *j = arg;
+  ll2utm_range(j->in1, j->in2, j->out1, j->out2, j->zone, j->start, j->stop,
+    j->a, j->e2, j->fast);
+  return NULL;
+}
+
+static void * utm2ll_worker(void *arg)
+{
+  utm_job_t *j = arg;
+  utm2ll_range(j->in1, j->in2, j->zone, j->out1, j->out2, j->start, j->stop,
+    j->a, j->e2, j->fast);
+  return NULL;
+}
+
+/* utm_run
+ * Runs WORKER over COUNT points as described by TEMPLATE, split into
+ * contiguous ranges over up to THREADS threads. The calling thread takes the
+ * first range, as well as any whose thread could not be started.
+ */
+static void utm_run(void *(*worker)(void *), const utm_job_t *template,
+  long count, long threads)
+{
+  utm_job_t jobs[UTM_MAX_THREADS];
+  int started[UTM_MAX_THREADS];
+  long t, per;
+
+  if(threads > UTM_MAX_THREADS) threads = UTM_MAX_THREADS;
+  if(threads > count / UTM_MIN_PER_THREAD)
+    threads = count / UTM_MIN_PER_THREAD;
+  if(threads < 1) threads = 1;
+
+  per = (count + threads - 1) / threads;
+  for(t = 0; t < threads; t++)
+  {
+    jobs[t] = *template;
+    jobs[t].start = t * per;
+    jobs[t].stop = t * per + per < count ? t * per + per : count;
+    started[t] = t > 0 &&
+      !pthread_create(&jobs[t].thread, NULL, worker, &jobs[t]);
+  }
+  worker(&jobs[0]);
+  for(t = 1; t < threads; t++)
+  {
+    if(started[t])
+      pthread_join(jobs[t].thread, NULL);
+    else
+      worker(&jobs[t]);
+  }
+}
+
+void ll2utm_batch(
+  double *lat, double *lon,
+  double *north, double *east, short *zone,
+  long count,
+  double a, double e2,
+  long threads, int fast)
+{
+  utm_job_t job = {.in1 = lat, .in2 = lon, .out1 = north, .out2 = east,
+    .zone = zone, .a = a, .e2 = e2, .fast = fast};
+  utm_run(ll2utm_worker, &job, count, threads);
+}
+
+void utm2ll_batch(
+  double *north, double *east, short *zone,
+  double *lon, double *lat,
+  long count,
+  double a, double e2,
+  long threads, int fast)
+{
+  utm_job_t job = {.in1 = north, .in2 = east, .out1 = lon, .out2 = lat,
+    .zone = zone, .a = a, .e2 = e2, .fast = fast};
+  utm_run(utm2ll_worker, &job, count, threads);
+}
+
+void ll2utm(
+  double *lat, double *lon,
+  double *north, double *east, short *zone,
+  long count,
+  double a, double e2)
+{
+  ll2utm_range(lat, lon, north, east, zone, 0, count, a, e2, 0);
+}
+
+void utm2ll(
+  double *north, double *east, short *zone,
+  double *lon, double *lat,
+  long count,
+  double a, double e2)
+{
+  utm2ll_range(north, east, zone, lon, lat, 0, count, a, e2, 0);
+}
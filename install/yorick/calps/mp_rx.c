@@ -0,0 +1,420 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "yapi.h"
+#include "pulses_exec.h"
+
+// Ways of locating each return, as for mpconf's alg_mode setting
+#define MP_RX_PEAK 0
+#define MP_RX_CENT 1
+#define MP_RX_NONE 2
+
+// Multi-peak conf values, for one channel
+typedef struct mp_conf_t
+{
+  double thresh;
+  long max_samples;
+  long smoothwf;
+  int alg_mode;
+} mp_conf_t;
+
+// Growable list of returns, with the pulse each belongs to
+typedef struct mp_rets_t
+{
+  long count, size;
+  long *pulse;
+  double *lrx;
+  double *lintensity;
+  // Whether any return was located by centroid, and so may be fractional
+  int cent;
+  // Whether any return came from a smoothed waveform, which Yorick holds as
+  // double rather than float
+  int smooth;
+  int failed;
+} mp_rets_t;
+
+// Shared state for the mp kernel, set up by mp_rx_prepare
+typedef struct mp_rx_t
+{
+  // Number of returns per pulse
+  long *num_rets;
+  // Returns found by each thread. Each thread handles whole pulses, so a
+  // pulse's returns are contiguous within its thread's list.
+  mp_rets_t rets[PULSES_EXEC_MAX_THREADS];
+} mp_rx_t;
+
+// Output columns, in the order of mp_rx_columns
+#define MP_RX_NUM_RETS 0
+
+static const pulses_column_t mp_rx_columns[] = {
+  {"num_rets", Y_CHAR}, {NULL, 0}
+};
+
+/* mp_rets_add
+ * Appends a return for pulse I to RETS. Returns 0 on success or 1 if out of
+ * memory.
+ */
+static int mp_rets_add(mp_rets_t *rets, long i, double lrx,
+  double lintensity)
+{
+  if(rets->count == rets->size)
+  {
+    long size = rets->size ? rets->size * 2 : 1024;
+    long *pulse = realloc(rets->pulse, sizeof(long) * size);
+    if(!pulse) return 1;
+    rets->pulse = pulse;
+    double *lrx = realloc(rets->lrx, sizeof(double) * size);
+    if(!lrx) return 1;
+    rets->lrx = lrx;
+    double *lint = realloc(rets->lintensity, sizeof(double) * size);
+    if(!lint) return 1;
+    rets->lintensity = lint;
+    rets->size = size;
+  }
+  rets->pulse[rets->count] = i;
+  rets->lrx[rets->count] = lrx;
+  rets->lintensity[rets->count] = lintensity;
+  rets->count++;
+  return 0;
+}
+
+/* mp_rx_peaks
+ * The "peak" alg_mode of eaarl_mp_rx_wf: each leading edge that exceeds the
+ * threshold is followed to its peak, the center of the plateau (if any) that
+ * ends the rise. The peaks are stored 0-based in PEAKS; returns how many.
+ */
+static long mp_rx_peaks(const double *wf, long n, double thresh, long *peaks)
+{
+  long i, j, npeaks = 0;
+  for(i = 1; i < n; i++)
+  {
+    if(wf[i] - wf[i-1] >= thresh)
+    {
+      while(i < n - 1 && wf[i] < wf[i+1]) i++;
+      j = i;
+      while(i < n - 1 && wf[j] == wf[i+1]) i++;
+      // Yorick's (j+i)/2, with both 1-based
+      peaks[npeaks++] = (j + i + 2) / 2 - 1;
+    }
+  }
+  return npeaks;
+}
+
+/* mp_rx_veg
+ * The "cent" and "none" alg_modes of eaarl_mp_rx_wf, which locate a return
+ * at each leading edge XR (1-based, as for ex_veg) as ex_veg_alg and
+ * ex_veg_noalg_none do for the last one. DD is the first derivative of WF.
+ * Returns 1 and sets LRX and LINTENSITY if the return is accepted.
+ */
+static int mp_rx_veg(const double *wf, const double *dd, long n, long xr,
+  const mp_conf_t *c, double *lrx, double *lintensity)
+{
+  long retdist = n - xr - 1, i;
+  if(retdist > 18) retdist = 18;
+
+  // Noise pulses
+  if(retdist < 5) return 0;
+
+  if(c->alg_mode == MP_RX_NONE)
+  {
+    // First maximum of wf(xr:xr+5)
+    long mx = xr - 1;
+    for(i = xr; i <= xr + 4; i++)
+      if(wf[i] > wf[mx]) mx = i;
+    *lrx = mx + 1;
+    *lintensity = wf[mx];
+    return 1;
+  }
+
+  // trailing_edge: if dd(xr+1:xr+retdist) turns positive again after going
+  // negative, the return ends at its last positive sample
+  long lastpos = 0, firstneg = 0;
+  for(i = 1; i <= retdist; i++)
+  {
+    if(dd[xr + i - 1] > 0) lastpos = i;
+    if(dd[xr + i - 1] < 0 && !firstneg) firstneg = i;
+  }
+  if(lastpos && firstneg && lastpos > firstneg) retdist = lastpos;
+
+  // The tail is wf(xr+1:xr+retdist)
+  const double *tail = wf + xr;
+  double min = tail[0], max = tail[0];
+  for(i = 1; i < retdist; i++)
+  {
+    if(tail[i] < min) min = tail[i];
+    if(tail[i] > max) max = tail[i];
+  }
+
+  // Intensity test
+  if(!(fabs(tail[0] - tail[retdist - 1]) < 0.8 * max)) return 0;
+  if(min > 240 && max < c->thresh) return 0;
+
+  // wf_centroid, which works on the tail as integers
+  long power = 0;
+  double weighted = 0.;
+  for(i = 0; i < retdist; i++)
+  {
+    power += (long)tail[i];
+    weighted += (long)tail[i] * (i + 1);
+  }
+  if(!power) return 0;
+  double cent = weighted / power;
+  if(cent <= 0) return 0;
+
+  // Yorick's int(xr+cent), 1-based
+  long idx = (long)(xr + cent);
+  if(idx > n) return 0;
+  *lrx = xr + cent;
+  *lintensity = wf[idx - 1];
+  return 1;
+}
+
+/* mp_rx_wf
+ * Equivalent to eaarl_mp_rx_wf in process_mp.i (without plotting): finds the
+ * returns in waveform RAW of length N using conf C and appends them to RETS
+ * as returns of pulse I. WORK must have room for 2*N doubles and PEAKS for N
+ * longs. Returns the number of returns found, or -1 if out of memory.
+ */
+static long mp_rx_wf(const unsigned char *raw, long n, const mp_conf_t *c,
+  double *work, long *peaks, mp_rets_t *rets, long pulse)
+{
+  double *wf = work, *tmp = work + n;
+  double bias = (unsigned char)~raw[0];
+  double lrx, lintensity;
+  long i, k, count = 0;
+
+  // Invert and remove bias
+  for(i = 0; i < n; i++)
+    wf[i] = (double)(unsigned char)~raw[i] - bias;
+
+  if(c->max_samples > 0 && n > c->max_samples) n = c->max_samples;
+
+  if(c->smoothwf > 0)
+  {
+    pulses_exec_smooth(wf, n, c->smoothwf, tmp);
+    memcpy(wf, tmp, sizeof(double) * n);
+  }
+
+  if(c->alg_mode == MP_RX_PEAK)
+  {
+    count = mp_rx_peaks(wf, n, c->thresh, peaks);
+    for(k = 0; k < count; k++)
+      if(mp_rets_add(rets, pulse, peaks[k] + 1, wf[peaks[k]])) return -1;
+    return count;
+  }
+
+  // First derivative
+  for(i = 0; i < n - 1; i++)
+    tmp[i] = wf[i+1] - wf[i];
+
+  // Leading edges: xr where (dd >= thresh)(dif) == 1
+  for(i = 1; i < n - 1; i++)
+  {
+    if(!(tmp[i] >= c->thresh) || tmp[i-1] >= c->thresh) continue;
+    if(!mp_rx_veg(wf, tmp, n, i, c, &lrx, &lintensity)) continue;
+    if(mp_rets_add(rets, pulse, lrx, lintensity)) return -1;
+    count++;
+  }
+  if(count && c->alg_mode == MP_RX_CENT) rets->cent = 1;
+  return count;
+}
+
+/* mp_rx_pulse
+ * Finds the returns of pulse I, adding them to the calling thread's list.
+ * WORK holds two waveforms followed by the peak indices.
+ */
+static void mp_rx_pulse(const pulses_exec_t *x, int thread, long i,
+  const unsigned char *wf, long n, const void *conf, double *work)
+{
+  const mp_conf_t *c = conf;
+  mp_rx_t *m = x->data;
+  mp_rets_t *rets = &m->rets[thread];
+  if(rets->failed) return;
+
+  long count = mp_rx_wf(wf, n, c, work, (long *)(work + 2 * n), rets, i);
+  if(count < 0)
+  {
+    rets->failed = 1;
+    return;
+  }
+  if(count && c->smoothwf > 0) rets->smooth = 1;
+  m->num_rets[i] = count;
+  ((char *)x->col[MP_RX_NUM_RETS])[i] = count;
+}
+
+/* mp_rx_free
+ * Frees the return lists of an mp_rx_t, when its scratch space is dropped
+ * from the stack (including on error).
+ */
+static void mp_rx_free(void *p)
+{
+  mp_rx_t *m = p;
+  int t;
+  for(t = 0; t < PULSES_EXEC_MAX_THREADS; t++)
+  {
+    free(m->rets[t].pulse);
+    free(m->rets[t].lrx);
+    free(m->rets[t].lintensity);
+  }
+}
+
+static void mp_rx_prepare(pulses_exec_t *x, long maxlen)
+{
+  long dims[Y_DIMSIZE];
+  dims[0] = 1;
+  dims[1] = x->count;
+
+  ypush_check(2);
+  // stack + 1
+  mp_rx_t *m = ypush_scratch(sizeof(mp_rx_t), mp_rx_free);
+  memset(m, 0, sizeof(mp_rx_t));
+  // stack + 1
+  m->num_rets = ypush_l(dims);
+  x->data = m;
+}
+
+/* mp_rx_finish
+ * Pushes the result group: lrx, lintensity, start, and had.
+ */
+static void mp_rx_finish(pulses_exec_t *x)
+{
+  mp_rx_t *m = x->data;
+  long dims[Y_DIMSIZE];
+  long i, j, t, total = 0;
+  int cent = 0, smooth = 0;
+
+  for(t = 0; t < x->nthreads; t++)
+  {
+    if(m->rets[t].failed) y_error("out of memory");
+    total += m->rets[t].count;
+    cent |= m->rets[t].cent;
+    smooth |= m->rets[t].smooth;
+  }
+
+  ypush_check(4);
+
+  dims[0] = 1;
+  dims[1] = x->count + 1;
+  yo_ops_t *ops;
+  // stack + 1 = +1
+  void *result = yo_new_group(&ops);
+  // stack + 1 = +2
+  long *start = ypush_l(dims);
+  start[0] = 0;
+  for(i = 0; i < x->count; i++)
+    start[i+1] = start[i] + m->num_rets[i];
+  ops->set_q(result, "start", -1, 0);
+  // Which pulses had a waveform on their channel and were processed
+  // stack + 1 = +3
+  pulses_exec_finish_had(x);
+  ops->set_q(result, "had", -1, 0);
+  // stack - 1 = +2
+  yarg_drop(1);
+
+  if(!total)
+  {
+    // stack + 1 = +3
+    ypush_nil();
+    ops->set_q(result, "lrx", -1, 0);
+    ops->set_q(result, "lintensity", -1, 0);
+    // stack - 2 = +1
+    yarg_drop(2);
+    return;
+  }
+
+  dims[1] = total;
+  // As in eaarl_mp_rx_wf, lrx is a sample number (long) unless a centroid
+  // was used (double)
+  long *lrx_l = NULL;
+  double *lrx_d = NULL;
+  // stack + 1 = +3
+  if(cent)
+    lrx_d = ypush_d(dims);
+  else
+    lrx_l = ypush_l(dims);
+  ops->set_q(result, "lrx", -1, 0);
+  // Likewise, lintensity is float unless the waveform was smoothed (double)
+  float *lint_f = NULL;
+  double *lint_d = NULL;
+  // stack + 1 = +4
+  if(smooth)
+    lint_d = ypush_d(dims);
+  else
+    lint_f = ypush_f(dims);
+  ops->set_q(result, "lintensity", -1, 0);
+
+  // Each thread's returns go to their pulses' places in pulse order
+  for(t = 0; t < x->nthreads; t++)
+  {
+    mp_rets_t *rets = &m->rets[t];
+    long prev = -1, k = 0;
+    for(j = 0; j < rets->count; j++)
+    {
+      if(rets->pulse[j] != prev)
+      {
+        prev = rets->pulse[j];
+        k = start[prev];
+      }
+      if(cent)
+        lrx_d[k] = rets->lrx[j];
+      else
+        lrx_l[k] = (long)rets->lrx[j];
+      if(smooth)
+        lint_d[k] = rets->lintensity[j];
+      else
+        lint_f[k] = rets->lintensity[j];
+      k++;
+    }
+  }
+
+  // stack - 3 = +1
+  yarg_drop(3);
+}
+
+/* mp_rx_alg_mode
+ * Converts an alg_mode setting to one of the MP_RX_* values.
+ */
+static int mp_rx_alg_mode(const char *mode)
+{
+  if(!mode || !strcmp(mode, "peak")) return MP_RX_PEAK;
+  if(!strcmp(mode, "cent")) return MP_RX_CENT;
+  if(!strcmp(mode, "none")) return MP_RX_NONE;
+  y_errorq("unknown alg_mode: %s", mode);
+  return MP_RX_PEAK;
+}
+
+static void mp_rx_read_conf(pulses_exec_t *x, void *obj, yo_ops_t *ops)
+{
+  static const char *names[3] = {"thresh", "max_samples", "smoothwf"};
+  mp_conf_t *conf = x->conf;
+  double val[3][4];
+  const char *mode[4];
+  long chan;
+  int i;
+  for(i = 0; i < 3; i++)
+    pulses_exec_conf_d(obj, ops, names[i], val[i]);
+  pulses_exec_conf_q(obj, ops, "alg_mode", mode);
+  for(chan = 0; chan < 4; chan++)
+  {
+    conf[chan].thresh = val[0][chan];
+    conf[chan].max_samples = val[1][chan];
+    conf[chan].smoothwf = val[2][chan];
+    conf[chan].alg_mode = mp_rx_alg_mode(mode[chan]);
+  }
+}
+
+// Channels are selected as eaarl_mp_rx_eaarla_channel does in process_mp.i.
+// Each thread's scratch holds two waveforms and as many peak indices, which
+// take a double's room apiece.
+const pulses_kernel_t mp_rx_kernel = {
+  "mp", mp_rx_columns, sizeof(mp_conf_t), 3, mp_rx_read_conf,
+  pulses_exec_select_sfc, mp_rx_prepare, mp_rx_pulse, mp_rx_finish
+};
+
+void Y_eaarl_mp_rx_batch(int nArgs)
+{
+  pulses_exec_builtin(&mp_rx_kernel, nArgs);
+}
@@ -1,6 +1,15 @@
 // vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
 #include "yapi.h"
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #ifndef MAX
 #define MAX( a, b ) ( ((a) > (b)) ? (a) : (b) )
@@ -55,10 +64,14 @@ void n88_interp_qfit2d(
   }
 }
 
-double n88_splinefit(double x, double *f, long size) {
-  long j, k;
-  double p, xx, result;
-  double q[MAXSPLINE], r[MAXSPLINE];
+/* n88_spline_moments
+ * Calculates the spline moments R for the SIZE known values F.
+ */
+static void n88_spline_moments(const double *f, long size, double *r)
+{
+  long k;
+  double p;
+  double q[MAXSPLINE];
 
   // Initialize spline moments, q
   q[0] = r[0] = 0.;
@@ -71,6 +84,16 @@ double n88_splinefit(double x, double *f, long size) {
   for(k = size - 2; k > 0; k--) {
     r[k] += q[k] * r[k+1];
   }
+}
+
+/* n88_spline_eval
+ * Evaluates at X the spline through the SIZE known values F with moments R.
+ */
+static double n88_spline_eval(double x, const double *f, const double *r,
+  long size)
+{
+  long j;
+  double xx, result;
 
   if(x < 1) {
     result = f[0] + (x-2) * (f[1] - f[0] - r[1]/6.);
@@ -87,15 +110,95 @@ double n88_splinefit(double x, double *f, long size) {
   return(result);
 }
 
-void n88_interp_spline2d(
-  double *result, double *x, double *y, long count,
-  double *f, long fxcount, long fycount)
+double n88_splinefit(double x, double *f, long size) {
+  double r[MAXSPLINE];
+  n88_spline_moments(f, size, r);
+  return n88_spline_eval(x, f, r, size);
+}
+
+/* A grid of geoid values with FXCOUNT columns and FYCOUNT rows, stored either
+ * as doubles (from Yorick) or as floats (mapped from a .bin file, possibly in
+ * the other byte order).
+ */
+#define N88_DOUBLE 0
+#define N88_FLOAT 1
+#define N88_FLOAT_SWAP 2
+
+typedef struct n88_grid_t
+{
+  const void *data;
+  int kind;
+  long fxcount, fycount;
+} n88_grid_t;
+
+static double n88_grid_at(const n88_grid_t *g, long offset)
 {
-  long i, j, offset, size, thresh, xi, yi;
+  if(g->kind == N88_DOUBLE)
+    return ((const double *)g->data)[offset];
+
+  uint32_t bits;
+  float val;
+  memcpy(&bits, (const float *)g->data + offset, sizeof(bits));
+  if(g->kind == N88_FLOAT_SWAP)
+    bits = __builtin_bswap32(bits);
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+/* A spline neighborhood of the grid: the SIZE by SIZE values whose corner is
+ * at XI, YI along with the spline moments of each of its rows. Every point
+ * that falls in the same neighborhood shares these, so they are cached; only
+ * the spline across the rows has to be calculated per point.
+ */
+typedef struct n88_window_t
+{
+  long xi, yi, size;
+  double f[MAXSPLINE][MAXSPLINE];
+  double r[MAXSPLINE][MAXSPLINE];
+} n88_window_t;
+
+// Slots in each window cache; points are usually clustered, so a small
+// direct-mapped cache catches nearly all reuse
+#define N88_CACHE_SLOTS 128
+
+typedef struct n88_cache_t
+{
+  n88_window_t slot[N88_CACHE_SLOTS];
+} n88_cache_t;
+
+static const n88_window_t * n88_window(const n88_grid_t *g, n88_cache_t *c,
+  long xi, long yi, long size)
+{
+  unsigned long h = (unsigned long)xi * 2654435761UL ^
+    (unsigned long)yi * 40503UL ^ (unsigned long)size;
+  n88_window_t *w = &c->slot[h % N88_CACHE_SLOTS];
+  long j, k, offset;
+
+  if(w->size == size && w->xi == xi && w->yi == yi)
+    return w;
+
+  offset = xi + yi * g->fxcount;
+  for(j = 0; j < size; j++) {
+    for(k = 0; k < size; k++)
+      w->f[j][k] = n88_grid_at(g, offset + g->fxcount * j + k);
+    n88_spline_moments(w->f[j], size, w->r[j]);
+  }
+  w->xi = xi;
+  w->yi = yi;
+  w->size = size;
+  return w;
+}
+
+static void n88_spline2d_range(const n88_grid_t *g, n88_cache_t *c,
+  double *result, const double *x, const double *y, long start, long stop)
+{
+  long i, j, size, thresh, xi, yi;
+  long fxcount = g->fxcount, fycount = g->fycount;
   double dist, xp, yp;
   double interim[MAXSPLINE];
+  const n88_window_t *w;
 
-  for(i = 0; i < count; i++) {
+  for(i = start; i < stop; i++) {
     dist = MIN(MIN(x[i], y[i]), MIN(fxcount - x[i], fycount - y[i]));
     for(size = MAXSPLINE; size > 0; size -= 2) {
       thresh = (size/2) - 1;
@@ -108,13 +211,235 @@ void n88_interp_spline2d(
       xp = x[i] - xi;
       yp = y[i] - yi;
 
-      offset = xi + yi * fxcount;
-
+      w = n88_window(g, c, xi, yi, size);
       for(j = 0; j < size; j++)
-        interim[j] = n88_splinefit(xp, f + offset + fxcount * j, size);
+        interim[j] = n88_spline_eval(xp, w->f[j], w->r[j], size);
 
       result[i] = n88_splinefit(yp, interim, size);
       size = -1;
     }
   }
 }
+
+void n88_interp_spline2d(
+  double *result, double *x, double *y, long count,
+  double *f, long fxcount, long fycount)
+{
+  n88_grid_t g = {f, N88_DOUBLE, fxcount, fycount};
+  n88_cache_t *c = calloc(1, sizeof(n88_cache_t));
+  if(!c) y_error("out of memory");
+  n88_spline2d_range(&g, c, result, x, y, 0, count);
+  free(c);
+}
+
+/* geoid_map
+ * A memory-mapped NGS .bin geoid file. The header is 4 doubles (glamn, glomn,
+ * dla, dlo) and 3 ints (nrows, ncols, itype), followed by the grid as floats,
+ * all in either byte order.
+ */
+#define GEOID_BIN_HEADER 44
+
+typedef struct geoid_map_t
+{
+  double glamn, glomn, dla, dlo;
+  long nrows, ncols, itype;
+  void *map;
+  size_t size;
+  n88_grid_t grid;
+} geoid_map_t;
+
+static void geoid_map_free(void *obj)
+{
+  geoid_map_t *m = obj;
+  if(m->map) munmap(m->map, m->size);
+}
+
+static void geoid_map_print(void *obj)
+{
+  geoid_map_t *m = obj;
+  char buf[160];
+  snprintf(buf, sizeof(buf),
+    "geoid_map: %ld x %ld grid from lat %g, lon %g by %g, %g",
+    m->ncols, m->nrows, m->glamn, m->glomn, m->dla, m->dlo);
+  y_print(buf, 1);
+}
+
+static void geoid_map_extract(void *obj, char *name)
+{
+  geoid_map_t *m = obj;
+  if(!strcmp(name, "glamn")) ypush_double(m->glamn);
+  else if(!strcmp(name, "glomn")) ypush_double(m->glomn);
+  else if(!strcmp(name, "dla")) ypush_double(m->dla);
+  else if(!strcmp(name, "dlo")) ypush_double(m->dlo);
+  else if(!strcmp(name, "nrows")) ypush_long(m->nrows);
+  else if(!strcmp(name, "ncols")) ypush_long(m->ncols);
+  else if(!strcmp(name, "itype")) ypush_long(m->itype);
+  else y_error("geoid_map has no such member");
+}
+
+static y_userobj_t geoid_map_ops = {
+  "geoid_map",
+  &geoid_map_free,
+  &geoid_map_print,
+  0,
+  &geoid_map_extract,
+  0
+};
+
+static double geoid_map_double(const unsigned char *p, int swap)
+{
+  uint64_t bits;
+  double val;
+  memcpy(&bits, p, sizeof(bits));
+  if(swap) bits = __builtin_bswap64(bits);
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+static long geoid_map_int(const unsigned char *p, int swap)
+{
+  uint32_t bits;
+  int32_t val;
+  memcpy(&bits, p, sizeof(bits));
+  if(swap) bits = __builtin_bswap32(bits);
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+void Y_geoid_map(int nArgs)
+{
+  if(nArgs != 1) y_error("geoid_map takes exactly one argument");
+  const char *fn = ygets_q(0);
+
+  geoid_map_t *m = ypush_obj(&geoid_map_ops, sizeof(geoid_map_t));
+  memset(m, 0, sizeof(geoid_map_t));
+
+  int fd = open(fn, O_RDONLY);
+  if(fd < 0) y_errorq("unable to open geoid file %s", fn);
+  struct stat st;
+  if(fstat(fd, &st) || st.st_size < GEOID_BIN_HEADER)
+  {
+    close(fd);
+    y_errorq("not a geoid .bin file: %s", fn);
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if(map == MAP_FAILED) y_errorq("unable to map geoid file %s", fn);
+  m->map = map;
+  m->size = st.st_size;
+
+  // itype is always 1, which gives away the byte order
+  const unsigned char *p = map;
+  int swap;
+  if(geoid_map_int(p + 40, 0) == 1)
+    swap = 0;
+  else if(geoid_map_int(p + 40, 1) == 1)
+    swap = 1;
+  else
+    y_errorq("not a geoid .bin file: %s", fn);
+
+  m->glamn = geoid_map_double(p, swap);
+  m->glomn = geoid_map_double(p + 8, swap);
+  m->dla = geoid_map_double(p + 16, swap);
+  m->dlo = geoid_map_double(p + 24, swap);
+  m->nrows = geoid_map_int(p + 32, swap);
+  m->ncols = geoid_map_int(p + 36, swap);
+  m->itype = 1;
+
+  if(m->nrows < 1 || m->ncols < 1 ||
+    (st.st_size - GEOID_BIN_HEADER) / 4 / m->ncols < m->nrows)
+    y_errorq("geoid file is truncated: %s", fn);
+
+  m->grid.data = p + GEOID_BIN_HEADER;
+  m->grid.kind = swap ? N88_FLOAT_SWAP : N88_FLOAT;
+  m->grid.fxcount = m->ncols;
+  m->grid.fycount = m->nrows;
+}
+
+// Interpolations are only split across threads in pieces at least this large
+#define GEOID_MIN_PER_THREAD 4096
+#define GEOID_MAX_THREADS 64
+
+typedef struct geoid_job_t
+{
+  const n88_grid_t *grid;
+  n88_cache_t *cache;
+  double *result;
+  const double *x, *y;
+  long start, stop;
+  pthread_t thread;
+} geoid_job_t;
+
+static void * geoid_worker(void *arg)
+{
+  geoid_job_t *j = arg;
+  n88_spline2d_range(j->grid, j->cache, j->result, j->x, j->y, j->start,
+    j->stop);
+  return NULL;
+}
+
+void Y_geoid_map_interp(int nArgs)
+{
+  static char *knames[2] = {"threads", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[3], i;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 3; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[2] == -1 || yarg_kw(iarg[2]-1, kglobs, kiargs) != -1)
+    y_error("must provide 3 arguments");
+
+  long threads = 1;
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+    threads = ygets_l(kiargs[0]);
+  if(threads > GEOID_MAX_THREADS) threads = GEOID_MAX_THREADS;
+
+  geoid_map_t *m = yget_obj(iarg[0], &geoid_map_ops);
+
+  long count, ycount, dims[Y_DIMSIZE];
+  double *x = ygeta_d(iarg[1], &count, dims);
+  double *y = ygeta_d(iarg[2], &ycount, 0);
+  if(count != ycount) y_error("x and y must have the same size");
+
+  if(threads > count / GEOID_MIN_PER_THREAD)
+    threads = count / GEOID_MIN_PER_THREAD;
+  if(threads < 1) threads = 1;
+
+  ypush_check(2);
+  // stack + 1 = +1
+  double *result = ypush_d(dims);
+  // stack + 1 = +2
+  n88_cache_t *cache = ypush_scratch(threads * sizeof(n88_cache_t), NULL);
+  memset(cache, 0, threads * sizeof(n88_cache_t));
+
+  geoid_job_t jobs[GEOID_MAX_THREADS];
+  int started[GEOID_MAX_THREADS];
+  long t, per = (count + threads - 1) / threads;
+  for(t = 0; t < threads; t++)
+  {
+    jobs[t].grid = &m->grid;
+    jobs[t].cache = &cache[t];
+    jobs[t].result = result;
+    jobs[t].x = x;
+    jobs[t].y = y;
+    jobs[t].start = t * per;
+    jobs[t].stop = t * per + per < count ? t * per + per : count;
+    started[t] = t > 0 &&
+      !pthread_create(&jobs[t].thread, NULL, geoid_worker, &jobs[t]);
+  }
+  geoid_worker(&jobs[0]);
+  for(t = 1; t < threads; t++)
+  {
+    if(started[t])
+      pthread_join(jobs[t].thread, NULL);
+    else
+      geoid_worker(&jobs[t]);
+  }
+
+  // stack - 1 = +1; the result is returned
+  yarg_drop(1);
+}
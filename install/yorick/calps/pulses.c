@@ -0,0 +1,97 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include "yapi.h"
+#include "pulses.h"
+
+// API methods, see pulses.h for documentation
+
+int pulses_wf_init(pulses_wf_t *wf, void *obj, yo_ops_t *ops, long count)
+{
+  long n = 0;
+  wf->count = count;
+  wf->tx = NULL;
+  wf->rx = NULL;
+  wf->buf = NULL;
+  wf->tx_start = NULL;
+  wf->tx_len = NULL;
+  wf->rx_start = NULL;
+  wf->rx_len = NULL;
+
+  if(!ops->get_q(obj, "rx", -1) && !yarg_nil(0))
+  {
+    wf->rx = (ypointer_t (*)[4])ygeta_p(0, &n, NULL);
+    if(n != 4 * count)
+      y_error("pulses.rx has the wrong size");
+    if(ops->get_q(obj, "tx", -1) || yarg_nil(0))
+      y_error("pulses.tx not defined");
+    wf->tx = ygeta_p(0, &n, NULL);
+    if(n != count)
+      y_error("pulses.tx has the wrong size");
+    return 2;
+  }
+  yarg_drop(1);
+
+  if(ops->get_q(obj, "wfbuf", -1))
+    y_error("pulses does not contain waveforms (rx or wfbuf)");
+  if(yarg_typeid(0) != Y_POINTER || yarg_rank(0) != 0)
+    y_error("pulses.wfbuf must be a scalar pointer");
+  wf->buf = *ygeta_p(0, NULL, NULL);
+
+  if(ops->get_q(obj, "tx_start", -1))
+    y_error("pulses.tx_start not defined");
+  wf->tx_start = ygeta_l(0, &n, NULL);
+  if(n != count) y_error("pulses.tx_start has the wrong size");
+
+  if(ops->get_q(obj, "tx_len", -1))
+    y_error("pulses.tx_len not defined");
+  wf->tx_len = ygeta_i(0, &n, NULL);
+  if(n != count) y_error("pulses.tx_len has the wrong size");
+
+  if(ops->get_q(obj, "rx_start", -1))
+    y_error("pulses.rx_start not defined");
+  wf->rx_start = (long (*)[4])ygeta_l(0, &n, NULL);
+  if(n != 4 * count) y_error("pulses.rx_start has the wrong size");
+
+  if(ops->get_q(obj, "rx_len", -1))
+    y_error("pulses.rx_len not defined");
+  wf->rx_len = (int (*)[4])ygeta_i(0, &n, NULL);
+  if(n != 4 * count) y_error("pulses.rx_len has the wrong size");
+
+  return 5;
+}
+
+const unsigned char * pulses_wf_get(pulses_wf_t *wf, long i, int chan,
+  long *len)
+{
+  if(wf->tx)
+  {
+    ypointer_t ptr = chan ? wf->rx[i][chan-1] : wf->tx[i];
+    if(!ptr)
+    {
+      *len = 0;
+      return NULL;
+    }
+    int typeid = ypush_ptr(ptr, len);
+    yarg_drop(1);
+    if(typeid != Y_CHAR)
+      y_error("waveform encountered that was not an array of char");
+    return ptr;
+  }
+
+  *len = chan ? wf->rx_len[i][chan-1] : wf->tx_len[i];
+  if(!*len || !wf->buf)
+  {
+    *len = 0;
+    return NULL;
+  }
+  return wf->buf + (chan ? wf->rx_start[i][chan-1] : wf->tx_start[i]) - 1;
+}
+
+void pulses_wf_table(pulses_wf_t *wf, int chan, const unsigned char **ptr,
+  long *len)
+{
+  long i;
+  for(i = 0; i < wf->count; i++)
+    ptr[i] = pulses_wf_get(wf, i, chan, &len[i]);
+}
@@ -0,0 +1,79 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#ifndef PULSES_H
+#define PULSES_H
+
+#include "yapi.h"
+
+/* pulses library
+ *
+ * This provides access to the waveforms in a pulses oxy group object, as
+ * returned by eaarl_decode_fast. Two layouts are supported:
+ *
+ *  - The default layout, where tx is an array of pointers and rx is a 4xN
+ *    array of pointers, each pointing to a separate array of char.
+ *  - The packed layout (packed=1), where wfbuf is a scalar pointer to a
+ *    single array of char holding every waveform, and tx_start, tx_len,
+ *    rx_start, and rx_len give the 1-based start and length of each waveform
+ *    within it. A length of 0 means the waveform is absent.
+ *
+ * Kernels that use this library work with either layout transparently.
+ */
+
+typedef struct pulses_wf_t
+{
+  // Number of pulses
+  long count;
+
+  // Default layout; NULL if packed
+  ypointer_t *tx;
+  ypointer_t (*rx)[4];
+
+  // Packed layout; buf is NULL if not packed (or if there are no waveforms)
+  const unsigned char *buf;
+  long *tx_start;
+  int *tx_len;
+  long (*rx_start)[4];
+  int (*rx_len)[4];
+} pulses_wf_t;
+
+/* pulses_wf_init
+ *
+ * Populates WF from the pulses object OBJ (with methods OPS). COUNT must be
+ * the number of pulses in the object; it is checked against the waveform
+ * fields.
+ *
+ * This pushes up to five entries onto the Yorick stack (the waveform fields
+ * retrieved from the object). Returns the number of entries pushed, so that
+ * the caller can drop them when finished.
+ */
+int pulses_wf_init(pulses_wf_t *wf, void *obj, yo_ops_t *ops, long count);
+
+/* pulses_wf_get
+ *
+ * Returns a pointer to the waveform for pulse I (0-based) and channel CHAN,
+ * where CHAN is 0 for tx or 1-4 for rx. The waveform's length is stored in
+ * LEN. If the waveform is absent, returns NULL and sets LEN to 0.
+ *
+ * For the packed layout, this does not touch the Yorick stack and may be
+ * called from any thread. For the default layout, it temporarily uses the
+ * Yorick stack (leaving it as it was) and must only be called from the main
+ * thread.
+ */
+const unsigned char * pulses_wf_get(pulses_wf_t *wf, long i, int chan,
+  long *len);
+
+/* pulses_wf_table
+ *
+ * Looks up the waveform for channel CHAN (as for pulses_wf_get) of every
+ * pulse, storing pointers in PTR and lengths in LEN, each of which must have
+ * room for wf->count entries. Absent waveforms get NULL and 0.
+ *
+ * The pointers remain valid as long as the pulses object holds its
+ * waveforms, and may be used from any thread. This must itself be called from
+ * the main thread.
+ */
+void pulses_wf_table(pulses_wf_t *wf, int chan, const unsigned char **ptr,
+  long *len);
+
+#endif
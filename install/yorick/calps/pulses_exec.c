@@ -0,0 +1,424 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "yapi.h"
+#include "pulses.h"
+#include "pulses_exec.h"
+
+// Number of pulses a thread claims from the queue at a time
+#define PULSES_EXEC_CHUNK 256
+
+// Kernel registry, for eaarl_rx_batch. Each kernel is defined in its own
+// file.
+extern const pulses_kernel_t be_rx_kernel;
+extern const pulses_kernel_t ba_rx_kernel;
+extern const pulses_kernel_t mp_rx_kernel;
+extern const pulses_kernel_t cf_rx_kernel;
+extern const pulses_kernel_t sb_rx_kernel;
+
+static const pulses_kernel_t *pulses_kernels[] = {
+  &be_rx_kernel, &ba_rx_kernel, &mp_rx_kernel, &cf_rx_kernel,
+  &sb_rx_kernel, NULL
+};
+
+typedef struct pulses_exec_worker_t
+{
+  pulses_exec_t *x;
+  int thread;
+  // Scratch space for this thread
+  double *work;
+  pthread_t thread_id;
+} pulses_exec_worker_t;
+
+void pulses_exec_smooth(const double *wf, long n, long smoothwf, double *out)
+{
+  long bin = smoothwf * 2 + 1;
+  long half = bin / 2;
+  long i, j, count, pts;
+  double sum;
+
+  memset(out, 0, sizeof(double) * n);
+  for(i = 0; i + bin <= n; i++)
+  {
+    sum = 0.;
+    for(j = 0; j < bin; j++) sum += wf[i + j];
+    out[i + half] = sum / (double)bin;
+  }
+
+  count = (n + 1) / 2;
+  if(half < count) count = half;
+  for(i = 0; i < count; i++)
+  {
+    pts = 2 * i + 1;
+    sum = 0.;
+    for(j = 0; j < pts; j++) sum += wf[j];
+    out[i] = (float)(sum / pts);
+    sum = 0.;
+    for(j = n - pts; j < n; j++) sum += wf[j];
+    out[n - 1 - i] = (float)(sum / pts);
+  }
+}
+
+void pulses_exec_select_sfc(pulses_exec_t *x, long *channel)
+{
+  long i, j, np, nsat;
+  double max_sat;
+  int chan;
+
+  // stack + 1 = +1
+  long idx = yfind_global("ops_conf", 0);
+  if(idx == -1) y_error("ops_conf not defined");
+  ypush_global(idx);
+  yo_ops_t *ops;
+  void *obj = yo_get(0, &ops);
+  if(!obj) y_error("ops_conf not defined properly");
+  // stack + 1 = +2
+  if(ops->get_q(obj, "max_sfc_sat", -1))
+    y_error("ops_conf.max_sfc_sat not defined");
+  max_sat = ygets_d(0);
+  // stack - 2 = +0
+  yarg_drop(2);
+
+  for(i = 0; i < x->count; i++)
+  {
+    channel[i] = 0;
+    for(chan = 1; chan <= 3; chan++)
+    {
+      const unsigned char *wf = x->wf[chan-1][i];
+      if(!wf) break;
+      // Channels 1 and 2 define saturation as < 5, whereas channel 3 defines
+      // saturation as == 0.
+      unsigned char sat_thresh = chan == 3 ? 0 : 4;
+      np = x->len[chan-1][i];
+      if(np > 12) np = 12;
+      nsat = 0;
+      for(j = 0; j < np; j++)
+        if(wf[j] <= sat_thresh) nsat++;
+      if(nsat <= max_sat)
+      {
+        channel[i] = chan;
+        break;
+      }
+    }
+  }
+}
+
+void pulses_exec_finish_had(pulses_exec_t *x)
+{
+  long dims[Y_DIMSIZE], i, chan;
+
+  if(!x->count)
+  {
+    // stack + 1
+    ypush_nil();
+    return;
+  }
+
+  dims[0] = 1;
+  dims[1] = x->count;
+  // stack + 1
+  char *had = ypush_c(dims);
+  for(i = 0; i < x->count; i++)
+  {
+    chan = x->channel[i];
+    had[i] = chan >= 1 && chan <= 4 && x->wf[chan-1][i];
+  }
+}
+
+void pulses_exec_conf_d(void *obj, yo_ops_t *ops, const char *name,
+  double val[4])
+{
+  long n, i;
+  // stack + 1 = +1
+  if(ops->get_q(obj, name, -1) || !yarg_number(0))
+    y_errorq("conf.%s must be a numeric scalar or array of 4 values", name);
+  double *v = ygeta_d(0, &n, NULL);
+  if(n != 1 && n != 4)
+    y_errorq("conf.%s must be a numeric scalar or array of 4 values", name);
+  for(i = 0; i < 4; i++)
+    val[i] = v[n == 1 ? 0 : i];
+  // stack - 1 = +0
+  yarg_drop(1);
+}
+
+void pulses_exec_conf_q(void *obj, yo_ops_t *ops, const char *name,
+  const char *val[4])
+{
+  long n, i;
+  // stack + 1 = +1
+  if(ops->get_q(obj, name, -1) || !yarg_string(0))
+    y_errorq("conf.%s must be a string scalar or array of 4 values", name);
+  char **v = ygeta_q(0, &n, NULL);
+  if(n != 1 && n != 4)
+    y_errorq("conf.%s must be a string scalar or array of 4 values", name);
+  for(i = 0; i < 4; i++)
+    val[i] = v[n == 1 ? 0 : i];
+  // stack - 1 = +0; OBJ still holds the strings
+  yarg_drop(1);
+}
+
+static void * pulses_exec_worker(void *arg)
+{
+  pulses_exec_worker_t *w = arg;
+  pulses_exec_t *x = w->x;
+  const pulses_kernel_t *k = x->kernel;
+  long i, i0, i1, chan;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&x->lock);
+    i0 = x->next;
+    x->next += PULSES_EXEC_CHUNK;
+    pthread_mutex_unlock(&x->lock);
+    if(i0 >= x->count) break;
+    i1 = i0 + PULSES_EXEC_CHUNK < x->count ? i0 + PULSES_EXEC_CHUNK : x->count;
+
+    for(i = i0; i < i1; i++)
+    {
+      chan = x->channel[i];
+      if(chan < 1 || chan > 4) continue;
+
+      const unsigned char *wf = x->wf[chan-1][i];
+      if(!wf) continue;
+
+      k->pulse(x, w->thread, i, wf, x->len[chan-1][i],
+        (const char *)x->conf + k->conf_size * (chan-1), w->work);
+    }
+  }
+  return NULL;
+}
+
+/* pulses_exec_run
+ * Runs X->kernel over the pulses object OBJ (with methods OPS) using up to
+ * NTHREADS threads. X->kernel, X->conf, and X->col_off must be set; the rest
+ * of X is filled in here. CHANNEL is NULL to select channels, otherwise it
+ * has NCHANNEL entries.
+ */
+static void pulses_exec_run(pulses_exec_t *x, void *obj, yo_ops_t *ops,
+  long *channel, long nchannel, long nthreads)
+{
+  const pulses_kernel_t *k = x->kernel;
+  int auto_channel = !channel;
+  int i;
+
+  if(auto_channel && !k->select)
+    y_errorq("%s kernel requires lchannel", k->name);
+
+  // stack + 1 = +1
+  if(ops->get_q(obj, "soe", -1))
+    y_error("pulses.soe not defined");
+  long npulses;
+  ygeta_any(0, &npulses, NULL, NULL);
+  if(!auto_channel && nchannel != npulses)
+    y_error("lchannel must have one value per pulse");
+
+  // stack + 5 = +6 (at most)
+  pulses_wf_t wfs;
+  pulses_wf_init(&wfs, obj, ops, npulses);
+
+  ypush_check(8);
+
+  memset(&x->wf, 0, sizeof(x->wf));
+  memset(&x->len, 0, sizeof(x->len));
+  x->count = npulses;
+
+  // Waveform tables for the channels in use: 1-3 when selecting, otherwise
+  // whichever appear in LCHANNEL
+  long dims[Y_DIMSIZE];
+  dims[0] = 1;
+  dims[1] = npulses;
+  int need[4] = {auto_channel, auto_channel, auto_channel, 0};
+  long j, maxlen = 0;
+  for(j = 0; j < npulses && !auto_channel; j++)
+    if(channel[j] >= 1 && channel[j] <= 4) need[channel[j] - 1] = 1;
+  // stack + 4 = +10 (at most)
+  for(i = 0; i < 4; i++)
+  {
+    if(!need[i]) continue;
+    x->wf[i] = ypush_scratch((sizeof(void *) + sizeof(long)) * npulses + 1,
+      NULL);
+    x->len[i] = (long *)(x->wf[i] + npulses);
+    pulses_wf_table(&wfs, i + 1, x->wf[i], x->len[i]);
+    for(j = 0; j < npulses; j++)
+      if(x->len[i][j] > maxlen) maxlen = x->len[i][j];
+  }
+
+  ypush_check(4);
+
+  if(auto_channel)
+  {
+    // stack + 1 = +11
+    channel = ypush_l(dims);
+    k->select(x, channel);
+    // stack + 1 = +12
+    char *lchannel = ypush_c(dims);
+    for(j = 0; j < npulses; j++) lchannel[j] = channel[j];
+    ops->set_q(obj, "lchannel", -1, 0);
+  }
+  x->channel = channel;
+
+  if(nthreads > npulses) nthreads = npulses;
+  if(nthreads < 1) nthreads = 1;
+  x->nthreads = nthreads;
+
+  // The kernel may push scratch of its own here
+  if(k->prepare) k->prepare(x, maxlen);
+
+  ypush_check(PULSES_EXEC_MAX_COLUMNS + 4);
+
+  // Output fields
+  // stack + 1 per column (at most PULSES_EXEC_MAX_COLUMNS)
+  for(i = 0; k->columns[i].name; i++)
+  {
+    x->col[i] = NULL;
+    if(x->col_off & (1U << i)) continue;
+    switch(k->columns[i].type)
+    {
+      case Y_CHAR:
+        x->col[i] = ypush_c(dims);
+        break;
+      case Y_LONG:
+        x->col[i] = ypush_l(dims);
+        break;
+      default:
+        x->col[i] = ypush_f(dims);
+    }
+    ops->set_q(obj, k->columns[i].name, -1, 0);
+  }
+
+  // Scratch for each thread
+  long worklen = k->work_per_sample * (maxlen + 1);
+  // stack + 1
+  double *work = ypush_scratch(sizeof(double) * worklen * nthreads, NULL);
+
+  pulses_exec_worker_t workers[PULSES_EXEC_MAX_THREADS];
+  long t, started = 0;
+  x->next = 0;
+  pthread_mutex_init(&x->lock, NULL);
+  for(t = 0; t < nthreads; t++)
+  {
+    workers[t].x = x;
+    workers[t].thread = t;
+    workers[t].work = work + worklen * t;
+  }
+  if(nthreads == 1)
+  {
+    pulses_exec_worker(&workers[0]);
+  }
+  else
+  {
+    for(t = 0; t < nthreads; t++)
+    {
+      if(pthread_create(&workers[t].thread_id, NULL, pulses_exec_worker,
+        &workers[t]))
+        break;
+      started++;
+    }
+    // If no thread could be started, do the work here instead; otherwise
+    // the threads that did start drain the queue
+    if(!started) pulses_exec_worker(&workers[0]);
+    for(t = 0; t < started; t++)
+      pthread_join(workers[t].thread_id, NULL);
+  }
+  pthread_mutex_destroy(&x->lock);
+
+  // stack + 1
+  k->finish(x);
+}
+
+/* pulses_exec_call
+ * Runs KERNEL with the arguments at stack indices IPULSES, ICHANNEL, and
+ * ICONF, and the threads= keyword at ITHREADS (-1 if not given).
+ */
+static void pulses_exec_call(const pulses_kernel_t *kernel, int ipulses,
+  int ichannel, int iconf, int ithreads)
+{
+  long nthreads = 1;
+  if(ithreads != -1 && !yarg_nil(ithreads))
+  {
+    if(yarg_number(ithreads) != 1 || yarg_rank(ithreads) != 0)
+      y_error("threads= must be scalar integer");
+    nthreads = ygets_l(ithreads);
+    if(nthreads < 1) nthreads = 1;
+    if(nthreads > PULSES_EXEC_MAX_THREADS)
+      nthreads = PULSES_EXEC_MAX_THREADS;
+  }
+
+  long *channel = NULL, nchannel = 0;
+  if(!yarg_nil(ichannel))
+  {
+    if(yarg_number(ichannel) != 1)
+      y_error("lchannel must be an integer array or []");
+    channel = ygeta_l(ichannel, &nchannel, NULL);
+  }
+
+  pulses_exec_t x;
+  memset(&x, 0, sizeof(x));
+  x.kernel = kernel;
+
+  yo_ops_t *ops;
+  void *obj;
+
+  // Conf values
+  obj = yo_get(iconf, &ops);
+  if(!obj) y_error("conf must be an oxy group");
+  // stack + 1 = +1
+  x.conf = ypush_scratch(kernel->conf_size * 4, NULL);
+  kernel->read_conf(&x, obj, ops);
+
+  // Retrieve pulses; IPULSES is now one deeper
+  obj = yo_get(ipulses + 1, &ops);
+  if(!obj) y_error("pulses not defined properly");
+
+  pulses_exec_run(&x, obj, ops, channel, nchannel, nthreads);
+}
+
+void pulses_exec_builtin(const pulses_kernel_t *kernel, int nArgs)
+{
+  static char *knames[2] = {"threads", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[3], i;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 3; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[2] == -1 || yarg_kw(iarg[2]-1, kglobs, kiargs) != -1)
+    y_error("must provide 3 arguments");
+
+  pulses_exec_call(kernel, iarg[0], iarg[1], iarg[2], kiargs[0]);
+}
+
+void Y_eaarl_rx_batch(int nArgs)
+{
+  static char *knames[2] = {"threads", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[4], i;
+  const pulses_kernel_t *kernel = NULL;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 4; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[3] == -1 || yarg_kw(iarg[3]-1, kglobs, kiargs) != -1)
+    y_error("must provide 4 arguments");
+
+  if(yarg_string(iarg[0]) != 1)
+    y_error("kernel must be a scalar string");
+  char *name = ygets_q(iarg[0]);
+  for(i = 0; name && pulses_kernels[i]; i++)
+  {
+    if(!strcmp(name, pulses_kernels[i]->name))
+    {
+      kernel = pulses_kernels[i];
+      break;
+    }
+  }
+  if(!kernel) y_errorq("unknown kernel: %s", name ? name : "");
+
+  pulses_exec_call(kernel, iarg[1], iarg[2], iarg[3], kiargs[0]);
+}
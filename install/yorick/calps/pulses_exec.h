@@ -0,0 +1,169 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#ifndef PULSES_EXEC_H
+#define PULSES_EXEC_H
+
+#include <pthread.h>
+#include "yapi.h"
+
+/* pulses_exec library
+ *
+ * This runs a native waveform kernel over every pulse in a pulses oxy group
+ * object, taking care of the parts that every kernel shares: reading the
+ * arguments and conf group, picking each pulse's channel, looking up its
+ * waveform (through the pulses library), spreading the pulses over a pool of
+ * threads with per-thread scratch space, and storing per-pulse output columns
+ * back in the object.
+ *
+ * A kernel is described by a pulses_kernel_t and listed in the registry in
+ * pulses_exec.c, which makes it available through eaarl_rx_batch. A kernel's
+ * own builtin (such as eaarl_be_rx_batch) takes the same arguments less the
+ * kernel name and is simply a call to pulses_exec_builtin.
+ */
+
+#define PULSES_EXEC_MAX_THREADS 64
+#define PULSES_EXEC_MAX_COLUMNS 8
+
+typedef struct pulses_exec_t pulses_exec_t;
+
+// An output column: one value per pulse, stored in the pulses object under
+// NAME. TYPE is Y_CHAR, Y_FLOAT, or Y_LONG.
+typedef struct pulses_column_t
+{
+  const char *name;
+  int type;
+} pulses_column_t;
+
+typedef struct pulses_kernel_t
+{
+  // Name in the registry, as given to eaarl_rx_batch
+  const char *name;
+
+  // Output columns, terminated by an entry with a NULL name. Each is zeroed
+  // before the kernel runs.
+  const pulses_column_t *columns;
+
+  // Size of one channel's conf; x->conf holds four of these (channels 1-4)
+  size_t conf_size;
+
+  // Per-thread scratch, in doubles per sample of the longest waveform
+  int work_per_sample;
+
+  // Main thread. Reads the conf for channels 1-4 into x->conf from the conf
+  // group OBJ, raising a Yorick error if it is invalid. May set x->col_off.
+  void (*read_conf)(pulses_exec_t *x, void *obj, yo_ops_t *ops);
+
+  // Main thread, optional. Picks the channel for each pulse when no channels
+  // are given, storing it in CHANNEL (0 to skip the pulse). Only channels 1-3
+  // are available. Kernels without one require lchannel.
+  void (*select)(pulses_exec_t *x, long *channel);
+
+  // Main thread, optional. Called once the channels and waveforms are known
+  // and before any pulse is processed. MAXLEN is the longest waveform. May
+  // push scratch space onto the stack.
+  void (*prepare)(pulses_exec_t *x, long maxlen);
+
+  // Any thread. Processes pulse I (0-based), whose waveform is WF with N
+  // samples, using CONF (the conf for the pulse's channel) and WORK (this
+  // thread's scratch). THREAD is the index of the calling thread, from 0 to
+  // x->nthreads-1. Pulses with no waveform on their channel are skipped.
+  void (*pulse)(const pulses_exec_t *x, int thread, long i,
+    const unsigned char *wf, long n, const void *conf, double *work);
+
+  // Main thread. Called after every pulse has been processed; pushes the
+  // builtin's result onto the stack.
+  void (*finish)(pulses_exec_t *x);
+} pulses_kernel_t;
+
+struct pulses_exec_t
+{
+  const pulses_kernel_t *kernel;
+
+  // Number of pulses
+  long count;
+  // Channel per pulse; 0 means the pulse is skipped
+  long *channel;
+  // Waveforms for channels 1-4 (index 0-3); NULL for channels not needed
+  const unsigned char **wf[4];
+  long *len[4];
+  // Conf for channels 1-4, kernel->conf_size bytes each
+  void *conf;
+
+  // Output columns, in the order of kernel->columns; NULL if disabled
+  void *col[PULSES_EXEC_MAX_COLUMNS];
+  // Bit K set disables column K (set by read_conf)
+  unsigned int col_off;
+
+  // Kernel-specific shared state, set by prepare
+  void *data;
+
+  // Number of threads the pulses are spread over
+  int nthreads;
+  // Next pulse to be claimed
+  long next;
+  pthread_mutex_t lock;
+};
+
+/* pulses_exec_builtin
+ *
+ * Implements a kernel's builtin, called with the NARGS arguments
+ * (pulses, lchannel, conf, threads=):
+ *
+ *  - pulses is the pulses oxy group object.
+ *  - lchannel gives the channel for each pulse (0 to skip it), or is [] to
+ *    have kernel->select pick it, in which case it is stored in the object as
+ *    lchannel (char).
+ *  - conf is an oxy group, read by kernel->read_conf.
+ *  - threads= is the number of threads to use, from 1 through
+ *    PULSES_EXEC_MAX_THREADS (default 1). Threads claim pulses in chunks from
+ *    a shared queue, so a thread that draws expensive waveforms does not hold
+ *    up the rest.
+ *
+ * The result pushed by kernel->finish is left on top of the stack.
+ */
+void pulses_exec_builtin(const pulses_kernel_t *kernel, int nArgs);
+
+/* pulses_exec_conf_d
+ *
+ * Retrieves member NAME of the conf group OBJ: either a numeric scalar (used
+ * for all channels) or an array of four values (one per channel), stored in
+ * VAL.
+ */
+void pulses_exec_conf_d(void *obj, yo_ops_t *ops, const char *name,
+  double val[4]);
+
+/* pulses_exec_conf_q
+ *
+ * As pulses_exec_conf_d, but for strings. The strings belong to Yorick and
+ * remain valid as long as OBJ holds them.
+ */
+void pulses_exec_conf_q(void *obj, yo_ops_t *ops, const char *name,
+  const char *val[4]);
+
+/* pulses_exec_select_sfc
+ *
+ * A select function for kernels that use EAARL-A surface channel selection:
+ * the first of channels 1-3 with no more than ops_conf.max_sfc_sat saturated
+ * samples among its first 12 (below 5 for channels 1 and 2, 0 for channel 3).
+ */
+void pulses_exec_select_sfc(pulses_exec_t *x, long *channel);
+
+/* pulses_exec_finish_had
+ *
+ * A finish function that pushes which pulses had a waveform on their
+ * channel, and so were given to kernel->pulse: char, 1 or 0 for each pulse
+ * (nil if there are no pulses). The Yorick code only sets lbias for those
+ * pulses.
+ */
+void pulses_exec_finish_had(pulses_exec_t *x);
+
+/* pulses_exec_smooth
+ *
+ * Equivalent to moving_average(wf, bin=smoothwf*2+1, taper=1) from lines.i,
+ * writing the result to OUT. Sums are accumulated in the same order as the
+ * Yorick version. The tapered ends are averages of float arrays, which Yorick
+ * returns as float, so they are rounded to float here as well.
+ */
+void pulses_exec_smooth(const double *wf, long n, long smoothwf, double *out);
+
+#endif
@@ -0,0 +1,448 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements the cell interpolation for radius_grid in gridding.i:
+ *
+ *    zgrid = radius_grid_cells(x, y, z, xc, yc, method, maxradius, minpoints,
+ *      wtpower, nodata, threads=)
+ *
+ * XC and YC are the evenly spaced cell center coordinates for the columns and
+ * rows of the grid. Each cell gets the value moveavg_interp or invdist_interp
+ * would give it: the points are binned once into buckets the size of a grid
+ * cell, and each cell only looks at the buckets that overlap its search
+ * radius. Rows of the grid are split across threads.
+ *
+ * The points found for each cell are handled in ascending index order, and
+ * the distance and weight arithmetic matches the Yorick code (including the
+ * pow used for its "^.5" radius test on the boundary), so the results are the
+ * same as the Yorick functions give.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yapi.h"
+
+#define RADIUS_GRID_AVERAGE 0
+#define RADIUS_GRID_INVDIST 1
+
+// Rows are only split across threads in pieces at least this large
+#define RADIUS_GRID_MIN_ROWS 8
+#define RADIUS_GRID_MAX_THREADS 64
+
+typedef struct radius_grid_t
+{
+  // Points, binned: bucket b holds entries start[b] through start[b+1]-1
+  double x0, y0, bucket;
+  long nx, ny;
+  long *start;
+  long *item;       // 0-based index into the original arrays
+  double *x, *y, *z;
+
+  // Grid and settings
+  const double *xc, *yc;
+  long xcount, ycount;
+  int method;
+  double radius, minpoints, nodata;
+  // The weighting power is wtpower_int if integer_power is set, else wtpower
+  int integer_power;
+  long wtpower_int;
+  double wtpower;
+  double *zgrid;
+} radius_grid_t;
+
+// A point found for a cell
+typedef struct radius_grid_hit_t
+{
+  long item;
+  double d2, z;
+} radius_grid_hit_t;
+
+// One thread's share of the rows
+typedef struct radius_grid_job_t
+{
+  const radius_grid_t *g;
+  long row0, row1;
+  int failed;
+  pthread_t thread;
+} radius_grid_job_t;
+
+static inline long radius_grid_cell(double v, double min, double size,
+  long n)
+{
+  double c = floor((v - min) / size);
+  if(!(c > 0)) return 0;
+  if(c >= n - 1) return n - 1;
+  return (long)c;
+}
+
+/* radius_grid_within
+ * Whether a point at squared distance D2 is within radius R, as Yorick's
+ * (d2)^.5 <= r decides it. sqrt settles all but the points right on the
+ * boundary, which get the same pow call Yorick makes.
+ */
+static inline int radius_grid_within(double d2, double r)
+{
+  double d = sqrt(d2);
+  if(fabs(d - r) > r * 1e-15) return d < r;
+  return pow(d2, .5) <= r;
+}
+
+/* radius_grid_ipow
+ * X raised to the integer power N, by repeated squaring.
+ */
+static double radius_grid_ipow(double x, long n)
+{
+  double result = 1;
+  int inv = n < 0;
+  if(inv) n = -n;
+  while(n)
+  {
+    if(n & 1) result *= x;
+    n >>= 1;
+    if(n) x *= x;
+  }
+  return inv ? 1. / result : result;
+}
+
+static int radius_grid_hit_cmp(const void *a, const void *b)
+{
+  long la = ((const radius_grid_hit_t *)a)->item;
+  long lb = ((const radius_grid_hit_t *)b)->item;
+  return la < lb ? -1 : la > lb;
+}
+
+/* radius_grid_value
+ * Calculates the value for a cell from its N points HIT (in ascending index
+ * order), as moveavg_interp or invdist_interp does.
+ */
+static double radius_grid_value(const radius_grid_t *g,
+  const radius_grid_hit_t *hit, long n)
+{
+  long k, zero = 0;
+  double sum = 0;
+
+  if(!n || !(n >= g->minpoints)) return g->nodata;
+
+  if(g->method == RADIUS_GRID_AVERAGE)
+  {
+    for(k = 0; k < n; k++)
+      sum += hit[k].z;
+    return sum / n;
+  }
+
+  // Points right on the cell center take over completely
+  for(k = 0; k < n; k++)
+  {
+    if(hit[k].d2 == 0)
+    {
+      sum += hit[k].z;
+      zero++;
+    }
+  }
+  if(zero) return sum / zero;
+
+  double wsum = 0, wt;
+  for(k = 0; k < n; k++)
+  {
+    double dist = sqrt(hit[k].d2);
+    if(g->integer_power)
+      wt = 1. / radius_grid_ipow(dist, g->wtpower_int);
+    else
+      wt = 1. / pow(dist, g->wtpower);
+    sum += hit[k].z * wt;
+    wsum += wt;
+  }
+  return sum / wsum;
+}
+
+static void * radius_grid_worker(void *arg)
+{
+  radius_grid_job_t *job = arg;
+  const radius_grid_t *g = job->g;
+  radius_grid_hit_t *hit = NULL, *nhit;
+  long cap = 0, n, i, j, bi, bj, k;
+  double r = g->radius;
+
+  for(j = job->row0; j < job->row1; j++)
+  {
+    double qy = g->yc[j];
+    double by0 = qy - r, by1 = qy + r;
+    long bj0 = radius_grid_cell(by0, g->y0, g->bucket, g->ny);
+    long bj1 = radius_grid_cell(by1, g->y0, g->bucket, g->ny);
+
+    for(i = 0; i < g->xcount; i++)
+    {
+      double qx = g->xc[i];
+      double bx0 = qx - r, bx1 = qx + r;
+      long bi0 = radius_grid_cell(bx0, g->x0, g->bucket, g->nx);
+      long bi1 = radius_grid_cell(bx1, g->x0, g->bucket, g->nx);
+      long buckets = 0;
+
+      n = 0;
+      for(bj = bj0; bj <= bj1; bj++)
+      {
+        for(bi = bi0; bi <= bi1; bi++)
+        {
+          long b = bj * g->nx + bi;
+          long stop = g->start[b+1];
+          if(g->start[b] < stop) buckets++;
+          for(k = g->start[b]; k < stop; k++)
+          {
+            double px = g->x[k], py = g->y[k];
+            // The box test comes first, as in find_points_in_radius
+            if(px < bx0 || px > bx1 || py < by0 || py > by1) continue;
+            double dx = qx - px, dy = qy - py;
+            double d2 = dx*dx + dy*dy;
+            if(!radius_grid_within(d2, r)) continue;
+
+            if(n == cap)
+            {
+              cap = cap ? 2 * cap : 256;
+              nhit = realloc(hit, sizeof(radius_grid_hit_t) * cap);
+              if(!nhit)
+              {
+                free(hit);
+                job->failed = 1;
+                return NULL;
+              }
+              hit = nhit;
+            }
+            hit[n].item = g->item[k];
+            hit[n].d2 = d2;
+            hit[n].z = g->z[k];
+            n++;
+          }
+        }
+      }
+
+      // Points from a single bucket are already in index order
+      if(buckets > 1 && n > 1)
+        qsort(hit, n, sizeof(radius_grid_hit_t), radius_grid_hit_cmp);
+
+      g->zgrid[j * g->xcount + i] = radius_grid_value(g, hit, n);
+    }
+  }
+
+  if(hit) free(hit);
+  return NULL;
+}
+
+/* radius_grid_bin
+ * Bins the COUNT points X, Y, Z into G, leaving out any that are too far from
+ * the grid for any cell to use. Returns 0 if memory could not be allocated.
+ */
+static int radius_grid_bin(radius_grid_t *g, const double *x,
+  const double *y, const double *z, long count)
+{
+  long i, k, b, nb, used = 0;
+  double r = g->radius;
+  double xlo = g->xc[0], xhi = g->xc[0], ylo = g->yc[0], yhi = g->yc[0];
+
+  for(i = 1; i < g->xcount; i++)
+  {
+    if(g->xc[i] < xlo) xlo = g->xc[i];
+    if(g->xc[i] > xhi) xhi = g->xc[i];
+  }
+  for(i = 1; i < g->ycount; i++)
+  {
+    if(g->yc[i] < ylo) ylo = g->yc[i];
+    if(g->yc[i] > yhi) yhi = g->yc[i];
+  }
+  // A point outside these is outside every cell's search box
+  xlo -= r;
+  xhi += r;
+  ylo -= r;
+  yhi += r;
+
+  // Buckets are the size of a grid cell, unless that would make far more
+  // buckets than there are cells and points
+  if(g->xcount > 1)
+    g->bucket = (xhi - xlo - 2 * r) / (g->xcount - 1);
+  else if(g->ycount > 1)
+    g->bucket = (yhi - ylo - 2 * r) / (g->ycount - 1);
+  else
+    g->bucket = 2 * r;
+  if(!(g->bucket > 0) || !isfinite(g->bucket)) g->bucket = 1;
+  double maxb = 4. * (g->xcount * g->ycount + count) + 16;
+  while((floor((xhi - xlo) / g->bucket) + 1) *
+    (floor((yhi - ylo) / g->bucket) + 1) > maxb)
+    g->bucket *= 2;
+
+  g->x0 = xlo;
+  g->y0 = ylo;
+  g->nx = (long)floor((xhi - xlo) / g->bucket) + 1;
+  g->ny = (long)floor((yhi - ylo) / g->bucket) + 1;
+  nb = g->nx * g->ny;
+
+  long *bin = malloc(sizeof(long) * (count ? count : 1));
+  g->start = calloc(nb + 1, sizeof(long));
+  if(!bin || !g->start)
+  {
+    if(bin) free(bin);
+    return 0;
+  }
+
+  for(i = 0; i < count; i++)
+  {
+    if(!(x[i] >= xlo && x[i] <= xhi && y[i] >= ylo && y[i] <= yhi))
+    {
+      bin[i] = -1;
+      continue;
+    }
+    b = radius_grid_cell(y[i], ylo, g->bucket, g->ny) * g->nx +
+      radius_grid_cell(x[i], xlo, g->bucket, g->nx);
+    bin[i] = b;
+    g->start[b+1]++;
+    used++;
+  }
+  for(b = 0; b < nb; b++)
+    g->start[b+1] += g->start[b];
+
+  g->item = malloc(sizeof(long) * (used ? used : 1));
+  g->x = malloc(sizeof(double) * (used ? used : 1));
+  g->y = malloc(sizeof(double) * (used ? used : 1));
+  g->z = malloc(sizeof(double) * (used ? used : 1));
+  if(!g->item || !g->x || !g->y || !g->z)
+  {
+    free(bin);
+    return 0;
+  }
+
+  // Counting sort, which keeps each bucket in index order
+  for(i = 0; i < count; i++)
+  {
+    b = bin[i];
+    if(b < 0) continue;
+    k = g->start[b]++;
+    g->item[k] = i;
+    g->x[k] = x[i];
+    g->y[k] = y[i];
+    g->z[k] = z[i];
+  }
+  for(b = nb; b > 0; b--)
+    g->start[b] = g->start[b-1];
+  g->start[0] = 0;
+
+  free(bin);
+  return 1;
+}
+
+static void radius_grid_free(radius_grid_t *g)
+{
+  if(g->start) free(g->start);
+  if(g->item) free(g->item);
+  if(g->x) free(g->x);
+  if(g->y) free(g->y);
+  if(g->z) free(g->z);
+}
+
+/* radius_grid_run
+ * Fills in the grid, with rows split into contiguous ranges over up to
+ * THREADS threads. The calling thread takes the first range, as well as any
+ * whose thread could not be started. Returns 0 if memory ran out.
+ */
+static int radius_grid_run(const radius_grid_t *g, long threads)
+{
+  radius_grid_job_t jobs[RADIUS_GRID_MAX_THREADS];
+  int started[RADIUS_GRID_MAX_THREADS];
+  long t, per;
+  int ok = 1;
+
+  if(threads > RADIUS_GRID_MAX_THREADS) threads = RADIUS_GRID_MAX_THREADS;
+  if(threads > g->ycount / RADIUS_GRID_MIN_ROWS)
+    threads = g->ycount / RADIUS_GRID_MIN_ROWS;
+  if(threads < 1) threads = 1;
+
+  per = (g->ycount + threads - 1) / threads;
+  for(t = 0; t < threads; t++)
+  {
+    jobs[t].g = g;
+    jobs[t].row0 = t * per;
+    jobs[t].row1 = t * per + per < g->ycount ? t * per + per : g->ycount;
+    jobs[t].failed = 0;
+    started[t] = t > 0 &&
+      !pthread_create(&jobs[t].thread, NULL, radius_grid_worker, &jobs[t]);
+  }
+  radius_grid_worker(&jobs[0]);
+  for(t = 1; t < threads; t++)
+  {
+    if(started[t])
+      pthread_join(jobs[t].thread, NULL);
+    else
+      radius_grid_worker(&jobs[t]);
+  }
+  for(t = 0; t < threads; t++)
+    if(jobs[t].failed) ok = 0;
+  return ok;
+}
+
+void Y_radius_grid_cells(int nArgs)
+{
+  static char *knames[2] = {"threads", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[10], i;
+  long count, n, threads = 1, dims[Y_DIMSIZE];
+  radius_grid_t g;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 10; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[9] == -1 || yarg_kw(iarg[9]-1, kglobs, kiargs) != -1)
+    y_error("must provide 10 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+    threads = ygets_l(kiargs[0]);
+
+  memset(&g, 0, sizeof(g));
+
+  if(!yarg_number(iarg[0])) y_error("x must be numeric");
+  if(!yarg_number(iarg[1])) y_error("y must be numeric");
+  if(!yarg_number(iarg[2])) y_error("z must be numeric");
+  double *x = ygeta_d(iarg[0], &count, 0);
+  double *y = ygeta_d(iarg[1], &n, 0);
+  if(n != count) y_error("x and y must have the same number of values");
+  double *z = ygeta_d(iarg[2], &n, 0);
+  if(n != count) y_error("x and z must have the same number of values");
+
+  if(!yarg_number(iarg[3])) y_error("xc must be numeric");
+  if(!yarg_number(iarg[4])) y_error("yc must be numeric");
+  g.xc = ygeta_d(iarg[3], &g.xcount, 0);
+  g.yc = ygeta_d(iarg[4], &g.ycount, 0);
+
+  if(!yarg_string(iarg[5]) || yarg_rank(iarg[5]) != 0)
+    y_error("method must be a scalar string");
+  char *method = ygets_q(iarg[5]);
+  if(method && !strcmp(method, "invdist"))
+    g.method = RADIUS_GRID_INVDIST;
+  else if(method && !strcmp(method, "average"))
+    g.method = RADIUS_GRID_AVERAGE;
+  else
+    y_error("Unknown method");
+
+  g.radius = fabs(ygets_d(iarg[6]));
+  g.minpoints = ygets_d(iarg[7]);
+  // As in Yorick, an integer power is done by multiplication and a real one
+  // by pow
+  g.integer_power = yarg_number(iarg[8]) == 1;
+  if(g.integer_power)
+    g.wtpower_int = ygets_l(iarg[8]);
+  else
+    g.wtpower = ygets_d(iarg[8]);
+  g.nodata = ygets_d(iarg[9]);
+
+  dims[0] = 2;
+  dims[1] = g.xcount;
+  dims[2] = g.ycount;
+  // stack + 1 = +1
+  g.zgrid = ypush_d(dims);
+  for(n = 0; n < g.xcount * g.ycount; n++)
+    g.zgrid[n] = g.nodata;
+  if(!g.xcount || !g.ycount) return;
+
+  int ok = radius_grid_bin(&g, x, y, z, count) && radius_grid_run(&g, threads);
+  radius_grid_free(&g);
+  if(!ok) y_error("unable to allocate memory for gridding");
+}
@@ -0,0 +1,228 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "yapi.h"
+
+#include "raster_index.h"
+
+#define RASTER_INDEX_MAGIC "ALPSRIDX"
+
+// Header at the start of a sidecar file; followed by COUNT offsets, COUNT
+// pulse counts, and COUNT+1 cumulative totals.
+typedef struct raster_index_header_t
+{
+  char magic[8];
+  int64_t version;
+  int64_t size;     // size of the TLD file when indexed
+  int64_t mtime;    // modification time of the TLD file when indexed
+  int64_t count;
+} raster_index_header_t;
+
+/* raster_index_free
+ * Internal function. Releases the index arrays prior to Yorick freeing the
+ * handle's memory.
+ */
+static void raster_index_free(void *ptr)
+{
+  raster_index_t *ri = ptr;
+  if(ri->offset) free(ri->offset);
+  if(ri->pulses) free(ri->pulses);
+  if(ri->cumulative) free(ri->cumulative);
+}
+
+/* raster_index_alloc
+ * Internal function. Allocates the index arrays for COUNT rasters. Returns 0
+ * on failure.
+ */
+static int raster_index_alloc(raster_index_t *ri, int64_t count)
+{
+  ri->count = count;
+  ri->offset = malloc(sizeof(int64_t) * (count ? count : 1));
+  ri->pulses = malloc(sizeof(int32_t) * (count ? count : 1));
+  ri->cumulative = malloc(sizeof(int64_t) * (count + 1));
+  return ri->offset && ri->pulses && ri->cumulative;
+}
+
+/* raster_index_read
+ * Internal function. Attempts to read the sidecar file SIDECAR into RI.
+ * Returns 1 on success, 0 if the sidecar is missing, stale, or invalid.
+ */
+static int raster_index_read(raster_index_t *ri, const char *sidecar,
+  struct stat *st)
+{
+  raster_index_header_t hdr;
+  int ok = 0;
+  FILE *f = fopen(sidecar, "rb");
+  if(!f) return 0;
+
+  if(fread(&hdr, sizeof(hdr), 1, f) == 1
+    && !memcmp(hdr.magic, RASTER_INDEX_MAGIC, 8)
+    && hdr.version == RASTER_INDEX_VERSION
+    && hdr.size == st->st_size
+    && hdr.mtime == st->st_mtime
+    && hdr.count >= 0
+    && raster_index_alloc(ri, hdr.count))
+  {
+    size_t n = (size_t)hdr.count;
+    ok =
+      fread(ri->offset, sizeof(int64_t), n, f) == n &&
+      fread(ri->pulses, sizeof(int32_t), n, f) == n &&
+      fread(ri->cumulative, sizeof(int64_t), n+1, f) == n+1;
+  }
+
+  fclose(f);
+  if(!ok)
+  {
+    raster_index_free(ri);
+    memset(ri, 0, sizeof(raster_index_t));
+  }
+  return ok;
+}
+
+/* raster_index_write
+ * Internal function. Writes RI to SIDECAR. The index is written to a
+ * temporary file first and then renamed into place, so that concurrent
+ * readers never see a partial index. Failures are silently ignored.
+ */
+static void raster_index_write(raster_index_t *ri, const char *sidecar,
+  struct stat *st)
+{
+  raster_index_header_t hdr;
+  size_t len = strlen(sidecar) + 32;
+  size_t n = (size_t)ri->count;
+  char *tmp = malloc(len);
+  FILE *f;
+  int ok;
+
+  if(!tmp) return;
+  snprintf(tmp, len, "%s.%ld", sidecar, (long)getpid());
+
+  f = fopen(tmp, "wb");
+  if(!f)
+  {
+    free(tmp);
+    return;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, RASTER_INDEX_MAGIC, 8);
+  hdr.version = RASTER_INDEX_VERSION;
+  hdr.size = st->st_size;
+  hdr.mtime = st->st_mtime;
+  hdr.count = ri->count;
+
+  ok =
+    fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+    fwrite(ri->offset, sizeof(int64_t), n, f) == n &&
+    fwrite(ri->pulses, sizeof(int32_t), n, f) == n &&
+    fwrite(ri->cumulative, sizeof(int64_t), n+1, f) == n+1;
+  ok = !fclose(f) && ok;
+
+  if(!ok || rename(tmp, sidecar)) remove(tmp);
+  free(tmp);
+}
+
+/* raster_index_build
+ * Internal function. Walks the raster headers in FB to populate RI, starting
+ * at byte OFFSET and stopping once a raster would start at or after STOP.
+ */
+static void raster_index_build(raster_index_t *ri, filebuffer_t *fb,
+  long offset, long stop)
+{
+  long size = filebuffer_size(fb);
+  long rlen = 0, cap = 1024, count = 0;
+
+  if(!raster_index_alloc(ri, cap)) y_error("unable to allocate raster index");
+  ri->cumulative[0] = 0;
+
+  // This mirrors the counting pass in eaarl_decode_fast: invalid rasters are
+  // stepped over, and a zero-length raster ends the walk.
+  if(stop > size) stop = size;
+  while(offset < stop && offset + 3 <= size)
+  {
+    rlen = filebuffer_i24(fb, offset);
+    if(!rlen) break;
+
+    if(count == cap)
+    {
+      int64_t *o, *c;
+      int32_t *p;
+      cap *= 2;
+      o = realloc(ri->offset, sizeof(int64_t) * cap);
+      if(o) ri->offset = o;
+      p = realloc(ri->pulses, sizeof(int32_t) * cap);
+      if(p) ri->pulses = p;
+      c = realloc(ri->cumulative, sizeof(int64_t) * (cap + 1));
+      if(c) ri->cumulative = c;
+      if(!o || !p || !c) y_error("unable to allocate raster index");
+    }
+
+    ri->offset[count] = offset;
+    ri->pulses[count] = 0;
+    if(rlen >= 18 && offset + 18 <= size && filebuffer_i8(fb, offset+3) == 5)
+      ri->pulses[count] = filebuffer_i16(fb, offset+16) & 0x7fff;
+    ri->cumulative[count+1] = ri->cumulative[count] + ri->pulses[count];
+
+    count++;
+    offset += rlen;
+  }
+
+  ri->count = count;
+}
+
+// API methods, see raster_index.h for documentation
+
+raster_index_t * raster_index_load(const char *fn, filebuffer_t *fb, int save)
+{
+  struct stat st;
+  raster_index_t *ri = ypush_scratch(sizeof(raster_index_t),
+    raster_index_free);
+  memset(ri, 0, sizeof(raster_index_t));
+
+  if(stat(fn, &st)) y_error("unable to stat file");
+
+  char sidecar[strlen(fn) + sizeof(RASTER_INDEX_EXT)];
+  strcpy(sidecar, fn);
+  strcat(sidecar, RASTER_INDEX_EXT);
+
+  if(!raster_index_read(ri, sidecar, &st))
+  {
+    raster_index_build(ri, fb, 0, filebuffer_size(fb));
+    if(save) raster_index_write(ri, sidecar, &st);
+  }
+
+  return ri;
+}
+
+raster_index_t * raster_index_scan(filebuffer_t *fb, long start, long stop)
+{
+  raster_index_t *ri = ypush_scratch(sizeof(raster_index_t),
+    raster_index_free);
+  memset(ri, 0, sizeof(raster_index_t));
+  raster_index_build(ri, fb, start, stop);
+  return ri;
+}
+
+long raster_index_find(raster_index_t *ri, long offset)
+{
+  long i = raster_index_bound(ri, offset);
+  return (i < ri->count && ri->offset[i] == offset) ? i : -1;
+}
+
+long raster_index_bound(raster_index_t *ri, long offset)
+{
+  long lo = 0, hi = ri->count, mid;
+  while(lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if(ri->offset[mid] < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
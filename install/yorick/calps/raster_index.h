@@ -0,0 +1,87 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#ifndef RASTER_INDEX_H
+#define RASTER_INDEX_H
+
+#include <stdint.h>
+#include "filebuffer.h"
+
+/* raster_index library
+ *
+ * This provides a per-TLD index of raster offsets and pulse counts. It allows
+ * callers to determine how many pulses are in a range of rasters, and where
+ * each raster starts, without walking the raster headers in the file.
+ *
+ * The index is built lazily the first time it is requested for a TLD file by
+ * walking the raster headers with the same rules as the counting pass in
+ * eaarl_decode_fast. It is then saved alongside the TLD file as a sidecar
+ * file (the TLD's filename with RASTER_INDEX_EXT appended). Later requests
+ * read the sidecar instead, as long as the file size and modification time
+ * recorded in it still match the TLD file. If the sidecar cannot be written
+ * (for instance, because the directory is read-only), the index is still
+ * built and returned; it just isn't saved.
+ *
+ * The sidecar is a cache, not an interchange format: it is written in native
+ * byte order and is rebuilt whenever it doesn't look right.
+ *
+ * Warning: raster_index_load places an item on the Yorick stack to
+ * dynamically allocate memory. See the documentation below for details.
+ */
+
+// Extension appended to the TLD filename to name the sidecar index
+#define RASTER_INDEX_EXT ".ridx"
+
+// Version of the sidecar format; bump if the layout changes
+#define RASTER_INDEX_VERSION 1
+
+typedef struct raster_index_t
+{
+  // Number of rasters in the index
+  int64_t count;
+  // Byte offset (0-based) where each raster starts; COUNT entries
+  int64_t *offset;
+  // Number of pulses claimed by each raster's header, or 0 for rasters that
+  // are not waveform rasters; COUNT entries
+  int32_t *pulses;
+  // Number of pulses in all rasters prior to each raster; COUNT+1 entries, so
+  // that cumulative[count] is the total number of pulses in the file
+  int64_t *cumulative;
+} raster_index_t;
+
+/* raster_index_load
+ *
+ * Returns the raster index for file FN, whose contents are accessible via the
+ * filebuffer handle FB. If SAVE is non-zero and the sidecar index is missing
+ * or stale, a new one is written.
+ *
+ * This pushes one entry onto the Yorick stack to allocate the memory for the
+ * index. The index's memory is released when Yorick releases that entry.
+ */
+raster_index_t * raster_index_load(const char *fn, filebuffer_t *fb, int save);
+
+/* raster_index_scan
+ *
+ * Returns an index covering only the rasters in FB that start in the byte
+ * range START (inclusive) through STOP (exclusive), both 0-based. This walks
+ * the raster headers directly and never touches the sidecar file; it is
+ * intended for ranges that do not start on a boundary known to the full
+ * index.
+ *
+ * This pushes one entry onto the Yorick stack to allocate the memory for the
+ * index, as with raster_index_load.
+ */
+raster_index_t * raster_index_scan(filebuffer_t *fb, long start, long stop);
+
+/* raster_index_find
+ * Returns the index of the raster that starts at byte OFFSET (0-based), or -1
+ * if no raster starts there.
+ */
+long raster_index_find(raster_index_t *ri, long offset);
+
+/* raster_index_bound
+ * Returns the index of the first raster that starts at or after byte OFFSET
+ * (0-based). Returns ri->count if there is none.
+ */
+long raster_index_bound(raster_index_t *ri, long offset);
+
+#endif
@@ -0,0 +1,126 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+#include <stdio.h>
+#include <string.h>
+#include "yapi.h"
+#include "pulses_exec.h"
+
+// How many samples into the waveform to look, as in eaarl_sb_rx_wf
+#define SB_RX_MAX_SAMPLES 20
+
+// Shallow bathy conf values, for one channel
+typedef struct sb_conf_t
+{
+  double thresh;
+} sb_conf_t;
+
+// Output columns, in the order of sb_rx_columns
+#define SB_RX_LRX 0
+#define SB_RX_LINTENSITY 1
+#define SB_RX_RETS 2
+
+static const pulses_column_t sb_rx_columns[] = {
+  {"lrx", Y_FLOAT}, {"lintensity", Y_FLOAT}, {"rets", Y_CHAR}, {NULL, 0}
+};
+
+/* sb_rx_wf
+ * Equivalent to eaarl_sb_rx_wf in process_sb.i (without plotting): finds the
+ * last return in the first SB_RX_MAX_SAMPLES samples of waveform RAW of length
+ * N using conf C. WORK must have room for 2*N doubles. Indices noted as
+ * 1-based match the Yorick code.
+ */
+static void sb_rx_wf(const unsigned char *raw, long n, const sb_conf_t *c,
+  double *work, float *lrx, float *lintensity, char *rets)
+{
+  double *wf, *wfd1;
+  double bias;
+  long i, nedges = 0, edge = 0, ret_len, rx;
+
+  *lrx = *lintensity = 0;
+  *rets = 0;
+  if(n < 1) return;
+
+  // Invert and remove bias: the lowest of the first 15 samples
+  bias = (unsigned char)~raw[0];
+  for(i = 1; i < n && i < 15; i++)
+    if((unsigned char)~raw[i] < bias) bias = (unsigned char)~raw[i];
+
+  if(n > SB_RX_MAX_SAMPLES) n = SB_RX_MAX_SAMPLES;
+  wf = work;
+  wfd1 = work + n;
+  for(i = 0; i < n; i++)
+    wf[i] = (double)(unsigned char)~raw[i] - bias;
+
+  // First derivative
+  for(i = 0; i < n - 1; i++)
+    wfd1[i] = wf[i+1] - wf[i];
+
+  // Leading edges: where the derivative first reaches the threshold. EDGE is
+  // the 1-based index of the last one.
+  for(i = 1; i < n - 1; i++)
+  {
+    if(wfd1[i] >= c->thresh && !(wfd1[i-1] >= c->thresh))
+    {
+      nedges++;
+      edge = i;
+    }
+  }
+  *rets = nedges;
+
+  if(!nedges)
+  {
+    double max = wf[0];
+    for(i = 1; i < n; i++)
+      if(wf[i] > max) max = wf[i];
+    *lintensity = max;
+    return;
+  }
+
+  // Assume 18ns to be the longest duration for a complete last return, but
+  // truncate based on length of waveform.
+  ret_len = n - edge - 1;
+  if(ret_len > 18) ret_len = 18;
+
+  // Noise pulses
+  if(ret_len < 5) return;
+
+  // Find where the bottom return changes direction after its trailing edge
+  for(i = 0; i < ret_len; i++)
+  {
+    if(wfd1[edge + i] < 0)
+    {
+      rx = edge + i + 1;
+      *lrx = rx;
+      *lintensity = wf[rx - 1];
+      return;
+    }
+  }
+}
+
+static void sb_rx_pulse(const pulses_exec_t *x, int thread, long i,
+  const unsigned char *wf, long n, const void *conf, double *work)
+{
+  sb_rx_wf(wf, n, conf, work, (float *)x->col[SB_RX_LRX] + i,
+    (float *)x->col[SB_RX_LINTENSITY] + i, (char *)x->col[SB_RX_RETS] + i);
+}
+
+static void sb_rx_read_conf(pulses_exec_t *x, void *obj, yo_ops_t *ops)
+{
+  sb_conf_t *conf = x->conf;
+  double thresh[4];
+  long chan;
+  pulses_exec_conf_d(obj, ops, "thresh", thresh);
+  for(chan = 0; chan < 4; chan++)
+    conf[chan].thresh = thresh[chan];
+}
+
+// Channels are selected as eaarl_sb_rx_eaarla_channel does in process_sb.i
+const pulses_kernel_t sb_rx_kernel = {
+  "sb", sb_rx_columns, sizeof(sb_conf_t), 2, sb_rx_read_conf,
+  pulses_exec_select_sfc, NULL, sb_rx_pulse, pulses_exec_finish_had
+};
+
+void Y_eaarl_sb_rx_batch(int nArgs)
+{
+  pulses_exec_builtin(&sb_rx_kernel, nArgs);
+}
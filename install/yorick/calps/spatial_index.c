@@ -0,0 +1,610 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements a spatial index over x/y points, for neighborhood searches
+ * that would otherwise scan every point for every query:
+ *
+ *    index = spatial_index(x, y, bucket=)
+ *    list = spatial_index_radius(index, xp, yp, radius, &start)
+ *    list = spatial_index_box(index, xmin, xmax, ymin, ymax, &start)
+ *    idx = spatial_index_nearest(index, xp, yp, &dist, k=)
+ *
+ * The points are binned into a uniform grid of square buckets, stored bucket
+ * by bucket (a counting sort, so each bucket keeps its points in their
+ * original order). Radius and box queries only look at the buckets that
+ * overlap the query's bounding box; nearest neighbor queries visit rings of
+ * buckets around the query until nothing farther out could be closer.
+ *
+ * Radius and box queries return the matches for all of their queries as a
+ * single list of 1-based indices, with the matches for query i at
+ * list(start(i):start(i+1)-1), like a compressed sparse row matrix. Each
+ * query's matches are in ascending order, the same order where gives.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yapi.h"
+
+// Points per bucket to aim for when picking the default bucket size
+#define SPATIAL_INDEX_PER_BUCKET 4
+
+typedef struct spatial_index_t
+{
+  long npoints;     // size of the x and y arrays indexed
+  long count;       // points with finite coordinates, which are indexed
+  double xmin, ymin, bucket;
+  long nx, ny;
+  // Points in bucket b are item[start[b]] through item[start[b+1]-1]
+  long *start;
+  long *item;       // 0-based index into the original arrays
+  double *x, *y;    // coordinates, in the same order as item
+} spatial_index_t;
+
+static void spatial_index_free(void *ptr)
+{
+  spatial_index_t *si = ptr;
+  if(si->start) free(si->start);
+  if(si->item) free(si->item);
+  if(si->x) free(si->x);
+  if(si->y) free(si->y);
+}
+
+static void spatial_index_print(void *ptr)
+{
+  spatial_index_t *si = ptr;
+  char buf[160];
+  snprintf(buf, sizeof(buf),
+    "spatial_index: %ld points in %ld x %ld buckets of size %g",
+    si->count, si->nx, si->ny, si->bucket);
+  y_print(buf, 1);
+}
+
+static void spatial_index_extract(void *ptr, char *name)
+{
+  spatial_index_t *si = ptr;
+  if(!strcmp(name, "count")) ypush_long(si->count);
+  else if(!strcmp(name, "npoints")) ypush_long(si->npoints);
+  else if(!strcmp(name, "bucket")) ypush_double(si->bucket);
+  else if(!strcmp(name, "nx")) ypush_long(si->nx);
+  else if(!strcmp(name, "ny")) ypush_long(si->ny);
+  else y_errorq("spatial_index has no member %s", name);
+}
+
+static y_userobj_t spatial_index_ops = {
+  "spatial_index",
+  &spatial_index_free,
+  &spatial_index_print,
+  0,
+  &spatial_index_extract,
+  0
+};
+
+/* spatial_index_cell
+ * Returns the bucket column (or row) for coordinate V, given the grid's
+ * minimum MIN, bucket size, and number of columns N, clamped to the grid.
+ */
+static inline long spatial_index_cell(const spatial_index_t *si, double v,
+  double min, long n)
+{
+  double c = floor((v - min) / si->bucket);
+  if(!(c > 0)) return 0;
+  if(c >= n - 1) return n - 1;
+  return (long)c;
+}
+
+/* spatial_index_build
+ * Bins the COUNT points X, Y into SI using buckets of size BUCKET, or a size
+ * picked from the points' density if BUCKET is not positive. Returns 0 if
+ * memory could not be allocated.
+ */
+static int spatial_index_build(spatial_index_t *si, const double *x,
+  const double *y, long count, double bucket)
+{
+  long i, b, nb;
+  double xmin = 0, xmax = 0, ymin = 0, ymax = 0;
+
+  si->npoints = count;
+  si->count = 0;
+  for(i = 0; i < count; i++)
+  {
+    if(!isfinite(x[i]) || !isfinite(y[i])) continue;
+    if(!si->count)
+    {
+      xmin = xmax = x[i];
+      ymin = ymax = y[i];
+    }
+    if(x[i] < xmin) xmin = x[i];
+    if(x[i] > xmax) xmax = x[i];
+    if(y[i] < ymin) ymin = y[i];
+    if(y[i] > ymax) ymax = y[i];
+    si->count++;
+  }
+
+  double w = xmax - xmin, h = ymax - ymin;
+  if(!(bucket > 0) || !isfinite(bucket))
+  {
+    if(w > 0 && h > 0)
+      bucket = sqrt(w * h / si->count * SPATIAL_INDEX_PER_BUCKET);
+    else
+      bucket = (w > h ? w : h) / si->count * SPATIAL_INDEX_PER_BUCKET;
+    if(!(bucket > 0)) bucket = 1;
+  }
+
+  // Keep the number of buckets proportional to the number of points, so that
+  // a small bucket over a wide area can't exhaust memory
+  double maxb = 4. * si->count * SPATIAL_INDEX_PER_BUCKET + 16;
+  while((floor(w / bucket) + 1) * (floor(h / bucket) + 1) > maxb)
+    bucket *= 2;
+
+  si->xmin = xmin;
+  si->ymin = ymin;
+  si->bucket = bucket;
+  si->nx = (long)floor(w / bucket) + 1;
+  si->ny = (long)floor(h / bucket) + 1;
+  nb = si->nx * si->ny;
+
+  si->start = calloc(nb + 1, sizeof(long));
+  si->item = malloc(sizeof(long) * (si->count ? si->count : 1));
+  si->x = malloc(sizeof(double) * (si->count ? si->count : 1));
+  si->y = malloc(sizeof(double) * (si->count ? si->count : 1));
+  long *bin = malloc(sizeof(long) * (si->count ? si->count : 1));
+  if(!si->start || !si->item || !si->x || !si->y || !bin)
+  {
+    if(bin) free(bin);
+    return 0;
+  }
+
+  // Count the points in each bucket, then turn the counts into offsets
+  long j = 0;
+  for(i = 0; i < count; i++)
+  {
+    if(!isfinite(x[i]) || !isfinite(y[i])) continue;
+    b = spatial_index_cell(si, y[i], ymin, si->ny) * si->nx +
+      spatial_index_cell(si, x[i], xmin, si->nx);
+    bin[j++] = b;
+    si->start[b+1]++;
+  }
+  for(b = 0; b < nb; b++)
+    si->start[b+1] += si->start[b];
+
+  // Place each point, using start[b] as the fill position for bucket b
+  j = 0;
+  for(i = 0; i < count; i++)
+  {
+    if(!isfinite(x[i]) || !isfinite(y[i])) continue;
+    b = bin[j++];
+    si->item[si->start[b]] = i;
+    si->x[si->start[b]] = x[i];
+    si->y[si->start[b]] = y[i];
+    si->start[b]++;
+  }
+  // Each start[b] is now where bucket b+1 begins; shift them back
+  for(b = nb; b > 0; b--)
+    si->start[b] = si->start[b-1];
+  si->start[0] = 0;
+
+  free(bin);
+  return 1;
+}
+
+void Y_spatial_index(int nArgs)
+{
+  static char *knames[2] = {"bucket", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[2];
+  double bucket = 0;
+  long count, ny;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  iarg[1] = iarg[0] == -1 ? -1 : yarg_kw(iarg[0]-1, kglobs, kiargs);
+  if(iarg[1] == -1 || yarg_kw(iarg[1]-1, kglobs, kiargs) != -1)
+    y_error("must provide 2 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+    bucket = ygets_d(kiargs[0]);
+
+  if(!yarg_number(iarg[0])) y_error("x must be numeric");
+  if(!yarg_number(iarg[1])) y_error("y must be numeric");
+  double *x = ygeta_d(iarg[0], &count, 0);
+  double *y = ygeta_d(iarg[1], &ny, 0);
+  if(count != ny) y_error("x and y must have the same number of values");
+
+  // stack + 1 = +1
+  spatial_index_t *si = ypush_obj(&spatial_index_ops, sizeof(spatial_index_t));
+  memset(si, 0, sizeof(spatial_index_t));
+  if(!spatial_index_build(si, x, y, count, bucket))
+    y_error("unable to allocate spatial index");
+}
+
+// Growable list of 0-based indices for the results of radius and box queries
+typedef struct spatial_list_t
+{
+  long *v;
+  long n, cap;
+} spatial_list_t;
+
+static int spatial_list_push(spatial_list_t *l, long v)
+{
+  if(l->n == l->cap)
+  {
+    long cap = l->cap ? 2 * l->cap : 1024;
+    long *nv = realloc(l->v, sizeof(long) * cap);
+    if(!nv) return 0;
+    l->v = nv;
+    l->cap = cap;
+  }
+  l->v[l->n++] = v;
+  return 1;
+}
+
+static int spatial_list_cmp(const void *a, const void *b)
+{
+  long la = *(const long *)a, lb = *(const long *)b;
+  return la < lb ? -1 : la > lb;
+}
+
+/* spatial_index_query
+ * Adds to L the points of SI inside the box BX0..BX1 by BY0..BY1 (inclusive)
+ * and, if R is not negative, within distance R of QX, QY. The points added
+ * are sorted. Returns 0 if memory ran out.
+ */
+static int spatial_index_query(const spatial_index_t *si, spatial_list_t *l,
+  double bx0, double bx1, double by0, double by1,
+  double qx, double qy, double r)
+{
+  long i, j, k, first = l->n, buckets = 0;
+
+  if(!si->count) return 1;
+  if(!(bx0 <= bx1) || !(by0 <= by1)) return 1;
+  if(bx1 < si->xmin || by1 < si->ymin) return 1;
+
+  long i0 = spatial_index_cell(si, bx0, si->xmin, si->nx);
+  long i1 = spatial_index_cell(si, bx1, si->xmin, si->nx);
+  long j0 = spatial_index_cell(si, by0, si->ymin, si->ny);
+  long j1 = spatial_index_cell(si, by1, si->ymin, si->ny);
+
+  for(j = j0; j <= j1; j++)
+  {
+    for(i = i0; i <= i1; i++)
+    {
+      long b = j * si->nx + i;
+      long stop = si->start[b+1];
+      if(si->start[b] < stop) buckets++;
+      for(k = si->start[b]; k < stop; k++)
+      {
+        double px = si->x[k], py = si->y[k];
+        if(px < bx0 || px > bx1 || py < by0 || py > by1) continue;
+        if(r >= 0)
+        {
+          // Yorick's (dx^2 + dy^2)^.5 <= r, which is pow rather than sqrt
+          double dx = qx - px, dy = qy - py;
+          if(!(pow(dx*dx + dy*dy, .5) <= r)) continue;
+        }
+        if(!spatial_list_push(l, si->item[k])) return 0;
+      }
+    }
+  }
+
+  // Points from a single bucket are already in order; short lists (the usual
+  // case) are cheaper to insertion sort than to qsort
+  long n = l->n - first, *v = l->v + first;
+  if(buckets < 2 || n < 2) return 1;
+  if(n > 32)
+  {
+    qsort(v, n, sizeof(long), spatial_list_cmp);
+    return 1;
+  }
+  for(i = 1; i < n; i++)
+  {
+    long t = v[i];
+    for(j = i; j > 0 && v[j-1] > t; j--)
+      v[j] = v[j-1];
+    v[j] = t;
+  }
+  return 1;
+}
+
+/* spatial_index_values
+ * Retrieves argument IARG as an array of doubles that has either one value or
+ * COUNT values; STEP is set to 0 or 1 accordingly.
+ */
+static double * spatial_index_values(int iarg, long count, long *step,
+  const char *name)
+{
+  long n;
+  if(!yarg_number(iarg)) y_errorq("%s must be numeric", name);
+  double *v = ygeta_d(iarg, &n, 0);
+  if(n != 1 && n != count) y_errorq("%s is not conformable", name);
+  *step = n > 1;
+  return v;
+}
+
+/* spatial_index_results
+ * Finishes a radius or box query: stores the 1-based offsets for the COUNT
+ * queries into the variable REF (if REF >= 0), then pushes the list in L (or
+ * nil if empty) and frees it.
+ */
+static void spatial_index_results(spatial_list_t *l, long *offset,
+  long count, long ref)
+{
+  long i, dims[Y_DIMSIZE];
+
+  if(ref >= 0)
+  {
+    dims[0] = 1;
+    dims[1] = count + 1;
+    // stack + 1 = +1
+    long *start = ypush_l(dims);
+    for(i = 0; i <= count; i++)
+      start[i] = offset[i] + 1;
+    yput_global(ref, 0);
+    // stack - 1 = +0
+    yarg_drop(1);
+  }
+
+  if(!l->n)
+  {
+    if(l->v) free(l->v);
+    // stack + 1 = +1
+    ypush_nil();
+    return;
+  }
+
+  dims[0] = 1;
+  dims[1] = l->n;
+  // stack + 1 = +1
+  long *list = ypush_l(dims);
+  for(i = 0; i < l->n; i++)
+    list[i] = l->v[i] + 1;
+  free(l->v);
+}
+
+void Y_spatial_index_radius(int nArgs)
+{
+  long count = 1, n, ref = -1, step[3], i, k;
+  double *val[3];
+  static const char *names[3] = {"xp", "yp", "radius"};
+
+  if(nArgs != 4 && nArgs != 5)
+    y_error("must provide 4 or 5 arguments");
+  if(nArgs == 5)
+  {
+    ref = yget_ref(0);
+    if(ref < 0) y_error("start must be a simple variable");
+  }
+
+  spatial_index_t *si = yget_obj(nArgs-1, &spatial_index_ops);
+  for(k = 0; k < 3; k++)
+  {
+    if(!yarg_number(nArgs-2-k)) y_errorq("%s must be numeric", names[k]);
+    ygeta_d(nArgs-2-k, &n, 0);
+    if(n > count) count = n;
+  }
+  for(k = 0; k < 3; k++)
+    val[k] = spatial_index_values(nArgs-2-k, count, &step[k], names[k]);
+
+  long *offset = ypush_scratch(sizeof(long) * (count + 1), 0);
+  spatial_list_t l = {0, 0, 0};
+
+  offset[0] = 0;
+  for(i = 0; i < count; i++)
+  {
+    double qx = val[0][i*step[0]], qy = val[1][i*step[1]];
+    double r = fabs(val[2][i*step[2]]);
+    if(!spatial_index_query(si, &l, qx - r, qx + r, qy - r, qy + r, qx, qy,
+      r))
+    {
+      if(l.v) free(l.v);
+      y_error("unable to allocate query results");
+    }
+    offset[i+1] = l.n;
+  }
+
+  spatial_index_results(&l, offset, count, ref);
+}
+
+void Y_spatial_index_box(int nArgs)
+{
+  long count = 1, n, ref = -1, step[4], i, k;
+  double *bound[4];
+  static const char *names[4] = {"xmin", "xmax", "ymin", "ymax"};
+
+  if(nArgs != 5 && nArgs != 6)
+    y_error("must provide 5 or 6 arguments");
+  if(nArgs == 6)
+  {
+    ref = yget_ref(0);
+    if(ref < 0) y_error("start must be a simple variable");
+  }
+
+  spatial_index_t *si = yget_obj(nArgs-1, &spatial_index_ops);
+  for(k = 0; k < 4; k++)
+  {
+    if(!yarg_number(nArgs-2-k)) y_errorq("%s must be numeric", names[k]);
+    ygeta_d(nArgs-2-k, &n, 0);
+    if(n > count) count = n;
+  }
+  for(k = 0; k < 4; k++)
+    bound[k] = spatial_index_values(nArgs-2-k, count, &step[k], names[k]);
+
+  long *offset = ypush_scratch(sizeof(long) * (count + 1), 0);
+  spatial_list_t l = {0, 0, 0};
+
+  offset[0] = 0;
+  for(i = 0; i < count; i++)
+  {
+    if(!spatial_index_query(si, &l, bound[0][i*step[0]], bound[1][i*step[1]],
+      bound[2][i*step[2]], bound[3][i*step[3]], 0, 0, -1))
+    {
+      if(l.v) free(l.v);
+      y_error("unable to allocate query results");
+    }
+    offset[i+1] = l.n;
+  }
+
+  spatial_index_results(&l, offset, count, ref);
+}
+
+/* spatial_index_knn
+ * Finds the K points of SI nearest QX, QY, storing their 0-based indices in
+ * IDX and squared distances in D2, nearest first (ties go to the lower
+ * index). Slots beyond the number of points available are left as -1.
+ */
+static void spatial_index_knn(const spatial_index_t *si, double qx,
+  double qy, long k, long *idx, double *d2)
+{
+  long i, j, r, n = 0;
+
+  for(i = 0; i < k; i++)
+  {
+    idx[i] = -1;
+    d2[i] = 0;
+  }
+  if(!si->count || !isfinite(qx) || !isfinite(qy)) return;
+
+  long cx = spatial_index_cell(si, qx, si->xmin, si->nx);
+  long cy = spatial_index_cell(si, qy, si->ymin, si->ny);
+  // Keep rings from being considered finished early due to rounding in the
+  // bucket boundaries
+  double slop = si->bucket * 1e-9;
+
+  for(r = 0; ; r++)
+  {
+    long j0 = cy - r, j1 = cy + r, i0 = cx - r, i1 = cx + r;
+    for(j = j0 < 0 ? 0 : j0; j <= j1 && j < si->ny; j++)
+    {
+      long step = (j == j0 || j == j1) ? 1 : i1 - i0;
+      for(i = i0; i <= i1; i += step)
+      {
+        if(i < 0 || i >= si->nx) continue;
+        long b = j * si->nx + i, p;
+        for(p = si->start[b]; p < si->start[b+1]; p++)
+        {
+          double dx = qx - si->x[p], dy = qy - si->y[p];
+          double d = dx*dx + dy*dy;
+          long item = si->item[p], m;
+
+          if(n == k && (d > d2[k-1] || (d == d2[k-1] && item > idx[k-1])))
+            continue;
+
+          // Insert in order of distance, then index
+          m = n < k ? n++ : k - 1;
+          while(m > 0 && (d < d2[m-1] || (d == d2[m-1] && item < idx[m-1])))
+          {
+            d2[m] = d2[m-1];
+            idx[m] = idx[m-1];
+            m--;
+          }
+          d2[m] = d;
+          idx[m] = item;
+        }
+      }
+    }
+
+    // Distance from the query to the nearest bucket outside this ring that
+    // still has part of the grid in it
+    double bound = -1, e;
+    if(i0 > 0)
+    {
+      e = qx - (si->xmin + i0 * si->bucket);
+      if(bound < 0 || e < bound) bound = e;
+    }
+    if(i1 < si->nx - 1)
+    {
+      e = si->xmin + (i1 + 1) * si->bucket - qx;
+      if(bound < 0 || e < bound) bound = e;
+    }
+    if(j0 > 0)
+    {
+      e = qy - (si->ymin + j0 * si->bucket);
+      if(bound < 0 || e < bound) bound = e;
+    }
+    if(j1 < si->ny - 1)
+    {
+      e = si->ymin + (j1 + 1) * si->bucket - qy;
+      if(bound < 0 || e < bound) bound = e;
+    }
+
+    // Every bucket has been visited
+    if(bound < 0) break;
+
+    bound -= slop;
+    if(n == k && bound > 0 && d2[k-1] < bound * bound) break;
+  }
+}
+
+void Y_spatial_index_nearest(int nArgs)
+{
+  static char *knames[2] = {"k", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[4], i;
+  long k = 1, count, ny, ref = -1, dims[Y_DIMSIZE], q, j;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 4; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[2] == -1 || (iarg[3] != -1 &&
+    yarg_kw(iarg[3]-1, kglobs, kiargs) != -1))
+    y_error("must provide 3 or 4 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+    k = ygets_l(kiargs[0]);
+  if(k < 1) y_error("k= must be at least 1");
+
+  if(iarg[3] != -1)
+  {
+    ref = yget_ref(iarg[3]);
+    if(ref < 0) y_error("dist must be a simple variable");
+  }
+
+  spatial_index_t *si = yget_obj(iarg[0], &spatial_index_ops);
+  if(!yarg_number(iarg[1])) y_error("xp must be numeric");
+  if(!yarg_number(iarg[2])) y_error("yp must be numeric");
+  double *xp = ygeta_d(iarg[1], &count, dims);
+  double *yp = ygeta_d(iarg[2], &ny, 0);
+  if(count != ny) y_error("xp and yp must have the same number of values");
+
+  // For k > 1, each query's results run along a new leading dimension
+  if(k > 1)
+  {
+    if(dims[0] >= Y_DIMSIZE - 1) y_error("too many dimensions");
+    for(j = dims[0]; j > 0; j--)
+      dims[j+1] = dims[j];
+    dims[1] = k;
+    dims[0]++;
+  }
+
+  // stack + 2 = +2
+  long *idx = ypush_l(dims);
+  double *dist = ypush_d(dims);
+
+  for(q = 0; q < count; q++)
+  {
+    long *qi = idx + q * k;
+    double *qd = dist + q * k;
+    spatial_index_knn(si, xp[q], yp[q], k, qi, qd);
+    for(j = 0; j < k; j++)
+    {
+      if(qi[j] < 0)
+      {
+        qi[j] = 0;
+        qd[j] = -1;
+      }
+      else
+      {
+        qi[j]++;
+        // pow, so the distance can be passed back in as a radius
+        qd[j] = pow(qd[j], .5);
+      }
+    }
+  }
+
+  if(ref >= 0) yput_global(ref, 0);
+  // stack - 1 = +1
+  yarg_drop(1);
+}
@@ -0,0 +1,240 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements eaarl_trajectory_interp, which interpolates all of the
+ * trajectory values eaarl_fs_trajectory needs in one pass:
+ *
+ *    traj = eaarl_trajectory_interp(sod, ins_sod, roll, pitch, heading,
+ *      gps_sod, alt, north, east, roll_bias=, pitch_bias=, yaw_bias=)
+ *
+ * INS_SOD and GPS_SOD must be ascending. SOD may be in any order, but is
+ * handled in linear time when it is sorted or nearly so: each track keeps a
+ * cursor that follows SOD, moving by galloping search (doubling steps, then
+ * bisection), so a run of ascending values is a merge and an out of order
+ * value costs a search proportional to the log of how far back it jumps.
+ */
+
+#include <math.h>
+#include "constants.h"
+#include "yapi.h"
+
+typedef struct traj_track_t
+{
+  const double *x;
+  long count;
+  // Cursor: x[b] <= xp < x[b+1] for the last value located
+  long b;
+} traj_track_t;
+
+/* traj_locate
+ * Moves the cursor of track T to the interval containing XP, which must be
+ * within the track's bounds. Returns the lower index B of that interval, with
+ * x[b] <= xp < x[b+1], or count-2 if XP is the last value.
+ */
+static long traj_locate(traj_track_t *t, double xp)
+{
+  const double *x = t->x;
+  long lo, hi, mid, step, last = t->count - 2;
+  long b = t->b;
+
+  if(xp >= x[b])
+  {
+    // Gallop forward
+    lo = b;
+    step = 1;
+    hi = b + step;
+    while(hi <= last && x[hi] <= xp)
+    {
+      lo = hi;
+      step *= 2;
+      hi = b + step;
+    }
+    if(hi > last + 1) hi = last + 1;
+  }
+  else
+  {
+    // Gallop backward
+    hi = b;
+    step = 1;
+    lo = b - step;
+    while(lo > 0 && x[lo] > xp)
+    {
+      hi = lo;
+      step *= 2;
+      lo = b - step;
+    }
+    if(lo < 0) lo = 0;
+  }
+
+  // Now x[lo] <= xp and either hi == last+1 or xp < x[hi]
+  while(hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+    if(x[mid] <= xp)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  if(lo > last) lo = last;
+  t->b = lo;
+  return lo;
+}
+
+/* traj_interp
+ * Linear interpolation, as interp does, between Y[B] and Y[B+1].
+ */
+static double traj_interp(const double *y, const double *x, long b,
+  double xp)
+{
+  double ratio = (xp - x[b]) / (x[b+1] - x[b]);
+  return y[b] + ratio * (y[b+1] - y[b]);
+}
+
+/* traj_interp_angle
+ * As traj_interp, but for angles in degrees, as interp_angles does: when the
+ * two angles are more than pi radians apart, their sines and cosines are
+ * interpolated instead so that the result doesn't wrap the wrong way.
+ */
+static double traj_interp_angle(const double *y, const double *x, long b,
+  double xp)
+{
+  double ratio = (xp - x[b]) / (x[b+1] - x[b]);
+  double y1 = y[b] * DEG2RAD, y2 = y[b+1] * DEG2RAD;
+  if(fabs(y1 - y2) > PI)
+  {
+    double c1 = cos(y1), c2 = cos(y2), s1 = sin(y1), s2 = sin(y2);
+    return atan2(s1 + ratio * (s2 - s1), c1 + ratio * (c2 - c1)) * RAD2DEG;
+  }
+  return (y1 + ratio * (y2 - y1)) * RAD2DEG;
+}
+
+/* traj_arg
+ * Retrieves argument IARG as an array of doubles with COUNT values.
+ */
+static double * traj_arg(int iarg, long count, const char *name)
+{
+  long n;
+  if(!yarg_number(iarg))
+    y_errorq("%s must be numeric", name);
+  double *val = ygeta_d(iarg, &n, 0);
+  if(n != count)
+    y_errorq("%s must match the size of its times", name);
+  return val;
+}
+
+void Y_eaarl_trajectory_interp(int nArgs)
+{
+  static char *knames[4] = {"roll_bias", "pitch_bias", "yaw_bias", 0};
+  static long kglobs[4];
+  int kiargs[3];
+  int iarg[9], i;
+  double bias[3] = {0, 0, 0};
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 9; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[8] == -1 || yarg_kw(iarg[8]-1, kglobs, kiargs) != -1)
+    y_error("must provide 9 arguments");
+
+  for(i = 0; i < 3; i++)
+  {
+    if(kiargs[i] == -1 || yarg_nil(kiargs[i])) continue;
+    if(!yarg_number(kiargs[i]) || yarg_rank(kiargs[i]) != 0)
+      y_errorq("%s= must be a scalar number", knames[i]);
+    bias[i] = ygets_d(kiargs[i]);
+  }
+
+  // Arguments are all converted before anything is pushed, so that their
+  // indices stay valid
+  long count, dims[Y_DIMSIZE];
+  if(!yarg_number(iarg[0])) y_error("sod must be numeric");
+  double *sod = ygeta_d(iarg[0], &count, dims);
+
+  traj_track_t ins, gps;
+  if(!yarg_number(iarg[1])) y_error("ins_sod must be numeric");
+  ins.x = ygeta_d(iarg[1], &ins.count, 0);
+  const double *roll = traj_arg(iarg[2], ins.count, "roll");
+  const double *pitch = traj_arg(iarg[3], ins.count, "pitch");
+  const double *heading = traj_arg(iarg[4], ins.count, "heading");
+
+  if(!yarg_number(iarg[5])) y_error("gps_sod must be numeric");
+  gps.x = ygeta_d(iarg[5], &gps.count, 0);
+  const double *alt = traj_arg(iarg[6], gps.count, "alt");
+  const double *north = traj_arg(iarg[7], gps.count, "north");
+  const double *east = traj_arg(iarg[8], gps.count, "east");
+
+  if(ins.count < 1) y_error("ins_sod must not be empty");
+  if(gps.count < 1) y_error("gps_sod must not be empty");
+  if(ins.x[0] > ins.x[ins.count-1]) y_error("ins_sod must be ascending");
+  if(gps.x[0] > gps.x[gps.count-1]) y_error("gps_sod must be ascending");
+  ins.b = gps.b = 0;
+
+  long j, b;
+  double smin = sod[0], smax = sod[0];
+  for(j = 1; j < count; j++)
+  {
+    if(sod[j] < smin) smin = sod[j];
+    if(sod[j] > smax) smax = sod[j];
+  }
+
+  /* eaarl_fs_trajectory first cuts the INS track down to the records around
+   * SOD. When that leaves a single record (the track has only one, or SOD
+   * lies entirely before its first time or at or after its last), it returns
+   * long zeros, one per value of SOD.
+   */
+  int single = ins.count == 1 || smax < ins.x[0] ||
+    smin >= ins.x[ins.count-1];
+
+  // A GPS track of one value can't be interpolated either; everything is out
+  // of bounds
+  int usable = ins.count > 1 && gps.count > 1;
+  double lo = ins.x[0] > gps.x[0] ? ins.x[0] : gps.x[0];
+  double hi = ins.x[ins.count-1] < gps.x[gps.count-1] ?
+    ins.x[ins.count-1] : gps.x[gps.count-1];
+
+  ypush_check(2);
+
+  // Result group
+  yo_ops_t *ops;
+  // stack + 1 = +1
+  void *obj = yo_new_group(&ops);
+  static const char *names[6] = {
+    "easting", "northing", "alt", "pitch", "roll", "yaw"
+  };
+  double *out[6];
+  for(i = 0; i < 6; i++)
+  {
+    // stack + 1 = +2
+    if(single)
+    {
+      long flat[Y_DIMSIZE] = {1, count};
+      ypush_l(flat);
+    }
+    else
+    {
+      out[i] = ypush_d(dims);
+    }
+    ops->set_q(obj, names[i], -1, 0);
+    // stack - 1 = +1
+    yarg_drop(1);
+  }
+  if(single) return;
+
+  for(j = 0; j < count; j++)
+  {
+    double xp = sod[j];
+
+    // Anything out of bounds of either track is left as 0 (including NaN)
+    if(!usable || !(xp >= lo && xp <= hi)) continue;
+
+    b = traj_locate(&gps, xp);
+    out[0][j] = traj_interp(east, gps.x, b, xp);
+    out[1][j] = traj_interp(north, gps.x, b, xp);
+    out[2][j] = traj_interp(alt, gps.x, b, xp);
+
+    b = traj_locate(&ins, xp);
+    out[3][j] = traj_interp(pitch, ins.x, b, xp) + bias[1];
+    out[4][j] = traj_interp(roll, ins.x, b, xp) + bias[0];
+    out[5][j] = -traj_interp_angle(heading, ins.x, b, xp) + bias[2];
+  }
+}
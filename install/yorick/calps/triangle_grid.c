@@ -0,0 +1,380 @@
+// vim: set tabstop=2 softtabstop=2 shiftwidth=2 autoindent shiftround expandtab:
+
+/* This implements the gridding for triangle_grid in gridding.i:
+ *
+ *    zgrid = triangle_grid_cells(x, y, z, v1, v2, v3, xc, yc, nodata,
+ *      threads=)
+ *
+ * XC and YC are the evenly spaced cell center coordinates for the columns and
+ * rows of the grid. Rather than searching for the triangle that contains each
+ * cell center, each triangle is rasterized: for every row of cell centers it
+ * spans, the columns between where its edges cross that row are the only ones
+ * it can contain. Those cells are checked with in_triangle and filled from the
+ * triangle's plane, so the work done is proportional to the size of the grid
+ * and the number of triangles.
+ *
+ * Triangles are handled in order and a cell is only filled by the first one
+ * that contains it, with the same test and plane arithmetic as
+ * _ytriangle_interp, so the results are the same as triangle_interp gives.
+ * Rows of the grid are split across threads; each thread rasterizes only the
+ * triangles that reach its rows.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yapi.h"
+
+// Rows are only split across threads in pieces at least this large
+#define TRIANGLE_GRID_MIN_ROWS 8
+#define TRIANGLE_GRID_MAX_THREADS 64
+
+// Defined in gridding.c
+extern short in_triangle(double x1, double y1, double x2, double y2,
+  double x3, double y3, double xp, double yp);
+extern void planar_params_from_pts(double x1, double y1, double z1,
+  double x2, double y2, double z2, double x3, double y3, double z3,
+  double *A, double *B, double *D);
+
+typedef struct triangle_grid_t
+{
+  // Points and triangles; v1, v2, v3 are 1-based
+  const double *x, *y, *z;
+  const long *v1, *v2, *v3;
+
+  // Rows of the grid spanned by each triangle (0-based, inclusive); rows are
+  // empty if row0 > row1
+  long *row0, *row1;
+
+  // Triangles that reach each thread's rows: band b lists tri[start[b]]
+  // through tri[start[b+1]-1], in order
+  long *start, *tri;
+  long per;
+
+  // Grid
+  const double *xc, *yc;
+  long xcount, ycount;
+  double *zgrid;
+  char *filled;
+} triangle_grid_t;
+
+// One thread's share of the grid
+typedef struct triangle_grid_job_t
+{
+  const triangle_grid_t *g;
+  long band, rowstart, rowstop;
+  pthread_t thread;
+} triangle_grid_job_t;
+
+/* triangle_grid_first
+ * Index of the first of the N ascending values in V that is >= LO.
+ */
+static long triangle_grid_first(const double *v, long n, double lo)
+{
+  long a = 0, b = n;
+  while(a < b)
+  {
+    long m = a + (b - a) / 2;
+    if(v[m] < lo)
+      a = m + 1;
+    else
+      b = m;
+  }
+  return a;
+}
+
+/* triangle_grid_last
+ * Index of the last of the N ascending values in V that is <= HI, or -1.
+ */
+static long triangle_grid_last(const double *v, long n, double hi)
+{
+  long a = 0, b = n;
+  while(a < b)
+  {
+    long m = a + (b - a) / 2;
+    if(v[m] <= hi)
+      a = m + 1;
+    else
+      b = m;
+  }
+  return a - 1;
+}
+
+/* triangle_grid_span
+ * Finds where the edges of the triangle cross the line at YP, giving the
+ * leftmost crossing in *XL and the rightmost in *XR. An edge lying along the
+ * line contributes both of its ends.
+ */
+static void triangle_grid_span(const double *tx, const double *ty, double yp,
+  double *xl, double *xr)
+{
+  int k, have = 0;
+  for(k = 0; k < 3; k++)
+  {
+    double x1 = tx[k], y1 = ty[k];
+    double x2 = tx[(k+1)%3], y2 = ty[(k+1)%3];
+    double lo = y1 < y2 ? y1 : y2, hi = y1 < y2 ? y2 : y1;
+    double a, b;
+    if(yp < lo || yp > hi) continue;
+    if(y1 == y2)
+    {
+      a = x1;
+      b = x2;
+    }
+    else
+    {
+      a = b = x1 + (yp - y1) * (x2 - x1) / (y2 - y1);
+    }
+    if(a > b)
+    {
+      double t = a;
+      a = b;
+      b = t;
+    }
+    if(!have || a < *xl) *xl = a;
+    if(!have || b > *xr) *xr = b;
+    have = 1;
+  }
+  if(!have)
+  {
+    // Only possible through rounding at a vertex; use the whole triangle
+    *xl = tx[0] < tx[1] ? (tx[0] < tx[2] ? tx[0] : tx[2]) :
+      (tx[1] < tx[2] ? tx[1] : tx[2]);
+    *xr = tx[0] > tx[1] ? (tx[0] > tx[2] ? tx[0] : tx[2]) :
+      (tx[1] > tx[2] ? tx[1] : tx[2]);
+  }
+}
+
+/* triangle_grid_raster
+ * Fills the cells in rows ROWSTART through ROWSTOP-1 that triangle I contains
+ * and that no earlier triangle has filled.
+ */
+static void triangle_grid_raster(const triangle_grid_t *g, long i,
+  long rowstart, long rowstop)
+{
+  long a = g->v1[i]-1, b = g->v2[i]-1, c = g->v3[i]-1;
+  double tx[3] = {g->x[a], g->x[b], g->x[c]};
+  double ty[3] = {g->y[a], g->y[b], g->y[c]};
+  double xmin = tx[0] < tx[1] ? (tx[0] < tx[2] ? tx[0] : tx[2]) :
+    (tx[1] < tx[2] ? tx[1] : tx[2]);
+  double xmax = tx[0] > tx[1] ? (tx[0] > tx[2] ? tx[0] : tx[2]) :
+    (tx[1] > tx[2] ? tx[1] : tx[2]);
+  long xcount = g->xcount;
+  long col0 = triangle_grid_first(g->xc, xcount, xmin);
+  long col1 = triangle_grid_last(g->xc, xcount, xmax);
+  if(col0 > col1) return;
+
+  // Column spacing, for turning the crossings into columns
+  double dx = xcount > 1 ? (g->xc[xcount-1] - g->xc[0]) / (xcount - 1) : 0;
+  int narrow = dx > 0 && isfinite(xmin) && isfinite(xmax) &&
+    isfinite(ty[0]) && isfinite(ty[1]) && isfinite(ty[2]);
+
+  long j0 = g->row0[i] > rowstart ? g->row0[i] : rowstart;
+  long j1 = g->row1[i] < rowstop - 1 ? g->row1[i] : rowstop - 1;
+  double A, B, D;
+  int have_plane = 0;
+  long j, k;
+
+  for(j = j0; j <= j1; j++)
+  {
+    double yp = g->yc[j];
+    long k0 = col0, k1 = col1;
+
+    // The crossings only narrow down which cells to check; in_triangle
+    // decides. They're widened by a column on each side to allow for
+    // rounding.
+    if(narrow)
+    {
+      double xl = 0, xr = 0;
+      triangle_grid_span(tx, ty, yp, &xl, &xr);
+      double f0 = floor((xl - g->xc[0]) / dx) - 1;
+      double f1 = ceil((xr - g->xc[0]) / dx) + 1;
+      if(f0 > k0) k0 = f0 < k1 ? (long)f0 : k1;
+      if(f1 < k1) k1 = f1 > k0 ? (long)f1 : k0;
+    }
+
+    double *zrow = g->zgrid + j * xcount;
+    char *frow = g->filled + j * xcount;
+    for(k = k0; k <= k1; k++)
+    {
+      if(frow[k]) continue;
+      double xp = g->xc[k];
+      if(!in_triangle(tx[0], ty[0], tx[1], ty[1], tx[2], ty[2], xp, yp))
+        continue;
+      if(!have_plane)
+      {
+        planar_params_from_pts(tx[0], ty[0], g->z[a], tx[1], ty[1], g->z[b],
+          tx[2], ty[2], g->z[c], &A, &B, &D);
+        have_plane = 1;
+      }
+      zrow[k] = A * xp + B * yp + D;
+      frow[k] = 1;
+    }
+  }
+}
+
+static void * triangle_grid_worker(void *arg)
+{
+  triangle_grid_job_t *job = arg;
+  const triangle_grid_t *g = job->g;
+  long k;
+  for(k = g->start[job->band]; k < g->start[job->band+1]; k++)
+    triangle_grid_raster(g, g->tri[k], job->rowstart, job->rowstop);
+  return NULL;
+}
+
+static void triangle_grid_free(triangle_grid_t *g)
+{
+  if(g->row0) free(g->row0);
+  if(g->row1) free(g->row1);
+  if(g->start) free(g->start);
+  if(g->tri) free(g->tri);
+  if(g->filled) free(g->filled);
+}
+
+/* triangle_grid_run
+ * Rasterizes the NV triangles, with rows split into contiguous bands over up
+ * to THREADS threads. The calling thread takes the first band, as well as any
+ * whose thread could not be started. Returns 0 if memory ran out.
+ */
+static int triangle_grid_run(triangle_grid_t *g, long nv, long threads)
+{
+  triangle_grid_job_t jobs[TRIANGLE_GRID_MAX_THREADS];
+  int started[TRIANGLE_GRID_MAX_THREADS];
+  long i, t, n;
+
+  if(threads > TRIANGLE_GRID_MAX_THREADS) threads = TRIANGLE_GRID_MAX_THREADS;
+  if(threads > g->ycount / TRIANGLE_GRID_MIN_ROWS)
+    threads = g->ycount / TRIANGLE_GRID_MIN_ROWS;
+  if(threads < 1) threads = 1;
+  g->per = (g->ycount + threads - 1) / threads;
+
+  g->row0 = malloc(sizeof(long) * (nv ? nv : 1));
+  g->row1 = malloc(sizeof(long) * (nv ? nv : 1));
+  g->start = calloc(threads + 1, sizeof(long));
+  g->filled = calloc(g->xcount * g->ycount, 1);
+  if(!g->row0 || !g->row1 || !g->start || !g->filled) return 0;
+
+  // Rows each triangle spans, and how many triangles reach each band
+  for(i = 0; i < nv; i++)
+  {
+    long a = g->v1[i]-1, b = g->v2[i]-1, c = g->v3[i]-1;
+    double y1 = g->y[a], y2 = g->y[b], y3 = g->y[c];
+    double ymin = y1 < y2 ? (y1 < y3 ? y1 : y3) : (y2 < y3 ? y2 : y3);
+    double ymax = y1 > y2 ? (y1 > y3 ? y1 : y3) : (y2 > y3 ? y2 : y3);
+    // A triangle with a NaN vertex contains nothing
+    if(isnan(y1) || isnan(y2) || isnan(y3) ||
+      isnan(g->x[a]) || isnan(g->x[b]) || isnan(g->x[c]))
+    {
+      g->row0[i] = 0;
+      g->row1[i] = -1;
+      continue;
+    }
+    g->row0[i] = triangle_grid_first(g->yc, g->ycount, ymin);
+    g->row1[i] = triangle_grid_last(g->yc, g->ycount, ymax);
+    if(g->row0[i] > g->row1[i]) continue;
+    for(t = g->row0[i] / g->per; t <= g->row1[i] / g->per; t++)
+      g->start[t+1]++;
+  }
+  for(t = 0; t < threads; t++)
+    g->start[t+1] += g->start[t];
+
+  n = g->start[threads];
+  g->tri = malloc(sizeof(long) * (n ? n : 1));
+  if(!g->tri) return 0;
+  for(i = 0; i < nv; i++)
+  {
+    if(g->row0[i] > g->row1[i]) continue;
+    for(t = g->row0[i] / g->per; t <= g->row1[i] / g->per; t++)
+      g->tri[g->start[t]++] = i;
+  }
+  for(t = threads; t > 0; t--)
+    g->start[t] = g->start[t-1];
+  g->start[0] = 0;
+
+  for(t = 0; t < threads; t++)
+  {
+    jobs[t].g = g;
+    jobs[t].band = t;
+    jobs[t].rowstart = t * g->per;
+    jobs[t].rowstop =
+      t * g->per + g->per < g->ycount ? t * g->per + g->per : g->ycount;
+    started[t] = t > 0 &&
+      !pthread_create(&jobs[t].thread, NULL, triangle_grid_worker, &jobs[t]);
+  }
+  triangle_grid_worker(&jobs[0]);
+  for(t = 1; t < threads; t++)
+  {
+    if(started[t])
+      pthread_join(jobs[t].thread, NULL);
+    else
+      triangle_grid_worker(&jobs[t]);
+  }
+  return 1;
+}
+
+void Y_triangle_grid_cells(int nArgs)
+{
+  static char *knames[2] = {"threads", 0};
+  static long kglobs[2];
+  int kiargs[1];
+  int iarg[9], i;
+  long count, n, nv, threads = 1, dims[Y_DIMSIZE];
+  triangle_grid_t g;
+
+  yarg_kw_init(knames, kglobs, kiargs);
+  iarg[0] = yarg_kw(nArgs-1, kglobs, kiargs);
+  for(i = 1; i < 9; i++)
+    iarg[i] = iarg[i-1] == -1 ? -1 : yarg_kw(iarg[i-1]-1, kglobs, kiargs);
+  if(iarg[8] == -1 || yarg_kw(iarg[8]-1, kglobs, kiargs) != -1)
+    y_error("must provide 9 arguments");
+
+  if(kiargs[0] != -1 && !yarg_nil(kiargs[0]))
+    threads = ygets_l(kiargs[0]);
+
+  memset(&g, 0, sizeof(g));
+
+  if(!yarg_number(iarg[0])) y_error("x must be numeric");
+  if(!yarg_number(iarg[1])) y_error("y must be numeric");
+  if(!yarg_number(iarg[2])) y_error("z must be numeric");
+  g.x = ygeta_d(iarg[0], &count, 0);
+  g.y = ygeta_d(iarg[1], &n, 0);
+  if(n != count) y_error("x and y must have the same number of values");
+  g.z = ygeta_d(iarg[2], &n, 0);
+  if(n != count) y_error("x and z must have the same number of values");
+
+  if(yarg_number(iarg[3]) != 1) y_error("v1 must be integer");
+  if(yarg_number(iarg[4]) != 1) y_error("v2 must be integer");
+  if(yarg_number(iarg[5]) != 1) y_error("v3 must be integer");
+  g.v1 = ygeta_l(iarg[3], &nv, 0);
+  g.v2 = ygeta_l(iarg[4], &n, 0);
+  if(n != nv) y_error("v1 and v2 must have the same number of values");
+  g.v3 = ygeta_l(iarg[5], &n, 0);
+  if(n != nv) y_error("v1 and v3 must have the same number of values");
+  for(n = 0; n < nv; n++)
+  {
+    if(g.v1[n] < 1 || g.v1[n] > count || g.v2[n] < 1 || g.v2[n] > count ||
+      g.v3[n] < 1 || g.v3[n] > count)
+      y_error("vertex index out of range");
+  }
+
+  if(!yarg_number(iarg[6])) y_error("xc must be numeric");
+  if(!yarg_number(iarg[7])) y_error("yc must be numeric");
+  g.xc = ygeta_d(iarg[6], &g.xcount, 0);
+  g.yc = ygeta_d(iarg[7], &g.ycount, 0);
+  double nodata = ygets_d(iarg[8]);
+
+  dims[0] = 2;
+  dims[1] = g.xcount;
+  dims[2] = g.ycount;
+  // stack + 1 = +1
+  g.zgrid = ypush_d(dims);
+  for(n = 0; n < g.xcount * g.ycount; n++)
+    g.zgrid[n] = nodata;
+  if(!g.xcount || !g.ycount) return;
+
+  int ok = triangle_grid_run(&g, nv, threads);
+  triangle_grid_free(&g);
+  if(!ok) y_error("unable to allocate memory for gridding");
+}
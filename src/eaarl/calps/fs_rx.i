@@ -12,7 +12,7 @@ func nocalps_eaarl_fs_rx_cent_eaarlb(pulses) {
 */
   extern ops_conf;
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
   // 10000 is the "bad data" value that cent will return, match that
   frx = array(float(10000), npulses);
   fintensity = array(float, npulses);
@@ -29,7 +29,7 @@ func nocalps_eaarl_fs_rx_cent_eaarlb(pulses) {
   ](fchannel);
 
   for(i = 1; i <= npulses; i++) {
-    wf = *pulses.rx(fchannel(i),i);
+    wf = eaarl_pulse_rx(pulses, fchannel(i), i);
     np = numberof(wf);
 
     // Give up if not at least 2 points
@@ -51,3 +51,68 @@ func nocalps_eaarl_fs_rx_cent_eaarlb(pulses) {
 }
 if(!is_func(eaarl_fs_rx_cent_eaarlb))
   eaarl_fs_rx_cent_eaarlb = nocalps_eaarl_fs_rx_cent_eaarlb;
+
+func nocalps_eaarl_fs_rx_cent_eaarla(pulses) {
+/* DOCUMENT eaarl_fs_rx_cent_eaarla, pulses
+  Updates the given pulses oxy group object with first return info. The most
+  sensitive channel that is not saturated will be used. The following fields
+  are added to pulses:
+    frx - Location in waveform of first return
+    fintensity - Peak intensity value of first return
+    fchannel - Channel used
+    fbias - The channel range bias (ops_conf.chn%d_range_bias)
+  Also, channel is replaced by fchannel.
+*/
+  extern ops_conf;
+
+  npulses = numberof(pulses.soe);
+  // 10000 is the "bad data" value that cent will return, match that
+  frx = array(float(10000), npulses);
+  fintensity = fbias = array(float, npulses);
+  fchannel = array(char, npulses);
+
+  // this is just to make the if() calls shorter & more readable
+  max_sfc_sat = ops_conf.max_sfc_sat;
+
+  for(i = 1; i <= npulses; i++) {
+    rx = eaarl_pulse_rxs(pulses, i);
+
+    // Number of points in most sensitive channel (all channels are same
+    // length)
+    np = numberof(*rx(1));
+
+    // Give up if not at least 2 points
+    if(np < 2) continue;
+
+    // use no more than 12 for saturation check
+    np = min(np, 12);
+
+    if(numberof(where((*rx(1))(:np) < 5)) <= max_sfc_sat) {
+      fchannel(i) = 1;
+      fbias(i) = ops_conf.chn1_range_bias;
+    } else if(numberof(where((*rx(2))(:np) < 5)) <= max_sfc_sat) {
+      fchannel(i) = 2;
+      fbias(i) = ops_conf.chn2_range_bias;
+    } else {
+      fchannel(i) = 3;
+      fbias(i) = ops_conf.chn3_range_bias;
+    }
+
+    rx_cent = cent(*rx(fchannel(i)));
+    
+    // Must be water column only return
+    if(fchannel(i) == 1 && rx_cent(3) < -90) {
+      slope = 0.029625;
+      x = rx_cent(3) - 90;
+      y = slope * x;
+      rx_cent(1) += y;
+    }
+
+    frx(i) = rx_cent(1);
+    fintensity(i) = rx_cent(3);
+  }
+
+  save, pulses, frx, fintensity, fchannel, fbias, channel=fchannel;
+}
+if(!is_func(eaarl_fs_rx_cent_eaarla))
+  eaarl_fs_rx_cent_eaarla = nocalps_eaarl_fs_rx_cent_eaarla;
@@ -22,7 +22,7 @@ if(!is_func(eaarl_decode_fast))
 if(!is_func(cent))
   include, base+"calps/cent.i";
 
-if(!is_func(eaarl_fs_rx_cent_eaarlb))
+if(!is_func(eaarl_fs_rx_cent_eaarlb) || !is_func(eaarl_fs_rx_cent_eaarla))
   include, base+"calps/fs_rx.i";
 
 restore, scratch;
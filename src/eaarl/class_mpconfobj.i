@@ -105,11 +105,13 @@ func mpconfobj_validate(group) {
 
   // Values that all confs have
   defaults = save(
-    thresh=4.0, max_samples=0, smoothwf=0
+    thresh=4.0, max_samples=0, smoothwf=0, alg_mode="peak"
   );
   if(numberof(channels) == 1 && channels(1) == 3)
     save, defaults, max_samples=20;
   key_default_and_cast, active, defaults;
+  if(noneof(active.alg_mode == ["peak", "cent", "none"]))
+    error, "Unknown alg_mode";
   tksync, idleadd,
     swrite(format="mpconf.data.%s.active.%s", group, defaults(*,)),
     swrite(format="::eaarl::mpconf::settings(%s,%s)", group, defaults(*,));
@@ -137,7 +139,7 @@ func mpconfobj_cleangroups(void) {
 
     for(j = 1; j <= grp.profiles(*); j++) {
       prof = grp.profiles(noop(j));
-      idx = prof(*, ["thresh", "max_samples", "smoothwf"]);
+      idx = prof(*, ["thresh", "max_samples", "smoothwf", "alg_mode"]);
       idx = idx(where(idx));
       if(numberof(idx))
         prof = prof(noop(idx));
@@ -271,6 +271,14 @@ maY, mag, &mx, &my, &mz, &px, &py, &pz) {
   log_id = logger_id();
   if(logger(debug)) logger, debug, log_id+"Entering eaarl_direct_vector";
 
+  // *** Attempts to use CALPS ***
+  if(is_func(eaarl_direct_vector_batch)) {
+    eaarl_direct_vector_batch, arZ, arX, arY, gx, gy, gz, dx, dy, dz, maZ, laX,
+      maX, maY, mag, mx, my, mz, px, py, pz;
+    if(logger(debug)) logger, debug, log_id+"Leaving eaarl_direct_vector";
+    return;
+  }
+
   z = arZ * DEG2RAD;
   x = arX * DEG2RAD;
   y = arY * DEG2RAD;
@@ -11,21 +11,25 @@ local EAARL_INDEX;
   struct EAARL_INDEX {
     int seconds;         seconds of the epoch
     int fseconds;        fractional seconds (1e-6)
-    int offset;          offset in file to raster data
+    long offset;         offset in file to raster data
     int raster_length;   length of raster
-    short file_number;   file raster is in (index into array of filenames)
+    int file_number;     file raster is in (index into array of filenames)
     char pixels;         pixel count for this raster
     char digitizer;      digitizer used
   };
 
-  SEE ALSO: edb_open load_edb
+  This is the in-memory form of the records in an EDB file. The records are
+  stored differently in each version of the EDB file format; use edb_records
+  to convert them.
+
+  SEE ALSO: edb_open load_edb edb_records
 */
 struct EAARL_INDEX {
   int seconds;
   int fseconds;
-  int offset;
+  long offset;
   int raster_length;
-  short file_number;
+  int file_number;
   char pixels;
   char digitizer;
 };
@@ -68,16 +72,35 @@ func get_total_edb_records {
   }
 }
 
+func edb_version(fn) {
+/* DOCUMENT version = edb_version(fn)
+  Returns the format version of the EDB file FN: 2 for files written by the
+  current efdb, which start with the magic "EFDB" and use 64-bit offsets, and
+  1 for legacy files, which are limited to 32-bit offsets.
+*/
+  magic = array(char, 4);
+  f = open(fn, "rb");
+  _read, f, 0, magic;
+  close, f;
+  return allof(magic == strchar("EFDB")(1:4)) ? 2 : 1;
+}
+
 func edb_open(fn, filemode=, verbose=) {
 /* DOCUMENT f = edb_open(fn, filemode=, verbose=);
-  Opens a filehandle to an EDB file. Variables will be installed as follows:
-
-    f.files_offset    int, scalar
-    f.record_count    int, scalar
-    f.file_count      int, scalar
-    f.records         struct EAARL_INDEX of length f.record_count
+  Opens a filehandle to an EDB file. Both versions of the EDB format are
+  supported (see edb_version). Variables will be installed as follows:
+
+    f.files_offset    int (version 1) or long (version 2), scalar
+    f.record_count    int (version 1) or long (version 2), scalar
+    f.file_count      int (version 1) or long (version 2), scalar
+    f.records         struct EDB_RECORD_V1 or EDB_RECORD_V2 of length
+                      f.record_count
     f.files           struct EDB_FILES of length f.file_count
 
+  The record structs have the same members as EAARL_INDEX, but their layouts
+  match the file rather than memory; in version 1, offset and raster_length
+  are unsigned 32-bit values. Use edb_records to get them as EAARL_INDEX.
+
   The EDB_FILES struct has the following fields:
 
     f.files.length    short
@@ -86,17 +109,46 @@ func edb_open(fn, filemode=, verbose=) {
   The values for f.files.length should always be 17. To get a file name in
   string format, use strchar(f.files.name).
 
-  SEE ALSO: EAARL_INDEX
+  SEE ALSO: EAARL_INDEX edb_records edb_version
 */
   default, filemode, "rb";
   default, verbose, 1;
+  version = edb_version(fn);
   f = open(fn, filemode);
-  i86_primitives, f;
 
-  add_variable, f, 0, "files_offset", int;
-  add_variable, f, 4, "record_count", int;
-  add_variable, f, 8, "file_count", int;
-  add_variable, f, 12, "records", EAARL_INDEX, f.record_count;
+  if(version == 2) {
+    // Same as i86_primitives, but with 64-bit longs
+    alpha_primitives, f;
+    add_variable, f, 8, "files_offset", long;
+    add_variable, f, 16, "record_count", long;
+    add_variable, f, 24, "file_count", long;
+
+    add_member, f, "EDB_RECORD_V2", 0, "seconds", int;
+    add_member, f, "EDB_RECORD_V2", 4, "fseconds", int;
+    add_member, f, "EDB_RECORD_V2", 8, "offset", long;
+    add_member, f, "EDB_RECORD_V2", 16, "raster_length", int;
+    add_member, f, "EDB_RECORD_V2", 20, "file_number", int;
+    add_member, f, "EDB_RECORD_V2", 24, "pixels", char;
+    add_member, f, "EDB_RECORD_V2", 25, "digitizer", char;
+    add_member, f, "EDB_RECORD_V2", 26, "pad", char, 6;
+    install_struct, f, "EDB_RECORD_V2";
+    add_variable, f, 32, "records", "EDB_RECORD_V2", f.record_count;
+  } else {
+    i86_primitives, f;
+    add_variable, f, 0, "files_offset", int;
+    add_variable, f, 4, "record_count", int;
+    add_variable, f, 8, "file_count", int;
+
+    add_member, f, "EDB_RECORD_V1", 0, "seconds", int;
+    add_member, f, "EDB_RECORD_V1", 4, "fseconds", int;
+    add_member, f, "EDB_RECORD_V1", 8, "offset", int;
+    add_member, f, "EDB_RECORD_V1", 12, "raster_length", int;
+    add_member, f, "EDB_RECORD_V1", 16, "file_number", short;
+    add_member, f, "EDB_RECORD_V1", 18, "pixels", char;
+    add_member, f, "EDB_RECORD_V1", 19, "digitizer", char;
+    install_struct, f, "EDB_RECORD_V1";
+    add_variable, f, 12, "records", "EDB_RECORD_V1", f.record_count;
+  }
 
   offset = f.files_offset;
   lengths = array(short, f.file_count);
@@ -130,6 +182,28 @@ func edb_open(fn, filemode=, verbose=) {
   return f;
 }
 
+func edb_records(f) {
+/* DOCUMENT edb = edb_records(f);
+  Returns the records of the EDB filehandle F (as opened by edb_open) as an
+  array of EAARL_INDEX, regardless of the version of the file.
+*/
+  rec = f.records;
+  edb = array(EAARL_INDEX, numberof(rec));
+  edb.seconds = rec.seconds;
+  edb.fseconds = rec.fseconds;
+  // Version 1 offsets are unsigned 32-bit values; the mask undoes the sign
+  // extension for offsets of 2GB and over.
+  if(structof(rec.offset) == int)
+    edb.offset = long(rec.offset) & 0xffffffff;
+  else
+    edb.offset = rec.offset;
+  edb.raster_length = rec.raster_length;
+  edb.file_number = rec.file_number;
+  edb.pixels = rec.pixels;
+  edb.digitizer = rec.digitizer;
+  return edb;
+}
+
 func edb_get_filenames(f) {
 /* DOCUMENT names = edb_get_filenames(f);
   Returns an array of the filenames defined by the stream f, which should be a
@@ -154,9 +228,10 @@ func edb_get_filenames(f) {
 func load_edb(fn=, update=, verbose=, override_offset=) {
 /* DOCUMENT load_edb, fn=, update, verbose=, override_offset=
 
-  This function reads the index file produced by the efdb program. The data is
-  a type of cross-reference to an entire EAARL data set. This permits easy
-  access to the data without regard to what file the data are located in.
+  This function reads the index file produced by the efdb program (either
+  version of its format; see edb_version). The data is a type of
+  cross-reference to an entire EAARL data set. This permits easy access to the
+  data without regard to what file the data are located in.
 
   Two variables are created by this load_edb: edb and edb_file. edb is an
   array of structures of type EAARL_INDEX, and edb_file is an array of
@@ -167,7 +242,7 @@ func load_edb(fn=, update=, verbose=, override_offset=) {
 */
   extern edb_filename, edb, edb_files, _edb_fd, total_edb_records,
     data_path, soe_day_start, eaarl_time_offset, tans, pnav,
-    gps_time_correction, initialdir;
+    gps_time_correction, initialdir, __edb_decoder;
 
   default, verbose, 1;
   default, update, 0;
@@ -180,14 +255,15 @@ func load_edb(fn=, update=, verbose=, override_offset=) {
   filemode = update ? "r+b" : "rb";
 
   edb_filename = fn;
+  // The decoder for the previous EDB may hold stale offsets, even if the
+  // filename is the same
+  __edb_decoder = [];
   //_edb_fd = idf = open(fn, filemode );
   f = edb_open(fn, filemode=filemode, verbose=verbose);
 
   edb_files = edb_get_filenames(f);
 
-  // Parentheses ensure that we make a copy, rather than making a reference to
-  // the file.
-  edb = (f.records);
+  edb = edb_records(f);
 
   /*
     eaarl_time_offset is computed below.  It needs to be added to any soe
@@ -339,7 +415,10 @@ func edb_update(adj) {
   if(!is_void(edb_filename) && !is_void(edb)) {
     edb.seconds += adj;
     f = edb_open(edb_filename, filemode="r+b");
-    f.records = edb;
+    // Only the times change; the records keep the layout of the file
+    rec = f.records;
+    rec.seconds = edb.seconds;
+    f.records = rec;
     close, f;
     write, "edb updated";
   }
@@ -542,7 +621,7 @@ func raster_sources(&rn_start, &rn_stop, &file, &offset_start, &offset_stop) {
   }
 }
 
-func decode_rasters(rn_start, rn_stop, wfs=) {
+func decode_rasters(rn_start, rn_stop, wfs=, packed=) {
 /* DOCUMENT pulses = decode_rasters(start, stop)
   Retrieves decoded pulse data for the specified range of rasters. START is
   the first raster number and STOP is the last. START and STOP may also be
@@ -551,21 +630,57 @@ func decode_rasters(rn_start, rn_stop, wfs=) {
   Options:
     wfs= By default, waveforms are included. Use wfs=0 to disable, which will
       omit the tx and rx fields.
+    packed= Use packed=1 to request the packed waveform layout described by
+      eaarl_decode_fast. This is ignored if the installed C-ALPS plugin does
+      not support it. Use eaarl_pulse_tx and eaarl_pulse_rx to access the
+      waveforms so that either layout is handled.
 
   Returns:
     An oxy object containing the same members as described by
     eaarl_decode_fast.
 */
+  // Packed output requires C-ALPS version 8
+  if(packed && !(is_func(calps_compatibility) && calps_compatibility() >= 8))
+    packed = 0;
+
+  // If available, decode everything in one call, even across TLD files
+  if(is_func(eaarl_index_decode)) {
+    if(packed)
+      return eaarl_index_decode(edb_decoder(), rn_start, rn_stop, wfs=wfs,
+        packed=1);
+    return eaarl_index_decode(edb_decoder(), rn_start, rn_stop, wfs=wfs);
+  }
+
   raster_sources, rn_start, rn_stop, tldfn, offset_start, offset_stop;
 
   count = numberof(rn_start);
   result = [];
   for(i = 1; i <= count; i++) {
-    current = eaarl_decode_fast(tldfn(i), offset_start(i), offset_stop(i),
-      wfs=wfs, rnstart=rn_start(i));
+    if(packed) {
+      current = eaarl_decode_fast(tldfn(i), offset_start(i), offset_stop(i),
+        wfs=wfs, rnstart=rn_start(i), packed=1);
+    } else {
+      current = eaarl_decode_fast(tldfn(i), offset_start(i), offset_stop(i),
+        wfs=wfs, rnstart=rn_start(i));
+    }
+    if(is_void(current)) continue;
 
     if(is_void(result)) {
       result = current;
+    } else if(packed && !is_void(current.wfbuf)) {
+      // The start indices are relative to each segment's own buffer, so they
+      // have to be shifted when the buffers are concatenated.
+      shift = numberof(*result.wfbuf);
+      tx_start = current.tx_start;
+      rx_start = current.rx_start;
+      w = where(current.tx_len);
+      if(numberof(w)) tx_start(w) += shift;
+      w = where(current.rx_len);
+      if(numberof(w)) rx_start(w) += shift;
+      save, current, tx_start, rx_start;
+      wfbuf = grow(*result.wfbuf, *current.wfbuf);
+      obj_grow, result, obj_delete(current, wfbuf);
+      save, result, wfbuf=&wfbuf;
     } else {
       obj_grow, result, current;
     }
@@ -574,6 +689,71 @@ func decode_rasters(rn_start, rn_stop, wfs=) {
   return result;
 }
 
+func edb_decoder(void) {
+/* DOCUMENT handle = edb_decoder()
+  Returns a handle for use with eaarl_index_decode for the currently loaded
+  EDB (see load_edb). The handle is cached and reused until load_edb is called
+  again or the mission is unloaded, so that the TLD files it keeps open can be
+  reused across calls.
+*/
+  extern edb, edb_files, edb_filename, __edb_decoder;
+  key = swrite(format="%s:%d", edb_filename, numberof(edb));
+  if(is_void(__edb_decoder) || __edb_decoder.key != key) {
+    tld_dir = file_dirname(edb_filename);
+    files = file_join(tld_dir, file_tail(edb_files));
+    __edb_decoder = [];
+    __edb_decoder = save(key, handle=eaarl_index_open(long(edb.offset),
+      long(edb.file_number), files));
+  }
+  return __edb_decoder.handle;
+}
+
+func eaarl_pulse_tx(pulses, i) {
+/* DOCUMENT wf = eaarl_pulse_tx(pulses, i)
+  Returns the transmit waveform for pulse I in PULSES, as returned by
+  eaarl_decode_fast or decode_rasters. This works with both the default and
+  the packed waveform layout. Returns [] if the waveform is absent.
+*/
+  if(!is_void(pulses.wfbuf)) {
+    len = pulses.tx_len(i);
+    if(!len) return [];
+    start = pulses.tx_start(i);
+    return (*pulses.wfbuf)(start:start+len-1);
+  }
+  return *pulses.tx(i);
+}
+
+func eaarl_pulse_rx(pulses, chan, i) {
+/* DOCUMENT wf = eaarl_pulse_rx(pulses, chan, i)
+  Returns the return waveform for channel CHAN of pulse I in PULSES, as
+  returned by eaarl_decode_fast or decode_rasters. This works with both the
+  default and the packed waveform layout. Returns [] if the waveform is
+  absent.
+*/
+  if(!is_void(pulses.wfbuf)) {
+    len = pulses.rx_len(chan,i);
+    if(!len) return [];
+    start = pulses.rx_start(chan,i);
+    return (*pulses.wfbuf)(start:start+len-1);
+  }
+  return *pulses.rx(chan,i);
+}
+
+func eaarl_pulse_rxs(pulses, i) {
+/* DOCUMENT rx = eaarl_pulse_rxs(pulses, i)
+  Returns the four return waveforms for pulse I in PULSES as an array of
+  pointers, matching pulses.rx(,i) in the default waveform layout. This works
+  with both the default and the packed waveform layout.
+*/
+  if(!is_void(pulses.wfbuf)) {
+    rx = array(pointer, 4);
+    for(chan = 1; chan <= 4; chan++)
+      rx(chan) = &eaarl_pulse_rx(pulses, chan, i);
+    return rx;
+  }
+  return pulses.rx(,i);
+}
+
 func get_soe_rasts(start, stop) {
 /* DOCUMENT get_soe_rasts(start, stop)
   Given a START time and STOP time in seconds of the epoch, this will return
@@ -343,6 +343,9 @@ func eaarl_mission_unload {
   edb = edb_filename = edb_files = total_edb_records = soe_day_start =
     eaarl_time_offset = [];
 
+  extern __edb_decoder;
+  __edb_decoder = [];
+
   extern pnav, gga, pnav_filename;
   pnav = gga = [];
   pnav_filename = "";
@@ -350,6 +353,9 @@ func eaarl_mission_unload {
   extern iex_nav, iex_head, tans, ins_filename;
   iex_nav = iex_head = tans = ins_filename = [];
 
+  extern __eaarl_fs_gps_cache;
+  __eaarl_fs_gps_cache = [];
+
   extern ops_conf, ops_conf_filename;
   ops_conf = ops_conf_filename = [];
 
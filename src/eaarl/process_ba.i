@@ -160,8 +160,8 @@ func eaarl_ba_tx_copy(pulses) {
   save, pulses, ltx=pulses.ftx;
 }
 
-func eaarl_ba_rx_channel(pulses) {
-/* DOCUMENT eaarl_ba_rx_channel, pulses
+func eaarl_ba_rx_channel(pulses, threads=) {
+/* DOCUMENT eaarl_ba_rx_channel, pulses, threads=
   Updates the given pulses oxy group object with bathy last return info. This
   uses the same channel that was used for the first return. The following
   fields are added to pulses:
@@ -173,30 +173,49 @@ func eaarl_ba_rx_channel(pulses) {
     lchannel - Channel used for bottom
   Additionally, this field is overwritten:
     fintensity - Intensity at location deemed as surface by bathy algorithm
+
+  If C-ALPS provides eaarl_ba_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local.
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   ba_rx_wf = eaarl_ba_rx_wf;
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = fintensity = lintensity = bback1 = bback2 = lbias =
     array(float, npulses);
   lchannel = pulses.channel;
 
+  batch_conf = eaarl_ba_rx_batch_conf(1, save(eaarl_ba_rx_wf=ba_rx_wf));
+  if(!is_void(batch_conf)) {
+    had = eaarl_ba_rx_batch(pulses, lchannel, batch_conf, threads=threads);
+    // As below, pulses without a waveform on their channel keep lbias 0
+    w = where(had);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    if(batch_conf.bback) {
+      save, pulses, lbias, lchannel;
+    } else {
+      save, pulses, bback1, bback2, lbias, lchannel;
+    }
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
     if(!lchannel(i)) continue;
-    if(!pulses.rx(lchannel(i),i)) continue;
+    wf = eaarl_pulse_rx(pulses, lchannel(i), i);
+    if(is_void(wf)) continue;
 
     conf = obj_copy(bathconf(settings, lchannel(i)));
     save, conf, channel=lchannel(i);
 
     lbias(i) = biases(lchannel(i));
 
-    tmp = ba_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = ba_rx_wf(wf, conf);
     fintensity(i) = tmp.fintensity;
     lintensity(i) = tmp.lintensity;
     bback1(i) = tmp.bback1;
@@ -207,8 +226,8 @@ func eaarl_ba_rx_channel(pulses) {
   save, pulses, lrx, fintensity, lintensity, bback1, bback2, lbias, lchannel;
 }
 
-func eaarl_ba_rx_eaarla(pulses) {
-/* DOCUMENT eaarl_ba_rx_eaarla, pulses
+func eaarl_ba_rx_eaarla(pulses, threads=) {
+/* DOCUMENT eaarl_ba_rx_eaarla, pulses, threads=
   Updates the given pulses oxy group object with bathy last return info. The
   most sensitive channel that is not saturated will be used. The following
   fields are added to pulses:
@@ -218,9 +237,13 @@ func eaarl_ba_rx_eaarla(pulses) {
     lchannel - Channel used for bottom
   Additionally, this field is overwritten:
     fintensity - Intensity at location deemed as surface by bathy algorithm
+
+  If C-ALPS provides eaarl_ba_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local.
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   ba_rx_channel = eaarl_ba_rx_eaarla_channel;
   ba_rx_wf = eaarl_ba_rx_wf;
@@ -230,20 +253,34 @@ func eaarl_ba_rx_eaarla(pulses) {
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = fintensity = lintensity = lbias = array(float, npulses);
   lchannel = array(char, npulses);
 
+  batch_conf = eaarl_ba_rx_batch_conf(0, save(eaarl_ba_rx_wf=ba_rx_wf,
+    eaarl_ba_rx_eaarla_channel=ba_rx_channel));
+  if(!is_void(batch_conf)) {
+    // Passing [] for lchannel selects the channel as
+    // eaarl_ba_rx_eaarla_channel does, which only picks channels that have a
+    // waveform
+    eaarl_ba_rx_batch, pulses, [], batch_conf, threads=threads;
+    lchannel = pulses.lchannel;
+    w = where(lchannel);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    save, pulses, lbias;
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
-    lchannel(i) = ba_rx_channel(pulses.rx(,i), conf);
+    lchannel(i) = ba_rx_channel(eaarl_pulse_rxs(pulses, i), conf);
     if(!lchannel(i)) continue;
     lbias(i) = biases(lchannel(i));
 
     conf = obj_copy(conf);
     save, conf, channel;
 
-    tmp = ba_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = ba_rx_wf(eaarl_pulse_rx(pulses, lchannel(i), i), conf);
     fintensity(i) = tmp.fintensity;
     lintensity(i) = tmp.lintensity;
     lrx(i) = tmp.lrx;
@@ -252,6 +289,48 @@ func eaarl_ba_rx_eaarla(pulses) {
   save, pulses, lrx, fintensity, lintensity, lbias, lchannel;
 }
 
+func eaarl_ba_rx_batch_conf(forced, funcs) {
+/* DOCUMENT conf = eaarl_ba_rx_batch_conf(forced, funcs)
+  Determines whether eaarl_ba_rx_batch can be used in place of the per-pulse
+  functions in FUNCS and, if so, returns its conf group; otherwise, returns
+  []. This works as eaarl_rx_batch_conf does, retrieving the bathy settings
+  used by eaarl_ba_rx_wf for each channel from bathconf. Settings for the
+  decay type not in use are 0.
+
+  The "eaarl_ba_rx_wf" hook must also be unused, apart from the EAARL-B
+  backscatter hook that eaarl_ba_rx_batch can replicate. If FORCED is 1 and
+  that hook is present, conf.bback is 1 so that the backscatter values are
+  computed too.
+
+  FORCED should be 1 if the channel is given per pulse (as for
+  eaarl_ba_rx_channel) and 0 if it is selected automatically (as for
+  eaarl_ba_rx_eaarla). This also determines what bathy_detect_surface is told
+  about the channel when working out the surface search window, wantlen.
+*/
+  hooks = hook_query("eaarl_ba_rx_wf");
+  if(numberof(hooks) && anyof(hooks != "hook_eaarlb_eaarl_ba_rx_wf"))
+    return [];
+
+  result = eaarl_rx_batch_conf(eaarl_ba_rx_batch, bathconf,
+    ["thresh", "first", "last", "sfc_last", "maxsat", "smoothwf",
+    "lwing_dist", "rwing_dist", "lwing_factor", "rwing_factor", "decay",
+    "laser", "water", "agc", "mean", "stdev", "xshift", "xscale", "tiepoint"],
+    funcs);
+  if(is_void(result)) return [];
+
+  wantlens = array(long, 4);
+  for(i = 1; i <= 4; i++) {
+    // Matches the forcechannel= that eaarl_ba_rx_wf passes along
+    forcechannel = forced ? i : [];
+    wantlen = 10;
+    restore, hook_invoke("bathy_detect_surface", save(forcechannel, wantlen));
+    wantlens(i) = wantlen;
+  }
+
+  save, result, wantlen=wantlens, bback=(forced && numberof(hooks) > 0);
+  return result;
+}
+
 func eaarl_ba_rx_eaarla_channel(rx, &conf) {
 /* DOCUMENT channel = eaarl_ba_rx_eaarla_channel(rx, &conf)
   Determines which channel to use for bathy. The channel number is returned,
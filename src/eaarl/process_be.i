@@ -143,8 +143,8 @@ func eaarl_be_tx_copy(pulses) {
   save, pulses, ltx=pulses.ftx;
 }
 
-func eaarl_be_rx_channel(pulses) {
-/* DOCUMENT eaarl_be_rx_channel, pulses
+func eaarl_be_rx_channel(pulses, threads=) {
+/* DOCUMENT eaarl_be_rx_channel, pulses, threads=
   Updates the given pulses oxy group object with veg last return info. This
   uses the same channel that was used for the first return. The following
   fields are added to pulses:
@@ -154,28 +154,45 @@ func eaarl_be_rx_channel(pulses) {
     lchannel - Channel used for bottom
   Additionally, this field is overwritten:
     fintensity - Intensity at location deemed as surface by veg algorithm
+
+  If C-ALPS provides eaarl_be_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local.
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   be_rx_wf = eaarl_be_rx_wf;
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = fintensity = lintensity = lbias = array(float, npulses);
   rets = array(char, npulses);
   lchannel = pulses.channel;
 
+  batch_conf = eaarl_rx_batch_conf(eaarl_be_rx_batch, vegconf,
+    ["thresh", "noiseadj", "max_samples", "smoothwf"],
+    save(eaarl_be_rx_wf=be_rx_wf));
+  if(!is_void(batch_conf)) {
+    had = eaarl_be_rx_batch(pulses, lchannel, batch_conf, threads=threads);
+    // As below, pulses without a waveform on their channel keep lbias 0
+    w = where(had);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    save, pulses, lbias, lchannel;
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
     if(!lchannel(i)) continue;
-    if(!pulses.rx(lchannel(i),i)) continue;
+    wf = eaarl_pulse_rx(pulses, lchannel(i), i);
+    if(is_void(wf)) continue;
 
     conf = vegconf(settings, lchannel(i));
     lbias(i) = biases(lchannel(i));
 
-    tmp = be_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = be_rx_wf(wf, conf);
     lintensity(i) = tmp.lintensity;
     lrx(i) = tmp.lrx;
     rets(i) = tmp.rets;
@@ -184,8 +201,8 @@ func eaarl_be_rx_channel(pulses) {
   save, pulses, lrx, lintensity, lbias, lchannel, rets;
 }
 
-func eaarl_be_rx_eaarla(pulses) {
-/* DOCUMENT eaarl_be_rx_eaarla, pulses
+func eaarl_be_rx_eaarla(pulses, threads=) {
+/* DOCUMENT eaarl_be_rx_eaarla, pulses, threads=
   Updates the given pulses oxy group object with veg last return info. The
   most sensitive channel that is not saturated will be used. The following
   fields are added to pulses:
@@ -195,9 +212,13 @@ func eaarl_be_rx_eaarla(pulses) {
     lchannel - Channel used for bottom
   Additionally, this field is overwritten:
     fintensity - Intensity at location deemed as surface by bathy algorithm
+
+  If C-ALPS provides eaarl_be_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local.
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   be_rx_channel = eaarl_be_rx_eaarla_channel;
   be_rx_wf = eaarl_be_rx_wf;
@@ -207,17 +228,32 @@ func eaarl_be_rx_eaarla(pulses) {
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = lintensity = lbias = array(float, npulses);
   lchannel = rets = array(char, npulses);
 
+  batch_conf = eaarl_rx_batch_conf(eaarl_be_rx_batch, vegconf,
+    ["thresh", "noiseadj", "max_samples", "smoothwf"],
+    save(eaarl_be_rx_wf=be_rx_wf, eaarl_be_rx_eaarla_channel=be_rx_channel));
+  if(!is_void(batch_conf)) {
+    // Passing [] for lchannel selects the channel as
+    // eaarl_be_rx_eaarla_channel does, which only picks channels that have a
+    // waveform
+    eaarl_be_rx_batch, pulses, [], batch_conf, threads=threads;
+    lchannel = pulses.lchannel;
+    w = where(lchannel);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    save, pulses, lbias;
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
-    lchannel(i) = be_rx_channel(pulses.rx(,i), conf);
+    lchannel(i) = be_rx_channel(eaarl_pulse_rxs(pulses, i), conf);
     if(!lchannel(i)) continue;
     lbias(i) = biases(lchannel(i));
 
-    tmp = be_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = be_rx_wf(eaarl_pulse_rx(pulses, lchannel(i), i), conf);
     lintensity(i) = tmp.lintensity;
     lrx(i) = tmp.lrx;
     rets(i) = tmp.rets;
@@ -111,8 +111,8 @@ func eaarl_cf_tx_copy(pulses) {
   save, pulses, ltx=pulses.ftx;
 }
 
-func eaarl_cf_rx_channel(pulses) {
-/* DOCUMENT eaarl_cf_rx_channel, pulses
+func eaarl_cf_rx_channel(pulses, threads=) {
+/* DOCUMENT eaarl_cf_rx_channel, pulses, threads=
   Updates the given pulses oxy group object with curve fitted last return info. This
   uses the same channel that was used for the first return. The following
   fields are added to pulses:
@@ -122,15 +122,20 @@ func eaarl_cf_rx_channel(pulses) {
     lchannel - Channel used for bottom
   Additionally, this field is overwritten:
     fintensity - Intensity at location deemed as surface by curve fitting algorithm
+
+  If C-ALPS provides eaarl_rx_batch, the curve fits for all pulses are done
+  in one call to its "cf" kernel with threads= threads. Default is
+  alpsrc.cores_local.
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   cf_rx_wf = eaarl_cf_rx_wf;
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   // lrx = fintensity = lintensity = lbias = array(float, npulses);
   lrx = array(long, npulses);
@@ -138,22 +143,86 @@ func eaarl_cf_rx_channel(pulses) {
   rets = array(char, npulses);
   lchannel = pulses.channel;
 
+  // With the C-ALPS cf kernel, waveforms are seeded one at a time but all of
+  // the curve fits are then done at once. STATES holds the seeding state for
+  // each pending fit, for pulse WHICH(j).
+  batch = is_func(eaarl_rx_batch);
+  if(batch) {
+    states = save();
+    which = array(long, npulses);
+    seeds = array(pointer, npulses);
+    npeaks = array(long, npulses);
+    smoothwf = array(long, 4);
+    npending = 0;
+  }
+
   for(i = 1; i <= npulses; i++) {
     if(!lchannel(i)) continue;
-    if(!pulses.rx(lchannel(i),i)) continue;
+    wf = eaarl_pulse_rx(pulses, lchannel(i), i);
+    if(is_void(wf)) continue;
 
     conf = cfconf(settings, lchannel(i));
     lbias(i) = biases(lchannel(i));
 
-    tmp = cf_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    if(batch) {
+      state = eaarl_cf_rx_wf_seed(wf, conf);
+      tmp = state.result;
+      if(!is_void(state.a)) {
+        npending++;
+        save, state, conf;
+        save, states, string(0), state;
+        which(npending) = i;
+        seeds(npending) = &double(state.a);
+        npeaks(i) = numberof(state.a)/3;
+        smoothwf(lchannel(i)) = conf.smoothwf;
+      }
+    } else {
+      tmp = cf_rx_wf(wf, conf);
+    }
     lintensity(i) = tmp.lintensity;
     lrx(i) = tmp.lrx;
     rets(i) = tmp.num_rets;
   }
 
+  if(batch && npending) {
+    which = which(:npending);
+    // Only the pulses with seeds are fitted. The kernel works from the raw
+    // waveforms, prepared as eaarl_cf_rx_wf_seed does; the seeds are in pulse
+    // order.
+    fitchannel = array(long, npulses);
+    fitchannel(which) = lchannel(which);
+    fit = eaarl_rx_batch("cf", pulses, fitchannel, save(smoothwf, itmax=200,
+      tol=0.001, seeds=merge_pointers(seeds(:npending)), npeaks),
+      threads=threads);
+    seeds = [];
+
+    last = npeaks(which)(cum)*3;
+    for(j = 1; j <= npending; j++) {
+      i = which(j);
+      if(fit.niter(i) == 200) continue;
+      state = states(j);
+      save, state, a=fit.a(last(j)+1:last(j+1));
+      // As in eaarl_cf_rx_wf, a pulse whose fit can't be finished keeps its
+      // seed result
+      tmp = eaarl_cf_rx_wf_finish_caught(state);
+      if(is_void(tmp)) continue;
+      lintensity(i) = tmp.lintensity;
+      lrx(i) = tmp.lrx;
+    }
+  }
+
   save, pulses, lrx, lintensity, lbias, lchannel, rets;
 }
 
+func eaarl_cf_rx_wf_finish_caught(state) {
+/* DOCUMENT result = eaarl_cf_rx_wf_finish_caught(state)
+  Calls eaarl_cf_rx_wf_finish with STATE and its conf (state.conf), returning
+  [] instead of raising an error if it fails. Used by eaarl_cf_rx_channel.
+*/
+  if(catch(-1)) return [];
+  return eaarl_cf_rx_wf_finish(state, state.conf);
+}
+
 func eaarl_cf_plot(raster, pulse, channel=, win=, xfma=) {
 /* DOCUMENT eaarl_cf_plot, raster, pulse, channel=, win=, xfma=
   Executes the veg algorithm for a single pulse and plots the result.
@@ -259,12 +328,48 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
       mx0 = last pulse index          -> lrx
       mv0 = last pulse peak value     -> lintensity
       nx = number of returns          -> num_rets
+
+  This is eaarl_cf_rx_wf_seed, a curve fit with lmfit, and
+  eaarl_cf_rx_wf_finish. eaarl_cf_rx_channel does the same, but fits with
+  eaarl_cf_fit_batch when C-ALPS provides it, so its results may differ
+  slightly from these.
+*/
+  state = eaarl_cf_rx_wf_seed(rx, conf, plot=plot);
+  result = state.result;
+  if(is_void(state.a)) return result;
+
+  a = state.a;
+  if (catch(-1)) return result;
+  // compute new peaks in by fitting a gauss curve to each peak.
+  xaxis = indgen(numberof(state.wf));
+  r = lmfit(eaarl_cf_lmfit_gauss, xaxis, a, state.wf, 1.0, itmax=200,
+    stdev=conf.initsd, tol=0.001);
+  if(r.niter == 200) return result;
+
+  save, state, a;
+  return eaarl_cf_rx_wf_finish(state, conf, plot=plot);
+}
+
+func eaarl_cf_rx_wf_seed(rx, conf, plot=) {
+/* DOCUMENT state = eaarl_cf_rx_wf_seed(rx, conf, plot=)
+  First half of eaarl_cf_rx_wf: prepares the waveform and finds the peaks that
+  seed the curve fit. Returns an oxy group object with these members:
+    result - The result for eaarl_cf_rx_wf, as it stands before fitting
+    a - The seed parameters for the fit (amplitude, center, and standard
+      deviation of each peak), or [] if no fit is needed because the result
+      is already final
+    wf, wfd1, edges, max_ret_len, cf_avg, cf_rms - Values needed by
+      eaarl_cf_rx_wf_finish
+
+  Once a has been replaced by the fitted parameters, pass the state to
+  eaarl_cf_rx_wf_finish.
 */
   local peaks, edges;
 
   conf = obj_copy(conf);
 
   result = save(lrx=0, lintensity=0, num_rets=0);
+  state = save(result, a=[]);
 
   // Retrieve waveform, determine max intensity value, and remove bias
   wf = float(~(rx));
@@ -288,7 +393,7 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
   save, result, num_rets=npeaks;
 
   if(!npeaks)
-    return result;
+    return state;
 
   // First derivative of waveform
   wfd1 = wf(dif);
@@ -302,7 +407,7 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
 
   if(!numberof(edges)) {
     save, result, fintensity=wf(max), lintensity=wf(max);
-    return result;
+    return state;
   }
 
   if(plot) {
@@ -319,7 +424,7 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
   max_ret_len = min(18, wflen - edges(0) - 1);
 
   // Noise pulses
-  if(max_ret_len < 5) return result;
+  if(max_ret_len < 5) return state;
 
   // compute standard deviation and select those within initsd distance
   // get stdev from peak values
@@ -329,17 +434,30 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
   if ( plot )
     write, format="Avg: %lf RMS: %lf\n", cf_avg, cf_rms;
 
-  if ( ! cf_rms ) return result;
+  if ( ! cf_rms ) return state;
 
   a = array(float, npeaks*3);
   a(1::3) = wf(peaks);     // 1: height of curve's peak
   a(2::3) = peaks;         // 2: position of center of peak
   a(3::3) = conf.initsd;   // 3: standard deviation
 
-  if (catch(-1)) return result;
-  // compute new peaks in by fitting a gauss curve to each peak.
-  r = lmfit(eaarl_cf_lmfit_gauss, xaxis, a, wf, 1.0, itmax=200, stdev=conf.initsd, tol=0.001);
-  if(r.niter == 200) return result;
+  save, state, a, wf, wfd1, edges, max_ret_len, cf_avg, cf_rms;
+  return state;
+}
+
+func eaarl_cf_rx_wf_finish(state, conf, plot=) {
+/* DOCUMENT result = eaarl_cf_rx_wf_finish(state, conf, plot=)
+  Second half of eaarl_cf_rx_wf: given the STATE from eaarl_cf_rx_wf_seed with
+  state.a replaced by the fitted parameters, locates the last return on the
+  fitted curve. Returns the result for eaarl_cf_rx_wf.
+*/
+  local a, wf, wfd1, edges, max_ret_len, cf_avg, cf_rms;
+  restore, state, a, wf, wfd1, edges, max_ret_len, cf_avg, cf_rms;
+
+  result = obj_copy(state.result);
+  wflen = numberof(wf);
+  xaxis = indgen(wflen);
+  marker = [[0,-.5,.5],[0,.866,.866]+.25];
 
   // fit a new curve to the adjusted peaks.
   yfit = eaarl_cf_lmfit_gauss(xaxis, a);
@@ -362,6 +480,8 @@ func eaarl_cf_rx_wf(rx, conf, &msg, plot=) {
         color="red", width=1;
 
     tmp = eaarl_cf_peak_finder( yfit, conf.thresh);
+    // A fitted curve without peaks has no last return
+    if(!numberof(tmp.peaks)) return result;
     if (plot) {
       // plot the entire computed curve
       plg, yfit, color="green", width=5;
@@ -62,7 +62,7 @@ func process_fs(start, stop, ext_bad_att=, channel=, opts=) {
   // Retrieve rasters
   if(is_integer(start)) {
     default, stop, start;
-    pulses = decode_rasters(start, stop);
+    pulses = decode_rasters(start, stop, packed=1);
   } else if(is_obj(start)) {
     pulses = start;
   } else {
@@ -124,7 +124,7 @@ func eaarl_fs_ftx_frx(&pulses, channel) {
   numchans = numberof(channel);
   for(i = 1; i <= numchans; i++) {
     curpulses = (i == numchans) ? pulses : obj_copy(pulses);
-    save, curpulses, channel=array(char(channel(i)), numberof(pulses.tx));
+    save, curpulses, channel=array(char(channel(i)), numberof(pulses.soe));
     result = is_void(result) ? curpulses : obj_grow(result, curpulses);
   }
   pulses = result;
@@ -220,77 +220,14 @@ func eaarl_fs_tx_cent(pulses) {
   following field to pulses:
     ftx - Location of peak (as used by first return)
 */
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
   ftx = array(float, npulses);
   for(i = 1; i <= npulses; i++) {
-    ftx(i) = cent(*pulses.tx(i))(1);
+    ftx(i) = cent(eaarl_pulse_tx(pulses, i))(1);
   }
   save, pulses, ftx;
 }
 
-func eaarl_fs_rx_cent_eaarla(pulses) {
-/* DOCUMENT eaarl_fs_rx_cent_eaarla, pulses
-  Updates the given pulses oxy group object with first return info. The most
-  sensitive channel that is not saturated will be used. The following fields
-  are added to pulses:
-    frx - Location in waveform of first return
-    fintensity - Peak intensity value of first return
-    fchannel - Channel used
-    fbias - The channel range bias (ops_conf.chn%d_range_bias)
-  Also, channel is replaced by fchannel.
-*/
-  extern ops_conf;
-
-  npulses = numberof(pulses.tx);
-  // 10000 is the "bad data" value that cent will return, match that
-  frx = array(float(10000), npulses);
-  fintensity = fbias = array(float, npulses);
-  fchannel = array(char, npulses);
-
-  // this is just to make the if() calls shorter & more readable
-  max_sfc_sat = ops_conf.max_sfc_sat;
-
-  for(i = 1; i <= npulses; i++) {
-    rx = pulses.rx(,i);
-
-    // Number of points in most sensitive channel (all channels are same
-    // length)
-    np = numberof(*rx(1));
-
-    // Give up if not at least 2 points
-    if(np < 2) continue;
-
-    // use no more than 12 for saturation check
-    np = min(np, 12);
-
-    if(numberof(where((*rx(1))(:np) < 5)) <= max_sfc_sat) {
-      fchannel(i) = 1;
-      fbias(i) = ops_conf.chn1_range_bias;
-    } else if(numberof(where((*rx(2))(:np) < 5)) <= max_sfc_sat) {
-      fchannel(i) = 2;
-      fbias(i) = ops_conf.chn2_range_bias;
-    } else {
-      fchannel(i) = 3;
-      fbias(i) = ops_conf.chn3_range_bias;
-    }
-
-    rx_cent = cent(*rx(fchannel(i)));
-    
-    // Must be water column only return
-    if(fchannel(i) == 1 && rx_cent(3) < -90) {
-      slope = 0.029625;
-      x = rx_cent(3) - 90;
-      y = slope * x;
-      rx_cent(1) += y;
-    }
-
-    frx(i) = rx_cent(1);
-    fintensity(i) = rx_cent(3);
-  }
-
-  save, pulses, frx, fintensity, fchannel, fbias, channel=fchannel;
-}
-
 func eaarl_fs_trajectory(soe) {
 /* DOCUMENT traj = eaarl_fs_trajectory(soe)
   Interpolates trajectory values needed for the given array of SOE values and
@@ -305,6 +242,17 @@ func eaarl_fs_trajectory(soe) {
 */
   extern ops_conf, soe_day_start, pnav, tans;
   sod = soe - soe_day_start;
+  use_ins = has_member(ops_conf, "use_ins_for_gps") && ops_conf.use_ins_for_gps;
+
+  // *** Attempts to use CALPS ***
+  if(is_func(eaarl_trajectory_interp)) {
+    local gps_sod, gps_alt, gps_north, gps_east;
+    eaarl_fs_gps_utm, use_ins, gps_sod, gps_alt, gps_north, gps_east;
+    return eaarl_trajectory_interp(sod, tans.somd, tans.roll, tans.pitch,
+      tans.heading, gps_sod, gps_alt, gps_north, gps_east,
+      roll_bias=ops_conf.roll_bias, pitch_bias=ops_conf.pitch_bias,
+      yaw_bias=ops_conf.yaw_bias);
+  }
 
   // Store tans in ins, reduced down to just the range we need
   bounds = digitize([sod(*)(min), sod(*)(max)], tans.somd);
@@ -318,7 +266,7 @@ func eaarl_fs_trajectory(soe) {
     return save(easting, northing, alt, pitch, roll, yaw);
   }
 
-  if(has_member(ops_conf, "use_ins_for_gps") && ops_conf.use_ins_for_gps) {
+  if(use_ins) {
     gps = ins;
     gps_sod = gps.somd;
     gps_alt = gps.alt;
@@ -357,6 +305,46 @@ func eaarl_fs_trajectory(soe) {
   return save(easting, northing, alt, pitch, roll, yaw);
 }
 
+func eaarl_fs_gps_utm(use_ins, &gps_sod, &gps_alt, &gps_north, &gps_east) {
+/* DOCUMENT eaarl_fs_gps_utm, use_ins, gps_sod, gps_alt, gps_north, gps_east
+  Retrieves the full GPS track used by eaarl_fs_trajectory: from tans if
+  USE_INS is true, otherwise from pnav. Its UTM coordinates are cached, so
+  ll2utm only runs on the track once rather than on every call. The cache is
+  replaced when the track or fixedzone changes and is discarded by
+  eaarl_mission_unload.
+*/
+  extern pnav, tans, pnav_filename, ins_filename, fixedzone;
+  extern __eaarl_fs_gps_cache;
+
+  if(use_ins) {
+    gps = tans;
+    gps_sod = gps.somd;
+    file = ins_filename;
+  } else {
+    gps = pnav;
+    gps_sod = gps.sod;
+    file = pnav_filename;
+  }
+  gps_alt = gps.alt;
+  if(is_void(file)) file = "";
+
+  key = [use_ins, numberof(gps), gps_sod(1), gps_sod(0),
+    (is_void(fixedzone) ? 0 : fixedzone), gps.lat(1), gps.lon(0)];
+
+  cache = __eaarl_fs_gps_cache;
+  if(!is_void(cache) && cache.file == file && allof(cache.key == key)) {
+    gps_north = cache.north;
+    gps_east = cache.east;
+    return;
+  }
+
+  local north, east;
+  ll2utm, gps.lat, gps.lon, north, east;
+  gps_north = north;
+  gps_east = east;
+  __eaarl_fs_gps_cache = save(file, key, north, east);
+}
+
 func eaarl_fs_spacing(channel, &scan_angles, &lasang) {
 /* DOCUMENT eaarl_fs_spacing, channel, &scan_angles, &lasang
   This adjusts scan_angles and lasang to compensate for the channel beam
@@ -77,9 +77,46 @@ func handle_process_eaarl_opts(&mode, &channel) {
   restore, hook_invoke("handle_process_eaarl_opts", save(mode, channel));
 }
 
-func process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=, opts=) {
+func eaarl_rx_batch_conf(batch, confobj, fields, funcs) {
+/* DOCUMENT conf = eaarl_rx_batch_conf(batch, confobj, fields, funcs)
+  Determines whether the C-ALPS batch kernel BATCH (such as eaarl_be_rx_batch)
+  can be used in place of the per-pulse Yorick functions. If so, returns the
+  conf group to pass to it; otherwise, returns [].
+
+  The kernels only implement the default per-pulse functions. FUNCS is an oxy
+  group that maps the name of each default function to the function actually
+  in use, which differs if it was replaced via hook.
+
+  The conf group has a member for each setting in FIELDS, retrieved from the
+  channel conf object CONFOBJ (such as vegconf) as an array indexed by
+  channel. The arrays always cover four channels; on systems with fewer, the
+  extra entries repeat the last channel's settings. Settings that are absent
+  from the conf are 0.
+*/
+  if(!is_func(batch)) return [];
+  for(i = 1; i <= funcs(*); i++)
+    if(nameof(funcs(noop(i))) != funcs(*,i)) return [];
+
+  nfields = numberof(fields);
+  vals = array(pointer, nfields);
+  for(i = 1; i <= 4; i++) {
+    conf = confobj(settings, min(i, CHANNEL_COUNT));
+    for(j = 1; j <= nfields; j++) {
+      val = conf(*,fields(j)) ? conf(fields(j)) : 0;
+      vals(j) = &grow(*vals(j), val);
+    }
+  }
+
+  result = save();
+  for(j = 1; j <= nfields; j++)
+    save, result, fields(j), *vals(j);
+  return result;
+}
+
+func process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=,
+batch=, opts=) {
 /* DOCUMENT process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=,
-   opts=)
+   batch=, opts=)
   Processes EAARL data for the given raster ranges as specified by the given
   mode.
 
@@ -103,6 +140,12 @@ func process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=, opts=) {
       handled differently based on the current EAARL plugin loaded.
     ptime= Processing time identifier. By default this will be the current SOE
       value times -1.
+    batch= Maximum number of pulses to decode and process at a time. By
+      default, the whole range is decoded at once. When set, the rasters are
+      decoded and processed in batches of whole rasters so that memory use is
+      bounded by the batch size instead of the size of the range. This is
+      ignored if START is a pulses object or if the C-ALPS plugin does not
+      provide eaarl_decode_open.
     opts= Oxy group that provides an alternative interface for providing
       function arguments/options. Any key/value pairs not used by process_eaarl
       will be passed through as-is to the underlying processing function.
@@ -111,9 +154,11 @@ func process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=, opts=) {
     An array of EAARL point cloud data, in the struct appropriate for the
     data's type.
 */
-  restore_if_exists, opts, start, stop, mode, ext_bad_att, channel, ptime;
+  restore_if_exists, opts, start, stop, mode, ext_bad_att, channel, ptime,
+    batch;
   handle_process_eaarl_opts, mode, channel;
   default, ptime, -getsoe();
+  default, batch, 0;
 
   extern eaarl_processing_modes;
   local process, cast;
@@ -123,17 +168,37 @@ func process_eaarl(start, stop, mode=, ext_bad_att=, channel=, ptime=, opts=) {
 
   passopts = save(start, stop, mode, ext_bad_att, channel);
   if(opts)
-    passopts = obj_merge(opts, passopts);
+    passopts = obj_merge(obj_delete(opts, batch), passopts);
 
-  result = cast(process(opts=passopts));
+  if(batch && is_integer(start) && is_func(eaarl_decode_open)) {
+    local tldfn, offset_start, offset_stop;
+    rn_start = start;
+    rn_stop = is_void(stop) ? start : stop;
+    raster_sources, rn_start, rn_stop, tldfn, offset_start, offset_stop;
+
+    result = [];
+    count = numberof(rn_start);
+    for(i = 1; i <= count; i++) {
+      handle = eaarl_decode_open(tldfn(i), offset_start(i), offset_stop(i),
+        rnstart=rn_start(i), packed=1);
+      while(!is_void((pulses = eaarl_decode_next(handle, batch)))) {
+        save, passopts, start=pulses;
+        result = grow(result, &cast(process(opts=passopts)));
+      }
+      handle = [];
+    }
+    result = merge_pointers(result);
+  } else {
+    result = cast(process(opts=passopts));
+  }
   if(has_member(result, "ptime")) result.ptime = ptime;
   return result;
 }
 
 func make_eaarl(mode=, q=, region=, ply=, ext_bad_att=, channel=, verbose=,
-opts=) {
+batch=, opts=) {
 /* DOCUMENT make_eaarl(mode=, q=, region=, ext_bad_att=, channel=, verbose=,
-   opts=)
+   batch=, opts=)
   Processes EAARL data for the given mode in a region specified by the user.
 
   Options for selection:
@@ -154,6 +219,10 @@ opts=) {
 
   Additional options:
     verbose= Specifies verbosity level.
+    batch= Maximum number of pulses to decode and process at a time; see
+      process_eaarl. By default, each flightline segment is decoded all at
+      once. Setting this (for example, batch=100000) bounds memory use by the
+      batch size instead of the segment length.
     opts= Oxy group that provides an alternative interface for providing
       function arguments/options. Any key/value pairs not used by make_eaarl
       will be passed through as-is to the underlying processing function.
@@ -165,7 +234,8 @@ opts=) {
   t0 = array(double, 3);
   timer, t0;
 
-  restore_if_exists, opts, mode, q, ply, region, ext_bad_att, channel, verbose;
+  restore_if_exists, opts, mode, q, ply, region, ext_bad_att, channel, verbose,
+    batch;
   handle_process_eaarl_opts, mode, channel;
   if(!is_void(ply)) {
     error, "ply= is no longer accepted by make_eaarl; use region= instead";
@@ -203,7 +273,7 @@ opts=) {
   data = array(pointer, count);
 
   ptime = -getsoe();
-  passopts = save(mode, channel, ext_bad_att, verbose, ptime);
+  passopts = save(mode, channel, ext_bad_att, verbose, ptime, batch);
   if(opts)
     passopts = obj_delete(obj_merge(opts, passopts), start, stop);
 
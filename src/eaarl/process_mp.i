@@ -89,21 +89,24 @@ func process_mp(start, stop, ext_bad_att=, channel=, opts=) {
   if(!numberof(w)) return;
   pulses = obj_index(pulses, w);
 
-  // Expand lrx and lintensity from pointer arrays into individual points. This also
-  // as a consequence gets rid of anything that had no returns. Also build up
-  // the ret_num field.
+  // Expand lrx and lintensity into individual points. This also as a
+  // consequence gets rid of anything that had no returns. Also build up the
+  // ret_num field. The returns are either pointer arrays (one per pulse) or,
+  // from eaarl_mp_rx_batch, the flat lrets group, which holds every pulse's
+  // returns in order (pulses dropped above have none).
   idx = histinv(pulses.num_rets);
-  lrx = obj_pop(pulses, "lrx");
-  lintensity = obj_pop(pulses, "lintensity");
-  n = numberof(lrx);
-  ret_num = array(pointer, n);
-  for(i = 1; i <= n; i++)
-    if(pulses.num_rets(i))
-      ret_num(i) = &char(indgen(pulses.num_rets(i)));
+  if(!numberof(idx)) return;
+  if(pulses(*,"lrets")) {
+    lrets = obj_pop(pulses, "lrets");
+    lrx = lrets.lrx;
+    lintensity = lrets.lintensity;
+  } else {
+    lrx = merge_pointers(obj_pop(pulses, "lrx"));
+    lintensity = merge_pointers(obj_pop(pulses, "lintensity"));
+  }
+  ret_num = char(indgen(numberof(idx)) - (long(pulses.num_rets)(cum))(idx));
   pulses = obj_index(pulses, idx);
-  save, pulses, lrx=merge_pointers(lrx);
-  save, pulses, lintensity=merge_pointers(lintensity);
-  save, pulses, ret_num=merge_pointers(ret_num);
+  save, pulses, lrx, lintensity, ret_num;
 
   // Adjusted offset in sample counts to surface
   fscnt = pulses.frx - pulses.ftx + pulses.fbias;
@@ -147,8 +150,8 @@ func eaarl_mp_tx_copy(pulses) {
   save, pulses, ltx=pulses.ftx;
 }
 
-func eaarl_mp_rx_channel(pulses) {
-/* DOCUMENT eaarl_mp_rx_channel, pulses
+func eaarl_mp_rx_channel(pulses, threads=) {
+/* DOCUMENT eaarl_mp_rx_channel, pulses, threads=
   Updates the given pulses oxy group object with multi-peak return info. This
   uses the same channel that was used for the first return. The following
   fields are added to pulses:
@@ -156,29 +159,49 @@ func eaarl_mp_rx_channel(pulses) {
     lintensity - Pointer to array of intensities at peaks
     lbias - The channel range bias (ops_conf.chn%d_range_bias)
     lchannel - Channel used
+    num_rets - Number of returns
+
+  If C-ALPS provides eaarl_mp_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local. In
+  that case, lrx and lintensity are replaced by lrets, an oxy group holding
+  the returns of every pulse as flat arrays (see eaarl_mp_rx_batch).
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   mp_rx_wf = eaarl_mp_rx_wf;
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = lintensity = array(pointer, npulses);
   lbias = array(float, npulses);
   num_rets = array(char, npulses);
   lchannel = pulses.channel;
 
+  batch_conf = eaarl_rx_batch_conf(eaarl_mp_rx_batch, mpconf,
+    ["thresh", "max_samples", "smoothwf", "alg_mode"],
+    save(eaarl_mp_rx_wf=mp_rx_wf));
+  if(!is_void(batch_conf)) {
+    lrets = eaarl_mp_rx_batch(pulses, lchannel, batch_conf, threads=threads);
+    // As below, pulses without a waveform on their channel keep lbias 0
+    w = where(lrets.had);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    save, pulses, lrets, lbias, lchannel;
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
     if(!lchannel(i)) continue;
-    if(!pulses.rx(lchannel(i),i)) continue;
+    wf = eaarl_pulse_rx(pulses, lchannel(i), i);
+    if(is_void(wf)) continue;
 
     conf = mpconf(settings, lchannel(i));
     lbias(i) = biases(lchannel(i));
 
-    tmp = mp_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = mp_rx_wf(wf, conf);
     lintensity(i) = &tmp.lintensity;
     lrx(i) = &tmp.lrx;
     num_rets(i) = tmp.num_rets;
@@ -187,8 +210,8 @@ func eaarl_mp_rx_channel(pulses) {
   save, pulses, lrx, lintensity, lbias, lchannel, num_rets;
 }
 
-func eaarl_mp_rx_eaarla(pulses) {
-/* DOCUMENT eaarl_mp_rx_eaarla, pulses
+func eaarl_mp_rx_eaarla(pulses, threads=) {
+/* DOCUMENT eaarl_mp_rx_eaarla, pulses, threads=
   Updates the given pulses oxy group object with multi-peak return info. The
   most sensitive channel that is not saturated will be used. The following
   fields are added to pulses:
@@ -196,9 +219,16 @@ func eaarl_mp_rx_eaarla(pulses) {
     lintensity - Pointer to array of intensities at peaks
     lbias - The channel range bias (ops_conf.chn%d_range_bias)
     lchannel - Channel used
+    num_rets - Number of returns
+
+  If C-ALPS provides eaarl_mp_rx_batch, it is used to process all of the
+  pulses at once with threads= threads. Default is alpsrc.cores_local. In
+  that case, lrx and lintensity are replaced by lrets, an oxy group holding
+  the returns of every pulse as flat arrays (see eaarl_mp_rx_batch).
 */
   local conf;
   extern ops_conf;
+  default, threads, alpsrc.cores_local;
 
   mp_rx_channel = eaarl_mp_rx_eaarla_channel;
   mp_rx_wf = eaarl_mp_rx_wf;
@@ -208,20 +238,36 @@ func eaarl_mp_rx_eaarla(pulses) {
 
   biases = get_range_biases(ops_conf);
 
-  npulses = numberof(pulses.tx);
+  npulses = numberof(pulses.soe);
 
   lrx = lintensity = array(pointer, npulses);
   lbias = array(float, npulses);
   num_rets = array(char, npulses);
   lchannel = array(char, npulses);
 
+  batch_conf = eaarl_rx_batch_conf(eaarl_mp_rx_batch, mpconf,
+    ["thresh", "max_samples", "smoothwf", "alg_mode"],
+    save(eaarl_mp_rx_wf=mp_rx_wf, eaarl_mp_rx_eaarla_channel=mp_rx_channel));
+  if(!is_void(batch_conf)) {
+    // Passing [] for lchannel selects the channel as
+    // eaarl_mp_rx_eaarla_channel does, which only picks channels that have a
+    // waveform
+    lrets = eaarl_mp_rx_batch(pulses, [], batch_conf, threads=threads);
+    lchannel = pulses.lchannel;
+    w = where(lchannel);
+    if(numberof(w)) lbias(w) = biases(lchannel(w));
+    save, pulses, lrets, lbias;
+    return;
+  }
+
   for(i = 1; i <= npulses; i++) {
-    lchannel(i) = mp_rx_channel(pulses.rx(,i), conf);
+    lchannel(i) = mp_rx_channel(eaarl_pulse_rxs(pulses, i), conf);
     if(!lchannel(i)) continue;
-    if(!pulses.rx(lchannel(i),i)) continue;
+    wf = eaarl_pulse_rx(pulses, lchannel(i), i);
+    if(is_void(wf)) continue;
     lbias(i) = biases(lchannel(i));
 
-    tmp = mp_rx_wf(*pulses.rx(lchannel(i),i), conf);
+    tmp = mp_rx_wf(wf, conf);
     lintensity(i) = &tmp.lintensity;
     lrx(i) = &tmp.lrx;
     num_rets(i) = tmp.num_rets;
@@ -355,9 +401,22 @@ func eaarl_mp_rx_wf(rx, conf, &msg, plot=) {
 
   Returns:
     An oxy group object with these members:
-      lrx - array of peak locations in waveform
+      lrx - array of return locations in waveform
       lintensity - array of intensities at lrx locations
       num_rets - number of peaks (returns) found
+
+  Each leading edge that exceeds conf.thresh is a return. How each is located
+  depends on conf.alg_mode:
+    "peak" - The peak following the leading edge (the default).
+    "cent" - As ex_veg_alg with alg_mode="cent" locates the last return: the
+      centroid of the section of the waveform after the leading edge, up to
+      where trailing_edge finds its end. Returns that fail its intensity
+      tests are dropped. lrx is fractional (double).
+    "none" - As ex_veg_noalg_none locates the last return: the highest of the
+      six samples starting at the leading edge.
+  For "cent" and "none", the leading edges are those ex_veg finds, and
+  returns with fewer than 5 samples after the leading edge are dropped as
+  noise.
 */
   conf = obj_copy(conf);
   sample_interval = 1.0;
@@ -414,14 +473,58 @@ func eaarl_mp_rx_wf(rx, conf, &msg, plot=) {
 
   edges = where(edges);
   peaks = where(peaks);
-  save, result, num_rets=numberof(peaks);
+  lrx = peaks;
+
+  if(conf.alg_mode == "cent" || conf.alg_mode == "none") {
+    // Locate a return at each leading edge XR as ex_veg locates the last one:
+    // "cent" as ex_veg_alg does and "none" as ex_veg_noalg_none does
+    local retdist, idx1;
+    xr = where((wf(dif) >= conf.thresh)(dif) == 1);
+    lrx = lintensity = edges = [];
+    for(k = 1; k <= numberof(xr); k++) {
+      x = xr(k);
+      // Assume 18ns to be the longest duration for a return, but truncate
+      // based on length of waveform. Shorter than 5 is a noise pulse.
+      retdist = min(18, nwf - x - 1);
+      if(retdist < 5) continue;
+
+      if(conf.alg_mode == "none") {
+        // ex_veg_noalg_none takes its intensity from wf(mvx), the offset of
+        // the peak within wf(x:x+5), rather than from the peak itself; this
+        // uses the peak
+        mx = x + wf(x:x+5)(mxx) - 1;
+        grow, lrx, mx;
+        grow, lintensity, wf(mx);
+      } else {
+        trailing_edge, wf, retdist, idx1, xr=[x];
+        wf_tail = wf(x+1:x+retdist);
+        // Intensity test
+        if(abs(wf_tail(1) - wf_tail(0)) >= 0.8*wf_tail(max)) continue;
+        if(min(wf_tail) > 240 && max(wf_tail) < conf.thresh) continue;
+        // wf_centroid takes integers, as ex_veg's waveforms are
+        wf_tail = long(wf_tail);
+        if(!wf_tail(sum)) continue;
+        cent = wf_centroid(wf_tail);
+        if(cent <= 0 || int(x+cent) > nwf) continue;
+        grow, lrx, x + cent;
+        // As for ex_veg_alg, the intensity is that of the sample the centroid
+        // falls in
+        grow, lintensity, wf(int(x+cent));
+      }
+      // For plotting, the first sample past the threshold, as for "peak"
+      grow, edges, x + 2;
+    }
+  } else if(conf.alg_mode != "peak") {
+    error, "unknown alg_mode: "+conf.alg_mode;
+  }
 
-  if(!numberof(peaks)) {
+  save, result, num_rets=numberof(lrx);
+  if(!numberof(lrx)) {
     return result;
   }
 
-  save, result, lrx=peaks;
-  save, result, lintensity=wf(peaks);
+  if(conf.alg_mode == "peak") lintensity = wf(lrx);
+  save, result, lrx, lintensity;
 
   if(plot) {
     // Use an equilateral triangle as a marker, but moved up a smidge
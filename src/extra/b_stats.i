@@ -33,9 +33,7 @@ func process_b_stats(start, stop, ext_bad_att=, channel=, opts=) {
   for(i = 1; i <= npulses; i++) {
     if(!pulses.lchannel(i)) continue;
     if(pulses.lrx(i) <= 0) continue;
-    if(!pulses.rx(pulses.lchannel(i),i)) continue;
-
-    wf = *pulses.rx(pulses.lchannel(i),i);
+    wf = eaarl_pulse_rx(pulses, pulses.lchannel(i), i);
     if(!numberof(wf)) continue;
 
     wf = float(~wf);
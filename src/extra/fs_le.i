@@ -76,7 +76,7 @@ func eaarl_fs_rx_channel_le(pulses) {
     }
 
     // Retrieve wf, flip and remove bias
-    rx = *pulses.rx(pulses.fchannel(j),j);
+    rx = eaarl_pulse_rx(pulses, pulses.fchannel(j), j);
     wf = short(~rx);
     wf -= wf(1);
 
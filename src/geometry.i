@@ -98,8 +98,8 @@ func affine_transform(&sx, &sy, coeffs) {
   }
 }
 
-func find_nearest_point(x, y, xs, ys, force_single=, radius=) {
-/* DOCUMENT find_nearest_point(x, y, xs, ys, force_single=, radius=)
+func find_nearest_point(x, y, xs, ys, force_single=, radius=, index=) {
+/* DOCUMENT find_nearest_point(x, y, xs, ys, force_single=, radius=, index=)
 
   Returns the index(es) of the nearest point(s) to a specified location.
 
@@ -122,10 +122,31 @@ func find_nearest_point(x, y, xs, ys, force_single=, radius=) {
       by the square root of 2 on each interation of the search. By
       default, radius initializes to 1.
 
+    index= A spatial index for xs, ys made by spatial_index. When searching
+      the same points repeatedly, building this once and passing it in
+      avoids scanning all of the points for each search. (radius= is
+      ignored in this case.)
+
+      With index=, the nearest points are always found exactly: every
+      bucket that could hold a nearer point is searched. Without it, the
+      search box is grown by multiplying radius by the square root of 2, so
+      a nearer point lying right on the edge of the final box can be missed
+      to rounding and a slightly farther one returned instead.
+
   Function returns:
 
     The index (or indexes) of the point(s) nearest to the specified point.
 */
+  if(!is_void(index)) {
+    local dist;
+    spatial_index_nearest, index, x, y, dist;
+    if(dist < 0)
+      return [];
+    // Every point at the nearest distance
+    point_indx = spatial_index_radius(index, x, y, dist);
+    return find_nearest_point_pick(point_indx, force_single);
+  }
+
   // Validate radius
   if(is_void(radius)) radius = 1.0;
   radius = abs(radius);
@@ -155,6 +176,13 @@ func find_nearest_point(x, y, xs, ys, force_single=, radius=) {
   // Find the indexes in the original array that have the min dist
   point_indx = where(dist == min_dist);
 
+  return find_nearest_point_pick(point_indx, force_single);
+}
+
+func find_nearest_point_pick(point_indx, force_single) {
+/* DOCUMENT find_nearest_point_pick(point_indx, force_single)
+  Internal helper for find_nearest_point that picks from equally near points.
+*/
   // Force single return if necessary
   if(force_single > 0) {
     pick = int(floor(numberof(point_indx) * random() + 1));
@@ -167,8 +195,8 @@ func find_nearest_point(x, y, xs, ys, force_single=, radius=) {
   return point_indx;
 }
 
-func find_points_in_radius(x, y, xs, ys, radius=) {
-/* DOCUMENT find_points_in_radius(x, y, xs, ys, radius=)
+func find_points_in_radius(x, y, xs, ys, radius=, index=) {
+/* DOCUMENT find_points_in_radius(x, y, xs, ys, radius=, index=)
 
   Returns the index(es) of the points within a radius of a specified location.
 
@@ -184,6 +212,11 @@ func find_points_in_radius(x, y, xs, ys, radius=) {
     radius= The radius within which to search. By default, radius
       initializes to 3.
 
+    index= A spatial index for xs, ys made by spatial_index. When searching
+      the same points repeatedly, building this once and passing it in
+      avoids scanning all of the points for each search. To search around
+      many locations at once, use spatial_index_radius directly.
+
   Function returns:
 
     The indexes of the points within radius.
@@ -192,6 +225,9 @@ func find_points_in_radius(x, y, xs, ys, radius=) {
   if(is_void(radius)) { radius = 3.0; }
   radius = abs(radius);
 
+  if(!is_void(index))
+    return spatial_index_radius(index, x, y, radius);
+
   // Initialize the indx of points in the box def by radius
   indx = data_box(xs, ys, x-radius, x+radius, y-radius, y+radius);
   if(!numberof(indx))
@@ -392,6 +428,20 @@ func point_project(p1, p2, dist, tp=) {
     > point_project([0,1], [0,0], 1)
     [0,-1]
 */
+  // *** Attempts to use CALPS ***
+  // Handles the common case of 3D points with tp=1, as used to project last
+  // returns along the beam.
+  dims = dimsof(p1);
+  if(tp && is_func(_ypoint_project3) && dims(1) == 2 && dims(3) == 3 &&
+    numberof(dimsof(p2)) == 3 && allof(dimsof(p2) == dims) &&
+    (numberof(dist) == 1 || numberof(dist) == dims(2))) {
+    result = array(double, dims);
+    if(_ypoint_project3(double(p1), double(p2), double(dist), numberof(dist),
+      result, dims(2)))
+      error, "p1 and p2 must not be the same";
+    return result;
+  }
+
   d1 = ppdist(p1, p2, tp=tp);
   if(nallof(d1))
     error, "p1 and p2 must not be the same";
@@ -358,9 +358,10 @@ xsnap=, ysnap=) {
   ymax = ymin + ycount * cell;
 }
 
-func triangle_grid(x, y, z, v, xmin=, xmax=, ymin=, ymax=, cell=, nodata=) {
+func triangle_grid(x, y, z, v, xmin=, xmax=, ymin=, ymax=, cell=, nodata=,
+threads=) {
 /* DOCUMENT grid = triangle_grid(x, y, z, v, xmin=, xmax=, ymin=, ymax=, cell=,
-  nodata=, progress=)
+  nodata=, threads=)
 
   Creates a grid for the data x,y,z using the triangulation defined by v.
 
@@ -378,22 +379,47 @@ func triangle_grid(x, y, z, v, xmin=, xmax=, ymin=, ymax=, cell=, nodata=) {
     ymax= Maximum y value for grid. (May be adjusted based on ymin and cell.)
     cell= Cell size for grid.
     nodata= Nodata value to use.
+    threads= Number of threads to use when C-ALPS is available. Defaults to
+      alpsrc.cores_local.
+
+  When C-ALPS is available, each triangle is rasterized onto the grid by
+  triangle_grid_cells, which gives the same results as triangle_interp in
+  time proportional to the size of the grid.
 */
   default, nodata, -32767.;
   default, cell, 1.;
   cell = double(cell);
+  default, threads, alpsrc.cores_local;
 
   grid_fix_params, x, y, cell, xmin, xmax, ymin, ymax, xcount, ycount;
 
-  xgrid = ygrid = array(double, xcount, ycount);
-  zgrid = array(double(nodata), xcount, ycount);
-
   // Each point represents a grid square, so we want to actually interpolate
   // for the cell centers.
   hc = 0.5 * cell;
+
+  // *** Attempts to use CALPS ***
+  if(is_func(triangle_grid_cells)) {
+    local v1, v2, v3;
+    splitary, v, 3, v1, v2, v3;
+    zgrid = triangle_grid_cells(x, y, z, v1, v2, v3,
+      span(xmin+hc, xmax-hc, xcount), span(ymin+hc, ymax-hc, ycount),
+      nodata, threads=threads);
+    goto FINISH;
+  }
+
+  xgrid = ygrid = array(double, xcount, ycount);
+  zgrid = array(double(nodata), xcount, ycount);
   xgrid(,) = span(xmin+hc, xmax-hc, xcount)(,-);
   ygrid(,) = span(ymin+hc, ymax-hc, ycount)(-,);
 
+  // Newer versions of _ytriangle_interp index the triangles themselves, so
+  // the whole grid can be done at once instead of block by block
+  if(is_func(calps_compatibility) && calps_compatibility() >= 26) {
+    zgrid = triangle_interp(x, y, z, v, xgrid, ygrid, nodata=nodata);
+    xgrid = ygrid = [];
+    goto FINISH;
+  }
+
   xv = x(v);
   yv = y(v);
   xvmin = xv(,min);
@@ -445,6 +471,7 @@ func triangle_grid(x, y, z, v, xmin=, xmax=, ymin=, ymax=, cell=, nodata=) {
   }
   status, finished;
 
+FINISH:
   // Check to see if we can safely convert to floats. If the float version
   // agrees with the double version to within 0.5mm, then switch to floats.
   fzgrid = float(zgrid);
@@ -474,6 +501,11 @@ func triangle_interp(x, y, z, v, xp, yp, nodata=) {
   Options:
     nodata= Value to use when no interpolation is possible.
         nodata=-32767.    (default)
+
+  If a point is in more than one triangle (for instance, on a shared edge),
+  the first of them in v is used. With C-ALPS version 26 and up, the
+  triangles are indexed by location on each call, so this is fast even for
+  large numbers of triangles and points.
 */
   default, nodata, -32767.;
 
@@ -517,9 +549,9 @@ cell=, maxradius=, minpoints=, wtpower=, verbose=) {
 }
 
 func radius_grid(x, y, z, method, xmin=, xmax=, ymin=, ymax=, cell=, nodata=,
-maxradius=, minpoints=, wtpower=, verbose=) {
+maxradius=, minpoints=, wtpower=, verbose=, threads=) {
 /* DOCUMENT grid = radius_grid(x, y, z, method, xmin=, xmax=, ymin=, ymax=,
-  cell=, nodata=, maxradius=, minpoints=, wtpower=)
+  cell=, nodata=, maxradius=, minpoints=, wtpower=, threads=)
 
   Creates a grid for the data x,y,z using one of two radius-based methods:
   invdist or average.
@@ -542,6 +574,12 @@ maxradius=, minpoints=, wtpower=, verbose=) {
     minpoints= Minimum points that must be found to perform interpolation.
     wtpower= Weighting power ("invdist" only).
     verbose= Specifies how chatty to be, default is verbose=1.
+    threads= Number of threads to use when C-ALPS is available. Defaults to
+      alpsrc.cores_local.
+
+  When C-ALPS is available, the cells are all calculated in one pass by
+  radius_grid_cells, which gives the same results as the Yorick code much
+  more quickly.
 */
   default, nodata, -32767.;
   default, cell, 1.;
@@ -551,6 +589,7 @@ maxradius=, minpoints=, wtpower=, verbose=) {
   default, wtpower, 2;
   default, method, "invdist";
   default, verbose, 1;
+  default, threads, alpsrc.cores_local;
 
   grid_fix_params, x, y, cell, xmin, xmax, ymin, ymax, xcount, ycount;
 
@@ -565,6 +604,19 @@ maxradius=, minpoints=, wtpower=, verbose=) {
 
   t0 = array(double, 3);
   timer, t0;
+
+  // *** Attempts to use CALPS ***
+  if(is_func(radius_grid_cells)) {
+    if(method != "invdist" && method != "average")
+      error, "Unknown method";
+    zgrid = radius_grid_cells(x, y, z, xgrid(,1), ygrid(1,), method,
+      maxradius, minpoints, wtpower, nodata, threads=threads);
+    if(verbose)
+      timer_finished, t0;
+    xgrid = ygrid = [];
+    goto FINISH;
+  }
+
   step = 50;
   if(verbose)
     write, format="Need to grid for %d rows...\n", dimsof(zgrid)(2);
@@ -619,6 +671,7 @@ maxradius=, minpoints=, wtpower=, verbose=) {
   if(verbose)
     timer_finished, t0;
 
+FINISH:
   // Check to see if we can safely convert to floats. If the float version
   // agrees with the double version to within 0.5mm, then switch to floats.
   fzgrid = float(zgrid);
@@ -651,6 +704,18 @@ func moveavg_interp(x, y, z, xp, yp, mrad, minpts, nodata=) {
 */
   default, nodata, -32767.;
   zp = array(double(nodata), dimsof(xp));
+
+  // *** Attempts to use CALPS ***
+  if(is_func(spatial_index)) {
+    local start;
+    list = spatial_index_radius(spatial_index(x, y), xp, yp, mrad, start);
+    for(i = 1; i <= numberof(xp); i++) {
+      if(start(i+1) > start(i) && start(i+1) - start(i) >= minpts)
+        zp(i) = z(list(start(i):start(i+1)-1))(avg);
+    }
+    return zp;
+  }
+
   for(i = 1; i <= numberof(xp); i++) {
     idx = find_points_in_radius(xp(i), yp(i), x, y, radius=mrad);
     if(numberof(idx) >= minpts)
@@ -684,8 +749,19 @@ func invdist_interp(x, y, z, xp, yp, mrad, minpts, wp, nodata=) {
 */
   default, nodata, -32767.;
   zp = array(double(nodata), dimsof(xp));
+
+  // *** Attempts to use CALPS ***
+  // The points for each location are found all at once, then handled as
+  // below
+  local start;
+  if(is_func(spatial_index))
+    list = spatial_index_radius(spatial_index(x, y), xp, yp, mrad, start);
+
   for(i = 1; i <= numberof(xp); i++) {
-    idx = find_points_in_radius(xp(i), yp(i), x, y, radius=mrad);
+    if(is_void(start))
+      idx = find_points_in_radius(xp(i), yp(i), x, y, radius=mrad);
+    else
+      idx = start(i+1) > start(i) ? list(start(i):start(i+1)-1) : [];
     if(numberof(idx) >= minpts) {
       dist = ppdist([x(idx), y(idx)], [xp(i), yp(i)], tp=1);
       if(anyof(!dist)) {
@@ -769,6 +845,14 @@ xsnap=, ysnap=) {
   grid_fix_params, x, y, cell, xmin, xmax, ymin, ymax, xcount, ycount,
     xsnap=xsnap, ysnap=ysnap;
 
+  // *** Attempts to use CALPS ***
+  // This does everything below in one pass, with the same results
+  if(is_func(cell_grid_cells)) {
+    zgrid = cell_grid_cells(x, y, z, method, xmin, ymin, cell, xcount, ycount,
+      nodata, xsnap=xsnap, ysnap=ysnap);
+    goto FINISH;
+  }
+
   // Restrict data to bounds (cell-based algorithm only uses data in each cell)
   w = data_box(x, y, xmin, xmax, ymin, ymax,
     keepxmin=xsnap=="w", keepxmax=xsnap=="e",
@@ -125,9 +125,20 @@ func gt_extract_comparisons(model, truth, modelmode=, truthmode=, radius=) {
       Y = ty(tw);
       Z = tz(tw);
       count = numberof(mw);
+
+      // *** Attempts to use CALPS ***
+      // Finds the truth points for all of these model points at once
+      start = [];
+      if(is_func(spatial_index))
+        list = spatial_index_radius(spatial_index(X, Y), mx(mw), my(mw),
+          radius, start);
+
       for(i = 1; i <= count; i++) {
         j = mw(i);
-        idx = find_points_in_radius(mx(j), my(j), X, Y, radius=radius);
+        if(is_void(start))
+          idx = find_points_in_radius(mx(j), my(j), X, Y, radius=radius);
+        else
+          idx = start(i+1) > start(i) ? list(start(i):start(i+1)-1) : [];
         if(!numberof(idx))
           continue;
 
@@ -25,10 +25,12 @@
 */
 
 func fll2utm {}
-func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
-/* DOCUMENT u = ll2utm(lat, lon, force_zone=, ellipsoid=)
-  ll2utm, lat, lon, north, east, zone, force_zone=, ellipsoid=
-  uxyz = ll2utm(llxyz, force_zone=, ellipsoid=)
+func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=, fast=,
+threads=) {
+/* DOCUMENT u = ll2utm(lat, lon, force_zone=, ellipsoid=, fast=, threads=)
+  ll2utm, lat, lon, north, east, zone, force_zone=, ellipsoid=, fast=,
+    threads=
+  uxyz = ll2utm(llxyz, force_zone=, ellipsoid=, fast=, threads=)
 
   (This function can be called as either ll2utm or fll2utm; both are the same
   function.)
@@ -56,6 +58,14 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
   The ellipsoid= option allows you to specify the ellipsoid to operate in.
   This defaults to ellipsoid="wgs84". See help, ELLIPSOID for other options.
 
+  The fast= and threads= options only have an effect when C-ALPS is
+  available. Setting fast=1 calculates the trigonometric functions in single
+  precision, which is quicker but puts the result within about 3 cm of the
+  full precision one (rather than within nanometers). The threads= option
+  gives the number of threads to use, defaulting to alpsrc.cores_local.
+  Conversions are only split up when each thread would get a sizable share
+  of the points.
+
   Historic note: The function ll2utm used to be separate from fll2utm. It
   would set the extern variables UTMNorthing, UTMEasting, and ZoneNumber. This
   usage was removed 2010-03-03 and both functions were made equivalent. If you
@@ -82,17 +92,19 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
       error, "Invalid call to ll2utm";
     }
     ll2utm, lat, lon, north, east, zone, force_zone=force_zone,
-      ellipsoid=ellipsoid;
+      ellipsoid=ellipsoid, fast=fast, threads=threads;
     if(is_void(force_zone) && allof(zone != zone(1))) {
       force_zone = histogram(zone)(mxx);
       ll2utm, lat, lon, north, east, zone, force_zone=force_zone,
-        ellipsoid=ellipsoid;
+        ellipsoid=ellipsoid, fast=fast, threads=threads;
     }
     return is_void(z) ? [east, north] : [east, north, z];
   }
 
   extern fixedzone, curzone;
   default, ellipsoid, "wgs84";
+  default, fast, 0;
+  default, threads, alpsrc.cores_local;
 
   // Retrieve ellipsoid-specific constants
   // a is semi-major axis
@@ -100,15 +112,18 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
   // e2 is eccentricity squared
   e2 = ELLIPSOID(ellipsoid).e2;
 
-  // Make sure we're working with copies so we don't change source data.
-  lat = (lat);
-  lon = (lon);
-
   // Make sure lat/lon are compatible
   dims = dimsof(lat, lon);
   if(is_void(dims))
     error, "lat and lon are not conformable";
 
+  // Make sure we're working with copies so we don't change source data. The
+  // batch conversion in CALPS leaves its input alone, so it can skip this.
+  if(!is_func(_yll2utm_batch)) {
+    lat = (lat);
+    lon = (lon);
+  }
+
   // Initialize output arrays
   north = east = array(double, dims);
   zone = array(short(0), dims);
@@ -128,6 +143,14 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
   }
 
   // *** Attempts to use CALPS ***
+  if(is_func(_yll2utm_batch)) {
+    _yll2utm_batch, double(lat), double(lon), north, east, zone,
+      numberof(zone), a, e2, threads, (fast ? 1n : 0n);
+    if(am_subroutine())
+      return;
+    else
+      return transpose([north, east, zone]);
+  }
   if(is_func(_yll2utm)) {
     _yll2utm, lat, lon, north, east, zone, numberof(zone), a, e2;
     if(am_subroutine())
@@ -136,9 +159,10 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
       return transpose([north, east, zone]);
   }
 
-  // The code that follows is structured to mirror the code in the C function
-  // from CALPS, so that the two can be kept in sync in case of code changes /
-  // bug fixes.
+  // The code that follows uses the same PP1395 equations as the C function
+  // from CALPS. The C version rearranges them to take fewer trigonometric
+  // calls, so it no longer follows this line by line, but fixes to one should
+  // be carried over to the other.
 
   // *** Calculate scalar values ***
 
@@ -222,9 +246,9 @@ func ll2utm(lat, lon, &north, &east, &zone, force_zone=, ellipsoid=) {
 }
 fll2utm = ll2utm;
 
-func utm2ll(north, east, zone, &lon, &lat, ellipsoid=) {
-/* DOCUMENT ll = utm2ll(north, east, zone, ellipsoid=)
-  utm2ll, north, east, zone, lon, lat, ellipsoid=;
+func utm2ll(north, east, zone, &lon, &lat, ellipsoid=, fast=, threads=) {
+/* DOCUMENT ll = utm2ll(north, east, zone, ellipsoid=, fast=, threads=)
+  utm2ll, north, east, zone, lon, lat, ellipsoid=, fast=, threads=;
 
   Converts UTM coordinates (north, east, zone) to geographic coordinates
   (lat/lon).
@@ -235,9 +259,15 @@ func utm2ll(north, east, zone, &lon, &lat, ellipsoid=) {
   The ellipsoid= option allows you to specify the ellipsoid to operate in.
   This defaults to ellipsoid="wgs84". See help, ELLIPSOID for other options.
 
+  The fast= and threads= options only have an effect when C-ALPS is
+  available; see ll2utm. With fast=1, the result is within about 3 cm of the
+  full precision one.
+
   SEE ALSO: ll2utm
 */
   default, ellipsoid, "wgs84";
+  default, fast, 0;
+  default, threads, alpsrc.cores_local;
 
   // *** Calculate scalar values ***
 
@@ -258,16 +288,21 @@ func utm2ll(north, east, zone, &lon, &lat, ellipsoid=) {
       east += lat;
     if(numberof(zone) < count)
       zone += lat;
-    _yutm2ll, north, east, short(zone), lon, lat, count, a, e2;
+    if(is_func(_yutm2ll_batch))
+      _yutm2ll_batch, double(north), double(east), short(zone), lon, lat,
+        count, a, e2, threads, (fast ? 1n : 0n);
+    else
+      _yutm2ll, north, east, short(zone), lon, lat, count, a, e2;
     if(am_subroutine())
       return;
     else
       return [lon, lat];
   }
 
-  // The code that follows is structured to mirror the code in the C function
-  // from CALPS, so that the two can be kept in sync in case of code changes /
-  // bug fixes.
+  // The code that follows uses the same PP1395 equations as the C function
+  // from CALPS. The C version rearranges them to take fewer trigonometric
+  // calls, so it no longer follows this line by line, but fixes to one should
+  // be carried over to the other.
 
   // Scale factor along central meridian
   k0 = 0.9996;
@@ -58,6 +58,60 @@ func geoid_load(fn) {
   );
 }
 
+func geoid_cached(fn, data=) {
+/* DOCUMENT g = geoid_cached(fn, data=)
+  Returns the GEOID data for a file as an oxy group with the same fields as
+  geoid_load, keeping it around for later calls so that each file is only
+  read once per session.
+
+  If C-ALPS is available, NGS .bin files are memory-mapped with geoid_map
+  instead of being read. In that case, g.map holds the mapping and g.data is
+  not present; only the parts of the grid that are actually used get read
+  from disk. Other formats are loaded with geoid_load. Pass data=1 when g.data
+  is needed regardless; it is then loaded and kept with the cached mapping.
+
+  Use geoid_cache_clear to discard the cached data (for instance, if the
+  files change).
+*/
+  extern __geoid_cache;
+  if(is_void(__geoid_cache))
+    __geoid_cache = save();
+  if(__geoid_cache(*,fn)) {
+    g = __geoid_cache(noop(fn));
+    if(data && !g(*,"data"))
+      save, g, data=geoid_load(fn).data;
+    return g;
+  }
+
+  if(is_func(geoid_map) && strlower(file_extension(fn)) == ".bin") {
+    map = geoid_map(fn);
+    g = save(
+      glamn=map.glamn,
+      glomn=(map.glomn < 0 ? 360 + map.glomn : map.glomn),
+      dla=map.dla,
+      dlo=map.dlo,
+      nrows=map.nrows,
+      ncols=map.ncols,
+      itype=map.itype,
+      map
+    );
+    if(data)
+      save, g, data=geoid_load(fn).data;
+  } else {
+    g = geoid_load(fn);
+  }
+  save, __geoid_cache, noop(fn), g;
+  return g;
+}
+
+func geoid_cache_clear(void) {
+/* DOCUMENT geoid_cache_clear
+  Discards the GEOID data cached by geoid_cached.
+*/
+  extern __geoid_cache;
+  __geoid_cache = save();
+}
+
 func geoid_open(fn) {
 /* DOCUMENT f = geoid_open(fn)
   Opens a GEOID file for NAVD-88 conversions.  This is primarily for internal
@@ -258,7 +312,7 @@ func navd88_geoid_file_coverage(lon, lat, geoid, gdata_dir=) {
   // Get bounds for each file
   latmin = latmax = lonmin = lonmax = array(double, numberof(files));
   for(i = 1; i <= numberof(files); i++) {
-    g = geoid_load(files(i));
+    g = geoid_cached(files(i));
     latmin(i) = g.glamn;
     lonmin(i) = g.glomn;
     latmax(i) = latmin(i) + g.dla * (g.nrows - 1);
@@ -318,9 +372,10 @@ func navd882nad83(lon, lat, &elv, gdata_dir=, geoid=, verbose=) {
   }
 }
 
-func nad832navd88offset(lon, lat, gdata_dir=, geoid=, verbose=, interpolator=) {
+func nad832navd88offset(lon, lat, gdata_dir=, geoid=, verbose=, interpolator=,
+threads=) {
 /*DOCUMENT offset = nad832navd88offset(lon, lat, gdata_dir=, geoid_version=,
-  interpolator=)
+  interpolator=, threads=)
   This function provides the offset between NAD83 and NAVD88 data at a given
   lat/lon location using the GEOIDxx model.
 
@@ -340,7 +395,11 @@ func nad832navd88offset(lon, lat, gdata_dir=, geoid=, verbose=, interpolator=) {
       If gdata_dir= is specified, then geoid= is ignored.
     interpolator= The interpolator function to use. Default is:
         interpolator=n88_interp2d
-      See help on n88_interp2d for further details.
+      See help on n88_interp2d for further details. When this is left at its
+      default and the GEOID file is memory-mapped (see geoid_cached), the
+      equivalent spline interpolation geoid_map_interp is used instead.
+    threads= Number of threads geoid_map_interp may use. Defaults to
+      alpsrc.cores_local.
 
   Output:
     The returns an array of offset values between NAD83 and NAVD88 for each
@@ -362,6 +421,8 @@ func nad832navd88offset(lon, lat, gdata_dir=, geoid=, verbose=, interpolator=) {
   default, geoid, "03";
   default, gdata_dir, file_join(alpsrc.geoid_data_root, "GEOID"+geoid);
   default, verbose, 1;
+  default, threads, alpsrc.cores_local;
+  use_map = is_void(interpolator) && nameof(n88_interp2d) == "n88_interp2d";
   default, interpolator, n88_interp2d;
 
   if(lon(1) < 0)
@@ -391,13 +452,17 @@ func nad832navd88offset(lon, lat, gdata_dir=, geoid=, verbose=, interpolator=) {
       write, format="grid file = %s\n", needed(i);
 
     w = where(which == needed(i));
-    g = geoid_load(needed(i));
+    // The full grid is only needed for an interpolator other than the default
+    g = geoid_cached(needed(i), data=!use_map);
 
     // Figure out where we are in the lat/lon grid
     ix = 1 + (lon(w) - g.glomn) / g.dlo;
     iy = 1 + (lat(w) - g.glamn) / g.dla;
 
-    offset(w) = interpolator(ix, iy, g.data);
+    if(use_map && g(*,"map"))
+      offset(w) = geoid_map_interp(g.map, ix, iy, threads=threads);
+    else
+      offset(w) = interpolator(ix, iy, g.data);
   }
   return offset;
 }
@@ -0,0 +1,146 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). The bias is the minimum of the
+// first 15 samples, 10 for all of these.
+//
+// The decay settings are steep enough that exp(laser*depth) and
+// exp(water*depth) underflow to nothing past the first sample and the agc
+// reaches 1 there. After the surface, the compensated waveform is then the
+// waveform itself, which keeps the expected values exact.
+
+// The surface peaks at sample 6 (50-10=40), so surface=6, escale=39 and
+// fintensity=40. After removing the bias and compensating:
+//   wf_decay = [-5,-5,-5,-5,-5,-5,-14,10,5,3,2,1,0,0,0,0,2,6,12,18,12,6,2,
+//     0,...]
+// The last peak is at 20 (18 > thresh). Its wings at 19 (12) and 22 (6) are
+// under .9*18, so lrx=20 and lintensity=18.
+ba1 = [10,10,10,15,30,50,35,20,15,13,12,11,10,10,10,10,12,16,22,28,22,16,12,
+  10,10,10,10,10,10,10];
+
+// As ba1, but the left wing at 19 is 17 > .9*18 = 16.2. The bottom is
+// rejected for its pulse shape; lintensity is still the candidate's.
+ba2 = ba1;
+ba2(19) = 27;
+
+// As ba1, with a water column before a bottom at 46 (34-10=24). The
+// backscatter windows are 25:35 (sum 33 over 11 samples) and 35:41, which is
+// cut short by the 5 sample backoff (sum 14 over 7 samples).
+ba3 = [10,10,10,15,30,50,35,20,15,13,12,11,10,10,10,10,11,11,11,11,11,11,11,
+  11,12,14,13,12,13,14,12,13,12,14,14,12,12,12,12,11,11,11,13,18,26,34,26,18,
+  13,11,10,10];
+
+// As ba1, with two and three saturated samples in the surface
+sat2 = ba1;
+sat2(5:6) = 255;
+sat3 = ba1;
+sat3(5:7) = 255;
+
+conf = save(thresh=4, first=1, last=60, sfc_last=12, maxsat=2, smoothwf=0,
+  lwing_dist=1, rwing_dist=2, lwing_factor=.9, rwing_factor=.9,
+  decay="exponential", laser=-1000, water=-1000, agc=-1000, mean=0, stdev=0,
+  xshift=0, xscale=0, tiepoint=0, wantlen=10);
+
+// =============================================================================
+ut_section, "eaarl_ba_rx_wf";
+
+r = eaarl_ba_rx_wf(char(255-ba1), conf);
+ut_eq, "r.lrx", 20;
+ut_eq, "r.fintensity", 40;
+ut_eq, "r.lintensity", 18;
+
+r = eaarl_ba_rx_wf(char(255-ba2), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.candidate_lrx", 20;
+ut_eq, "r.fintensity", 40;
+ut_eq, "r.lintensity", 18;
+
+r = eaarl_ba_rx_wf(char(255-ba3), conf);
+ut_eq, "r.lrx", 46;
+ut_eq, "r.lintensity", 24;
+
+// Two saturated samples meet maxsat=2, so nothing is found
+r = eaarl_ba_rx_wf(char(255-sat2), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.fintensity", 0;
+ut_eq, "r.lintensity", 0;
+
+// The right wing at 22 may be exactly at last, but not beyond it
+conf_last = obj_copy(conf);
+save, conf_last, last=22;
+r = eaarl_ba_rx_wf(char(255-ba1), conf_last);
+ut_eq, "r.lrx", 20;
+save, conf_last, last=21;
+r = eaarl_ba_rx_wf(char(255-ba1), conf_last);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 18;
+
+// =============================================================================
+ut_section, "eaarl_ba_bback";
+
+r = save(lrx=46);
+eaarl_ba_bback, float(ba3-10), r;
+ut_eq, "r.bback1", 3;
+ut_eq, "r.bback2", 2;
+
+// At lrx=20, the first window would end at 15, before it starts
+r = save(lrx=20);
+eaarl_ba_bback, float(ba1-10), r;
+ut_eq, "r.bback1", 0;
+ut_eq, "r.bback2", 0;
+
+if(is_func(eaarl_ba_rx_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_ba_rx_batch";
+
+  // Channel 2 stops at sample 21, which rejects the bottom in pulse 4
+  batch_conf = obj_copy(conf);
+  save, batch_conf, last=[60,21,60,60];
+
+  rx = array(pointer, 4, 7);
+  rx(1,1) = &char(255-ba1);
+  rx(1,2) = &char(255-ba2);
+  rx(1,3) = &char(255-sat2);
+  rx(2,4) = &char(255-ba1);
+  rx(1,5) = &char(255-ba3);
+  rx(1,6) = &char(255-ba1);
+  // Pulse 7 has no waveform on channel 3
+  rx(1,7) = &char(255-ba1);
+  pulses = save(soe=double(indgen(7)), tx=array(pointer, 7), rx);
+  lchannel = [1,1,1,2,1,0,3];
+
+  had = eaarl_ba_rx_batch(pulses, lchannel, batch_conf);
+  ut_ok, "allof(had == [1,1,1,1,1,0,0])";
+  ut_ok, "allof(pulses.lrx == [20,0,0,0,46,0,0])";
+  ut_ok, "allof(pulses.fintensity == [40,40,0,40,40,0,0])";
+  ut_ok, "allof(pulses.lintensity == [18,18,0,18,24,0,0])";
+  ut_ok, "structof(pulses.lrx) == float";
+  ut_ok, "!pulses(*,\"bback1\")";
+
+  lrx = pulses.lrx;
+  save, batch_conf, bback=1;
+  had = eaarl_ba_rx_batch(pulses, lchannel, batch_conf, threads=3);
+  ut_ok, "allof(pulses.lrx == lrx)";
+  ut_ok, "allof(pulses.bback1 == [0,0,0,0,3,0,0])";
+  ut_ok, "allof(pulses.bback2 == [0,0,0,0,2,0,0])";
+
+  // ===========================================================================
+  ut_section, "eaarl_ba_rx_batch channel selection";
+
+  // Pulse 1: channel 1 has three saturated samples, more than maxsat, so
+  //   channel 2 is used.
+  // Pulse 2: channel 1 has two, which is allowed here (but then rejected by
+  //   eaarl_ba_rx_wf).
+  // Pulse 3: channel 1 is missing, so none is used.
+  rx = array(pointer, 4, 3);
+  rx(1,1) = &char(255-sat3);
+  rx(2,1) = &char(255-ba1);
+  rx(1,2) = &char(255-sat2);
+  rx(2,2) = &char(255-ba1);
+  rx(2,3) = &char(255-ba1);
+  pulses = save(soe=double(indgen(3)), tx=array(pointer, 3), rx);
+
+  eaarl_ba_rx_batch, pulses, [], conf;
+  ut_ok, "allof(pulses.lchannel == [2,1,0])";
+  ut_ok, "allof(pulses.lrx == [20,0,0])";
+}
@@ -0,0 +1,181 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). The first sample is the bias.
+
+// A single return. After removing the bias of 10:
+//   wf   = [0,0,0,10,30,50,40,20,10,5,2,0,0,0,0,0]
+//   wfd1 = [0,0,10,20,20,-10,-20,-10,-5,-3,-2,0,0,0,0]
+// The derivative reaches thresh=4 after sample 2 (one edge). The first
+// negative derivative after the edge is wfd1(6), so lrx=6 and wf(6)=50.
+wf1 = [10,10,10,20,40,60,50,30,20,15,12,10,10,10,10,10];
+
+// Two returns; the second is used. After removing the bias:
+//   wf   = [0,0,20,50,30,10,0,0,0,0,10,25,40,35,20,10,0,0,0,0,0,0,0,0]
+//   wfd1 = [0,20,30,-20,-20,-10,0,0,0,10,15,15,-5,-15,-10,-10,0,...]
+// Edges are at 1 and 9. After edge 9, wfd1(13) is the first negative, so
+// lrx=13 and wf(13)=40.
+wf2 = [10,10,30,60,40,20,10,10,10,10,20,35,50,45,30,20,10,10,10,10,10,10,10,
+  10];
+
+// No edge: wfd1 = [2,1,-1,-1,-1,0,0] never reaches 4. lintensity is the max,
+// wf(3)=3.
+wf3 = [10,12,13,12,11,10,10,10];
+
+// Edge at 5, too close to the end: min(18, 10-5-1) = 4 samples is a noise
+// pulse, so nothing is found.
+wf4 = [10,10,10,10,10,10,30,50,40,30];
+
+// A dip right after the edge. After removing the bias:
+//   wf   = [0,0,0,10,9,12,15,5,0,0,0,0,0,0,0,0]
+//   wfd1 = [0,0,10,-1,3,3,-10,-5,0,...]
+// The edge is at 2. Without noiseadj, wfd1(4) ends the return: lrx=4,
+// wf(4)=10. With noiseadj, wfd1(2:5) goes negative at its third sample, so
+// the edge moves to 5, and wfd1(7) ends the return: lrx=7, wf(7)=15.
+wf5 = [10,10,10,20,19,22,25,15,10,10,10,10,10,10,10,10];
+
+// The derivative is exactly thresh=4 at wfd1(2), which counts as an edge:
+//   wf   = [0,0,4,8,6,2,0,0,0,0,0,0]
+//   wfd1 = [0,4,4,-2,-4,-2,0,0,0,0,0]
+// lrx=4 and wf(4)=8. With thresh=4.5 there is no edge and lintensity=8.
+wf6 = [10,10,14,18,16,12,10,10,10,10,10,10];
+
+// Channel 1 and 2 samples at or below 4 (raw) are saturated; this has three
+// in its first 12 samples.
+sat = [10,252,253,254,60,50,40,30,20,15,12,10,10,10,10,10];
+
+// =============================================================================
+ut_section, "eaarl_be_rx_wf";
+
+conf = save(thresh=4, noiseadj=0, max_samples=0, smoothwf=0);
+
+r = eaarl_be_rx_wf(char(255-wf1), conf);
+ut_eq, "r.lrx", 6;
+ut_eq, "r.lintensity", 50;
+ut_eq, "r.rets", 1;
+
+r = eaarl_be_rx_wf(char(255-wf2), conf);
+ut_eq, "r.lrx", 13;
+ut_eq, "r.lintensity", 40;
+ut_eq, "r.rets", 2;
+
+r = eaarl_be_rx_wf(char(255-wf3), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 3;
+ut_eq, "r.rets", 0;
+
+r = eaarl_be_rx_wf(char(255-wf4), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 0;
+ut_eq, "r.rets", 1;
+
+r = eaarl_be_rx_wf(char(255-wf5), conf);
+ut_eq, "r.lrx", 4;
+ut_eq, "r.lintensity", 10;
+
+r = eaarl_be_rx_wf(char(255-wf6), conf);
+ut_eq, "r.lrx", 4;
+ut_eq, "r.lintensity", 8;
+
+r = eaarl_be_rx_wf(char(255-wf6), save(thresh=4.5, noiseadj=0,
+  max_samples=0, smoothwf=0));
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 8;
+ut_eq, "r.rets", 0;
+
+// =============================================================================
+ut_section, "eaarl_be_rx_wf options";
+
+r = eaarl_be_rx_wf(char(255-wf5), save(thresh=4, noiseadj=1, max_samples=0,
+  smoothwf=0));
+ut_eq, "r.lrx", 7;
+ut_eq, "r.lintensity", 15;
+
+// With 8 samples the return still fits: min(18, 8-2-1) = 5
+r = eaarl_be_rx_wf(char(255-wf1), save(thresh=4, noiseadj=0, max_samples=8,
+  smoothwf=0));
+ut_eq, "r.lrx", 6;
+ut_eq, "r.lintensity", 50;
+
+// With 7 it is a noise pulse: min(18, 7-2-1) = 4
+r = eaarl_be_rx_wf(char(255-wf1), save(thresh=4, noiseadj=0, max_samples=7,
+  smoothwf=0));
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 0;
+ut_eq, "r.rets", 1;
+
+// smoothwf=1 averages over 3 samples:
+//   wf   = [0,0,3.33,13.33,30,40,36.67,23.33,11.67,5.67,2.33,.67,0,0,0,0]
+//   wfd1 = [0,3.33,10,16.67,10,-3.33,...]
+// The edge is at 2, and lrx=6, but wf(6) is now (30+50+40)/3 = 40.
+r = eaarl_be_rx_wf(char(255-wf1), save(thresh=4, noiseadj=0, max_samples=0,
+  smoothwf=1));
+ut_eq, "r.lrx", 6;
+ut_eq, "r.lintensity", 40;
+
+if(is_func(eaarl_be_rx_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_be_rx_batch";
+
+  // Channel 1 uses the defaults, channel 2 noiseadj, channel 3 max_samples,
+  // and channel 4 smoothwf.
+  conf = save(thresh=4, noiseadj=[0,1,0,0], max_samples=[0,0,7,0],
+    smoothwf=[0,0,0,1]);
+
+  rx = array(pointer, 4, 10);
+  rx(1,1) = &char(255-wf1);
+  rx(1,2) = &char(255-wf2);
+  rx(1,3) = &char(255-wf3);
+  rx(1,4) = &char(255-wf4);
+  rx(1,5) = &char(255-wf5);
+  rx(2,6) = &char(255-wf5);
+  rx(3,7) = &char(255-wf1);
+  rx(4,8) = &char(255-wf1);
+  rx(1,9) = &char(255-wf1);
+  // Pulse 10 has no waveform on channel 2
+  rx(1,10) = &char(255-wf1);
+  pulses = save(soe=double(indgen(10)), tx=array(pointer, 10), rx);
+  lchannel = [1,1,1,1,1,2,3,4,0,2];
+
+  had = eaarl_be_rx_batch(pulses, lchannel, conf);
+  ut_ok, "allof(had == [1,1,1,1,1,1,1,1,0,0])";
+  ut_ok, "allof(pulses.lrx == [6,13,0,0,4,7,0,6,0,0])";
+  ut_ok, "allof(pulses.lintensity == [50,40,3,0,10,15,0,40,0,0])";
+  ut_ok, "allof(pulses.rets == [1,2,0,1,1,1,1,1,0,0])";
+  ut_ok, "structof(pulses.lrx) == float";
+  ut_ok, "structof(pulses.rets) == char";
+
+  lrx = pulses.lrx;
+  had = eaarl_be_rx_batch(pulses, lchannel, conf, threads=4);
+  ut_ok, "allof(pulses.lrx == lrx)";
+  ut_ok, "allof(had == [1,1,1,1,1,1,1,1,0,0])";
+
+  // ===========================================================================
+  ut_section, "eaarl_be_rx_batch channel selection";
+
+  // Pulse 1: channel 1 is saturated, so channel 2 is used.
+  // Pulse 2: channel 1 is not saturated.
+  // Pulse 3: channels 1 and 2 are saturated; channel 3 only counts samples
+  //   equal to 0, of which it has none.
+  // Pulse 4: channel 1 is saturated and channel 2 is missing, so none is
+  //   used.
+  ops_conf = save(max_sfc_sat=2);
+  rx = array(pointer, 4, 4);
+  rx(1,1) = &char(255-sat);
+  rx(2,1) = &char(255-wf1);
+  rx(3,1) = &char(255-wf2);
+  rx(1,2) = &char(255-wf2);
+  rx(2,2) = &char(255-wf1);
+  rx(3,2) = &char(255-wf1);
+  rx(1,3) = &char(255-sat);
+  rx(2,3) = &char(255-sat);
+  rx(3,3) = &char(255-wf1);
+  rx(1,4) = &char(255-sat);
+  pulses = save(soe=double(indgen(4)), tx=array(pointer, 4), rx);
+
+  had = eaarl_be_rx_batch(pulses, [], save(thresh=4, noiseadj=0,
+    max_samples=0, smoothwf=0));
+  ut_ok, "allof(pulses.lchannel == [2,1,3,0])";
+  ut_ok, "allof(had == [1,1,1,0])";
+  ut_ok, "allof(pulses.lrx == [6,13,6,0])";
+}
@@ -0,0 +1,49 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. For char input, cent inverts
+// the raw samples, so each is stored as char(255 - intensity), and removes
+// the first sample as the bias. The result is [centroid, peak, intensity].
+
+// =============================================================================
+ut_section, "cent";
+
+// After removing the bias: [0,0,10,30,10,0,...]. The centroid is
+// (3*10 + 4*30 + 5*10) / 50 = 4.
+wf = [10,10,20,40,20,10,10,10,10,10,10,10,10,10];
+ut_ok, "allof(cent(char(255-wf)) == [4,4,30])";
+
+// The same waveform as long is used as is, without removing the bias
+ut_ok, "allof(cent([0,0,10,30,10,0,0,0,0,0,0,0]) == [4,4,30])";
+
+// Ties use the first peak: (4*20 + 5*20) / 40 = 4.5
+wf = [10,10,10,30,30,10,10,10,10,10,10,10,10,10];
+ut_ok, "allof(cent(char(255-wf)) == [4.5,4,20])";
+
+// Samples below the bias count against the power:
+// [0,20,-10,0,...] gives (2*20 - 3*10) / 10 = 1
+wf = [20,40,10,20,20,20,20,20,20,20,20,20];
+ut_ok, "allof(cent(char(255-wf)) == [1,2,20])";
+
+// No power: [0,10,-10,0,...]
+wf = [20,30,10,20,20,20,20,20,20,20,20,20];
+ut_ok, "allof(cent(char(255-wf)) == [10000,2,10])";
+
+// Fewer than 2 samples
+ut_ok, "allof(cent(char([245])) == [0,0,0])";
+ut_ok, "allof(cent([]) == [0,0,0])";
+
+// =============================================================================
+ut_section, "cent lim=";
+
+// A return at 17-19 is beyond the default 12 samples, which are flat. With
+// lim=20: (17*10 + 18*30 + 19*10) / 50 = 18.
+wf = array(10, 24);
+wf(17:19) = [20,40,20];
+ut_ok, "allof(cent(char(255-wf)) == [10000,1,0])";
+ut_ok, "allof(cent(char(255-wf), lim=20) == [18,18,30])";
+
+// The 17th sample is the only one past the first 16
+wf = array(10, 17);
+wf(17) = 30;
+ut_ok, "allof(cent(char(255-wf), lim=17) == [17,17,20])";
+ut_ok, "allof(cent(char(255-wf), lim=16) == [10000,1,0])";
@@ -0,0 +1,83 @@
+save, ut, eq_ev="ev";
+
+// Two gaussians sampled exactly, [amplitude, center, standard deviation]:
+// [50,12,2] and [30,25,3]. Fitting from nearby seeds should recover them.
+x = indgen(40);
+wf1 = 50*exp(-.5*((x-12)/2.)^2) + 30*exp(-.5*((x-25)/3.)^2);
+seed1 = [45,11.5,2.5, 28,25.5,2.5];
+want1 = [50.,12,2, 30,25,3];
+
+// A single gaussian, [40,8,1.5]
+x = indgen(20);
+wf2 = 40*exp(-.5*((x-8)/1.5)^2);
+seed2 = [35,8.5,2];
+want2 = [40.,8,1.5];
+
+if(is_func(eaarl_cf_fit_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_cf_fit_batch";
+
+  local niter;
+  fit = eaarl_cf_fit_batch(wf1, 40, seed1, 2, niter, itmax=200, tol=0.001);
+  ut_ok, "allof(abs(fit - want1) < 1e-6)";
+  ut_ok, "niter(1) > 0 && niter(1) < 200";
+
+  // Both waveforms at once give the same fits as one at a time
+  fit = eaarl_cf_fit_batch(grow(wf1, wf2), [40,20], grow(seed1, seed2), [2,1],
+    niter, itmax=200, tol=0.001);
+  ut_ok, "allof(abs(fit - grow(want1, want2)) < 1e-6)";
+  ut_ok, "numberof(niter) == 2 && allof(niter < 200)";
+
+  // Seeds that already fit exactly need no iterations
+  fit = eaarl_cf_fit_batch(wf2, 20, want2, 1, niter);
+  ut_ok, "allof(fit == want2)";
+  ut_eq, "niter(1)", 0;
+
+  // A fit that has not converged after itmax reports itmax
+  fit = eaarl_cf_fit_batch(wf1, 40, seed1, 2, niter, itmax=1, tol=1e-12);
+  ut_eq, "niter(1)", 1;
+
+  // A waveform without peaks is left alone
+  fit = eaarl_cf_fit_batch(grow(wf2, wf2), [20,20], seed2, [0,1], niter);
+  ut_ok, "allof(abs(fit - want2) < 1e-6)";
+  ut_eq, "niter(1)", 0;
+
+  // ===========================================================================
+  ut_section, "eaarl_cf_fit_batch vs lmfit";
+
+  // lmfit uses finite differences rather than analytic derivatives, so the
+  // two only agree within a tolerance
+  a = double(seed1);
+  r = lmfit(eaarl_cf_lmfit_gauss, indgen(40), a, wf1, 1.0, itmax=200,
+    tol=0.001);
+  fit = eaarl_cf_fit_batch(wf1, 40, seed1, 2, niter, itmax=200, tol=0.001);
+  ut_ok, "r.niter < 200";
+  ut_ok, "allof(abs(fit - a) < 1e-3)";
+  ut_ok, "allof(abs(a - want1) < 1e-3)";
+
+  // ===========================================================================
+  ut_section, "eaarl_cf_rx_channel vs eaarl_cf_rx_wf";
+
+  // A surface at 10 and a bottom at 30. eaarl_cf_rx_wf fits with lmfit and
+  // eaarl_cf_rx_channel natively (with the cf kernel once eaarl_rx_batch is
+  // available); the last return must be found at the same sample with nearly
+  // the same intensity.
+  ops_conf = save(chn1_range_bias=1., chn2_range_bias=2., chn3_range_bias=3.,
+    chn4_range_bias=4.);
+  cfconf = cfconfobj();
+  t = double(indgen(50));
+  s1 = 10 + 150*exp(-.5*((t-10)/2.)^2) + 60*exp(-.5*((t-30)/2.5)^2);
+  s2 = 10 + 120*exp(-.5*((t-12)/2.)^2) + 40*exp(-.5*((t-27)/3.)^2);
+  rx = array(pointer, 4, 2);
+  rx(1,1) = &char(255 - long(s1 + .5));
+  rx(1,2) = &char(255 - long(s2 + .5));
+  pulses = save(soe=[1.,2.], tx=array(pointer, 2), rx, channel=char([1,1]));
+
+  eaarl_cf_rx_channel, pulses;
+  for(i = 1; i <= 2; i++) {
+    r = eaarl_cf_rx_wf(*rx(1,i), cfconf(settings, 1));
+    ut_ok, "r.lrx > 0";
+    ut_ok, "pulses.lrx(i) == r.lrx";
+    ut_ok, "abs(pulses.lintensity(i) - r.lintensity) < .5";
+  }
+}
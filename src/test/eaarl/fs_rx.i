@@ -0,0 +1,90 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). cent removes the first sample
+// as the bias and only looks at the first 12 samples.
+
+// After removing the bias: [0,0,10,30,10,0,...]. The centroid is
+// (3*10 + 4*30 + 5*10) / 50 = 4 and the peak is 30.
+fs1 = [10,10,20,40,20,10,10,10,10,10,10,10,10,10];
+
+// After removing the bias: [0,0,0,20,20,0,...]. The centroid is
+// (4*20 + 5*20) / 40 = 4.5 and the peak is 20 (the first of the two).
+fs2 = [10,10,10,30,30,10,10,10,10,10,10,10,10,10];
+
+// Two and three samples that are saturated (raw 0): [0,245,245,0,...] has
+// its centroid at 2.5.
+sat2 = [10,255,255,10,10,10,10,10,10,10,10,10,10,10];
+sat3 = [10,255,255,255,10,10,10,10,10,10,10,10,10,10];
+
+// No power, so cent returns its "bad data" value
+flat = array(10, 14);
+
+ops_conf = save(chn1_range_bias=1.5, chn2_range_bias=2.5, chn3_range_bias=3.5,
+  max_sfc_sat=2);
+
+// =============================================================================
+ut_section, "eaarl_fs_rx_cent_eaarla";
+
+// Pulse 1: channel 1.
+// Pulse 2: channel 1 has two saturated samples, which is allowed.
+// Pulse 3: channel 1 has three, so channel 2 is used.
+// Pulse 4: channels 1 and 2 have three, so channel 3 is used.
+// Pulse 5: channel 1 has no power.
+// Pulse 6: channel 1 has a single sample, so the pulse is skipped.
+rx = array(pointer, 4, 6);
+rx(,1) = [&char(255-fs1), &char(255-fs2), &char(255-fs2), &char(255-fs2)];
+rx(,2) = [&char(255-sat2), &char(255-fs2), &char(255-fs2), &char(255-fs2)];
+rx(,3) = [&char(255-sat3), &char(255-fs2), &char(255-fs1), &char(255-fs1)];
+rx(,4) = [&char(255-sat3), &char(255-sat3), &char(255-fs1), &char(255-fs2)];
+rx(,5) = [&char(255-flat), &char(255-fs2), &char(255-fs2), &char(255-fs2)];
+rx(1,6) = &char(245);
+pulses = save(soe=double(indgen(6)), tx=array(pointer, 6), rx,
+  channel=array(char(1), 6));
+
+eaarl_fs_rx_cent_eaarla, pulses;
+ut_ok, "allof(pulses.fchannel == [1,1,2,3,1,0])";
+ut_ok, "allof(pulses.channel == pulses.fchannel)";
+ut_ok, "allof(pulses.frx == [4,2.5,4.5,4,10000,10000])";
+ut_ok, "allof(pulses.fintensity == [30,245,20,30,0,0])";
+ut_ok, "allof(pulses.fbias == float([1.5,1.5,2.5,3.5,1.5,0]))";
+ut_ok, "structof(pulses.frx) == float";
+ut_ok, "structof(pulses.fchannel) == char";
+
+if(is_func(eaarl_fs_rx_cent_eaarla) == 2) {
+  // ===========================================================================
+  ut_section, "eaarl_fs_rx_cent_eaarla missing channel 2";
+
+  // Channel 1 is saturated and channel 2 is missing. The Yorick version
+  // raises an error; the compiled one uses channel 2 with nothing in it.
+  rx = array(pointer, 4, 1);
+  rx(1,1) = &char(255-sat3);
+  rx(3,1) = &char(255-fs1);
+  pulses = save(soe=[1.], tx=array(pointer, 1), rx, channel=[char(1)]);
+
+  eaarl_fs_rx_cent_eaarla, pulses;
+  ut_ok, "allof(pulses.fchannel == [2])";
+  ut_ok, "allof(pulses.frx == [0])";
+  ut_ok, "allof(pulses.fintensity == [0])";
+}
+
+// =============================================================================
+ut_section, "eaarl_fs_rx_cent_eaarlb";
+
+// Channel 4 uses channel 2. Samples with raw values of 0 or 1 add 20 each to
+// the intensity, so pulse 2 gets 245 + 2*20.
+rx = array(pointer, 4, 3);
+rx(1,1) = &char(255-fs1);
+rx(1,2) = &char(255-sat2);
+rx(2,3) = &char(255-fs2);
+rx(4,3) = &char(255-fs1);
+pulses = save(soe=double(indgen(3)), tx=array(pointer, 3), rx,
+  channel=char([1,1,4]));
+
+eaarl_fs_rx_cent_eaarlb, pulses;
+ut_ok, "allof(pulses.fchannel == [1,1,2])";
+ut_ok, "allof(pulses.frx == [4,2.5,4.5])";
+// The compiled version stores the intensity as fint
+fint = is_func(eaarl_fs_rx_cent_eaarlb) == 2 ? pulses.fint : pulses.fintensity;
+ut_ok, "allof(fint == [30,285,20])";
+ut_ok, "allof(pulses.fbias == float([1.5,1.5,2.5]))";
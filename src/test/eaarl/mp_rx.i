@@ -0,0 +1,220 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). The first sample is the bias,
+// 10 for all of these. Leading edges for "cent" and "none" are found as ex_veg
+// finds them: xr where (wfd1 >= thresh)(dif) == 1, with thresh=4.
+
+// After removing the bias: [0,0,0,10,30,30,10,0,...]
+//   wfd1 = [0,0,10,20,0,-20,-10,0,...]
+// "peak": the peak is the plateau at 5-6, so lrx=(5+6)/2=5 and 30.
+// "cent": xr=2 and the tail is wf(3:19). Its centroid is
+//   (2*10 + 3*30 + 4*30 + 5*10) / 80 = 3.5, so lrx=5.5 and wf(5)=30.
+// "none": wf(2:7) peaks at its 4th sample, so lrx=5 and 30.
+mp1 = array(10, 20);
+mp1(4:7) = [20,40,40,20];
+
+// After removing the bias: [0,0,0,4,14,4,0,2,4,2,0,...]
+//   wfd1 = [0,0,4,10,-10,-4,2,2,-2,-2,0,...]
+// "cent": wfd1(3:19) goes negative at its 3rd sample and is last positive at
+// its 6th, so trailing_edge cuts the tail to wf(3:8) = [0,4,14,4,0,2]. Its
+// centroid is (2*4 + 3*14 + 4*4 + 6*2) / 24 = 3.25, so lrx=5.25 and wf(5)=14.
+mp2 = array(10, 20);
+mp2(4:10) = [14,24,14,10,12,14,12];
+
+// After removing the bias: [0,0,0,10,30,50,50,50,50,50,50]
+// "peak": the plateau is 6-11, so lrx=8.
+// "cent": the tail wf(3:10) goes from 0 to 50, which fails the intensity
+// test (50 >= .8*50), so there is no return.
+// "none": wf(2:7) first peaks at its 5th sample, so lrx=6.
+mp3 = [10,10,10,20,40,60,60,60,60,60,60];
+
+// After removing the bias: [0,0,0,0,0,0,0,10,30,20]
+// "peak": lrx=9. For "cent" and "none", xr=6 leaves min(18, 10-6-1) = 3
+// samples, which is a noise pulse.
+mp4 = [10,10,10,10,10,10,10,20,40,30];
+
+// Two returns, far enough apart that the first's tail ends before the second
+// rises. The first is at 4-6 ([10,30,10]); "cent" gives xr=2 and
+// (2*10 + 3*30 + 4*10) / 50 = 3, so lrx=5. The second is at 24-26
+// ([10,40,30]); "cent" gives xr=22 and (2*10 + 3*40 + 4*30) / 80 = 3.25, so
+// lrx=25.25.
+mp5 = array(10, 40);
+mp5(4:6) = [20,40,20];
+mp5(24:26) = [20,50,40];
+
+conf_peak = save(thresh=4, max_samples=0, smoothwf=0, alg_mode="peak");
+conf_cent = save(thresh=4, max_samples=0, smoothwf=0, alg_mode="cent");
+conf_none = save(thresh=4, max_samples=0, smoothwf=0, alg_mode="none");
+
+// =============================================================================
+ut_section, "eaarl_mp_rx_wf peak";
+
+r = eaarl_mp_rx_wf(char(255-mp1), conf_peak);
+ut_ok, "allof(r.lrx == [5])";
+ut_ok, "allof(r.lintensity == [30])";
+ut_eq, "r.num_rets", 1;
+
+r = eaarl_mp_rx_wf(char(255-mp3), conf_peak);
+ut_ok, "allof(r.lrx == [8])";
+
+r = eaarl_mp_rx_wf(char(255-mp4), conf_peak);
+ut_ok, "allof(r.lrx == [9])";
+ut_ok, "allof(r.lintensity == [30])";
+
+r = eaarl_mp_rx_wf(char(255-mp5), conf_peak);
+ut_ok, "allof(r.lrx == [5,25])";
+ut_ok, "allof(r.lintensity == [30,40])";
+ut_eq, "r.num_rets", 2;
+
+// With 20 samples, only the first return is left
+r = eaarl_mp_rx_wf(char(255-mp5), save(thresh=4, max_samples=20, smoothwf=0,
+  alg_mode="peak"));
+ut_ok, "allof(r.lrx == [5])";
+
+// =============================================================================
+ut_section, "eaarl_mp_rx_wf cent";
+
+r = eaarl_mp_rx_wf(char(255-mp1), conf_cent);
+ut_ok, "allof(r.lrx == [5.5])";
+ut_ok, "allof(r.lintensity == [30])";
+ut_ok, "structof(r.lrx) == double";
+
+r = eaarl_mp_rx_wf(char(255-mp2), conf_cent);
+ut_ok, "allof(r.lrx == [5.25])";
+ut_ok, "allof(r.lintensity == [14])";
+
+r = eaarl_mp_rx_wf(char(255-mp3), conf_cent);
+ut_eq, "r.num_rets", 0;
+
+r = eaarl_mp_rx_wf(char(255-mp4), conf_cent);
+ut_eq, "r.num_rets", 0;
+
+r = eaarl_mp_rx_wf(char(255-mp5), conf_cent);
+ut_ok, "allof(r.lrx == [5,25.25])";
+ut_ok, "allof(r.lintensity == [30,40])";
+ut_eq, "r.num_rets", 2;
+
+// =============================================================================
+ut_section, "eaarl_mp_rx_wf none";
+
+r = eaarl_mp_rx_wf(char(255-mp1), conf_none);
+ut_ok, "allof(r.lrx == [5])";
+ut_ok, "allof(r.lintensity == [30])";
+
+r = eaarl_mp_rx_wf(char(255-mp3), conf_none);
+ut_ok, "allof(r.lrx == [6])";
+ut_ok, "allof(r.lintensity == [50])";
+
+r = eaarl_mp_rx_wf(char(255-mp4), conf_none);
+ut_eq, "r.num_rets", 0;
+
+r = eaarl_mp_rx_wf(char(255-mp5), conf_none);
+ut_ok, "allof(r.lrx == [5,25])";
+ut_ok, "allof(r.lintensity == [30,40])";
+
+// =============================================================================
+ut_section, "eaarl_mp_rx_wf vs ex_veg";
+
+// ex_veg_alg and ex_veg_noalg_none locate the last return. With no transmit
+// offset, range bias, or irange, their mx0 is the sample number.
+ctx = [0.];
+range_bias = 0;
+veg_conf = save(thresh=4);
+wfs = [&mp1, &mp2, &mp5];
+for(i = 1; i <= numberof(wfs); i++) {
+  wf = long(*wfs(i) - 10);
+  xr = where((wf(dif) >= 4)(dif) == 1);
+  retdist = min(18, numberof(wf) - xr(0) - 1);
+
+  mx0 = mv0 = -10;
+  ex_veg_alg, mx0, mv0, wf, xr, 0, 1, numberof(wf), retdist, "cent";
+  r = eaarl_mp_rx_wf(char(255-*wfs(i)), conf_cent);
+  ut_ok, "r.lrx(0) == mx0";
+  ut_ok, "r.lintensity(0) == mv0";
+
+  mx0 = mv0 = -10;
+  ex_veg_noalg_none, mx0, mv0, wf, xr, 0;
+  r = eaarl_mp_rx_wf(char(255-*wfs(i)), conf_none);
+  ut_ok, "r.lrx(0) == mx0";
+}
+
+// For mp5, ex_veg_noalg_none takes its intensity from the offset of the peak
+// within wf(22:27), which is 4, rather than from the peak at 25
+ut_eq, "mv0", 10;
+ut_ok, "r.lintensity(0) == 40";
+
+if(is_func(eaarl_mp_rx_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_mp_rx_batch";
+
+  // Channel 1 uses "peak", channel 2 "cent", channel 3 "none"
+  conf = save(thresh=4, max_samples=0, smoothwf=0,
+    alg_mode=["peak","cent","none","peak"]);
+
+  rx = array(pointer, 4, 7);
+  rx(1,1) = &char(255-mp5);
+  rx(2,2) = &char(255-mp5);
+  rx(3,3) = &char(255-mp5);
+  rx(1,4) = &char(255-mp4);
+  rx(2,5) = &char(255-mp4);
+  rx(1,6) = &char(255-mp5);
+  // Pulse 7 has no waveform on channel 2
+  rx(1,7) = &char(255-mp5);
+  pulses = save(soe=double(indgen(7)), tx=array(pointer, 7), rx);
+  lchannel = [1,2,3,1,2,0,2];
+
+  lrets = eaarl_mp_rx_batch(pulses, lchannel, conf);
+  ut_ok, "allof(lrets.had == [1,1,1,1,1,0,0])";
+  ut_ok, "allof(lrets.start == [0,2,4,6,7,7,7,7])";
+  ut_ok, "allof(lrets.lrx == [5,25,5,25.25,5,25,9])";
+  ut_ok, "allof(lrets.lintensity == [30,40,30,40,30,40,30])";
+  ut_ok, "allof(pulses.num_rets == [2,2,2,1,0,0,0])";
+  ut_ok, "structof(lrets.lrx) == double";
+  ut_ok, "structof(lrets.lintensity) == float";
+  ut_ok, "structof(pulses.num_rets) == char";
+
+  lrx = lrets.lrx;
+  lrets = eaarl_mp_rx_batch(pulses, lchannel, conf, threads=3);
+  ut_ok, "allof(lrets.lrx == lrx)";
+  ut_ok, "allof(lrets.start == [0,2,4,6,7,7,7,7])";
+
+  // Without "cent", lrx is long. Channel 4 smooths, so lintensity is double:
+  // after removing the bias, mp1 averaged over 3 samples has the plateau
+  // (10+30+30)/3 = (30+30+10)/3 at 5-6.
+  conf = save(thresh=4, max_samples=0, smoothwf=[0,0,0,1], alg_mode="peak");
+  rx = array(pointer, 4, 2);
+  rx(1,1) = &char(255-mp1);
+  rx(4,2) = &char(255-mp1);
+  pulses = save(soe=[1.,2.], tx=array(pointer, 2), rx);
+
+  lrets = eaarl_mp_rx_batch(pulses, [1,4], conf);
+  ut_ok, "allof(lrets.lrx == [5,5])";
+  ut_ok, "structof(lrets.lrx) == long";
+  ut_ok, "structof(lrets.lintensity) == double";
+  ut_ok, "abs(lrets.lintensity(2) - 70/3.) < 1e-6";
+
+  // None found
+  lrets = eaarl_mp_rx_batch(pulses, [0,0], conf);
+  ut_ok, "is_void(lrets.lrx) && is_void(lrets.lintensity)";
+  ut_ok, "allof(lrets.start == [0,0,0])";
+
+  // ===========================================================================
+  ut_section, "eaarl_mp_rx_batch channel selection";
+
+  // Pulse 1: channel 1 has three saturated samples, so channel 2 is used.
+  // Pulse 2: channel 1 is missing, so none is used.
+  ops_conf = save(max_sfc_sat=2);
+  sat = mp5;
+  sat(2:4) = 255;
+  rx = array(pointer, 4, 2);
+  rx(1,1) = &char(255-sat);
+  rx(2,1) = &char(255-mp1);
+  rx(2,2) = &char(255-mp1);
+  pulses = save(soe=[1.,2.], tx=array(pointer, 2), rx);
+
+  lrets = eaarl_mp_rx_batch(pulses, [], conf);
+  ut_ok, "allof(pulses.lchannel == [2,0])";
+  ut_ok, "allof(lrets.had == [1,0])";
+  ut_ok, "allof(lrets.lrx == [5])";
+}
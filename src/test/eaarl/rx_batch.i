@@ -0,0 +1,157 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). Each kernel's results are
+// worked out in the test for its own builtin; these check that
+// eaarl_rx_batch runs the same kernels and that the results do not depend on
+// how the pulses are spread over threads.
+
+// wf1 in be_rx.i: lrx=6 and lintensity=50
+be1 = [10,10,10,20,40,60,50,30,20,15,12,10,10,10,10,10];
+
+// wf2 in be_rx.i: two returns, the second at lrx=13 with lintensity=40
+be2 = [10,10,30,60,40,20,10,10,10,10,20,35,50,45,30,20,10,10,10,10,10,10,10,
+  10];
+
+// ba1 in ba_rx.i: lrx=20, fintensity=40, and lintensity=18
+ba1 = [10,10,10,15,30,50,35,20,15,13,12,11,10,10,10,10,12,16,22,28,22,16,12,
+  10,10,10,10,10,10,10];
+
+// mp5 in mp_rx.i: returns at 5 and 25, with intensities 30 and 40
+mp5 = array(10, 40);
+mp5(4:6) = [20,40,20];
+mp5(24:26) = [20,50,40];
+
+// sb1 in sb_rx.i: the bias is its 12th sample, giving lrx=6 and
+// lintensity=60
+sb1 = [20,20,20,30,50,70,60,40,30,25,22,10,12,12,12,12,12,12,12,0];
+
+// A single gaussian, [40,8,1.5], on a bias of 10. Rounded to whole samples
+// it is no longer an exact fit.
+x = indgen(20);
+cf1 = long(10 + 40*exp(-.5*((x-8)/1.5)^2) + .5);
+
+if(is_func(eaarl_rx_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch be";
+
+  // 600 pulses, so that three threads each take a run of 256 or fewer from
+  // the queue. Odd pulses have be1 and even pulses be2. Every 100th pulse
+  // (all even) has no channel.
+  n = 600;
+  rx = array(pointer, 4, n);
+  rx(1,1::2) = &char(255-be1);
+  rx(1,2::2) = &char(255-be2);
+  lchannel = array(1, n);
+  lchannel(100::100) = 0;
+  conf = save(thresh=4, noiseadj=0, max_samples=0, smoothwf=0);
+  pulses = save(soe=double(indgen(n)), tx=array(pointer, n), rx);
+
+  had = eaarl_rx_batch("be", pulses, lchannel, conf, threads=3);
+  ut_eq, "sum(had)", 594;
+  ut_ok, "allof(pulses.lrx(1:4) == [6,13,6,13])";
+  ut_ok, "allof(pulses.lrx(99:101) == [6,0,6])";
+  ut_ok, "allof(pulses.lrx(599:600) == [6,0])";
+  ut_eq, "sum(pulses.lrx == 6)", 300;
+  ut_eq, "sum(pulses.lrx == 13)", 294;
+  ut_eq, "sum(pulses.lintensity == 40)", 294;
+  ut_eq, "pulses.rets(2)", 2;
+
+  // The builtin gives the same, as does any number of threads
+  lrx = pulses.lrx;
+  lintensity = pulses.lintensity;
+  had = eaarl_be_rx_batch(pulses, lchannel, conf);
+  ut_ok, "allof(pulses.lrx == lrx)";
+  ut_ok, "allof(pulses.lintensity == lintensity)";
+  had = eaarl_rx_batch("be", pulses, lchannel, conf, threads=64);
+  ut_ok, "allof(pulses.lrx == lrx)";
+  ut_eq, "sum(had)", 594;
+
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch ba";
+
+  conf = save(thresh=4, first=1, last=60, sfc_last=12, maxsat=2, smoothwf=0,
+    lwing_dist=1, rwing_dist=2, lwing_factor=.9, rwing_factor=.9,
+    decay="exponential", laser=-1000, water=-1000, agc=-1000, mean=0,
+    stdev=0, xshift=0, xscale=0, tiepoint=0, wantlen=10);
+  rx = array(pointer, 4, 3);
+  rx(1,) = &char(255-ba1);
+  pulses = save(soe=[1.,2.,3.], tx=array(pointer, 3), rx);
+
+  had = eaarl_rx_batch("ba", pulses, [1,1,0], conf, threads=2);
+  ut_ok, "allof(had == [1,1,0])";
+  ut_ok, "allof(pulses.lrx == [20,20,0])";
+  ut_ok, "allof(pulses.fintensity == [40,40,0])";
+  ut_ok, "allof(pulses.lintensity == [18,18,0])";
+  ut_ok, "!pulses(*,\"bback1\") && !pulses(*,\"bback2\")";
+
+  // With conf.bback, the backscatter is added too. Its first window starts
+  // at 25, past the 5 sample backoff from the bottom at 20, so it is 0.
+  pulses = save(soe=[1.,2.,3.], tx=array(pointer, 3), rx);
+  save, conf, bback=1;
+  had = eaarl_rx_batch("ba", pulses, [1,1,0], conf);
+  ut_ok, "allof(pulses.lrx == [20,20,0])";
+  ut_ok, "allof(pulses.bback1 == [0,0,0])";
+  ut_ok, "allof(pulses.bback2 == [0,0,0])";
+
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch mp";
+
+  conf = save(thresh=4, max_samples=0, smoothwf=0, alg_mode="peak");
+  rx = array(pointer, 4, 3);
+  rx(1,1) = &char(255-mp5);
+  rx(2,3) = &char(255-mp5);
+  pulses = save(soe=[1.,2.,3.], tx=array(pointer, 3), rx);
+
+  lrets = eaarl_rx_batch("mp", pulses, [1,1,2], conf, threads=2);
+  ut_ok, "allof(lrets.had == [1,0,1])";
+  ut_ok, "allof(lrets.start == [0,2,2,4])";
+  ut_ok, "allof(lrets.lrx == [5,25,5,25])";
+  ut_ok, "allof(lrets.lintensity == [30,40,30,40])";
+  ut_ok, "allof(pulses.num_rets == [2,0,2])";
+
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch sb";
+
+  rx = array(pointer, 4, 3);
+  rx(1,) = &char(255-sb1);
+  pulses = save(soe=[1.,2.,3.], tx=array(pointer, 3), rx);
+
+  had = eaarl_rx_batch("sb", pulses, [1,0,1], save(thresh=4), threads=2);
+  ut_ok, "allof(had == [1,0,1])";
+  ut_ok, "allof(pulses.lrx == [6,0,6])";
+  ut_ok, "allof(pulses.lintensity == [60,0,60])";
+
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch cf";
+
+  // Pulse 1 is fitted from a rough seed. Pulse 2 has the same waveform but no
+  // seed, so it is left alone. Pulse 3 has no channel.
+  rx = array(pointer, 4, 3);
+  rx(1,1:2) = &char(255-cf1);
+  pulses = save(soe=[1.,2.,3.], tx=array(pointer, 3), rx);
+  seed = [35,8.5,2];
+  conf = save(smoothwf=0, itmax=200, tol=0.001, seeds=double(seed),
+    npeaks=[1,0,0]);
+
+  fit = eaarl_rx_batch("cf", pulses, [1,1,0], conf, threads=2);
+  ut_ok, "allof(abs(fit.a - [40,8,1.5]) < .5)";
+  ut_ok, "fit.niter(1) > 0 && fit.niter(1) < 200";
+  ut_ok, "allof(fit.niter(2:3) == [0,0])";
+
+  // The kernel removes the first sample as the bias, after which it fits as
+  // eaarl_cf_fit_batch does
+  local niter;
+  a = eaarl_cf_fit_batch(double(cf1 - 10), 20, seed, 1, niter, itmax=200,
+    tol=0.001);
+  ut_ok, "allof(fit.a == a)";
+  ut_eq, "fit.niter(1)", niter(1);
+
+  // ===========================================================================
+  ut_section, "eaarl_rx_batch errors";
+
+  ut_error, "eaarl_rx_batch, \"xx\", pulses, [1,1,0], conf";
+  // The cf kernel has no channel selection
+  ut_error, "eaarl_rx_batch, \"cf\", pulses, [], conf";
+  ut_error, "eaarl_rx_batch, \"cf\", pulses, [1,1], conf";
+}
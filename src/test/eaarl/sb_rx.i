@@ -0,0 +1,115 @@
+save, ut, eq_ev="ev";
+
+// Waveforms below are written as intensities. The raw samples are inverted,
+// so each is stored as char(255 - intensity). Unlike the other algorithms,
+// the bias is the lowest of the first 15 samples, and only the first 20
+// samples are searched.
+
+// The bias is sample 12 (10), not the first sample (20). Sample 20 is lower
+// still, but lies outside the first 15. After removing the bias:
+//   wf   = [10,10,10,20,40,60,50,30,20,15,12,0,2,2,2,2,2,2,2,-10]
+//   wfd1 = [0,0,10,20,20,-10,-20,-10,-5,-3,-12,2,0,0,0,0,0,0,-12]
+// The edge is at 2 and wfd1(6) is the first negative, so lrx=6 and
+// wf(6)=60. With the first sample as the bias, it would have been 50.
+sb1 = [20,20,20,30,50,70,60,40,30,25,22,10,12,12,12,12,12,12,12,0];
+
+// Two returns, but the second (at 22-24) is past sample 20, so it is cut off.
+// The first has its edge at 2 and ends at wfd1(5): lrx=5, wf(5)=30.
+sb2 = array(10, 30);
+sb2(4:6) = [20,40,20];
+sb2(22:24) = [20,50,40];
+
+// The second return starts at sample 17. After cutting to 20 samples, its
+// edge is at 15, which leaves min(18, 20-15-1) = 4 samples: a noise pulse.
+// Both edges still count as returns.
+sb3 = array(10, 24);
+sb3(4:6) = [20,40,20];
+sb3(17:20) = [30,50,40,20];
+
+// Shorter than 15 samples: the bias is the lowest of all of them (10). The
+// edge is at 2, min(18, 10-2-1) = 7, and lrx=5 with wf(5)=30.
+sb4 = [12,10,10,20,40,20,10,10,10,10];
+
+// No edge: wfd1 = [-2,1,1,1,-1,-1,-1] never reaches 4. lintensity is the max,
+// wf(5)=3.
+sb5 = [12,10,11,12,13,12,11,10];
+
+conf = save(thresh=4);
+
+// =============================================================================
+ut_section, "eaarl_sb_rx_wf";
+
+r = eaarl_sb_rx_wf(char(255-sb1), conf);
+ut_eq, "r.lrx", 6;
+ut_eq, "r.lintensity", 60;
+ut_eq, "r.rets", 1;
+
+r = eaarl_sb_rx_wf(char(255-sb2), conf);
+ut_eq, "r.lrx", 5;
+ut_eq, "r.lintensity", 30;
+ut_eq, "r.rets", 1;
+
+r = eaarl_sb_rx_wf(char(255-sb3), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 0;
+ut_eq, "r.rets", 2;
+
+r = eaarl_sb_rx_wf(char(255-sb4), conf);
+ut_eq, "r.lrx", 5;
+ut_eq, "r.lintensity", 30;
+
+r = eaarl_sb_rx_wf(char(255-sb5), conf);
+ut_eq, "r.lrx", 0;
+ut_eq, "r.lintensity", 3;
+ut_eq, "r.rets", 0;
+
+if(is_func(eaarl_sb_rx_batch)) {
+  // ===========================================================================
+  ut_section, "eaarl_sb_rx_batch";
+
+  rx = array(pointer, 4, 7);
+  rx(1,1) = &char(255-sb1);
+  rx(1,2) = &char(255-sb2);
+  rx(1,3) = &char(255-sb3);
+  rx(2,4) = &char(255-sb4);
+  rx(3,5) = &char(255-sb5);
+  rx(1,6) = &char(255-sb1);
+  // Pulse 7 has no waveform on channel 2
+  rx(1,7) = &char(255-sb1);
+  pulses = save(soe=double(indgen(7)), tx=array(pointer, 7), rx);
+  lchannel = [1,1,1,2,3,0,2];
+
+  had = eaarl_sb_rx_batch(pulses, lchannel, conf);
+  ut_ok, "allof(had == [1,1,1,1,1,0,0])";
+  ut_ok, "allof(pulses.lrx == [6,5,0,5,0,0,0])";
+  ut_ok, "allof(pulses.lintensity == [60,30,0,30,3,0,0])";
+  ut_ok, "allof(pulses.rets == [1,1,2,1,0,0,0])";
+  ut_ok, "structof(pulses.lrx) == float";
+  ut_ok, "structof(pulses.rets) == char";
+
+  // thresh is per channel: at 25, sb1's rise of 20 is no longer an edge and
+  // lintensity is the max
+  had = eaarl_sb_rx_batch(pulses, lchannel, save(thresh=[25,4,4,4]),
+    threads=3);
+  ut_ok, "allof(pulses.lrx == [0,0,0,5,0,0,0])";
+  ut_ok, "allof(pulses.lintensity == [60,30,40,30,3,0,0])";
+
+  // ===========================================================================
+  ut_section, "eaarl_sb_rx_batch channel selection";
+
+  // Pulse 1: channel 1 has three saturated samples, so channel 2 is used.
+  // Pulse 2: channel 1 is missing, so none is used.
+  ops_conf = save(max_sfc_sat=2);
+  sat = sb2;
+  sat(2:4) = 255;
+  rx = array(pointer, 4, 2);
+  rx(1,1) = &char(255-sat);
+  rx(2,1) = &char(255-sb1);
+  rx(2,2) = &char(255-sb1);
+  pulses = save(soe=[1.,2.], tx=array(pointer, 2), rx);
+
+  had = eaarl_sb_rx_batch(pulses, [], conf);
+  ut_ok, "allof(pulses.lchannel == [2,0])";
+  ut_ok, "allof(had == [1,0])";
+  ut_ok, "allof(pulses.lrx == [6,0])";
+}
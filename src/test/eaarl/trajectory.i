@@ -0,0 +1,96 @@
+save, ut, eq_ev="ev";
+
+// The INS track runs from 10 to 17. Roll and pitch are linear in time, so
+// interpolating them is exact: roll = 2*sod and pitch = sod - 10. Heading
+// crosses north between 10 and 11 (350 to 10), where it must be interpolated
+// the short way round.
+ins_sod = double(indgen(10:17));
+roll = 2 * ins_sod;
+pitch = ins_sod - 10;
+heading = [350.,10,20,30,40,50,60,70];
+
+// The GPS track runs from 9 to 17 in steps of 2. North and east are
+// multiples of alt.
+gps_sod = [9.,11,13,15,17];
+alt = [100.,110,120,130,140];
+north = 10 * alt;
+east = 100 * alt;
+
+if(is_func(eaarl_trajectory_interp)) {
+  // ===========================================================================
+  ut_section, "eaarl_trajectory_interp";
+
+  // Out of order, as the cursors must move back as well as forward. 8 is
+  // before both tracks. 17 is the last time of both, which is in bounds.
+  sod = [16.5,10.5,12,17,8,14.25];
+  t = eaarl_trajectory_interp(sod, ins_sod, roll, pitch, heading, gps_sod,
+    alt, north, east);
+
+  ut_ok, "allof(t.roll == [33,21,24,34,0,28.5])";
+  ut_ok, "allof(t.pitch == [6.5,.5,2,7,0,4.25])";
+  // 16.5 lies between 15 (130) and 17 (140); 14.25 is 5/8 of the way from 13
+  // (120) to 15 (130)
+  ut_ok, "allof(t.alt == [135,105,115,140,0,126.25])";
+  ut_ok, "allof(t.northing == [1350,1050,1150,1400,0,1262.5])";
+  ut_ok, "allof(t.easting == [13500,10500,11500,14000,0,12625])";
+  // yaw is -heading; halfway between 350 and 10 is 0, not 180
+  ut_ok, "allof(abs(t.yaw - [-65,0,-20,-70,0,-42.5]) < 1e-9)";
+  ut_ok, "structof(t.yaw) == double";
+
+  // The biases are added to roll, pitch, and yaw, except where out of bounds
+  t = eaarl_trajectory_interp(sod, ins_sod, roll, pitch, heading, gps_sod,
+    alt, north, east, roll_bias=1, pitch_bias=-1, yaw_bias=2);
+  ut_ok, "allof(t.roll == [34,22,25,35,0,29.5])";
+  ut_ok, "allof(t.pitch == [5.5,-.5,1,6,0,3.25])";
+  ut_ok, "allof(abs(t.yaw - [-63,2,-18,-68,0,-40.5]) < 1e-9)";
+
+  // Results are dimensioned like sod
+  t = eaarl_trajectory_interp([[12,13],[14,15]], ins_sod, roll, pitch,
+    heading, gps_sod, alt, north, east);
+  ut_ok, "allof(dimsof(t.roll) == [2,2,2])";
+  ut_ok, "allof(t.roll == [[24,26],[28,30]])";
+
+  // ===========================================================================
+  ut_section, "eaarl_trajectory_interp track cursor";
+
+  // A long ascending run with jumps back to the start, the end, and the
+  // middle. Every value is on a multiple of 1/4, so roll is exact.
+  sod = grow(span(10,17,29), [10.25,16.75,11,13.5,10,17]);
+  t = eaarl_trajectory_interp(sod, ins_sod, roll, pitch, heading, gps_sod,
+    alt, north, east);
+  ut_ok, "allof(t.roll == 2*sod)";
+  ut_ok, "allof(t.pitch == sod - 10)";
+  ut_eq, "t.roll(30)", 20.5;
+  ut_eq, "t.roll(0)", 34;
+  ut_eq, "t.alt(0)", 140;
+  ut_eq, "t.alt(33)", 122.5;
+
+  // ===========================================================================
+  ut_section, "eaarl_trajectory_interp single INS record";
+
+  // eaarl_fs_trajectory returns long zeros, one per value of sod, when only
+  // one INS record is left around sod: when sod is entirely before the INS
+  // track or at or after its last time, or the track has one record.
+  t = eaarl_trajectory_interp([5.,6], ins_sod, roll, pitch, heading, gps_sod,
+    alt, north, east, roll_bias=1);
+  ut_ok, "structof(t.roll) == long";
+  ut_ok, "allof(t.roll == [0,0])";
+  ut_ok, "structof(t.easting) == long";
+
+  t = eaarl_trajectory_interp([17.,18], ins_sod, roll, pitch, heading,
+    gps_sod, alt, north, east);
+  ut_ok, "structof(t.alt) == long";
+  ut_ok, "allof(t.alt == [0,0])";
+
+  t = eaarl_trajectory_interp([[12,13],[14,15]], [12.], [1.], [1.], [1.],
+    gps_sod, alt, north, east);
+  ut_ok, "structof(t.yaw) == long";
+  ut_ok, "allof(dimsof(t.yaw) == [1,4])";
+  ut_ok, "allof(t.yaw == 0)";
+
+  // One value before the track is enough for it to be interpolated
+  t = eaarl_trajectory_interp([5.,12], ins_sod, roll, pitch, heading, gps_sod,
+    alt, north, east);
+  ut_ok, "structof(t.roll) == double";
+  ut_ok, "allof(t.roll == [0,24])";
+}
@@ -0,0 +1,47 @@
+save, ut, eq_ev="ev";
+
+// Two points, given as [[x1,x2],[y1,y2],[z1,z2]] for tp=1. From the origin,
+// p2 is 5 away for the first point (3,4,0) and 3 away for the second (1,2,2).
+p1 = array(0., 2, 3);
+p2 = [[3.,1],[4,2],[0,2]];
+
+// =============================================================================
+ut_section, "point_project 3d tp=1";
+
+// The first is projected 5 further, doubling it; the second 3 further, also
+// doubling it.
+r = point_project(p1, p2, [5,3], tp=1);
+ut_ok, "allof(dimsof(r) == [2,2,3])";
+ut_ok, "allof(r == [[6,2],[8,4],[0,4]])";
+
+// A scalar distance applies to both: 6 further scales the first by 11/5 and
+// triples the second
+r = point_project(p1, p2, 6, tp=1);
+ut_ok, "allof(abs(r - [[6.6,3],[8.8,6],[0,6]]) < 1e-12)";
+
+// Moving both ends moves the result with them
+r = point_project(p1 + 1, p2 + 1, [5,3], tp=1);
+ut_ok, "allof(r == [[7,3],[9,5],[1,5]])";
+
+// A negative distance projects back toward p1
+r = point_project(p1, p2, [-5,-1.5], tp=1);
+ut_ok, "allof(r == [[0,.5],[0,1],[0,1]])";
+
+// Integer input gives double output
+r = point_project([[0,0],[0,0],[0,0]], [[3,1],[4,2],[0,2]], [5,3], tp=1);
+ut_ok, "structof(r) == double";
+ut_ok, "allof(r == [[6,2],[8,4],[0,4]])";
+
+ut_error, "point_project(p1, [[3.,0],[4,0],[0,0]], 1, tp=1)";
+
+// =============================================================================
+ut_section, "point_project other shapes";
+
+// These don't match the 3d tp=1 case and take the general path. The results
+// are the same as above.
+r = point_project([0,0,0], [3,4,0], 5, tp=1);
+ut_ok, "allof(r == [6,8,0])";
+r = point_project(transpose(p1), transpose(p2), [5,3]);
+ut_ok, "allof(r == [[6,8,0],[2,4,4]])";
+r = point_project([0,1], [0,0], 1);
+ut_ok, "allof(r == [0,-1])";
@@ -0,0 +1,111 @@
+save, ut, eq_ev="ev";
+
+// A 3x3 lattice with unit spacing (points 1-9, x varying fastest), a point
+// in the middle of its upper right square (10), and one far away (11). Many
+// queries below put points exactly on the radius or on a box edge, which
+// must be included.
+x = [0.,1,2,0,1,2,0,1,2,1.5,10];
+y = [0.,0,0,1,1,1,2,2,2,1.5,10];
+
+if(is_func(spatial_index)) {
+  // ===========================================================================
+  ut_section, "spatial_index";
+
+  index = spatial_index(x, y);
+  ut_eq, "index.count", 11;
+  ut_eq, "index.npoints", 11;
+
+  // A bucket size that gives more buckets than allowed for 11 points is
+  // doubled until it fits: .5 would be 21x21 buckets, 1 is 11x11
+  small = spatial_index(x, y, bucket=.5);
+  ut_eq, "small.bucket", 1;
+  ut_eq, "small.nx", 11;
+  ut_eq, "small.ny", 11;
+
+  ut_error, "spatial_index(x, y(:5))";
+
+  // ===========================================================================
+  ut_section, "spatial_index_radius";
+
+  // Around (1,1) with radius 1, points 2, 4, 6, and 8 are exactly on the
+  // radius. (2,2) with radius .75 finds 9 and 10 (.707 away). (5,5) finds
+  // nothing.
+  xp = [1.,0,5,2];
+  yp = [1.,0,5,2];
+  radius = [1,.5,1,.75];
+  local start;
+  list = spatial_index_radius(index, xp, yp, radius, start);
+  ut_ok, "allof(list == [2,4,5,6,8,10,1,9,10])";
+  ut_ok, "allof(start == [1,7,8,8,10])";
+
+  // The results do not depend on the bucket size
+  list = spatial_index_radius(small, xp, yp, radius, start);
+  ut_ok, "allof(list == [2,4,5,6,8,10,1,9,10])";
+  ut_ok, "allof(start == [1,7,8,8,10])";
+
+  // A scalar radius applies to every location
+  list = spatial_index_radius(index, [0.,2], [0.,2], 1, start);
+  ut_ok, "allof(list == [1,2,4,6,8,9,10])";
+  ut_ok, "allof(start == [1,4,8])";
+
+  // Nothing found gives []
+  ut_ok, "is_void(spatial_index_radius(index, 5, 5, 1))";
+
+  ut_error, "spatial_index_radius(index, [1.,2], [1.,2,3], 1)";
+
+  // ===========================================================================
+  ut_section, "spatial_index_box";
+
+  // Edges are included
+  list = spatial_index_box(index, [0.,1.5,3,10,-1], [1.,2,4,10,.5],
+    [0.,1.5,3,10,-1], [1.,2,4,10,5], start);
+  ut_ok, "allof(list == [1,2,4,5,9,10,11,1,4,7])";
+  ut_ok, "allof(start == [1,5,7,7,8,11])";
+
+  list = spatial_index_box(small, [0.,1.5,3,10,-1], [1.,2,4,10,.5],
+    [0.,1.5,3,10,-1], [1.,2,4,10,5], start);
+  ut_ok, "allof(list == [1,2,4,5,9,10,11,1,4,7])";
+
+  // ===========================================================================
+  ut_section, "spatial_index_nearest";
+
+  local dist;
+  idx = spatial_index_nearest(index, [.1,1.4,9], [.1,1.6,10], dist);
+  ut_ok, "allof(idx == [1,10,11])";
+  ut_ok, "allof(abs(dist - [.02,.02,1]^.5) < 1e-15)";
+
+  // Points 9 and 11 are both 32^.5 from (6,6); the lower index is first
+  idx = spatial_index_nearest(index, 6., 6., dist);
+  ut_eq, "idx", 9;
+  ut_eq, "dist", 32^.5;
+  idx = spatial_index_nearest(small, 6., 6.);
+  ut_eq, "idx", 9;
+
+  // k=3 from (0,0): point 1 itself, then 2 and 4, which are both 1 away
+  idx = spatial_index_nearest(index, 0., 0., dist, k=3);
+  ut_ok, "allof(idx == [1,2,4])";
+  ut_ok, "allof(dist == [0,1,1])";
+
+  // Asking for more points than there are pads with 0 and a distance of -1
+  idx = spatial_index_nearest(index, [0.,6], [0.,6], dist, k=12);
+  ut_ok, "allof(dimsof(idx) == [2,12,2])";
+  ut_ok, "allof(idx(,2) == [9,11,10,6,8,5,3,7,2,4,1,0])";
+  ut_eq, "dist(12,2)", -1;
+  ut_eq, "dist(1,2)", dist(2,2);
+
+  ut_error, "spatial_index_nearest(index, 0., 0., k=0)";
+
+  // ===========================================================================
+  ut_section, "find_nearest_point and find_points_in_radius index=";
+
+  // (1.25,1.25) is equally near 5 and 10
+  ut_eq, "find_nearest_point(1.25, 1.25, x, y, index=index)", 5;
+  ut_eq, "find_nearest_point(1.25, 1.25, x, y)", 5;
+  ut_eq, "find_nearest_point(1.4, 1.6, x, y, index=index)", 10;
+  ut_eq, "find_nearest_point(9., 10., x, y, index=small)", 11;
+
+  ut_ok, "allof(find_points_in_radius(1., 1., x, y, radius=1, index=index) "+
+    "== [2,4,5,6,8,10])";
+  ut_ok, "allof(find_points_in_radius(1., 1., x, y, radius=1) "+
+    "== [2,4,5,6,8,10])";
+}
@@ -189,3 +189,79 @@ ut_eq, "pr1(dimsof(*g.zgrid))", "[2,41,41]";
 ut_eq, "(*g.zgrid)(*)(sum)", 2;
 ut_eq, "(*g.zgrid)(41,1)", 1;
 ut_eq, "(*g.zgrid)(1,41)", 1;
+
+// =============================================================================
+ut_section, "cell_grid, other methods";
+
+// A 3x2 grid of unit cells. With xsnap=w and ysnap=s, the cells get:
+//   (1,1): 3,1,8   (2,1): 4,2,9,10   (3,1): none
+//   (1,2): 5       (2,2): none       (3,2): 6
+// The last point is on x=2, the grid's east edge, so xmax grows to 3.
+x = [.5,.25,.75,1.5,1.5,1.5,1.5,.5,2];
+y = [.5,.25,.75,.5,.5,.5,.5,1.5,1.5];
+z = [3.,1,8,4,2,9,10,5,6];
+
+g = cell_grid(x, y, z, cell=1, method="median", xsnap="w", ysnap="s",
+  nodata=-1);
+ut_eq, "pr1(dimsof(*g.zgrid))", "[2,3,2]";
+// The median of an even number of points is the mean of the middle two
+ut_ok, "allof(*g.zgrid == [[3,6.5,-1],[5,-1,6]])";
+
+g = cell_grid(x, y, z, cell=1, method="average", xsnap="w", ysnap="s",
+  nodata=-1);
+ut_ok, "allof(*g.zgrid == [[4,6.25,-1],[5,-1,6]])";
+
+// The last point in each cell wins
+g = cell_grid(x, y, z, cell=1, method="last", xsnap="w", ysnap="s",
+  nodata=-1);
+ut_ok, "allof(*g.zgrid == [[8,10,-1],[5,-1,6]])";
+
+g = cell_grid(x, y, z, cell=1, method="coverage", xsnap="w", ysnap="s");
+ut_eq, "pr1(*g.zgrid)", "[[1,1,0],[1,0,1]]";
+
+// Cells up to the last one with data get their count, even if it is 0; the
+// rest get nodata. With xmax=4, the last cell with data is (3,2).
+g = cell_grid(x, y, z, cell=1, method="counts", xsnap="w", ysnap="s",
+  xmax=4, nodata=-1);
+ut_eq, "pr1(*g.zgrid)", "[[3,4,0,0],[1,0,1,-1]]";
+
+// With cell=2, the first cell has 8 points and the second has 1, on an area
+// of 4
+g = cell_grid(x, y, z, cell=2, method="density", xsnap="w", ysnap="s");
+ut_eq, "pr1(dimsof(*g.zgrid))", "[2,2,1]";
+ut_ok, "allof(*g.zgrid == [2,.25])";
+
+// With xsnap=e and ysnap=n, the point on x=2 stays in the second column
+g = cell_grid(x, y, z, cell=1, method="last", xsnap="e", ysnap="n",
+  nodata=-1);
+ut_eq, "pr1(dimsof(*g.zgrid))", "[2,2,2]";
+ut_ok, "allof(*g.zgrid == [[8,10],[5,6]])";
+
+ut_error, "cell_grid(x, y, z, cell=1, method=\"mode\")";
+
+if(is_func(cell_grid_cells)) {
+  // ===========================================================================
+  ut_section, "cell_grid_cells";
+
+  // The snaps default to w and s here
+  r = cell_grid_cells(x, y, z, "median", 0, 0, 1, 3, 2, -1.);
+  ut_ok, "structof(r) == double";
+  ut_ok, "allof(r == [[3,6.5,-1],[5,-1,6]])";
+
+  r = cell_grid_cells(x, y, z, "counts", 0, 0, 1, 3, 2, 0);
+  ut_ok, "structof(r) == long";
+  ut_eq, "pr1(r)", "[[3,4,0],[1,0,1]]";
+
+  // Points on the west edge are left out with xsnap=e, and points past the
+  // grid are always left out
+  r = cell_grid_cells([0.,.5,1,5], [.5,.5,.5,.5], [1.,2,3,4], "average", 0,
+    0, 1, 1, 1, -1., xsnap="e");
+  ut_eq, "r(1)", 2.5;
+
+  // For float z, the two middle values are added as floats
+  r = cell_grid_cells(x, y, float(z), "median", 0, 0, 1, 3, 2, -1.);
+  ut_ok, "allof(r == [[3,6.5,-1],[5,-1,6]])";
+
+  ut_error, "cell_grid_cells(x, y, z, \"mode\", 0, 0, 1, 3, 2, -1.)";
+  ut_error, "cell_grid_cells(x, y, z, \"median\", 0, 0, 1, 0, 2, -1.)";
+}
@@ -0,0 +1,91 @@
+save, ut, eq_ev="ev";
+
+// Five points, gridded at cell centers x = 0, 1, 2 and y = 0, 1 with a radius
+// of 1. Points 1-4 sit on cell centers, so every neighboring center is
+// exactly on the radius and must be included.
+//   1 (0,0) 10   2 (1,0) 20   3 (2,0) 30   4 (1,1) 40   5 (.5,1) 50
+// Point 5 is .5 from centers (0,1) and (1,1) and too far from the rest.
+x = [0.,1,2,1,.5];
+y = [0.,0,0,1,1];
+z = [10.,20,30,40,50];
+
+// Points found for each cell:
+//   (0,0): 1,2        (1,0): 1,2,3,4    (2,0): 2,3
+//   (0,1): 1,4,5      (1,1): 2,4,5      (2,1): 3,4
+// Averaged, (0,1) is 100/3 and (1,1) is 110/3.
+avg = [[15,25,25],[100./3,110./3,35]];
+// Weighted by inverse distance, a point on the cell center takes over. At
+// (0,1), the weights are 1, 1, and 4 for a power of 2 (250/6) and 1, 1, and
+// 2 for a power of 1 (150/4).
+inv2 = [[10,20,30],[250./6,40,35]];
+inv1 = [[10,20,30],[37.5,40,35]];
+
+// =============================================================================
+ut_section, "radius_grid";
+
+g = radius_grid(x, y, z, "average", xmin=-.5, xmax=2.5, ymin=-.5, ymax=1.5,
+  cell=1, maxradius=1, verbose=0);
+ut_eq, "g.xmin", -.5;
+ut_eq, "g.ymin", -.5;
+ut_ok, "allof(dimsof(*g.zgrid) == [2,3,2])";
+// Close enough to be stored as floats
+ut_ok, "structof(*g.zgrid) == float";
+ut_ok, "allof(abs(*g.zgrid - avg) < 1e-5)";
+
+g = radius_grid(x, y, z, "invdist", xmin=-.5, xmax=2.5, ymin=-.5, ymax=1.5,
+  cell=1, maxradius=1, verbose=0);
+ut_ok, "allof(abs(*g.zgrid - inv2) < 1e-5)";
+
+// Only cells with at least 3 points
+g = radius_grid(x, y, z, "average", xmin=-.5, xmax=2.5, ymin=-.5, ymax=1.5,
+  cell=1, maxradius=1, minpoints=3, nodata=-1, verbose=0);
+ut_ok, "allof(abs(*g.zgrid - [[-1,25,-1],[100./3,110./3,-1]]) < 1e-5)";
+
+ut_error, "radius_grid(x, y, z, \"median\", cell=1, verbose=0)";
+
+if(is_func(radius_grid_cells)) {
+  // ===========================================================================
+  ut_section, "radius_grid_cells";
+
+  xc = [0.,1,2];
+  yc = [0.,1];
+  r = radius_grid_cells(x, y, z, xc, yc, "average", 1, 1, 2, -1.);
+  ut_ok, "structof(r) == double";
+  ut_ok, "allof(dimsof(r) == [2,3,2])";
+  ut_ok, "allof(r == avg)";
+
+  r = radius_grid_cells(x, y, z, xc, yc, "invdist", 1, 1, 2, -1.);
+  ut_ok, "allof(r == inv2)";
+
+  // An integer power is applied by multiplication and a real one by pow; both
+  // are exact here
+  r = radius_grid_cells(x, y, z, xc, yc, "invdist", 1, 1, 2., -1.);
+  ut_ok, "allof(r == inv2)";
+  r = radius_grid_cells(x, y, z, xc, yc, "invdist", 1, 1, 1, -1.);
+  ut_ok, "allof(r == inv1)";
+  r = radius_grid_cells(x, y, z, xc, yc, "invdist", 1, 1, 1., -1.);
+  ut_ok, "allof(r == inv1)";
+
+  r = radius_grid_cells(x, y, z, xc, yc, "average", 1, 3, 2, -1.);
+  ut_ok, "allof(r == [[-1,25,-1],[100./3,110./3,-1]])";
+
+  // Just short of 1, only the points on the centers (and point 5) are found
+  r = radius_grid_cells(x, y, z, xc, yc, "average", .999, 1, 2, -1.);
+  ut_ok, "allof(r == [[10,20,30],[50,45,-1]])";
+
+  // Rows are split across threads in pieces of at least 8, so this needs
+  // enough rows for 4 threads. Row 17 is y=1. In row 33 (y=2), only (1,2)
+  // reaches a point (4, exactly 1 away); past it there are none.
+  yc = indgen(0:39)/16.;
+  r = radius_grid_cells(x, y, z, xc, yc, "invdist", 1, 1, 2, -1., threads=1);
+  ut_ok, "allof(radius_grid_cells(x, y, z, xc, yc, \"invdist\", 1, 1, 2, "+
+    "-1., threads=4) == r)";
+  ut_ok, "allof(r(,1) == [10,20,30])";
+  ut_ok, "allof(r(,17) == inv2(,2))";
+  ut_ok, "allof(r(,33) == [-1,40,-1])";
+  ut_ok, "allof(r(,34:) == -1)";
+
+  ut_error, "radius_grid_cells(x, y, z, xc, yc, \"median\", 1, 1, 2, -1.)";
+  ut_error, "radius_grid_cells(x, y(:4), z, xc, yc, \"average\", 1, 1, 2, "+
+    "-1.)";
+}
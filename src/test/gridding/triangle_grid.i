@@ -0,0 +1,88 @@
+save, ut, eq_ev="ev";
+
+if(is_func(_ytriangle_interp)) {
+  // ===========================================================================
+  ut_section, "triangle_grid, shared diagonal";
+
+  // Two triangles over the unit square that share the diagonal but not its
+  // top corner: point 3 (z=6) is in the first and point 5 (z=10) in the
+  // second. The first is z = 2x + 4y and the second z = 6x + 4y. The cell
+  // centers are at 0, .5, and 1, so (.5,.5) and (1,1) are on the diagonal
+  // and take their value from whichever triangle is first.
+  x = [0.,1,1,0,1];
+  y = [0.,0,1,1,1];
+  z = [0.,2,6,4,10];
+  v = [[1,2,3],[1,5,4]];
+
+  g = triangle_grid(x, y, z, v, xmin=-.25, xmax=1.25, ymin=-.25, ymax=1.25,
+    cell=.5, nodata=-1);
+  ut_eq, "g.xmin", -.25;
+  ut_eq, "g.cell", .5;
+  ut_ok, "allof(dimsof(*g.zgrid) == [2,3,3])";
+  ut_ok, "allof(*g.zgrid == [[0,1,2],[2,3,4],[4,7,6]])";
+
+  g = triangle_grid(x, y, z, v(,::-1), xmin=-.25, xmax=1.25, ymin=-.25,
+    ymax=1.25, cell=.5, nodata=-1);
+  ut_ok, "allof(*g.zgrid == [[0,1,2],[2,5,4],[4,7,10]])";
+
+  // ===========================================================================
+  ut_section, "triangle_grid, lattice";
+
+  // A 5x5 lattice of points, with z = x + 10y, split into 32 triangles, and
+  // a large triangle (points 26-28, z=100) over its lower left half. Cell
+  // centers run from -.5 to 4.5 by .5, so many are on edges and vertices
+  // shared by several triangles, and the outer ones are outside all of them.
+  x = grow(double(indgen(0:4))(,-:1:5)(*), [0.,4,0]);
+  y = grow(double(indgen(0:4))(-:1:5,)(*), [0.,0,4]);
+  z = grow(x(:25) + 10*y(:25), [100.,100,100]);
+  a = (indgen(0:3)(,-:1:4) + 5*indgen(0:3)(-:1:4,) + 1)(*);
+  v = transpose([grow(a,a), grow(a+1,a+6), grow(a+6,a+5)]);
+
+  c = span(-.5, 4.5, 11);
+  cx = c(,-:1:11);
+  cy = c(-:1:11,);
+  expect = cx + 10*cy;
+  expect(where((cx < 0) | (cy < 0) | (cx > 4) | (cy > 4))) = -1;
+  big = expect;
+  big(where((cx >= 0) & (cy >= 0) & (cx + cy <= 4))) = 100;
+
+  g = triangle_grid(x, y, z, v, xmin=-.75, xmax=4.75, ymin=-.75, ymax=4.75,
+    cell=.5, nodata=-1);
+  ut_ok, "allof(dimsof(*g.zgrid) == [2,11,11])";
+  ut_ok, "allof(*g.zgrid == expect)";
+
+  // The large triangle only wins, up to and including its long edge, when it
+  // is listed first
+  g = triangle_grid(x, y, z, grow(v,[26,27,28]), xmin=-.75, xmax=4.75,
+    ymin=-.75, ymax=4.75, cell=.5, nodata=-1);
+  ut_ok, "allof(*g.zgrid == expect)";
+  g = triangle_grid(x, y, z, grow([26,27,28],v), xmin=-.75, xmax=4.75,
+    ymin=-.75, ymax=4.75, cell=.5, nodata=-1);
+  ut_ok, "allof(*g.zgrid == big)";
+
+  // On a finer grid, split across threads, the cells are what
+  // triangle_interp gives for their centers
+  v = grow([26,27,28],v);
+  c = span(-.5, 4.5, 41);
+  zp = triangle_interp(x, y, z, v, c(,-:1:41), c(-:1:41,), nodata=-1);
+  g = triangle_grid(x, y, z, v, xmin=-.5625, xmax=4.5625, ymin=-.5625,
+    ymax=4.5625, cell=.125, nodata=-1, threads=4);
+  ut_ok, "allof(dimsof(*g.zgrid) == [2,41,41])";
+  ut_ok, "allof(*g.zgrid == zp)";
+
+  if(is_func(triangle_grid_cells)) {
+    // =========================================================================
+    ut_section, "triangle_grid_cells";
+
+    local v1, v2, v3;
+    splitary, v, 3, v1, v2, v3;
+    r = triangle_grid_cells(x, y, z, v1, v2, v3, c, c, -1., threads=1);
+    ut_ok, "structof(r) == double";
+    ut_ok, "allof(r == zp)";
+    ut_ok, "allof(triangle_grid_cells(x, y, z, v1, v2, v3, c, c, -1., "+
+      "threads=4) == r)";
+
+    ut_error, "triangle_grid_cells(x, y, z, v1, v2, v3*10, c, c, -1.)";
+    ut_error, "triangle_grid_cells(x, y, z, double(v1), v2, v3, c, c, -1.)";
+  }
+}
@@ -0,0 +1,60 @@
+save, ut, eq_ev="ev";
+
+if(is_func(_ytriangle_interp)) {
+  // ===========================================================================
+  ut_section, "triangle_interp, few triangles";
+
+  // Two triangles over the unit square, which share the diagonal from (0,0)
+  // to (1,1) but with different corners there: point 3 has z=6 and point 5
+  // has z=10. The first triangle is z = 2x + 4y and the second z = 6x + 4y.
+  // With this few triangles, each point checks all of them in order.
+  x = [0.,1,1,0,1];
+  y = [0.,0,1,1,1];
+  z = [0.,2,6,4,10];
+  v = [[1,2,3],[1,5,4]];
+
+  // On the diagonal, (.5,.5) is in both and the first wins. (1,.5) and (.5,1)
+  // are on outer edges. (2,2) is in neither.
+  xp = [.5,.75,.25,0,1,.5,2];
+  yp = [.5,.25,.75,0,.5,1,2];
+  zp = triangle_interp(x, y, z, v, xp, yp, nodata=-1);
+  ut_ok, "allof(zp == [3,2.5,4.5,0,4,7,-1])";
+
+  zp = triangle_interp(x, y, z, v(,::-1), xp, yp, nodata=-1);
+  ut_ok, "allof(zp == [5,2.5,4.5,0,4,7,-1])";
+
+  // v may also be nx3, and the result is shaped like xp
+  zp = triangle_interp(x, y, z, transpose(v), [[.5,.75],[.25,0]],
+    [[.5,.25],[.75,0]], nodata=-1);
+  ut_ok, "allof(zp == [[3,2.5],[4.5,0]])";
+
+  ut_eq, "triangle_interp(x, y, z, v, 2, 2)", -32767;
+
+  // ===========================================================================
+  ut_section, "triangle_interp, indexed triangles";
+
+  // A 5x5 lattice of points, with z = x + 10y, split into 32 triangles. That
+  // is enough for the triangles to be indexed by location. Points 26-28 are
+  // a large triangle over the lower left half, with z=100, that overlaps many
+  // of the others.
+  x = grow(double(indgen(0:4))(,-:1:5)(*), [0.,4,0]);
+  y = grow(double(indgen(0:4))(-:1:5,)(*), [0.,0,4]);
+  z = grow(x(:25) + 10*y(:25), [100.,100,100]);
+  a = (indgen(0:3)(,-:1:4) + 5*indgen(0:3)(-:1:4,) + 1)(*);
+  v = transpose([grow(a,a), grow(a+1,a+6), grow(a+6,a+5)]);
+
+  // (2,1.5) is on an edge shared by two lattice triangles. (2.25,1.75) and
+  // (3.75,.25) are on the large triangle's long edge.
+  xp = [.5,2.25,3.5,4,0,3.75,2,5,-1];
+  yp = [.5,1.75,3.5,4,0,.25,1.5,1,2];
+  zp = triangle_interp(x, y, z, v, xp, yp, nodata=-1);
+  ut_ok, "allof(zp == [5.5,19.75,38.5,44,0,6.25,17,-1,-1])";
+
+  // Listed last, the large triangle never wins
+  zp = triangle_interp(x, y, z, grow(v,[26,27,28]), xp, yp, nodata=-1);
+  ut_ok, "allof(zp == [5.5,19.75,38.5,44,0,6.25,17,-1,-1])";
+
+  // Listed first, it wins everywhere it reaches, including its edges
+  zp = triangle_interp(x, y, z, grow([26,27,28],v), xp, yp, nodata=-1);
+  ut_ok, "allof(zp == [100,100,38.5,44,100,100,100,-1,-1])";
+}
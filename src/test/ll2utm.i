@@ -0,0 +1,90 @@
+save, ut, eq_ev="ev";
+
+// Expected values are from the PP1395 series that ll2utm implements, on
+// WGS84. On a zone's central meridian, east is 500000 and north is k0 times
+// the meridian arc: 0.9996 * 4984944.378 = 4982950.4005 at 45 degrees. There
+// is no false northing for the southern hemisphere.
+
+// =============================================================================
+ut_section, "ll2utm";
+
+u = ll2utm(0., 3.);
+ut_eq, "u(1)", 0;
+ut_eq, "u(2)", 500000;
+ut_eq, "u(3)", 31;
+
+u = ll2utm(45., -81.);
+ut_ok, "abs(u(1) - 4982950.4005) < 1e-4";
+ut_ok, "abs(u(2) - 500000) < 1e-6";
+ut_eq, "u(3)", 17;
+
+u = ll2utm(-45., -81.);
+ut_ok, "abs(u(1) + 4982950.4005) < 1e-4";
+
+lat = [45., -33.9];
+lon = [-80.3, 151.2];
+u = ll2utm(lat, lon);
+ut_ok, "allof(abs(u(1,) - [4983188.7146,-3752526.6632]) < 1e-4)";
+ut_ok, "allof(abs(u(2,) - [555170.7097,333568.9410]) < 1e-4)";
+ut_ok, "allof(u(3,) == [17,56])";
+ut_ok, "structof(u(3,)) == double";
+
+// The input is left alone
+ut_ok, "allof(lat == [45.,-33.9]) && allof(lon == [-80.3,151.2])";
+
+// Zones run west to east from 1 at -180. A longitude on a boundary belongs to
+// the zone to its east, and 180 is the same as -180.
+local north, east, zone;
+ll2utm, [0.,0,0,0,0], [-84.,-78,-180,180,179.9], north, east, zone;
+ut_ok, "allof(zone == [17,18,1,1,60])";
+ut_ok, "structof(zone) == short";
+
+// Forcing the zone projects onto its central meridian instead
+ll2utm, 45., -80.3, north, east, zone, force_zone=18;
+ut_eq, "zone", 18;
+ut_ok, "abs(north - 4996631.4141) < 1e-4";
+ut_ok, "abs(east - 82278.6996) < 1e-4";
+
+// =============================================================================
+ut_section, "utm2ll";
+
+ll = utm2ll(4982950.4005, 500000., 17);
+ut_ok, "abs(ll(1) + 81) < 1e-7";
+ut_ok, "abs(ll(2) - 45) < 1e-7";
+
+north = [4983188.7146,-3752526.6632];
+east = [555170.7097,333568.9410];
+ll = utm2ll(north, east, [17,56]);
+ut_ok, "allof(abs(ll(,1) - [-80.3,151.2]) < 1e-7)";
+ut_ok, "allof(abs(ll(,2) - [45,-33.9]) < 1e-7)";
+
+local lon, lat;
+utm2ll, north, east, [17,56], lon, lat;
+ut_ok, "allof(abs(lon - [-80.3,151.2]) < 1e-7)";
+ut_ok, "allof(abs(lat - [45,-33.9]) < 1e-7)";
+
+if(is_func(_yll2utm_batch)) {
+  // ===========================================================================
+  ut_section, "ll2utm and utm2ll, threads= and fast=";
+
+  // Enough points to be split over four threads. Each thread works on its own
+  // range, so the result does not depend on how many there are.
+  lat = span(24., 31., 100000);
+  lon = span(-82., -79., 100000);
+
+  u = ll2utm(lat, lon, threads=1);
+  ut_ok, "allof(ll2utm(lat, lon, threads=4) == u)";
+  ut_ok, "allof(abs(u(,50000) - ll2utm(lat(50000), lon(50000))) < 1e-6)";
+
+  // fast=1 is within about 3 cm
+  f = ll2utm(lat, lon, fast=1, threads=4);
+  ut_ok, "allof(f(3,) == u(3,))";
+  ut_ok, "abs(f(1:2,) - u(1:2,))(*)(max) < .05";
+  ut_ok, "abs(f(1:2,) - u(1:2,))(*)(max) > 0";
+
+  ll = utm2ll(u(1,), u(2,), u(3,), threads=1);
+  ut_ok, "allof(utm2ll(u(1,), u(2,), u(3,), threads=4) == ll)";
+  ut_ok, "abs(ll - [lon, lat])(*)(max) < 1e-7";
+  ll = utm2ll(u(1,), u(2,), u(3,), fast=1);
+  ut_ok, "abs(ll - [lon, lat])(*)(max) < 1e-6";
+}
@@ -0,0 +1,100 @@
+save, ut, eq_ev="ev";
+
+// A small GEOID grid in NGS .bin format: 20 columns and 15 rows at .25
+// degree spacing from 24N, 82W (278E). The values are bilinear in the column
+// and row, f = -30 + x/2 + y/4 + x*y/8, so the spline (and qfit) fits along
+// each row and then along the column reproduce it exactly. At x=8.5 and
+// y=5.5 (80.125W, 25.125N) that is -30 + 4.25 + 1.375 + 5.84375 = -18.53125.
+// At x=1.5 and y=2.25 (81.875W, 24.3125N), next to the edge where only a 2x2
+// neighborhood fits, it is -30 + .75 + .5625 + .421875 = -28.265625.
+ncols = 20;
+nrows = 15;
+x = double(indgen(ncols))(,-:1:nrows);
+y = double(indgen(nrows))(-:1:ncols,);
+data = float(-30 + x/2 + y/4 + x*y/8);
+
+lon = [-80.125, -81.875, -80, -70];
+lat = [25.125, 24.3125, 25, 25];
+// The third point is on the grid (x=9, y=5); the fourth is east of it and
+// gets no offset
+expect = [-18.53125, -28.265625, -18.625, 0];
+
+dir = mktempdir("navd88_test");
+fn = file_join(dir, "test.bin");
+f = open(fn, "wb");
+i86_primitives, f;
+_write, f, 0, [24., 278., .25, .25];
+_write, f, 32, int([nrows, ncols, 1]);
+_write, f, 44, data;
+close, f;
+
+// The same grid, big endian
+dir_be = mktempdir("navd88_test");
+fn_be = file_join(dir_be, "test.bin");
+f = open(fn_be, "wb");
+sun_primitives, f;
+_write, f, 0, [24., 278., .25, .25];
+_write, f, 32, int([nrows, ncols, 1]);
+_write, f, 44, data;
+close, f;
+
+// Keep the test's files out of the session's GEOID cache
+geoid_cache_clear;
+
+// =============================================================================
+ut_section, "nad832navd88offset";
+
+off = nad832navd88offset(lon, lat, gdata_dir=dir, verbose=0);
+ut_ok, "allof(off == expect)";
+off = nad832navd88offset(lon, lat, gdata_dir=dir, verbose=0,
+  interpolator=n88_interp_spline2d);
+ut_ok, "allof(off == expect)";
+off = nad832navd88offset(lon, lat, gdata_dir=dir_be, verbose=0);
+ut_ok, "allof(off == expect)";
+
+// =============================================================================
+ut_section, "geoid_cached";
+
+geoid_cache_clear;
+g = geoid_cached(fn);
+ut_eq, "g.glamn", 24;
+ut_eq, "g.glomn", 278;
+ut_eq, "g.nrows", 15;
+ut_eq, "g.ncols", 20;
+// A mapped file only has its grid loaded when asked for
+ut_ok, "g(*,\"map\") == !g(*,\"data\")";
+g = geoid_cached(fn, data=1);
+ut_ok, "allof(g.data == data)";
+
+if(is_func(geoid_map)) {
+  // ===========================================================================
+  ut_section, "geoid_map";
+
+  m = geoid_map(fn);
+  ut_eq, "m.glamn", 24;
+  ut_eq, "m.glomn", 278;
+  ut_eq, "m.dla", .25;
+  ut_eq, "m.dlo", .25;
+  ut_eq, "m.nrows", 15;
+  ut_eq, "m.ncols", 20;
+  ut_eq, "m.itype", 1;
+
+  ix = [8.5, 1.5, 9];
+  iy = [5.5, 2.25, 5];
+  ut_ok, "allof(geoid_map_interp(m, ix, iy) == expect(1:3))";
+  ut_ok, "allof(geoid_map_interp(m, ix, iy, threads=3) == expect(1:3))";
+  // On the grid, the result is the grid value
+  ut_eq, "geoid_map_interp(m, 20, 15)", data(20,15);
+  ut_eq, "geoid_map_interp(m, 1, 1)", data(1,1);
+
+  m = geoid_map(fn_be);
+  ut_eq, "m.glomn", 278;
+  ut_ok, "allof(geoid_map_interp(m, ix, iy) == expect(1:3))";
+  m = [];
+
+  ut_error, "geoid_map(file_join(dir, \"missing.bin\"))";
+}
+
+geoid_cache_clear;
+remove_recursive, dir;
+remove_recursive, dir_be;